@@ -0,0 +1,55 @@
+#!/bin/sh
+# Records the replay benchmark corpus into the given directory (default:
+# ./corpus), for use with:
+#
+#     kgx --replay corpus/ls-usr.cast --replay-speed 0 --benchmark
+#
+# With asciinema available recordings keep their timing (.cast), otherwise
+# script(1) captures the raw output (.raw), which always replays at full
+# speed. Recordings are machine specific, so compare numbers from the same
+# corpus only.
+
+set -eu
+
+out="${1:-corpus}"
+cols=120
+rows=40
+
+mkdir -p "$out"
+
+record () {
+    name="$1"
+    shift
+
+    echo "Recording $name…" >&2
+
+    if command -v asciinema > /dev/null; then
+        asciinema rec --quiet --overwrite \
+            --cols "$cols" --rows "$rows" \
+            --command "$*" "$out/$name.cast" < /dev/null
+    else
+        COLUMNS=$cols LINES=$rows \
+            script --quiet --return --log-out "$out/$name.raw" \
+            --command "$*" < /dev/null > /dev/null
+    fi
+}
+
+# Compiler spew, lots of short coloured lines
+record compiler "for i in \$(seq 200); do cc -fdiagnostics-color=always -Wall -Wextra -x c -c -o /dev/null - <<'EOF'
+int main (int argc, char **argv) { int unused; return argv; }
+EOF
+done || true"
+
+# Scrolling through a big directory tree
+record ls-usr "ls -R --color=always /usr"
+
+# Full screen redraws
+record htop "timeout 10 htop"
+
+# Plenty of non-ASCII text
+utf8="$(mktemp)"
+trap 'rm -f "$utf8"' EXIT
+for _ in $(seq 2000); do
+    printf '%s\n' "Ⅰ. Καλημέρα κόσμε — こんにちは世界 — Здравствуй, мир — مرحبا بالعالم — 🌍🌎🌏"
+done > "$utf8"
+record cat-utf8 "cat $utf8"
@@ -0,0 +1,100 @@
+# kgx-shell-integration.sh
+#
+# Copyright 2024 Zander Brown
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Marks prompts and commands (OSC 133) so Console knows exactly when a
+# command starts and finishes, and what it was, and reports the host and
+# directory (OSC 7) so it knows when it's talking to another machine.
+# Source it from ~/.bashrc or ~/.zshrc, here and on the hosts you ssh to,
+# and turn on the shell-integration setting
+
+[ -n "$KGX_SHELL_INTEGRATION" ] && return
+KGX_SHELL_INTEGRATION=1
+
+# Leaves the result in $__kgx_url, so there's no subshell to pay for
+__kgx_urlencode () {
+  local LC_ALL=C str="$1" c i
+  __kgx_url=
+  # Usually there's nothing to escape at all
+  if [[ "$str" != *[!a-zA-Z0-9/._~-]* ]]; then
+    __kgx_url="$str"
+    return
+  fi
+  for (( i = 0; i < ${#str}; i++ )); do
+    c="${str:$i:1}"
+    case "$c" in
+      [a-zA-Z0-9/._~-]) __kgx_url+="$c" ;;
+      *) printf -v c '%%%02X' "'$c"; __kgx_url+="$c" ;;
+    esac
+  done
+}
+
+__kgx_preexec () {
+  __kgx_urlencode "$1"
+  printf '\033]133;C;cmdline_url=%s\007' "$__kgx_url"
+  __kgx_running=1
+}
+
+__kgx_precmd () {
+  local ret=$?
+  if [ -n "$__kgx_running" ]; then
+    printf '\033]133;D;%s\007' "$ret"
+    __kgx_running=
+  fi
+  __kgx_urlencode "$PWD"
+  printf '\033]7;file://%s%s\007' "${HOSTNAME:-$HOST}" "$__kgx_url"
+  printf '\033]133;A\007'
+}
+
+if [ -n "$ZSH_VERSION" ]; then
+  autoload -Uz add-zsh-hook
+  add-zsh-hook preexec __kgx_preexec
+  add-zsh-hook precmd __kgx_precmd
+  PS1="$PS1%{"$'\033]133;B\007'"%}"
+elif [ -n "$BASH_VERSION" ]; then
+  __kgx_debug () {
+    [ -n "$COMP_LINE" ] && return
+    [ -n "$__kgx_at_prompt" ] || return
+    __kgx_at_prompt=
+    # Only the first simple command of the line, but history may well not
+    # have it at all (ignorespace, ignoredups)
+    __kgx_preexec "$BASH_COMMAND"
+  }
+
+  # Ours goes first to see $?, then whatever trap was there before
+  # (bash-preexec and friends) so it still decides whether the command
+  # runs. $_ is put back for it, bash-preexec wants that
+  __kgx_trap='__kgx_last_arg="$_"; __kgx_debug; : "$__kgx_last_arg"; eval "$__kgx_prev_debug"'
+
+  # Neither functions nor sourced files like this see anybody else's DEBUG
+  # trap, so it's swapped in from the top level at the first prompt. The
+  # command substitution only sees it with functrace on
+  __kgx_install='
+    case "$-" in
+      *T*) __kgx_prev_debug=$(trap -p DEBUG) ;;
+      *) set -T; __kgx_prev_debug=$(trap -p DEBUG); set +T ;;
+    esac
+    __kgx_prev_debug=${__kgx_prev_debug#"trap -- "}
+    eval "__kgx_prev_debug=${__kgx_prev_debug%" DEBUG"}"
+    trap "$__kgx_trap" DEBUG
+    __kgx_install=
+  '
+
+  # Only once the rest of PROMPT_COMMAND has run is it the user's commands
+  # tripping the trap
+  PROMPT_COMMAND="__kgx_precmd${PROMPT_COMMAND:+;$PROMPT_COMMAND};eval \"\$__kgx_install\";__kgx_at_prompt=1"
+  PS1="$PS1\[\033]133;B\007\]"
+fi
@@ -33,18 +33,35 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 
+#ifdef GDK_WINDOWING_WAYLAND
+#include <gdk/wayland/gdkwayland.h>
+#endif
+
 #include "rgba.h"
 
 #include "kgx-application.h"
 #include "kgx-window.h"
 #include "kgx-pages.h"
 #include "kgx-drop-target.h"
+#include "kgx-font-warmup.h"
 #include "kgx-simple-tab.h"
+#include "kgx-replay-tab.h"
+#include "kgx-benchmark.h"
 #include "kgx-resources.h"
+#include "kgx-recorder.h"
+#include "kgx-remote.h"
+#include "kgx-session.h"
 #include "kgx-watcher.h"
+#include "kgx-notifier.h"
+#include "kgx-monitor.h"
+#include "kgx-tab-index.h"
 
 #define LOGO_COL_SIZE 28
 #define LOGO_ROW_SIZE 14
+#define LATENCY_PROBES 200
+#define TABS_BENCH_COUNT 1000
+/* Between spawns when opening a layout, so the UI keeps up */
+#define SPAWN_STAGGER 15
 
 
 struct _KgxApplication {
@@ -53,6 +70,24 @@ struct _KgxApplication {
   GTree                    *pages;
   KgxSettings              *settings;
   KgxWatcher               *watcher;
+  KgxNotifier              *notifier;
+  KgxMonitor               *monitor;
+  KgxTabIndex              *tab_index;
+  KgxHistory               *history;
+  KgxSession               *session;
+
+  GQueue                    spawn_queue;
+  guint                     spawn_timeout;
+
+  /* With window-isolation, in a process hosting a single window this is
+   * the instance that started it, otherwise it's the child whose window
+   * was last focused (if it wasn't one of our own) */
+  char                     *primary;
+  char                     *active_child;
+  guint                     n_children;
+
+  gint64                    started_at;
+  gboolean                  had_first_frame;
 };
 
 
@@ -67,11 +102,70 @@ kgx_application_dispose (GObject *object)
   g_clear_pointer (&self->pages, g_tree_unref);
   g_clear_object (&self->settings);
   g_clear_object (&self->watcher);
+  g_clear_object (&self->notifier);
+  g_clear_object (&self->monitor);
+  g_clear_object (&self->tab_index);
+  g_clear_object (&self->history);
+  g_clear_object (&self->session);
+  g_clear_pointer (&self->primary, g_free);
+  g_clear_pointer (&self->active_child, g_free);
+
+  g_clear_handle_id (&self->spawn_timeout, g_source_remove);
+  g_queue_clear_full (&self->spawn_queue, g_object_unref);
 
   G_OBJECT_CLASS (kgx_application_parent_class)->dispose (object);
 }
 
 
+static gboolean restore_session (KgxApplication  *self,
+                                 guint32          timestamp);
+static gboolean open_layout     (KgxApplication  *self,
+                                 guint32          timestamp,
+                                 const char      *layout,
+                                 GFile           *base,
+                                 GError         **error);
+static gboolean forward_tab     (KgxApplication  *self,
+                                 GFile           *working_directory,
+                                 GStrv            argv,
+                                 const char      *title);
+static KgxTab  *create_terminal (KgxApplication  *self,
+                                 GFile           *working_directory,
+                                 GStrv            argv,
+                                 const char      *title);
+static void     present_tab     (KgxApplication  *self,
+                                 KgxWindow       *existing_window,
+                                 guint32          timestamp,
+                                 KgxTab          *tab);
+
+
+/*
+ * The active window, so long as it's a terminal window rather than
+ * something like the tab switcher
+ */
+static KgxWindow *
+get_active_window (KgxApplication *self)
+{
+  GtkWindow *window = gtk_application_get_active_window (GTK_APPLICATION (self));
+
+  return KGX_IS_WINDOW (window) ? KGX_WINDOW (window) : NULL;
+}
+
+
+/*
+ * Made on first use, like the rest of what only tabs need, so nothing
+ * holds up the first window
+ */
+static KgxSession *
+get_session (KgxApplication *self)
+{
+  if (G_UNLIKELY (!self->session)) {
+    self->session = kgx_session_new (self->settings);
+  }
+
+  return self->session;
+}
+
+
 static void
 kgx_application_activate (GApplication *app)
 {
@@ -83,6 +177,10 @@ kgx_application_activate (GApplication *app)
   /* Get the current window or create one if necessary. */
   window = gtk_application_get_active_window (GTK_APPLICATION (app));
   if (window == NULL) {
+    if (restore_session (KGX_APPLICATION (app), timestamp)) {
+      return;
+    }
+
     kgx_application_add_terminal (KGX_APPLICATION (app),
                                   NULL,
                                   timestamp,
@@ -97,8 +195,8 @@ kgx_application_activate (GApplication *app)
 }
 
 
-static void
-kgx_application_startup (GApplication *app)
+static gboolean
+setup_accels (gpointer app)
 {
   const char *const new_window_accels[] = { "<shift><primary>n", NULL };
   const char *const new_tab_accels[] = { "<shift><primary>t", NULL };
@@ -110,14 +208,11 @@ kgx_application_startup (GApplication *app)
   const char *const zoom_out_accels[] = { "<primary>minus", NULL };
   const char *const zoom_normal_accels[] = { "<primary>0", NULL };
   const char *const show_tabs_accels[] = { "<shift><primary>o", NULL };
-
-  g_resources_register (kgx_get_resource ());
-
-  g_type_ensure (KGX_TYPE_TERMINAL);
-  g_type_ensure (KGX_TYPE_PAGES);
-  g_type_ensure (KGX_TYPE_DROP_TARGET);
-
-  G_APPLICATION_CLASS (kgx_application_parent_class)->startup (app);
+  const char *const switch_tab_accels[] = { "<shift><primary>k", NULL };
+  const char *const search_history_accels[] = { "<shift><primary>r", NULL };
+  const char *const previous_prompt_accels[] = { "<shift><primary>Up", NULL };
+  const char *const next_prompt_accels[] = { "<shift><primary>Down", NULL };
+  const char *const copy_last_output_accels[] = { "<shift><primary>y", NULL };
 
   gtk_application_set_accels_for_action (GTK_APPLICATION (app),
                                          "win.new-window", new_window_accels);
@@ -141,6 +236,86 @@ kgx_application_startup (GApplication *app)
                                          "win.show-tabs", show_tabs_accels);
   gtk_application_set_accels_for_action (GTK_APPLICATION (app),
                                          "win.show-tabs-desktop", show_tabs_accels);
+  gtk_application_set_accels_for_action (GTK_APPLICATION (app),
+                                         "win.switch-tab", switch_tab_accels);
+  gtk_application_set_accels_for_action (GTK_APPLICATION (app),
+                                         "win.search-history", search_history_accels);
+  gtk_application_set_accels_for_action (GTK_APPLICATION (app),
+                                         "term.previous-prompt", previous_prompt_accels);
+  gtk_application_set_accels_for_action (GTK_APPLICATION (app),
+                                         "term.next-prompt", next_prompt_accels);
+  gtk_application_set_accels_for_action (GTK_APPLICATION (app),
+                                         "term.copy-last-output", copy_last_output_accels);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Only the instance others will talk to should say it's running, a
+ * --benchmark run shares our id but never registers it
+ */
+static gboolean
+is_primary (GApplication *app)
+{
+  return g_strcmp0 (g_application_get_application_id (app), KGX_APPLICATION_ID) == 0 &&
+         !(g_application_get_flags (app) & G_APPLICATION_NON_UNIQUE) &&
+         !g_application_get_is_remote (app);
+}
+
+
+static void
+kgx_application_startup (GApplication *app)
+{
+  KgxApplication *self = KGX_APPLICATION (app);
+  g_autoptr (PangoFontDescription) font = NULL;
+
+  /* Get fontconfig going whilst we build the window */
+  font = kgx_settings_get_font (self->settings);
+  kgx_font_warmup (font);
+
+  g_resources_register (kgx_get_resource ());
+
+  g_type_ensure (KGX_TYPE_TERMINAL);
+  g_type_ensure (KGX_TYPE_PAGES);
+  g_type_ensure (KGX_TYPE_DROP_TARGET);
+
+  G_APPLICATION_CLASS (kgx_application_parent_class)->startup (app);
+
+  /* Nobody can press anything before the window is up, so let that
+   * happen first, but not so low that a busy terminal holds it off */
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                   setup_accels,
+                   g_object_ref (app),
+                   g_object_unref);
+
+  if (is_primary (app)) {
+    kgx_remote_set_running (TRUE);
+  }
+}
+
+
+static void
+kgx_application_shutdown (GApplication *app)
+{
+  KgxApplication *self = KGX_APPLICATION (app);
+
+  if (self->session) {
+    kgx_session_stop (self->session);
+  }
+
+  if (self->history) {
+    kgx_history_stop (self->history);
+  }
+
+  /* Let the logs of closed tabs finish */
+  kgx_recorder_wait_all ();
+
+  if (is_primary (app)) {
+    kgx_remote_set_running (FALSE);
+  }
+
+  G_APPLICATION_CLASS (kgx_application_parent_class)->shutdown (app);
 }
 
 
@@ -152,6 +327,8 @@ kgx_application_open (GApplication  *app,
 {
   guint32 timestamp = GDK_CURRENT_TIME;
 
+  restore_session (KGX_APPLICATION (app), timestamp);
+
   for (int i = 0; i < n_files; i++) {
     kgx_application_add_terminal (KGX_APPLICATION (app),
                                   NULL,
@@ -163,6 +340,103 @@ kgx_application_open (GApplication  *app,
 }
 
 
+static void
+window_active_changed (GtkWindow      *window,
+                       GParamSpec     *pspec,
+                       KgxApplication *self)
+{
+  GDBusConnection *bus;
+
+  if (!gtk_window_is_active (window)) {
+    return;
+  }
+
+  if (!self->primary) {
+    /* One of ours, so --tab belongs here again */
+    g_clear_pointer (&self->active_child, g_free);
+    return;
+  }
+
+  bus = g_application_get_dbus_connection (G_APPLICATION (self));
+  if (bus) {
+    const char *id = g_application_get_application_id (G_APPLICATION (self));
+
+    kgx_remote_activate (bus,
+                         self->primary,
+                         "child-active",
+                         g_variant_new_string (id));
+  }
+}
+
+
+/*
+ * Our own id has no desktop file, so as far as the compositor is concerned
+ * we're the primary, for the icon and grouping
+ */
+static void
+isolated_window_realized (GtkWindow      *window,
+                          KgxApplication *self)
+{
+#ifdef GDK_WINDOWING_WAYLAND
+  GdkSurface *surface = gtk_native_get_surface (GTK_NATIVE (window));
+
+  if (GDK_IS_WAYLAND_TOPLEVEL (surface)) {
+    gdk_wayland_toplevel_set_application_id (GDK_TOPLEVEL (surface),
+                                             self->primary);
+  }
+#endif
+}
+
+
+static void
+kgx_application_window_added (GtkApplication *app,
+                              GtkWindow      *window)
+{
+  KgxApplication *self = KGX_APPLICATION (app);
+
+  g_signal_connect_object (window,
+                           "notify::is-active", G_CALLBACK (window_active_changed),
+                           app,
+                           G_CONNECT_DEFAULT);
+
+  if (self->primary) {
+    /* After GTK has set it to ours */
+    g_signal_connect_object (window,
+                             "realize", G_CALLBACK (isolated_window_realized),
+                             app,
+                             G_CONNECT_AFTER);
+  }
+
+  GTK_APPLICATION_CLASS (kgx_application_parent_class)->window_added (app, window);
+}
+
+
+static void
+kgx_application_window_removed (GtkApplication *app,
+                                GtkWindow      *window)
+{
+  KgxApplication *self = KGX_APPLICATION (app);
+
+  GTK_APPLICATION_CLASS (kgx_application_parent_class)->window_removed (app, window);
+
+  if (!KGX_IS_WINDOW (window)) {
+    return;
+  }
+
+  for (GList *l = gtk_application_get_windows (app); l; l = l->next) {
+    if (KGX_IS_WINDOW (l->data)) {
+      return;
+    }
+  }
+
+  /* We're on the way out, so its tabs are the session to come back to
+   * rather than tabs being closed */
+  if (self->session) {
+    kgx_session_stop (self->session);
+  }
+}
+
+
 static int
 kgx_application_local_command_line (GApplication   *app,
                                     char         ***arguments,
@@ -191,6 +465,11 @@ kgx_application_local_command_line (GApplication   *app,
       }
 
       break;
+    } else if (strcmp ((*arguments)[i], "--benchmark") == 0) {
+      /* GOption can't do optional values, so a bare --benchmark gets the
+       * original meaning of replaying */
+      g_free ((*arguments)[i]);
+      (*arguments)[i] = g_strdup ("--benchmark=replay");
     } else if (strcmp ((*arguments)[i], "--") == 0) {
       /* Don't continue to edit arguments after the -- separator,
        * so you can do: kgx -- some-command ... -e ... */
@@ -202,170 +481,572 @@ kgx_application_local_command_line (GApplication   *app,
 }
 
 
-static int
-kgx_application_command_line (GApplication            *app,
-                              GApplicationCommandLine *cli)
+static void
+replay_playing_changed (KgxReplayTab *tab,
+                        GParamSpec   *pspec,
+                        KgxBenchmark *bench)
 {
-  KgxApplication *self = KGX_APPLICATION (app);
-  guint32 timestamp = GDK_CURRENT_TIME;
-  GVariantDict *options = NULL;
-  g_auto (GStrv) argv = NULL;
-  const char *command = NULL;
-  const char *working_dir = NULL;
-  const char *title = NULL;
-  const char *const *shell = NULL;
-  const char *cwd = NULL;
-  gint64 scrollback;
-  gboolean tab;
-  g_autoptr (GFile) path = NULL;
+  if (kgx_replay_tab_get_playing (tab) && !kgx_benchmark_get_running (bench)) {
+    kgx_benchmark_start (bench, GTK_WIDGET (tab));
+  }
+}
 
-  options = g_application_command_line_get_options_dict (cli);
-  cwd = g_application_command_line_get_cwd (cli);
 
-  g_variant_dict_lookup (options, "working-directory", "^&ay", &working_dir);
-  g_variant_dict_lookup (options, "title", "&s", &title);
-  g_variant_dict_lookup (options, "command", "^&ay", &command);
-  g_variant_dict_lookup (options, G_OPTION_REMAINING, "^aay", &argv);
+static void
+replay_died (KgxReplayTab   *tab,
+             GtkMessageType  type,
+             const char     *message,
+             gboolean        success,
+             KgxBenchmark   *bench)
+{
+  kgx_benchmark_add_bytes (bench, kgx_replay_tab_get_length (tab));
+  kgx_benchmark_finish (bench);
+}
 
-  if (g_variant_dict_lookup (options, "set-shell", "^as", &shell) && shell) {
-    kgx_settings_set_custom_shell (self->settings, shell);
 
-    return EXIT_SUCCESS;
+static void
+throughput_died (KgxTab         *tab,
+                 GtkMessageType  type,
+                 const char     *message,
+                 gboolean        success,
+                 KgxBenchmark   *bench)
+{
+  if (type == GTK_MESSAGE_ERROR || !success) {
+    kgx_benchmark_abort (bench);
+    return;
   }
 
-  if (g_variant_dict_lookup (options, "set-scrollback", "x", &scrollback)) {
-    kgx_settings_set_scrollback (self->settings, scrollback);
+  kgx_benchmark_finish (bench);
+}
 
-    return EXIT_SUCCESS;
+
+static int
+run_throughput_benchmark (KgxApplication          *self,
+                          GApplicationCommandLine *cli,
+                          guint32                  timestamp,
+                          const char              *content,
+                          int                      size)
+{
+  g_autoptr (KgxBenchmark) bench = NULL;
+  g_autoptr (PangoFontDescription) font = NULL;
+  g_autofree char *font_name = NULL;
+  g_autofree char *size_arg = NULL;
+  KgxTab *page;
+
+  if (!kgx_benchmark_is_content (content)) {
+    g_application_command_line_printerr (cli,
+                                         _("Unknown benchmark content “%s”\n"),
+                                         content);
+    return EXIT_FAILURE;
   }
 
-  if (working_dir != NULL) {
-    path = g_file_new_for_commandline_arg_and_cwd (working_dir, cwd);
+  if (size <= 0) {
+    g_application_command_line_printerr (cli, "%s\n", _("--benchmark-size must be positive"));
+    return EXIT_FAILURE;
   }
 
-  if (path == NULL) {
-    path = g_file_new_for_path (cwd);
+  size_arg = g_strdup_printf ("%i", size);
+  font = kgx_settings_get_font (self->settings);
+  font_name = pango_font_description_to_string (font);
+
+  {
+    /* Run ourselves as the generator, through the same pty path as any
+     * other command */
+    const char *argv[] = {
+      "/proc/self/exe",
+      "--benchmark-generate", content,
+      "--benchmark-size", size_arg,
+      NULL
+    };
+
+    page = kgx_application_add_terminal (self,
+                                         NULL,
+                                         timestamp,
+                                         NULL,
+                                         (GStrv) argv,
+                                         "Throughput");
   }
 
-  if (command != NULL) {
-    gboolean can_exec_directly;
+  bench = kgx_benchmark_new (cli, "throughput");
+  kgx_benchmark_set_detail (bench, "content", content);
+  kgx_benchmark_set_detail (bench, "size_mib", size_arg);
+  kgx_benchmark_set_detail (bench, "font", font_name);
+  kgx_benchmark_add_bytes (bench, (guint64) size * 1024 * 1024);
 
-    if (argv != NULL && argv[0] != NULL) {
-      g_warning (_("Cannot use both --command and positional parameters"));
-      return EXIT_FAILURE;
-    }
+  g_signal_connect_data (page,
+                         "died", G_CALLBACK (throughput_died),
+                         g_object_ref (bench), (GClosureNotify) g_object_unref,
+                         G_CONNECT_DEFAULT);
 
-    g_clear_pointer (&argv, g_strfreev);
+  kgx_benchmark_start (bench, GTK_WIDGET (page));
 
-    if (strchr (command, '/') != NULL) {
-      can_exec_directly = g_file_test (command, G_FILE_TEST_IS_EXECUTABLE);
-    } else {
-      g_autofree char *program = g_find_program_in_path (command);
+  return EXIT_SUCCESS;
+}
 
-      can_exec_directly = (program != NULL);
-    }
 
-    if (can_exec_directly) {
-      argv = g_new0 (char *, 2);
-      argv[0] = g_strdup (command);
-      argv[1] = NULL;
-    } else {
-      argv = g_new0 (char *, 4);
-      argv[0] = g_strdup ("/bin/sh");
-      argv[1] = g_strdup ("-c");
-      argv[2] = g_strdup (command);
-      argv[3] = NULL;
-    }
+static void
+latency_died (KgxTab         *tab,
+              GtkMessageType  type,
+              const char     *message,
+              gboolean        success,
+              KgxBenchmark   *bench)
+{
+  /* Normally we finish first, having told the echo program to quit */
+  if (kgx_benchmark_get_running (bench)) {
+    kgx_benchmark_abort (bench);
   }
+}
 
-  if (g_variant_dict_lookup (options, "tab", "b", &tab) && tab) {
-    kgx_application_add_terminal (self,
-                                  KGX_WINDOW (gtk_application_get_active_window (GTK_APPLICATION (self))),
-                                  timestamp,
-                                  path,
-                                  argv,
-                                  title);
-  } else {
-    kgx_application_add_terminal (self, NULL, timestamp, path, argv, title);
-  }
+
+static int
+run_latency_benchmark (KgxApplication          *self,
+                       GApplicationCommandLine *cli,
+                       guint32                  timestamp)
+{
+  const char *argv[] = { "/proc/self/exe", "--benchmark-echo", NULL };
+  g_autoptr (KgxBenchmark) bench = NULL;
+  g_autoptr (KgxTerminal) terminal = NULL;
+  KgxTab *page;
+
+  page = kgx_application_add_terminal (self,
+                                       NULL,
+                                       timestamp,
+                                       NULL,
+                                       (GStrv) argv,
+                                       "Latency");
+
+  bench = kgx_benchmark_new (cli, "latency");
+  kgx_benchmark_set_detail (bench, "probes", G_STRINGIFY (LATENCY_PROBES));
+
+  g_signal_connect_data (page,
+                         "died", G_CALLBACK (latency_died),
+                         g_object_ref (bench), (GClosureNotify) g_object_unref,
+                         G_CONNECT_DEFAULT);
+
+  g_object_get (page, "terminal", &terminal, NULL);
+  kgx_benchmark_start_latency (bench, terminal, LATENCY_PROBES);
 
   return EXIT_SUCCESS;
 }
 
 
+typedef struct {
+  KgxApplication *app;
+  KgxBenchmark   *bench;
+  KgxWindow      *window;
+  guint           n_tabs;
+  guint64         rss_before;
+} TabsBench;
+
+
 static void
-print_center (char *msg, int ign, short width)
+tabs_bench_free (gpointer data)
 {
-  int half_msg = 0;
-  int half_screen = 0;
+  TabsBench *state = data;
 
-  half_msg = strlen (msg) / 2;
-  half_screen = width / 2;
+  g_clear_object (&state->bench);
+  g_clear_weak_pointer (&state->window);
 
-  g_print ("%*s\n",
-           half_screen + half_msg,
-           msg);
+  g_free (state);
 }
 
-static void
-print_logo (short width)
-{
-  g_autoptr (GFile) logo = NULL;
-  g_autoptr (GError) error = NULL;
-  g_auto (GStrv) logo_lines = NULL;
-  g_autofree char *logo_text = NULL;
-  int i = 0;
-  int half_screen = width / 2;
 
-  logo = g_file_new_for_uri ("resource:/" KGX_APPLICATION_PATH "logo.txt");
+static guint64
+resident_size (void)
+{
+  g_autofree char *statm = NULL;
+  char *resident;
 
-  g_file_load_contents (logo, NULL, &logo_text, NULL, NULL, &error);
+  if (!g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL)) {
+    return 0;
+  }
 
-  if (error) {
-    g_error ("Wat? %s", error->message);
+  /* size resident shared … (in pages) */
+  resident = strchr (statm, ' ');
+  if (!resident) {
+    return 0;
   }
 
-  logo_lines = g_strsplit (logo_text, "\n", -1);
+  return g_ascii_strtoull (resident, NULL, 10) * sysconf (_SC_PAGESIZE);
+}
 
-  while (logo_lines[i]) {
-    g_print ("%*s%s\n",
-             half_screen - (LOGO_COL_SIZE / 2),
-             "",
-             logo_lines[i]);
 
-    i++;
-  }
+static KgxTab *
+add_bench_tab (TabsBench *state)
+{
+  KgxTab *tab;
+  gint64 start = g_get_monotonic_time ();
+
+  /* Never started, so we measure the tab rather than the shell */
+  tab = create_terminal (state->app, NULL, NULL, "Tab");
+  present_tab (state->app, state->window, GDK_CURRENT_TIME, tab);
+
+  kgx_benchmark_sample (state->bench,
+                        "create_ms",
+                        (g_get_monotonic_time () - start) / 1000.0);
+  state->n_tabs++;
+
+  return tab;
 }
 
-static int
-kgx_application_handle_local_options (GApplication *app,
-                                      GVariantDict *options)
+
+static gboolean
+tabs_bench_step (gpointer data)
 {
-  gboolean version = FALSE;
-  gboolean about = FALSE;
+  TabsBench *state = data;
+  guint64 rss_after;
+  g_autofree char *rss = NULL;
 
-  if (g_variant_dict_lookup (options, "version", "b", &version)) {
-    if (version) {
-      // Translators: The leading # is intentional, the initial %s is the
-      // version of KGX itself, the latter format is the VTE version
-      g_print (_("# KGX %s using VTE %u.%u.%u %s\n"),
-               PACKAGE_VERSION,
-               vte_get_major_version (),
-               vte_get_minor_version (),
-               vte_get_micro_version (),
-               vte_get_features ());
-      return EXIT_SUCCESS;
-    }
+  if (!state->window || !kgx_benchmark_get_running (state->bench)) {
+    return G_SOURCE_REMOVE;
   }
 
-  if (g_variant_dict_lookup (options, "about", "b", &about)) {
-    if (about) {
-      g_autofree char *copyright = g_strdup_printf (_("© %s Zander Brown"),
-                                                    "2019-2024");
-      struct winsize w;
-      int padding = 0;
+  if (state->n_tabs < TABS_BENCH_COUNT) {
+    add_bench_tab (state);
+
+    return G_SOURCE_CONTINUE;
+  }
+
+  rss_after = resident_size ();
+  if (state->rss_before && rss_after > state->rss_before) {
+    rss = g_strdup_printf ("%.1f",
+                           (rss_after - state->rss_before) / 1024.0 / state->n_tabs);
+    kgx_benchmark_set_detail (state->bench, "rss_per_tab_kib", rss);
+  }
+
+  kgx_benchmark_finish (state->bench);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Opens lots of (idle) tabs into one window, one per main loop iteration,
+ * to see what each costs us
+ */
+static int
+run_tabs_benchmark (KgxApplication          *self,
+                    GApplicationCommandLine *cli)
+{
+  TabsBench *state = g_new0 (TabsBench, 1);
+  KgxTab *tab;
+
+  state->app = self;
+  state->bench = kgx_benchmark_new (cli, "tabs");
+  state->rss_before = resident_size ();
+  kgx_benchmark_set_detail (state->bench, "tabs", G_STRINGIFY (TABS_BENCH_COUNT));
+
+  tab = add_bench_tab (state);
+  g_set_weak_pointer (&state->window,
+                      KGX_WINDOW (gtk_widget_get_root (GTK_WIDGET (tab))));
+
+  kgx_benchmark_start (state->bench, GTK_WIDGET (state->window));
+
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                   tabs_bench_step,
+                   state,
+                   tabs_bench_free);
+
+  return EXIT_SUCCESS;
+}
+
+
+/*
+ * Run @command as-is when it names a program, otherwise hand it to the
+ * shell (so `-e "ls -al"` works)
+ */
+static GStrv
+command_to_argv (const char *command)
+{
+  gboolean can_exec_directly;
+  GStrv argv;
+
+  if (strchr (command, '/') != NULL) {
+    can_exec_directly = g_file_test (command, G_FILE_TEST_IS_EXECUTABLE);
+  } else {
+    g_autofree char *program = g_find_program_in_path (command);
+
+    can_exec_directly = (program != NULL);
+  }
+
+  if (can_exec_directly) {
+    argv = g_new0 (char *, 2);
+    argv[0] = g_strdup (command);
+    argv[1] = NULL;
+  } else {
+    argv = g_new0 (char *, 4);
+    argv[0] = g_strdup ("/bin/sh");
+    argv[1] = g_strdup ("-c");
+    argv[2] = g_strdup (command);
+    argv[3] = NULL;
+  }
+
+  return argv;
+}
+
+
+static int
+kgx_application_command_line (GApplication            *app,
+                              GApplicationCommandLine *cli)
+{
+  KgxApplication *self = KGX_APPLICATION (app);
+  guint32 timestamp = GDK_CURRENT_TIME;
+  GVariantDict *options = NULL;
+  g_auto (GStrv) argv = NULL;
+  const char *command = NULL;
+  const char *working_dir = NULL;
+  const char *title = NULL;
+  const char *log_dir = NULL;
+  const char *replay = NULL;
+  const char *layout = NULL;
+  const char *primary = NULL;
+  double replay_speed = 1.0;
+  const char *benchmark = NULL;
+  const char *content = "ascii";
+  int size = 64;
+  const char *const *shell = NULL;
+  const char *cwd = NULL;
+  gint64 scrollback;
+  gboolean tab = FALSE;
+  g_autoptr (GFile) path = NULL;
+  g_autoptr (GFile) log_directory = NULL;
+  KgxTab *page;
+
+  options = g_application_command_line_get_options_dict (cli);
+  cwd = g_application_command_line_get_cwd (cli);
+
+  g_variant_dict_lookup (options, "working-directory", "^&ay", &working_dir);
+  g_variant_dict_lookup (options, "title", "&s", &title);
+  g_variant_dict_lookup (options, "command", "^&ay", &command);
+  g_variant_dict_lookup (options, "log-dir", "^&ay", &log_dir);
+  g_variant_dict_lookup (options, "replay", "^&ay", &replay);
+  g_variant_dict_lookup (options, "layout", "^&ay", &layout);
+  g_variant_dict_lookup (options, "replay-speed", "d", &replay_speed);
+  g_variant_dict_lookup (options, "benchmark", "&s", &benchmark);
+  g_variant_dict_lookup (options, "benchmark-content", "&s", &content);
+  g_variant_dict_lookup (options, "benchmark-size", "i", &size);
+  g_variant_dict_lookup (options, G_OPTION_REMAINING, "^aay", &argv);
+
+  if (g_variant_dict_lookup (options, "isolated", "&s", &primary)) {
+    g_set_str (&self->primary, primary);
+
+    /* Where X11 gets the class from, see isolated_window_realized() */
+    g_set_prgname (primary);
+
+    /* The session is the primary's to keep */
+    kgx_session_stop (get_session (self));
+  }
+
+  if (g_variant_dict_lookup (options, "set-shell", "^as", &shell) && shell) {
+    kgx_settings_set_custom_shell (self->settings, shell);
+
+    return EXIT_SUCCESS;
+  }
+
+  if (g_variant_dict_lookup (options, "set-scrollback", "x", &scrollback)) {
+    kgx_settings_set_scrollback (self->settings, scrollback);
+
+    return EXIT_SUCCESS;
+  }
+
+  if (g_strcmp0 (benchmark, "throughput") == 0) {
+    return run_throughput_benchmark (self, cli, timestamp, content, size);
+  } else if (g_strcmp0 (benchmark, "latency") == 0) {
+    return run_latency_benchmark (self, cli, timestamp);
+  } else if (g_strcmp0 (benchmark, "tabs") == 0) {
+    return run_tabs_benchmark (self, cli);
+  } else if (benchmark && !g_str_equal (benchmark, "replay")) {
+    g_application_command_line_printerr (cli,
+                                         _("Unknown benchmark “%s”\n"),
+                                         benchmark);
+    return EXIT_FAILURE;
+  }
+
+  if (benchmark && replay == NULL) {
+    g_application_command_line_printerr (cli, "%s\n", _("--benchmark requires --replay"));
+    return EXIT_FAILURE;
+  }
+
+  if (replay != NULL) {
+    g_autoptr (GFile) file = g_application_command_line_create_file_for_arg (cli, replay);
+
+    page = kgx_application_add_replay (self, NULL, timestamp, file, replay_speed);
+
+    if (benchmark) {
+      g_autoptr (KgxBenchmark) bench = kgx_benchmark_new (cli, "replay");
+      g_autofree char *speed = g_strdup_printf ("%g", replay_speed);
+
+      kgx_benchmark_set_detail (bench, "file", g_file_peek_path (file));
+      kgx_benchmark_set_detail (bench, "speed", speed);
+
+      g_signal_connect_data (page,
+                             "notify::playing", G_CALLBACK (replay_playing_changed),
+                             g_object_ref (bench), (GClosureNotify) g_object_unref,
+                             G_CONNECT_DEFAULT);
+      g_signal_connect_data (page,
+                             "died", G_CALLBACK (replay_died),
+                             g_object_ref (bench), (GClosureNotify) g_object_unref,
+                             G_CONNECT_DEFAULT);
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  if (layout != NULL) {
+    g_autoptr (GFile) file = g_application_command_line_create_file_for_arg (cli, layout);
+    g_autoptr (GFile) base = g_file_get_parent (file);
+    g_autoptr (GError) error = NULL;
+    g_autofree char *contents = NULL;
+
+    if (!g_file_load_contents (file, NULL, &contents, NULL, NULL, &error) ||
+        !open_layout (self, timestamp, contents, base, &error)) {
+      g_application_command_line_printerr (cli,
+                                           _("Couldn’t open layout: %s\n"),
+                                           error->message);
+      return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  g_variant_dict_lookup (options, "tab", "b", &tab);
+
+  /* Just `kgx` brings back the last session, rather than adding to it */
+  if (restore_session (self, timestamp) &&
+      !tab &&
+      working_dir == NULL &&
+      command == NULL &&
+      title == NULL &&
+      log_dir == NULL &&
+      (argv == NULL || argv[0] == NULL)) {
+    return EXIT_SUCCESS;
+  }
+
+  if (working_dir != NULL) {
+    path = g_file_new_for_commandline_arg_and_cwd (working_dir, cwd);
+  }
+
+  if (path == NULL) {
+    path = g_file_new_for_path (cwd);
+  }
+
+  if (command != NULL) {
+    if (argv != NULL && argv[0] != NULL) {
+      g_warning (_("Cannot use both --command and positional parameters"));
+      return EXIT_FAILURE;
+    }
+
+    g_clear_pointer (&argv, g_strfreev);
+    argv = command_to_argv (command);
+  }
+
+  /* Only for the tab this opens, not whatever comes after */
+  if (log_dir != NULL) {
+    log_directory = g_application_command_line_create_file_for_arg (cli, log_dir);
+  }
+
+  if (tab) {
+    if (log_dir == NULL && forward_tab (self, path, argv, title)) {
+      return EXIT_SUCCESS;
+    }
+
+    page = kgx_application_add_terminal (self,
+                                         get_active_window (self),
+                                         timestamp,
+                                         path,
+                                         argv,
+                                         title);
+  } else if (log_dir != NULL) {
+    /* Recording is set up on the tab, so this one stays here */
+    page = kgx_application_add_terminal (self, NULL, timestamp, path, argv, title);
+  } else {
+    page = kgx_application_open_window (self, timestamp, path, argv, title);
+  }
+
+  if (log_directory != NULL) {
+    kgx_tab_record_to (page, log_directory);
+  }
+
+  return EXIT_SUCCESS;
+}
 
-      ioctl (STDOUT_FILENO, TIOCGWINSZ, &w);
+
+static void
+print_center (char *msg, int ign, short width)
+{
+  int half_msg = 0;
+  int half_screen = 0;
+
+  half_msg = strlen (msg) / 2;
+  half_screen = width / 2;
+
+  g_print ("%*s\n",
+           half_screen + half_msg,
+           msg);
+}
+
+static void
+print_logo (short width)
+{
+  g_autoptr (GFile) logo = NULL;
+  g_autoptr (GError) error = NULL;
+  g_auto (GStrv) logo_lines = NULL;
+  g_autofree char *logo_text = NULL;
+  int i = 0;
+  int half_screen = width / 2;
+
+  logo = g_file_new_for_uri ("resource:/" KGX_APPLICATION_PATH "logo.txt");
+
+  g_file_load_contents (logo, NULL, &logo_text, NULL, NULL, &error);
+
+  if (error) {
+    g_error ("Wat? %s", error->message);
+  }
+
+  logo_lines = g_strsplit (logo_text, "\n", -1);
+
+  while (logo_lines[i]) {
+    g_print ("%*s%s\n",
+             half_screen - (LOGO_COL_SIZE / 2),
+             "",
+             logo_lines[i]);
+
+    i++;
+  }
+}
+
+static int
+kgx_application_handle_local_options (GApplication *app,
+                                      GVariantDict *options)
+{
+  gboolean version = FALSE;
+  gboolean about = FALSE;
+  const char *benchmark = NULL;
+  const char *generate = NULL;
+  int size = 64;
+
+  if (g_variant_dict_lookup (options, "version", "b", &version)) {
+    if (version) {
+      // Translators: The leading # is intentional, the initial %s is the
+      // version of KGX itself, the latter format is the VTE version
+      g_print (_("# KGX %s using VTE %u.%u.%u %s\n"),
+               PACKAGE_VERSION,
+               vte_get_major_version (),
+               vte_get_minor_version (),
+               vte_get_micro_version (),
+               vte_get_features ());
+      return EXIT_SUCCESS;
+    }
+  }
+
+  if (g_variant_dict_lookup (options, "about", "b", &about)) {
+    if (about) {
+      g_autofree char *copyright = g_strdup_printf (_("© %s Zander Brown"),
+                                                    "2019-2024");
+      struct winsize w;
+      int padding = 0;
+
+      ioctl (STDOUT_FILENO, TIOCGWINSZ, &w);
 
       padding = ((w.ws_row -1) - (LOGO_ROW_SIZE + 5)) / 2;
 
@@ -388,6 +1069,22 @@ kgx_application_handle_local_options (GApplication *app,
     }
   }
 
+  if (g_variant_dict_lookup (options, "benchmark-generate", "&s", &generate)) {
+    g_variant_dict_lookup (options, "benchmark-size", "i", &size);
+
+    return kgx_benchmark_generate (generate, (guint64) MAX (size, 0) * 1024 * 1024);
+  }
+
+  if (g_variant_dict_contains (options, "benchmark-echo")) {
+    return kgx_benchmark_echo ();
+  }
+
+  if (g_variant_dict_lookup (options, "benchmark", "&s", &benchmark)) {
+    /* Don't let an existing instance (and its windows) skew the numbers */
+    g_application_set_flags (app,
+                             g_application_get_flags (app) | G_APPLICATION_NON_UNIQUE);
+  }
+
   return G_APPLICATION_CLASS (kgx_application_parent_class)->handle_local_options (app, options);
 }
 
@@ -397,15 +1094,20 @@ kgx_application_class_init (KgxApplicationClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GApplicationClass *app_class = G_APPLICATION_CLASS (klass);
+  GtkApplicationClass *gtk_app_class = GTK_APPLICATION_CLASS (klass);
 
   object_class->dispose = kgx_application_dispose;
 
   app_class->activate = kgx_application_activate;
   app_class->startup = kgx_application_startup;
+  app_class->shutdown = kgx_application_shutdown;
   app_class->open = kgx_application_open;
   app_class->local_command_line = kgx_application_local_command_line;
   app_class->command_line = kgx_application_command_line;
   app_class->handle_local_options = kgx_application_handle_local_options;
+
+  gtk_app_class->window_added = kgx_application_window_added;
+  gtk_app_class->window_removed = kgx_application_window_removed;
 }
 
 
@@ -475,69 +1177,239 @@ static GOptionEntry entries[] = {
     N_("TITLE")
   },
   {
-    "set-shell",
+    "log-dir",
     0,
     0,
-    G_OPTION_ARG_STRING_ARRAY,
+    G_OPTION_ARG_FILENAME,
     NULL,
-    N_("ADVANCED: Set the shell to launch"),
-    N_("SHELL")
+    N_("Record the terminal’s output to a log in this directory"),
+    // Translators: Placeholder of for a given directory
+    N_("DIRNAME")
   },
   {
-    "set-scrollback",
+    "layout",
     0,
     0,
-    G_OPTION_ARG_INT64,
+    G_OPTION_ARG_FILENAME,
     NULL,
-    N_("ADVANCED: Set the scrollback length"),
-    N_("LINES")
+    N_("Open the windows and tabs described by a layout file"),
+    N_("FILE")
   },
   {
-    G_OPTION_REMAINING,
+    "replay",
     0,
     0,
-    G_OPTION_ARG_FILENAME_ARRAY,
+    G_OPTION_ARG_FILENAME,
     NULL,
+    N_("Play back recorded output, raw or asciicast v2"),
+    N_("FILE")
+  },
+  {
+    "replay-speed",
+    0,
+    0,
+    G_OPTION_ARG_DOUBLE,
     NULL,
-    N_("[-e|-- COMMAND [ARGUMENT...]]")
+    N_("Speed multiplier for --replay, 0 for as fast as possible"),
+    N_("SPEED")
   },
-  { NULL }
-};
-
-
-static void
-new_window_activated (GSimpleAction *action,
-                      GVariant      *parameter,
-                      gpointer       data)
-{
-  KgxApplication *self = KGX_APPLICATION (data);
-  guint32 timestamp = GDK_CURRENT_TIME;
-
-  kgx_application_add_terminal (self, NULL, timestamp, NULL, NULL, NULL);
-}
-
-
-static void
-new_tab_activated (GSimpleAction *action,
-                   GVariant      *parameter,
-                   gpointer       data)
-{
-  KgxApplication *self = KGX_APPLICATION (data);
-  guint32 timestamp = GDK_CURRENT_TIME;
-  g_autoptr (GFile) dir = NULL;
-  GtkWindow *window;
-
-  window = gtk_application_get_active_window (GTK_APPLICATION (self));
-  if (window) {
-    dir = kgx_window_get_working_dir (KGX_WINDOW (window));
+  {
+    "benchmark",
+    0,
+    0,
+    G_OPTION_ARG_STRING,
+    NULL,
+    N_("Report timings as JSON, then exit. MODE is “replay” (the default, needs --replay), “throughput”, “latency” or “tabs”"),
+    N_("MODE")
+  },
+  {
+    "benchmark-content",
+    0,
+    0,
+    G_OPTION_ARG_STRING,
+    NULL,
+    N_("Output for --benchmark=throughput: “ascii”, “cjk”, “sgr” or “long-lines”"),
+    N_("CONTENT")
+  },
+  {
+    "benchmark-size",
+    0,
+    0,
+    G_OPTION_ARG_INT,
+    NULL,
+    N_("Output for --benchmark=throughput, in MiB"),
+    N_("MIB")
+  },
+  {
+    "benchmark-generate",
+    0,
+    G_OPTION_FLAG_HIDDEN,
+    G_OPTION_ARG_STRING,
+    NULL,
+    NULL,
+    NULL
+  },
+  {
+    "benchmark-echo",
+    0,
+    G_OPTION_FLAG_HIDDEN,
+    G_OPTION_ARG_NONE,
+    NULL,
+    NULL,
+    NULL
+  },
+  {
+    "isolated",
+    0,
+    G_OPTION_FLAG_HIDDEN,
+    G_OPTION_ARG_STRING,
+    NULL,
+    NULL,
+    NULL
+  },
+  {
+    "set-shell",
+    0,
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    NULL,
+    N_("ADVANCED: Set the shell to launch"),
+    N_("SHELL")
+  },
+  {
+    "set-scrollback",
+    0,
+    0,
+    G_OPTION_ARG_INT64,
+    NULL,
+    N_("ADVANCED: Set the scrollback length"),
+    N_("LINES")
+  },
+  {
+    G_OPTION_REMAINING,
+    0,
+    0,
+    G_OPTION_ARG_FILENAME_ARRAY,
+    NULL,
+    NULL,
+    N_("[-e|-- COMMAND [ARGUMENT...]]")
+  },
+  { NULL }
+};
+
+
+static void
+new_window_activated (GSimpleAction *action,
+                      GVariant      *parameter,
+                      gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  guint32 timestamp = GDK_CURRENT_TIME;
+
+  kgx_application_open_window (self, timestamp, NULL, NULL, NULL);
+}
+
+
+static void
+new_tab_activated (GSimpleAction *action,
+                   GVariant      *parameter,
+                   gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  guint32 timestamp = GDK_CURRENT_TIME;
+  g_autoptr (GFile) dir = NULL;
+  KgxWindow *window;
 
-    kgx_application_add_terminal (self, KGX_WINDOW (window), timestamp, dir, NULL, NULL);
+  window = get_active_window (self);
+  if (window) {
+    dir = kgx_window_get_working_dir (window);
+
+    kgx_application_add_terminal (self, window, timestamp, dir, NULL, NULL);
   } else {
     kgx_application_add_terminal (self, NULL, timestamp, NULL, NULL, NULL);
   }
 }
 
 
+/*
+ * What `kgx --tab -e …` & co send when they find us already running,
+ * see kgx_remote_try()
+ */
+static void
+new_terminal_activated (GSimpleAction *action,
+                        GVariant      *parameter,
+                        gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  guint32 timestamp = GDK_CURRENT_TIME;
+  g_autoptr (GVariantDict) options = g_variant_dict_new (parameter);
+  g_autoptr (GFile) path = NULL;
+  g_auto (GStrv) argv = NULL;
+  const char *working_dir = NULL;
+  const char *command = NULL;
+  const char *title = NULL;
+  gboolean tab = FALSE;
+  KgxWindow *window = NULL;
+
+  g_variant_dict_lookup (options, "working-directory", "^&ay", &working_dir);
+  g_variant_dict_lookup (options, "command", "^&ay", &command);
+  g_variant_dict_lookup (options, "argv", "^aay", &argv);
+  g_variant_dict_lookup (options, "title", "&s", &title);
+  g_variant_dict_lookup (options, "tab", "b", &tab);
+
+  if (working_dir != NULL) {
+    path = g_file_new_for_path (working_dir);
+  }
+
+  if (command != NULL) {
+    g_clear_pointer (&argv, g_strfreev);
+    argv = command_to_argv (command);
+  } else if (argv != NULL && argv[0] == NULL) {
+    g_clear_pointer (&argv, g_strfreev);
+  }
+
+  if (!tab) {
+    kgx_application_open_window (self, timestamp, path, argv, title);
+    return;
+  }
+
+  if (forward_tab (self, path, argv, title)) {
+    return;
+  }
+
+  window = get_active_window (self);
+
+  kgx_application_add_terminal (self, window, timestamp, path, argv, title);
+}
+
+
+/*
+ * The D-Bus face of --layout, takes the layout itself along with the
+ * directory relative paths in it are from (which may be empty)
+ */
+static void
+open_layout_activated (GSimpleAction *action,
+                       GVariant      *parameter,
+                       gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GFile) base = NULL;
+  const char *layout;
+  const char *directory;
+
+  g_variant_get (parameter, "(&s^&ay)", &layout, &directory);
+
+  if (directory[0]) {
+    base = g_file_new_for_path (directory);
+  }
+
+  if (!open_layout (self, GDK_CURRENT_TIME, layout, base, &error)) {
+    g_warning ("Couldn’t open layout: %s", error->message);
+  }
+}
+
+
 static void
 focus_activated (GSimpleAction *action,
                  GVariant      *parameter,
@@ -548,7 +1420,13 @@ focus_activated (GSimpleAction *action,
   KgxPages *pages;
   KgxTab *page;
 
+  /* Wherever the tab is now, which needn't be where it was when the
+   * notification went out */
   page = kgx_application_lookup_page (self, g_variant_get_uint32 (parameter));
+  if (!page) {
+    return;
+  }
+
   pages = kgx_tab_get_pages (page);
   kgx_pages_focus_page (pages, page);
   root = gtk_widget_get_root (GTK_WIDGET (pages));
@@ -557,6 +1435,88 @@ focus_activated (GSimpleAction *action,
 }
 
 
+/*
+ * The rest are how the processes of window-isolation keep in touch, the
+ * primary instance hears from its children about which of them has focus
+ * and what they'd like to notify about. Notifications are sent from here
+ * as the desktop only knows our real application id
+ */
+static void
+child_active_activated (GSimpleAction *action,
+                        GVariant      *parameter,
+                        gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+
+  g_set_str (&self->active_child, g_variant_get_string (parameter, NULL));
+}
+
+
+static void
+child_notification_activated (GSimpleAction *action,
+                              GVariant      *parameter,
+                              gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  g_autoptr (GNotification) noti = NULL;
+  g_autofree char *noti_id = NULL;
+  const char *child;
+  const char *id;
+  const char *title;
+  const char *body;
+  guint page;
+
+  g_variant_get (parameter, "(&s&s&s&su)", &child, &id, &title, &body, &page);
+
+  noti = g_notification_new (title);
+  g_notification_set_body (noti, body);
+  g_notification_set_default_action_and_target (noti,
+                                                "app.focus-child",
+                                                "(su)",
+                                                child,
+                                                page);
+
+  noti_id = g_strdup_printf ("%s-%s", child, id);
+  g_application_send_notification (G_APPLICATION (self), noti_id, noti);
+}
+
+
+static void
+child_withdraw_activated (GSimpleAction *action,
+                          GVariant      *parameter,
+                          gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  g_autofree char *noti_id = NULL;
+  const char *child;
+  const char *id;
+
+  g_variant_get (parameter, "(&s&s)", &child, &id);
+
+  noti_id = g_strdup_printf ("%s-%s", child, id);
+  g_application_withdraw_notification (G_APPLICATION (self), noti_id);
+}
+
+
+static void
+focus_child_activated (GSimpleAction *action,
+                       GVariant      *parameter,
+                       gpointer       data)
+{
+  KgxApplication *self = KGX_APPLICATION (data);
+  GDBusConnection *bus;
+  const char *child;
+  guint page;
+
+  g_variant_get (parameter, "(&su)", &child, &page);
+
+  bus = g_application_get_dbus_connection (G_APPLICATION (self));
+  if (bus) {
+    kgx_remote_activate (bus, child, "focus-page", g_variant_new_uint32 (page));
+  }
+}
+
+
 static void
 zoom_out_activated (GSimpleAction *action,
                     GVariant      *parameter,
@@ -593,7 +1553,13 @@ zoom_in_activated (GSimpleAction *action,
 static GActionEntry app_entries[] = {
   { "new-window", new_window_activated, NULL, NULL, NULL },
   { "new-tab", new_tab_activated, NULL, NULL, NULL },
+  { "new-terminal", new_terminal_activated, "a{sv}", NULL, NULL },
+  { "open-layout", open_layout_activated, "(say)", NULL, NULL },
   { "focus-page", focus_activated, "u", NULL, NULL },
+  { "child-active", child_active_activated, "s", NULL, NULL },
+  { "child-notification", child_notification_activated, "(ssssu)", NULL, NULL },
+  { "child-withdraw", child_withdraw_activated, "(ss)", NULL, NULL },
+  { "focus-child", focus_child_activated, "(su)", NULL, NULL },
   { "zoom-out", zoom_out_activated, NULL, NULL, NULL },
   { "zoom-normal", zoom_normal_activated, NULL, NULL, NULL },
   { "zoom-in", zoom_in_activated, NULL, NULL, NULL },
@@ -681,6 +1647,8 @@ kgx_application_init (KgxApplication *self)
   self->watcher = g_object_new (KGX_TYPE_WATCHER, NULL);
 
   self->pages = g_tree_new_full (kgx_pid_cmp, NULL, NULL, NULL);
+
+  self->started_at = g_get_monotonic_time ();
 }
 
 
@@ -713,6 +1681,8 @@ kgx_application_add_page (KgxApplication *self,
 
   g_tree_insert (self->pages, GINT_TO_POINTER (id), page);
   g_object_weak_ref (G_OBJECT (page), page_died, GINT_TO_POINTER (id));
+
+  kgx_tab_index_add (kgx_application_get_tab_index (self), page);
 }
 
 
@@ -735,6 +1705,26 @@ kgx_application_lookup_page (KgxApplication *self,
 }
 
 
+static void
+shell_integrated (KgxTab     *page,
+                  GParamSpec *pspec,
+                  gpointer    data)
+{
+  KgxApplication *self = KGX_APPLICATION (g_application_get_default ());
+  GPid pid = GPOINTER_TO_INT (data);
+
+  /* The shell tells us what it's running, no need to keep looking in
+   * /proc, at least until it stops telling us */
+  if (kgx_tab_get_shell_integrated (page)) {
+    g_debug ("app: %i is integrated, no longer watching", pid);
+    kgx_watcher_remove (self->watcher, pid);
+  } else {
+    g_debug ("app: %i is no longer integrated, watching again", pid);
+    kgx_watcher_add (self->watcher, pid, page);
+  }
+}
+
+
 static void
 started (GObject      *src,
          GAsyncResult *res,
@@ -755,42 +1745,36 @@ started (GObject      *src,
     return;
   }
 
-  kgx_watcher_add (self->watcher, pid, page);
+  if (pid > 0) {
+    kgx_watcher_add (self->watcher, pid, page);
+    g_signal_connect (page,
+                      "notify::shell-integrated", G_CALLBACK (shell_integrated),
+                      GINT_TO_POINTER (pid));
+  }
 }
 
 
-KgxTab *
-kgx_application_add_terminal (KgxApplication *self,
-                              KgxWindow      *existing_window,
-                              guint32         timestamp,
-                              GFile          *working_directory,
-                              GStrv           argv,
-                              const char     *title)
+static gboolean
+first_frame (GtkWidget     *widget,
+             GdkFrameClock *clock,
+             gpointer       data)
 {
-  g_autofree char *directory = NULL;
-  g_auto (GStrv) shell = NULL;
-  GtkWindow *window;
-  KgxTab *tab;
+  KgxApplication *self = data;
 
-  if (G_LIKELY (argv == NULL)) {
-    shell = kgx_settings_get_shell (self->settings);
-  }
+  g_debug ("app: first frame after %.1fms",
+           (g_get_monotonic_time () - self->started_at) / 1000.0);
 
-  if (working_directory) {
-    directory = g_file_get_path (working_directory);
-  } else {
-    directory = g_strdup (g_get_home_dir ());
-  }
+  return G_SOURCE_REMOVE;
+}
 
-  tab = g_object_new (KGX_TYPE_SIMPLE_TAB,
-                      "application", self,
-                      "settings", self->settings,
-                      "initial-work-dir", directory,
-                      "command", shell != NULL ? shell : argv,
-                      "tab-title", title,
-                      "close-on-quit", argv == NULL,
-                      NULL);
-  kgx_tab_start (tab, started, self);
+
+static void
+present_tab (KgxApplication *self,
+             KgxWindow      *existing_window,
+             guint32         timestamp,
+             KgxTab         *tab)
+{
+  GtkWindow *window;
 
   if (existing_window) {
     window = GTK_WINDOW (existing_window);
@@ -818,11 +1802,732 @@ kgx_application_add_terminal (KgxApplication *self,
                            "default-height", height,
                            "maximized", maximised,
                            NULL);
+
+    if (G_UNLIKELY (!self->had_first_frame)) {
+      self->had_first_frame = TRUE;
+      gtk_widget_add_tick_callback (GTK_WIDGET (window), first_frame, self, NULL);
+    }
   }
 
   kgx_window_add_tab (KGX_WINDOW (window), tab);
 
   gtk_window_present_with_time (window, timestamp);
+}
+
+
+static KgxTab *
+create_terminal (KgxApplication *self,
+                 GFile          *working_directory,
+                 GStrv           argv,
+                 const char     *title)
+{
+  g_autofree char *directory = NULL;
+  g_auto (GStrv) shell = NULL;
+  KgxTab *tab;
+
+  if (G_LIKELY (argv == NULL)) {
+    shell = kgx_settings_get_shell (self->settings);
+  }
+
+  if (working_directory) {
+    directory = g_file_get_path (working_directory);
+  } else {
+    directory = g_strdup (g_get_home_dir ());
+  }
+
+  tab = g_object_new (KGX_TYPE_SIMPLE_TAB,
+                      "application", self,
+                      "settings", self->settings,
+                      "initial-work-dir", directory,
+                      "command", shell != NULL ? shell : argv,
+                      "tab-title", title,
+                      "close-on-quit", argv == NULL,
+                      NULL);
 
   return KGX_TAB (tab);
 }
+
+
+KgxTab *
+kgx_application_add_terminal (KgxApplication *self,
+                              KgxWindow      *existing_window,
+                              guint32         timestamp,
+                              GFile          *working_directory,
+                              GStrv           argv,
+                              const char     *title)
+{
+  KgxTab *tab;
+
+  tab = create_terminal (self, working_directory, argv, title);
+  kgx_tab_start (tab, started, self);
+
+  present_tab (self, existing_window, timestamp, tab);
+
+  kgx_session_add_tab (get_session (self), tab, NULL, argv);
+
+  return tab;
+}
+
+
+/*
+ * As new-terminal expects, see kgx_remote_try()
+ */
+static GVariant *
+build_new_terminal (GFile      *working_directory,
+                    GStrv       argv,
+                    const char *title,
+                    gboolean    tab)
+{
+  g_autoptr (GVariantDict) options = g_variant_dict_new (NULL);
+
+  if (working_directory && g_file_peek_path (working_directory)) {
+    g_variant_dict_insert (options,
+                           "working-directory", "^ay",
+                           g_file_peek_path (working_directory));
+  }
+
+  if (argv && argv[0]) {
+    g_variant_dict_insert (options, "argv", "^aay", argv);
+  }
+
+  if (title) {
+    g_variant_dict_insert (options, "title", "s", title);
+  }
+
+  g_variant_dict_insert (options, "tab", "b", tab);
+
+  return g_variant_dict_end (options);
+}
+
+
+/*
+ * With window-isolation, --tab should land in whichever window was last
+ * focused, even when that's in another process
+ */
+static gboolean
+forward_tab (KgxApplication *self,
+             GFile          *working_directory,
+             GStrv           argv,
+             const char     *title)
+{
+  GDBusConnection *bus;
+
+  if (!self->active_child) {
+    return FALSE;
+  }
+
+  bus = g_application_get_dbus_connection (G_APPLICATION (self));
+  if (!bus) {
+    return FALSE;
+  }
+
+  kgx_remote_activate (bus,
+                       self->active_child,
+                       "new-terminal",
+                       build_new_terminal (working_directory, argv, title, TRUE));
+
+  return TRUE;
+}
+
+
+typedef struct {
+  KgxApplication *self;
+  char           *id;
+} Child;
+
+
+static void
+child_exited (GObject      *source,
+              GAsyncResult *res,
+              gpointer      data)
+{
+  g_autoptr (GError) error = NULL;
+  Child *child = data;
+
+  if (!g_subprocess_wait_finish (G_SUBPROCESS (source), res, &error)) {
+    g_warning ("isolation: lost track of %s: %s", child->id, error->message);
+  }
+
+  g_debug ("isolation: %s exited", child->id);
+
+  if (g_strcmp0 (child->self->active_child, child->id) == 0) {
+    g_clear_pointer (&child->self->active_child, g_free);
+  }
+
+  g_application_release (G_APPLICATION (child->self));
+
+  g_object_unref (child->self);
+  g_free (child->id);
+  g_free (child);
+}
+
+
+/*
+ * Start another copy of ourselves, under an application id of its own, to
+ * host a window. We stay around for as long as it does, so it always has
+ * someone to report to. That id is only for D-Bus, the window presents as
+ * ours, see isolated_window_realized()
+ */
+static gboolean
+spawn_isolated (KgxApplication  *self,
+                GFile           *working_directory,
+                GStrv            argv,
+                const char      *title,
+                GError         **error)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_autoptr (GSubprocess) process = NULL;
+  g_autofree char *exe = NULL;
+  g_autofree char *id = NULL;
+  g_auto (GStrv) args = NULL;
+  const char *app_id;
+  Child *child;
+
+  exe = g_file_read_link ("/proc/self/exe", error);
+  if (!exe) {
+    return FALSE;
+  }
+
+  app_id = g_application_get_application_id (G_APPLICATION (self));
+  id = g_strdup_printf ("%s.Window%u_%u",
+                        app_id,
+                        (guint) getpid (),
+                        ++self->n_children);
+
+  g_strv_builder_add_many (builder,
+                           exe,
+                           "--gapplication-app-id", id,
+                           "--isolated", app_id,
+                           NULL);
+
+  if (working_directory && g_file_peek_path (working_directory)) {
+    g_strv_builder_add_many (builder,
+                             "--working-directory",
+                             g_file_peek_path (working_directory),
+                             NULL);
+  }
+
+  if (title) {
+    g_strv_builder_add_many (builder, "--title", title, NULL);
+  }
+
+  if (argv && argv[0]) {
+    g_strv_builder_add (builder, "--");
+    g_strv_builder_addv (builder, (const char **) argv);
+  }
+
+  args = g_strv_builder_end (builder);
+
+  process = g_subprocess_newv ((const char *const *) args,
+                               G_SUBPROCESS_FLAGS_NONE,
+                               error);
+  if (!process) {
+    return FALSE;
+  }
+
+  g_debug ("isolation: started %s", id);
+
+  child = g_new0 (Child, 1);
+  child->self = g_object_ref (self);
+  child->id = g_steal_pointer (&id);
+
+  g_application_hold (G_APPLICATION (self));
+  g_subprocess_wait_async (process, NULL, child_exited, child);
+
+  return TRUE;
+}
+
+
+/**
+ * kgx_application_open_window:
+ * @self: the #KgxApplication
+ * @timestamp: the timestamp of the event that led to this
+ * @working_directory: (nullable): where to start
+ * @argv: (nullable): the command to run, or %NULL for the shell
+ * @title: (nullable): a title for the new tab
+ *
+ * Like kgx_application_add_terminal() with no @existing_window, except that
+ * with window-isolation enabled, windows after the first are hosted by
+ * processes of their own
+ *
+ * Returns: (transfer none) (nullable): the tab, unless another process is
+ * taking care of it
+ */
+KgxTab *
+kgx_application_open_window (KgxApplication *self,
+                             guint32         timestamp,
+                             GFile          *working_directory,
+                             GStrv           argv,
+                             const char     *title)
+{
+  g_autoptr (GError) error = NULL;
+
+  g_return_val_if_fail (KGX_IS_APPLICATION (self), NULL);
+
+  if (!kgx_settings_get_window_isolation (self->settings) ||
+      !gtk_application_get_windows (GTK_APPLICATION (self))) {
+    return kgx_application_add_terminal (self, NULL, timestamp, working_directory, argv, title);
+  }
+
+  if (self->primary) {
+    GDBusConnection *bus = g_application_get_dbus_connection (G_APPLICATION (self));
+
+    /* Only the primary starts windows, so they all report to it */
+    if (bus) {
+      kgx_remote_activate (bus,
+                           self->primary,
+                           "new-terminal",
+                           build_new_terminal (working_directory, argv, title, FALSE));
+
+      return NULL;
+    }
+  } else if (spawn_isolated (self, working_directory, argv, title, &error)) {
+    return NULL;
+  } else {
+    g_warning ("isolation: opening the window here instead: %s", error->message);
+  }
+
+  return kgx_application_add_terminal (self, NULL, timestamp, working_directory, argv, title);
+}
+
+
+/**
+ * kgx_application_send_notification:
+ * @self: the #KgxApplication
+ * @id: identifies the notification within @self
+ * @page: the id of the tab it's about
+ * @title: the summary
+ * @body: the details
+ *
+ * Tell the user something about @page, activating the notification
+ * focuses it
+ */
+void
+kgx_application_send_notification (KgxApplication *self,
+                                   const char     *id,
+                                   guint           page,
+                                   const char     *title,
+                                   const char     *body)
+{
+  g_autoptr (GNotification) noti = NULL;
+  GDBusConnection *bus;
+
+  g_return_if_fail (KGX_IS_APPLICATION (self));
+
+  bus = g_application_get_dbus_connection (G_APPLICATION (self));
+  if (self->primary && bus) {
+    const char *app_id = g_application_get_application_id (G_APPLICATION (self));
+
+    kgx_remote_activate (bus,
+                         self->primary,
+                         "child-notification",
+                         g_variant_new ("(ssssu)",
+                                        app_id,
+                                        id,
+                                        title,
+                                        body ? body : "",
+                                        page));
+
+    return;
+  }
+
+  noti = g_notification_new (title);
+  g_notification_set_body (noti, body);
+  g_notification_set_default_action_and_target (noti,
+                                                "app.focus-page",
+                                                "u",
+                                                page);
+
+  g_application_send_notification (G_APPLICATION (self), id, noti);
+}
+
+
+/**
+ * kgx_application_withdraw_notification:
+ * @self: the #KgxApplication
+ * @id: as passed to kgx_application_send_notification()
+ *
+ * Take back a notification, if it's still around
+ */
+void
+kgx_application_withdraw_notification (KgxApplication *self,
+                                       const char     *id)
+{
+  GDBusConnection *bus;
+
+  g_return_if_fail (KGX_IS_APPLICATION (self));
+
+  bus = g_application_get_dbus_connection (G_APPLICATION (self));
+  if (self->primary && bus) {
+    const char *app_id = g_application_get_application_id (G_APPLICATION (self));
+
+    kgx_remote_activate (bus,
+                         self->primary,
+                         "child-withdraw",
+                         g_variant_new ("(ss)", app_id, id));
+
+    return;
+  }
+
+  g_application_withdraw_notification (G_APPLICATION (self), id);
+}
+
+
+static void
+start_on_map (KgxTab         *tab,
+              KgxApplication *self)
+{
+  g_signal_handlers_disconnect_by_func (tab, G_CALLBACK (start_on_map), self);
+
+  kgx_tab_start (tab, started, self);
+}
+
+
+static void
+contents_restored (GObject      *source,
+                   GAsyncResult *res,
+                   gpointer      data)
+{
+  KgxApplication *self = KGX_APPLICATION (g_application_get_default ());
+  g_autoptr (KgxTab) tab = data;
+
+  kgx_session_restore_contents_finish (KGX_SESSION (source), res, NULL);
+
+  /* Background tabs wait until they're first looked at */
+  if (gtk_widget_get_mapped (GTK_WIDGET (tab))) {
+    kgx_tab_start (tab, started, self);
+  } else {
+    g_signal_connect (tab, "map", G_CALLBACK (start_on_map), self);
+  }
+}
+
+
+static gboolean
+restore_session (KgxApplication *self,
+                 guint32         timestamp)
+{
+  g_autoptr (GPtrArray) tabs = NULL;
+  KgxWindow *window = NULL;
+  KgxTab *selected = NULL;
+  guint window_id = 0;
+
+  if (self->primary) {
+    return FALSE;
+  }
+
+  tabs = kgx_session_load (get_session (self));
+
+  if (!tabs) {
+    return FALSE;
+  }
+
+  for (guint i = 0; i < tabs->len; i++) {
+    KgxSessionTab *saved = g_ptr_array_index (tabs, i);
+    g_autoptr (GFile) directory = NULL;
+    KgxTab *tab;
+
+    if (saved->window != window_id) {
+      if (selected) {
+        kgx_pages_focus_page (kgx_tab_get_pages (selected), selected);
+      }
+
+      window = NULL;
+      selected = NULL;
+      window_id = saved->window;
+    }
+
+    if (saved->cwd) {
+      directory = g_file_new_for_path (saved->cwd);
+    }
+
+    tab = create_terminal (self, directory, saved->argv, saved->title);
+    present_tab (self, window, timestamp, tab);
+    window = KGX_WINDOW (gtk_widget_get_root (GTK_WIDGET (tab)));
+
+    if (saved->selected) {
+      selected = tab;
+    }
+
+    kgx_session_add_tab (get_session (self), tab, saved->key, saved->argv);
+    kgx_session_restore_contents (get_session (self),
+                                  tab,
+                                  saved->key,
+                                  contents_restored,
+                                  g_object_ref (tab));
+  }
+
+  if (selected) {
+    kgx_pages_focus_page (kgx_tab_get_pages (selected), selected);
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+spawn_next (gpointer data)
+{
+  KgxApplication *self = data;
+  g_autoptr (KgxTab) tab = g_queue_pop_head (&self->spawn_queue);
+
+  /* Closed before its turn */
+  if (tab && gtk_widget_get_parent (GTK_WIDGET (tab))) {
+    kgx_tab_start (tab, started, self);
+  }
+
+  if (g_queue_is_empty (&self->spawn_queue)) {
+    self->spawn_timeout = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static GFile *
+resolve_directory (const char *directory, GFile *base)
+{
+  if (g_str_equal (directory, "~")) {
+    return g_file_new_for_path (g_get_home_dir ());
+  } else if (g_str_has_prefix (directory, "~/")) {
+    g_autofree char *path = g_build_filename (g_get_home_dir (), directory + 2, NULL);
+
+    return g_file_new_for_path (path);
+  } else if (g_path_is_absolute (directory) || !base) {
+    return g_file_new_for_path (directory);
+  }
+
+  return g_file_resolve_relative_path (base, directory);
+}
+
+
+typedef struct {
+  char   *window;
+  GFile  *directory;
+  GStrv   argv;
+  char   *title;
+} LayoutTab;
+
+
+static void
+layout_tab_free (gpointer data)
+{
+  LayoutTab *tab = data;
+
+  g_clear_pointer (&tab->window, g_free);
+  g_clear_object (&tab->directory);
+  g_clear_pointer (&tab->argv, g_strfreev);
+  g_clear_pointer (&tab->title, g_free);
+
+  g_free (tab);
+}
+
+
+/*
+ * Layouts are key files, each group being a tab, in order:
+ *
+ *     [Editor]
+ *     Window=work
+ *     Directory=~/src/project
+ *     Command=vim .
+ *     Title=Editor
+ *
+ * Tabs with the same Window share one (by default they all do). Directory
+ * is relative to the layout, Command is parsed as by the shell and
+ * defaults to the user's shell. Everything is read before anything is
+ * created, so a bad layout doesn't leave half a workspace behind
+ */
+static gboolean
+open_layout (KgxApplication  *self,
+             guint32          timestamp,
+             const char      *layout,
+             GFile           *base,
+             GError         **error)
+{
+  g_autoptr (GKeyFile) file = g_key_file_new ();
+  g_autoptr (GHashTable) windows = NULL;
+  g_autoptr (GPtrArray) tabs = NULL;
+  g_auto (GStrv) groups = NULL;
+
+  if (!g_key_file_load_from_data (file, layout, -1, G_KEY_FILE_NONE, error)) {
+    return FALSE;
+  }
+
+  groups = g_key_file_get_groups (file, NULL);
+  if (!groups[0]) {
+    g_set_error_literal (error,
+                         G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                         _("No tabs"));
+    return FALSE;
+  }
+
+  tabs = g_ptr_array_new_with_free_func (layout_tab_free);
+
+  for (int i = 0; groups[i]; i++) {
+    g_autofree char *directory = NULL;
+    g_autofree char *command = NULL;
+    LayoutTab *tab = g_new0 (LayoutTab, 1);
+
+    g_ptr_array_add (tabs, tab);
+
+    tab->window = g_key_file_get_string (file, groups[i], "Window", NULL);
+    tab->title = g_key_file_get_string (file, groups[i], "Title", NULL);
+
+    directory = g_key_file_get_string (file, groups[i], "Directory", NULL);
+    if (directory) {
+      tab->directory = resolve_directory (directory, base);
+    }
+
+    command = g_key_file_get_string (file, groups[i], "Command", NULL);
+    if (command && !g_shell_parse_argv (command, NULL, &tab->argv, error)) {
+      g_prefix_error (error, "[%s] ", groups[i]);
+      return FALSE;
+    }
+  }
+
+  windows = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (guint i = 0; i < tabs->len; i++) {
+    LayoutTab *layout_tab = g_ptr_array_index (tabs, i);
+    const char *name = layout_tab->window ? layout_tab->window : "";
+    KgxTab *tab;
+
+    tab = create_terminal (self,
+                           layout_tab->directory,
+                           layout_tab->argv,
+                           layout_tab->title);
+    present_tab (self, g_hash_table_lookup (windows, name), timestamp, tab);
+
+    g_hash_table_insert (windows,
+                         (gpointer) name,
+                         gtk_widget_get_root (GTK_WIDGET (tab)));
+
+    kgx_session_add_tab (get_session (self), tab, NULL, layout_tab->argv);
+
+    g_queue_push_tail (&self->spawn_queue, g_object_ref (tab));
+  }
+
+  /* Spawn one at a time, rather than fifty at once */
+  if (!self->spawn_timeout) {
+    self->spawn_timeout = g_timeout_add (SPAWN_STAGGER, spawn_next, self);
+    g_source_set_name_by_id (self->spawn_timeout, "[kgx] layout spawn");
+  }
+
+  return TRUE;
+}
+
+
+/**
+ * kgx_application_add_replay:
+ * @self: the #KgxApplication
+ * @existing_window: (nullable): window to add to, or %NULL for a new one
+ * @timestamp: of the triggering event
+ * @file: the recording
+ * @speed: see #KgxReplayTab:speed
+ *
+ * Returns: (transfer none): the new #KgxReplayTab
+ */
+KgxTab *
+kgx_application_add_replay (KgxApplication *self,
+                            KgxWindow      *existing_window,
+                            guint32         timestamp,
+                            GFile          *file,
+                            double          speed)
+{
+  g_autofree char *title = NULL;
+  KgxTab *tab;
+
+  title = g_file_get_basename (file);
+
+  tab = g_object_new (KGX_TYPE_REPLAY_TAB,
+                      "application", self,
+                      "settings", self->settings,
+                      "file", file,
+                      "speed", speed,
+                      "tab-title", title,
+                      NULL);
+  kgx_tab_start (tab, started, self);
+
+  present_tab (self, existing_window, timestamp, tab);
+
+  return tab;
+}
+
+
+/**
+ * kgx_application_get_notifier:
+ * @self: the #KgxApplication
+ *
+ * Returns: (transfer none): gathers up command completion notifications
+ */
+KgxNotifier *
+kgx_application_get_notifier (KgxApplication *self)
+{
+  g_return_val_if_fail (KGX_IS_APPLICATION (self), NULL);
+
+  if (G_UNLIKELY (!self->notifier)) {
+    self->notifier = kgx_notifier_new (self);
+  }
+
+  return self->notifier;
+}
+
+
+/**
+ * kgx_application_get_monitor:
+ * @self: the #KgxApplication
+ *
+ * Returns: (transfer none): watches tabs for activity and silence
+ */
+KgxMonitor *
+kgx_application_get_monitor (KgxApplication *self)
+{
+  g_return_val_if_fail (KGX_IS_APPLICATION (self), NULL);
+
+  if (G_UNLIKELY (!self->monitor)) {
+    self->monitor = kgx_monitor_new (self, self->settings);
+  }
+
+  return self->monitor;
+}
+
+
+/**
+ * kgx_application_get_tab_index:
+ * @self: the #KgxApplication
+ *
+ * Returns: (transfer none): a search index of every tab in @self
+ */
+KgxTabIndex *
+kgx_application_get_tab_index (KgxApplication *self)
+{
+  g_return_val_if_fail (KGX_IS_APPLICATION (self), NULL);
+
+  if (G_UNLIKELY (!self->tab_index)) {
+    self->tab_index = kgx_tab_index_new ();
+  }
+
+  return self->tab_index;
+}
+
+
+/**
+ * kgx_application_get_history:
+ * @self: the #KgxApplication
+ *
+ * The history is only read in once something wants it, so processes
+ * hosting an isolated window don't all load it
+ *
+ * Returns: (transfer none): the command history
+ */
+KgxHistory *
+kgx_application_get_history (KgxApplication *self)
+{
+  g_return_val_if_fail (KGX_IS_APPLICATION (self), NULL);
+
+  if (G_UNLIKELY (!self->history)) {
+    self->history = kgx_history_new (self->settings);
+  }
+
+  return self->history;
+}
@@ -21,6 +21,10 @@
 #include "kgx-window.h"
 #include "kgx-tab.h"
 #include "kgx-settings.h"
+#include "kgx-history.h"
+#include "kgx-monitor.h"
+#include "kgx-notifier.h"
+#include "kgx-tab-index.h"
 
 G_BEGIN_DECLS
 
@@ -41,5 +45,28 @@ KgxTab *              kgx_application_add_terminal    (KgxApplication *self,
                                                        GFile          *working_directory,
                                                        GStrv           command,
                                                        const char     *title);
+KgxTab               *kgx_application_open_window     (KgxApplication *self,
+                                                       guint32         timestamp,
+                                                       GFile          *working_directory,
+                                                       GStrv           argv,
+                                                       const char     *title);
+KgxTab               *kgx_application_add_replay      (KgxApplication *self,
+                                                       KgxWindow      *existing_window,
+                                                       guint32         timestamp,
+                                                       GFile          *file,
+                                                       double          speed);
+KgxNotifier          *kgx_application_get_notifier    (KgxApplication *self);
+KgxMonitor           *kgx_application_get_monitor     (KgxApplication *self);
+KgxTabIndex          *kgx_application_get_tab_index   (KgxApplication *self);
+KgxHistory           *kgx_application_get_history     (KgxApplication *self);
+void                  kgx_application_send_notification
+                                                      (KgxApplication *self,
+                                                       const char     *id,
+                                                       guint           page,
+                                                       const char     *title,
+                                                       const char     *body);
+void                  kgx_application_withdraw_notification
+                                                      (KgxApplication *self,
+                                                       const char     *id);
 
 G_END_DECLS
@@ -0,0 +1,970 @@
+/* kgx-benchmark.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-benchmark
+ * @title: KgxBenchmark
+ * @short_description: Collects numbers for `--benchmark`
+ *
+ * Whilst running, the frame clock of the watched widget is sampled every
+ * frame and a high priority timer watches for the main loop stalling.
+ * Callers add whatever else they measured as named series, and when
+ * finished a single line of JSON is printed to the invoking command line
+ * and the window is closed
+ */
+
+#include "kgx-config.h"
+
+#include <errno.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vte/vte.h>
+
+#include "kgx-benchmark.h"
+#include "kgx-terminal.h"
+
+/* How often we check on the main loop, and how late counts as a stall */
+#define STALL_PERIOD 5
+#define STALL_THRESHOLD (16 * G_TIME_SPAN_MILLISECOND)
+
+/* Roughly how much output the generator prepares up front */
+#define BLOCK_SIZE (256 * 1024)
+#define LONG_LINE_LENGTH (16 * 1024)
+
+/* Latency probing, the echo program treats these bytes specially */
+#define ECHO_FLOOD_START '+'
+#define ECHO_QUIT '\x04'
+#define PROBE_GAP 20
+#define PROBE_TIMEOUT 1000
+#define PHASE_SETTLE 500
+/* Frames we'll wait for the compositor to say when one was shown */
+#define PRESENTATION_WAIT 4
+
+
+static const char *const contents[] = {
+  "ascii",
+  "cjk",
+  "sgr",
+  "long-lines",
+  NULL
+};
+
+
+typedef struct {
+  char   *name;
+  GArray *values;
+} Series;
+
+
+static void
+series_free (gpointer data)
+{
+  Series *self = data;
+
+  g_clear_pointer (&self->name, g_free);
+  g_clear_pointer (&self->values, g_array_unref);
+
+  g_free (self);
+}
+
+
+struct _KgxBenchmark {
+  GObject                   parent_instance;
+
+  GApplicationCommandLine  *cli;
+  char                     *mode;
+  GPtrArray                *details;
+  GPtrArray                *series;
+
+  GtkWidget                *widget;
+  guint                     tick;
+  gint64                    last_frame;
+
+  guint                     stall_timer;
+  gint64                    last_check;
+
+  /* Latency probing */
+  gboolean                  tapped;
+  GdkFrameClock            *clock;
+  gulong                    after_paint;
+  guint                     probe_timer;
+  guint                     probes;
+  guint                     probes_sent;
+  gboolean                  flooding;
+  char                      expected;
+  gint64                    probe_event;
+  gint64                    probe_write;
+  gint64                    probe_read;
+  gint64                    probe_processed;
+  gint64                    probe_frame;
+
+  gint64                    started_at;
+  gint64                    finished_at;
+  guint64                   bytes;
+  gboolean                  running;
+  gboolean                  aborted;
+};
+
+
+G_DEFINE_TYPE (KgxBenchmark, kgx_benchmark, G_TYPE_OBJECT)
+
+
+static void
+stop_watching (KgxBenchmark *self)
+{
+  g_clear_handle_id (&self->probe_timer, g_source_remove);
+  g_clear_signal_handler (&self->after_paint, self->clock);
+  g_clear_object (&self->clock);
+
+  if (self->widget && self->tapped) {
+    kgx_terminal_pop_tap (KGX_TERMINAL (self->widget));
+  }
+  self->tapped = FALSE;
+
+  if (self->widget) {
+    if (self->tick) {
+      gtk_widget_remove_tick_callback (self->widget, self->tick);
+      self->tick = 0;
+    }
+    g_signal_handlers_disconnect_by_data (self->widget, self);
+    g_clear_weak_pointer (&self->widget);
+  }
+
+  g_clear_handle_id (&self->stall_timer, g_source_remove);
+}
+
+
+static void
+kgx_benchmark_dispose (GObject *object)
+{
+  KgxBenchmark *self = KGX_BENCHMARK (object);
+
+  stop_watching (self);
+
+  g_clear_object (&self->cli);
+  g_clear_pointer (&self->mode, g_free);
+  g_clear_pointer (&self->details, g_ptr_array_unref);
+  g_clear_pointer (&self->series, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (kgx_benchmark_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_benchmark_class_init (KgxBenchmarkClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = kgx_benchmark_dispose;
+}
+
+
+static void
+kgx_benchmark_init (KgxBenchmark *self)
+{
+  self->details = g_ptr_array_new_with_free_func (g_free);
+  self->series = g_ptr_array_new_with_free_func (series_free);
+}
+
+
+static gboolean
+frame_tick (GtkWidget     *widget,
+            GdkFrameClock *clock,
+            gpointer       user_data)
+{
+  KgxBenchmark *self = user_data;
+  gint64 frame_time = gdk_frame_clock_get_frame_time (clock);
+
+  if (self->last_frame > 0) {
+    kgx_benchmark_sample (self,
+                          "frame_interval_ms",
+                          (frame_time - self->last_frame) / 1000.0);
+  }
+  self->last_frame = frame_time;
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean
+check_stall (gpointer user_data)
+{
+  KgxBenchmark *self = user_data;
+  gint64 now = g_get_monotonic_time ();
+  gint64 late = now - self->last_check - (STALL_PERIOD * G_TIME_SPAN_MILLISECOND);
+
+  if (late > STALL_THRESHOLD) {
+    kgx_benchmark_sample (self, "stall_ms", late / 1000.0);
+  }
+  self->last_check = now;
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+widget_destroyed (GtkWidget    *widget,
+                  KgxBenchmark *self)
+{
+  if (!self->running) {
+    return;
+  }
+
+  g_debug ("benchmark: %s went away early", self->mode);
+
+  kgx_benchmark_abort (self);
+}
+
+
+static void
+append_json_string (GString *out, const char *str)
+{
+  g_string_append_c (out, '"');
+
+  for (const char *c = str; *c; c++) {
+    switch (*c) {
+      case '"':
+        g_string_append (out, "\\\"");
+        break;
+      case '\\':
+        g_string_append (out, "\\\\");
+        break;
+      case '\n':
+        g_string_append (out, "\\n");
+        break;
+      default:
+        if ((guchar) *c < 0x20) {
+          g_string_append_printf (out, "\\u%04x", (guint) *c);
+        } else {
+          g_string_append_c (out, *c);
+        }
+        break;
+    }
+  }
+
+  g_string_append_c (out, '"');
+}
+
+
+static void
+append_json_double (GString *out, double value)
+{
+  char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append (out, g_ascii_formatd (buffer, sizeof (buffer), "%.3f", value));
+}
+
+
+static int
+compare_double (gconstpointer a, gconstpointer b)
+{
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+
+  return (da > db) - (da < db);
+}
+
+
+static inline double
+percentile (GArray *sorted, double p)
+{
+  guint index = (guint) (p * (sorted->len - 1) + 0.5);
+
+  return g_array_index (sorted, double, index);
+}
+
+
+static void
+append_series (GString *out, Series *series)
+{
+  GArray *values = series->values;
+  double total = 0;
+
+  g_array_sort (values, compare_double);
+
+  for (guint i = 0; i < values->len; i++) {
+    total += g_array_index (values, double, i);
+  }
+
+  append_json_string (out, series->name);
+  g_string_append_printf (out, ":{\"count\":%u", values->len);
+
+  if (values->len > 0) {
+    g_string_append (out, ",\"total\":");
+    append_json_double (out, total);
+    g_string_append (out, ",\"mean\":");
+    append_json_double (out, total / values->len);
+    g_string_append (out, ",\"p50\":");
+    append_json_double (out, percentile (values, 0.50));
+    g_string_append (out, ",\"p95\":");
+    append_json_double (out, percentile (values, 0.95));
+    g_string_append (out, ",\"p99\":");
+    append_json_double (out, percentile (values, 0.99));
+    g_string_append (out, ",\"max\":");
+    append_json_double (out, g_array_index (values, double, values->len - 1));
+  }
+
+  g_string_append_c (out, '}');
+}
+
+
+static char *
+build_report (KgxBenchmark *self)
+{
+  g_autoptr (GString) out = g_string_new ("{\"mode\":");
+  double seconds = 0;
+
+  if (self->started_at > 0) {
+    seconds = (self->finished_at - self->started_at) / (double) G_USEC_PER_SEC;
+  }
+
+  append_json_string (out, self->mode);
+  g_string_append (out, ",\"kgx\":");
+  append_json_string (out, PACKAGE_VERSION);
+  g_string_append_printf (out, ",\"vte\":\"%u.%u.%u\"",
+                          vte_get_major_version (),
+                          vte_get_minor_version (),
+                          vte_get_micro_version ());
+  g_string_append_printf (out, ",\"complete\":%s",
+                          self->aborted || self->started_at == 0 ? "false" : "true");
+
+  for (guint i = 0; i + 1 < self->details->len; i += 2) {
+    g_string_append_c (out, ',');
+    append_json_string (out, g_ptr_array_index (self->details, i));
+    g_string_append_c (out, ':');
+    append_json_string (out, g_ptr_array_index (self->details, i + 1));
+  }
+
+  g_string_append (out, ",\"seconds\":");
+  append_json_double (out, seconds);
+  g_string_append_printf (out, ",\"bytes\":%" G_GUINT64_FORMAT, self->bytes);
+  g_string_append (out, ",\"bytes_per_second\":");
+  append_json_double (out, seconds > 0 ? self->bytes / seconds : 0);
+
+  g_string_append (out, ",\"series\":{");
+  for (guint i = 0; i < self->series->len; i++) {
+    if (i > 0) {
+      g_string_append_c (out, ',');
+    }
+    append_series (out, g_ptr_array_index (self->series, i));
+  }
+  g_string_append (out, "}}");
+
+  return g_string_free_and_steal (g_steal_pointer (&out));
+}
+
+
+/**
+ * kgx_benchmark_new:
+ * @cli: where to report to
+ * @mode: what we're benchmarking, for the report
+ *
+ * Returns: (transfer full): a new #KgxBenchmark
+ */
+KgxBenchmark *
+kgx_benchmark_new (GApplicationCommandLine *cli,
+                   const char              *mode)
+{
+  KgxBenchmark *self;
+
+  g_return_val_if_fail (G_IS_APPLICATION_COMMAND_LINE (cli), NULL);
+  g_return_val_if_fail (mode != NULL, NULL);
+
+  self = g_object_new (KGX_TYPE_BENCHMARK, NULL);
+  /* Keeping this alive keeps the invoking process waiting for our report */
+  self->cli = g_object_ref (cli);
+  self->mode = g_strdup (mode);
+
+  return self;
+}
+
+
+void
+kgx_benchmark_set_detail (KgxBenchmark *self,
+                          const char   *key,
+                          const char   *value)
+{
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+  g_return_if_fail (key != NULL);
+
+  g_ptr_array_add (self->details, g_strdup (key));
+  g_ptr_array_add (self->details, g_strdup (value ? value : ""));
+}
+
+
+/**
+ * kgx_benchmark_start:
+ * @self: the #KgxBenchmark
+ * @widget: the widget being exercised
+ *
+ * Start the clock, @self stays alive until kgx_benchmark_finish()
+ */
+void
+kgx_benchmark_start (KgxBenchmark *self,
+                     GtkWidget    *widget)
+{
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+  g_return_if_fail (GTK_IS_WIDGET (widget));
+  g_return_if_fail (!self->running && self->cli);
+
+  g_debug ("benchmark: starting %s", self->mode);
+
+  g_object_ref (self);
+
+  self->running = TRUE;
+  self->started_at = g_get_monotonic_time ();
+  self->last_check = self->started_at;
+
+  g_set_weak_pointer (&self->widget, widget);
+  self->tick = gtk_widget_add_tick_callback (widget, frame_tick, self, NULL);
+  g_signal_connect (widget, "destroy", G_CALLBACK (widget_destroyed), self);
+
+  self->stall_timer = g_timeout_add_full (G_PRIORITY_HIGH,
+                                          STALL_PERIOD,
+                                          check_stall,
+                                          self,
+                                          NULL);
+  g_source_set_name_by_id (self->stall_timer, "[kgx] benchmark stall");
+}
+
+
+void
+kgx_benchmark_add_bytes (KgxBenchmark *self,
+                         guint64       bytes)
+{
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+
+  self->bytes += bytes;
+}
+
+
+/**
+ * kgx_benchmark_sample:
+ * @self: the #KgxBenchmark
+ * @series: name of the series, by convention suffixed with the unit
+ * @value: the measurement
+ *
+ * Each series is reported as a distribution
+ */
+void
+kgx_benchmark_sample (KgxBenchmark *self,
+                      const char   *series,
+                      double        value)
+{
+  Series *target = NULL;
+
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+  g_return_if_fail (series != NULL);
+
+  for (guint i = 0; i < self->series->len; i++) {
+    Series *candidate = g_ptr_array_index (self->series, i);
+
+    if (g_str_equal (candidate->name, series)) {
+      target = candidate;
+      break;
+    }
+  }
+
+  if (G_UNLIKELY (!target)) {
+    target = g_new0 (Series, 1);
+    target->name = g_strdup (series);
+    target->values = g_array_new (FALSE, FALSE, sizeof (double));
+    g_ptr_array_add (self->series, target);
+  }
+
+  g_array_append_val (target->values, value);
+}
+
+
+/**
+ * kgx_benchmark_finish:
+ * @self: the #KgxBenchmark
+ *
+ * Stop the clock, print the report, and close the window we were watching
+ */
+void
+kgx_benchmark_finish (KgxBenchmark *self)
+{
+  g_autoptr (GtkWidget) widget = NULL;
+  g_autofree char *report = NULL;
+  GtkRoot *root = NULL;
+  gboolean was_running;
+
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+
+  if (!self->cli) {
+    return;
+  }
+
+  was_running = self->running;
+  self->running = FALSE;
+  self->finished_at = g_get_monotonic_time ();
+
+  if (self->widget) {
+    widget = g_object_ref (self->widget);
+  }
+
+  stop_watching (self);
+
+  report = build_report (self);
+  g_application_command_line_print (self->cli, "%s\n", report);
+  g_application_command_line_set_exit_status (self->cli,
+                                              self->aborted || !was_running ?
+                                                EXIT_FAILURE : EXIT_SUCCESS);
+  g_clear_object (&self->cli);
+
+  if (widget) {
+    root = gtk_widget_get_root (widget);
+  }
+
+  if (root && !gtk_widget_in_destruction (GTK_WIDGET (root))) {
+    gtk_window_destroy (GTK_WINDOW (root));
+  }
+
+  if (was_running) {
+    g_object_unref (self);
+  }
+}
+
+
+/**
+ * kgx_benchmark_abort:
+ * @self: the #KgxBenchmark
+ *
+ * As kgx_benchmark_finish(), but the report is marked incomplete
+ */
+void
+kgx_benchmark_abort (KgxBenchmark *self)
+{
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+
+  self->aborted = TRUE;
+  kgx_benchmark_finish (self);
+}
+
+
+gboolean
+kgx_benchmark_get_running (KgxBenchmark *self)
+{
+  g_return_val_if_fail (KGX_IS_BENCHMARK (self), FALSE);
+
+  return self->running;
+}
+
+
+gboolean
+kgx_benchmark_is_content (const char *content)
+{
+  return content != NULL && g_strv_contains (contents, content);
+}
+
+
+static GBytes *
+build_block (const char *content)
+{
+  static const char *const attributes[] = { "", "1;", "3;", "4;" };
+  g_autoptr (GString) block = g_string_sized_new (BLOCK_SIZE + LONG_LINE_LENGTH);
+
+  for (guint line = 0; block->len < BLOCK_SIZE; line++) {
+    if (g_str_equal (content, "ascii")) {
+      for (guint i = 0; i < 79; i++) {
+        g_string_append_c (block, '!' + (line + i) % 94);
+      }
+    } else if (g_str_equal (content, "cjk")) {
+      /* Double width, so this fills 78 columns */
+      for (guint i = 0; i < 39; i++) {
+        g_string_append_unichar (block, 0x4e00 + (line * 39 + i) % 0x5000);
+      }
+    } else if (g_str_equal (content, "sgr")) {
+      for (guint i = 0; i < 79; i++) {
+        g_string_append_printf (block,
+                                "\033[%s38;5;%u;48;5;%um%c",
+                                attributes[i % G_N_ELEMENTS (attributes)],
+                                (line + i) % 256,
+                                (line * 7 + i) % 256,
+                                'A' + i % 26);
+      }
+      g_string_append (block, "\033[0m");
+    } else if (g_str_equal (content, "long-lines")) {
+      for (guint i = 0; i < LONG_LINE_LENGTH; i++) {
+        g_string_append_c (block, 'a' + (line + i) % 26);
+      }
+    } else {
+      g_return_val_if_reached (NULL);
+    }
+
+    g_string_append_c (block, '\n');
+  }
+
+  return g_string_free_to_bytes (g_steal_pointer (&block));
+}
+
+
+/**
+ * kgx_benchmark_generate:
+ * @content: one of `ascii`, `cjk`, `sgr` or `long-lines`
+ * @size: bytes to write
+ *
+ * Write @size bytes of @content to stdout as fast as we can, this is what
+ * runs inside the terminal for `--benchmark=throughput`
+ *
+ * Returns: the exit status
+ */
+int
+kgx_benchmark_generate (const char *content,
+                        guint64     size)
+{
+  g_autoptr (GBytes) block = NULL;
+  const guint8 *data;
+  gsize block_len;
+  guint64 written = 0;
+
+  if (!kgx_benchmark_is_content (content)) {
+    g_printerr ("Unknown content “%s”\n", content);
+    return EXIT_FAILURE;
+  }
+
+  block = build_block (content);
+  data = g_bytes_get_data (block, &block_len);
+
+  while (written < size) {
+    gsize len = MIN (block_len, size - written);
+    gsize done = 0;
+
+    while (done < len) {
+      gssize res = write (STDOUT_FILENO, data + done, len - done);
+
+      if (G_UNLIKELY (res < 0)) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        return EXIT_FAILURE;
+      }
+
+      done += res;
+    }
+
+    written += len;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+static void
+stop_echo_flood (int *flooding, GThread **thread)
+{
+  if (*thread) {
+    g_atomic_int_set (flooding, FALSE);
+    g_clear_pointer (thread, g_thread_join);
+  }
+}
+
+
+static gpointer
+echo_flood (gpointer data)
+{
+  int *flooding = data;
+  g_autoptr (GString) block = g_string_new (NULL);
+
+  /* No letters, they're what's being echoed */
+  for (guint line = 0; line < 64; line++) {
+    for (guint i = 0; i < 78; i++) {
+      g_string_append_c (block, '0' + (line + i) % 10);
+    }
+    g_string_append (block, "\r\n");
+  }
+
+  while (g_atomic_int_get (flooding)) {
+    if (write (STDOUT_FILENO, block->str, block->len) < 0 && errno != EINTR) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * kgx_benchmark_echo:
+ *
+ * What runs inside the terminal for `--benchmark=latency`, stdin is put
+ * in raw mode and everything read is immediately written back, except
+ * `+` starts flooding stdout in the background and `^D` quits
+ *
+ * Returns: the exit status
+ */
+int
+kgx_benchmark_echo (void)
+{
+  GThread *thread = NULL;
+  int flooding = FALSE;
+  struct termios attrs;
+  char c;
+
+  if (tcgetattr (STDIN_FILENO, &attrs) == 0) {
+    cfmakeraw (&attrs);
+    tcsetattr (STDIN_FILENO, TCSANOW, &attrs);
+  }
+
+  if (write (STDOUT_FILENO, "ready\r\n", 7) < 0) {
+    return EXIT_FAILURE;
+  }
+
+  while (TRUE) {
+    gssize res = read (STDIN_FILENO, &c, 1);
+
+    if (res < 0 && errno == EINTR) {
+      continue;
+    } else if (res <= 0 || c == ECHO_QUIT) {
+      break;
+    } else if (c == ECHO_FLOOD_START) {
+      if (!thread) {
+        g_atomic_int_set (&flooding, TRUE);
+        thread = g_thread_new ("flood", echo_flood, &flooding);
+      }
+    } else if (write (STDOUT_FILENO, &c, 1) < 0) {
+      break;
+    }
+  }
+
+  stop_echo_flood (&flooding, &thread);
+
+  return EXIT_SUCCESS;
+}
+
+
+static gboolean send_probe (gpointer data);
+
+
+static void
+schedule_probe (KgxBenchmark *self, guint delay)
+{
+  g_clear_handle_id (&self->probe_timer, g_source_remove);
+
+  /* A little jitter so we don't lock step with the display */
+  self->probe_timer = g_timeout_add (delay + g_random_int_range (0, 8),
+                                     send_probe,
+                                     self);
+  g_source_set_name_by_id (self->probe_timer, "[kgx] benchmark probe");
+}
+
+
+static void
+sample_probe (KgxBenchmark *self, const char *step, gint64 from, gint64 to)
+{
+  g_autofree char *series = NULL;
+
+  series = g_strdup_printf ("%s_%s_ms", self->flooding ? "flood" : "idle", step);
+
+  kgx_benchmark_sample (self, series, (to - from) / 1000.0);
+}
+
+
+/*
+ * When the frame drawing the echo reached the screen, or at least when
+ * it was drawn if the compositor isn't telling. Returns 0 whilst we're
+ * still waiting to hear
+ */
+static gint64
+probe_drawn_at (KgxBenchmark *self, GdkFrameClock *clock)
+{
+  GdkFrameTimings *timings = gdk_frame_clock_get_timings (clock, self->probe_frame);
+  gint64 waited = gdk_frame_clock_get_frame_counter (clock) - self->probe_frame;
+
+  if (timings && gdk_frame_timings_get_complete (timings) &&
+      gdk_frame_timings_get_presentation_time (timings) > 0) {
+    return gdk_frame_timings_get_presentation_time (timings);
+  } else if (timings && (gdk_frame_timings_get_complete (timings) ||
+                         waited >= PRESENTATION_WAIT)) {
+    return gdk_frame_timings_get_frame_time (timings);
+  } else if (!timings) {
+    /* Fell out of the history, the best we have is now */
+    return gdk_frame_clock_get_frame_time (clock);
+  }
+
+  return 0;
+}
+
+
+static void
+after_paint (GdkFrameClock *clock,
+             KgxBenchmark  *self)
+{
+  gint64 drawn;
+
+  if (!self->probe_processed) {
+    return;
+  }
+
+  if (!self->probe_frame) {
+    /* This is the frame with the echo in it */
+    self->probe_frame = gdk_frame_clock_get_frame_counter (clock);
+  }
+
+  drawn = probe_drawn_at (self, clock);
+  if (!drawn) {
+    /* Keep frames coming until the timings are in */
+    gdk_frame_clock_request_phase (clock, GDK_FRAME_CLOCK_PHASE_AFTER_PAINT);
+    return;
+  }
+
+  sample_probe (self, "event_to_write", self->probe_event, self->probe_write);
+  sample_probe (self, "write_to_read", self->probe_write, self->probe_read);
+  sample_probe (self, "read_to_processed", self->probe_read, self->probe_processed);
+  sample_probe (self, "processed_to_paint", self->probe_processed, drawn);
+  sample_probe (self, "total", self->probe_event, drawn);
+
+  self->probe_read = 0;
+  self->probe_processed = 0;
+  self->probe_frame = 0;
+
+  schedule_probe (self, PROBE_GAP);
+}
+
+
+static void
+probe_output (KgxTerminal  *terminal,
+              GBytes       *output,
+              KgxBenchmark *self)
+{
+  const char *data;
+  gsize len;
+
+  data = g_bytes_get_data (output, &len);
+
+  if (self->probes_sent == 0 && !self->probe_timer) {
+    /* The echo program is up, give it a moment */
+    schedule_probe (self, PHASE_SETTLE);
+    return;
+  }
+
+  if (self->expected && memchr (data, self->expected, len)) {
+    self->probe_read = g_get_monotonic_time ();
+    self->expected = 0;
+  }
+}
+
+
+static void
+probe_contents_changed (KgxTerminal  *terminal,
+                        KgxBenchmark *self)
+{
+  if (self->probe_read && !self->probe_processed) {
+    self->probe_processed = g_get_monotonic_time ();
+    gtk_widget_queue_draw (GTK_WIDGET (terminal));
+  }
+}
+
+
+static gboolean
+send_probe (gpointer data)
+{
+  KgxBenchmark *self = data;
+  VteTerminal *terminal = VTE_TERMINAL (self->widget);
+
+  self->probe_timer = 0;
+
+  if (self->expected) {
+    /* Never came back */
+    kgx_benchmark_sample (self, self->flooding ? "flood_lost" : "idle_lost", 1);
+    self->expected = 0;
+    self->probe_read = 0;
+    self->probe_processed = 0;
+    self->probe_frame = 0;
+  }
+
+  if (!self->clock) {
+    self->clock = gtk_widget_get_frame_clock (self->widget);
+    if (!self->clock) {
+      schedule_probe (self, PHASE_SETTLE);
+      return G_SOURCE_REMOVE;
+    }
+    g_object_ref (self->clock);
+    self->after_paint = g_signal_connect (self->clock,
+                                          "after-paint", G_CALLBACK (after_paint),
+                                          self);
+  }
+
+  if (self->probes_sent == self->probes) {
+    char command = self->flooding ? ECHO_QUIT : ECHO_FLOOD_START;
+
+    vte_terminal_feed_child (terminal, &command, 1);
+
+    if (self->flooding) {
+      kgx_benchmark_finish (self);
+      return G_SOURCE_REMOVE;
+    }
+
+    self->flooding = TRUE;
+    self->probes_sent = 0;
+    schedule_probe (self, PHASE_SETTLE);
+
+    return G_SOURCE_REMOVE;
+  }
+
+  self->probes_sent++;
+  self->expected = 'a' + self->probes_sent % 26;
+
+  /* GTK has no way to inject a key event, so this is as close as we get,
+   * it's what VTE does with a key once the input method commits it */
+  self->probe_event = g_get_monotonic_time ();
+  vte_terminal_feed_child (terminal, &self->expected, 1);
+  self->probe_write = g_get_monotonic_time ();
+
+  self->probe_timer = g_timeout_add (PROBE_TIMEOUT, send_probe, self);
+  g_source_set_name_by_id (self->probe_timer, "[kgx] benchmark probe timeout");
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * kgx_benchmark_start_latency:
+ * @self: the #KgxBenchmark
+ * @terminal: running `--benchmark-echo`
+ * @probes: how many keys to send in each condition
+ *
+ * Measure how long it takes for a key sent to @terminal to come back and
+ * be drawn, first with nothing else happening, then whilst flooded with
+ * output. Finishes by itself
+ */
+void
+kgx_benchmark_start_latency (KgxBenchmark *self,
+                             KgxTerminal  *terminal,
+                             guint         probes)
+{
+  g_return_if_fail (KGX_IS_BENCHMARK (self));
+  g_return_if_fail (KGX_IS_TERMINAL (terminal));
+
+  kgx_benchmark_start (self, GTK_WIDGET (terminal));
+
+  self->probes = probes;
+
+  /* Read the pty ourselves so we know exactly when the echo arrives */
+  kgx_terminal_push_tap (terminal);
+  self->tapped = TRUE;
+
+  g_signal_connect (terminal,
+                    "output", G_CALLBACK (probe_output),
+                    self);
+  g_signal_connect (terminal,
+                    "contents-changed", G_CALLBACK (probe_contents_changed),
+                    self);
+}
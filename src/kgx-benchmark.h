@@ -0,0 +1,54 @@
+/* kgx-benchmark.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "kgx-terminal.h"
+
+G_BEGIN_DECLS
+
+#define KGX_TYPE_BENCHMARK kgx_benchmark_get_type ()
+G_DECLARE_FINAL_TYPE (KgxBenchmark, kgx_benchmark, KGX, BENCHMARK, GObject)
+
+
+KgxBenchmark         *kgx_benchmark_new             (GApplicationCommandLine *cli,
+                                                     const char              *mode);
+void                  kgx_benchmark_set_detail      (KgxBenchmark            *self,
+                                                     const char              *key,
+                                                     const char              *value);
+void                  kgx_benchmark_start           (KgxBenchmark            *self,
+                                                     GtkWidget               *widget);
+void                  kgx_benchmark_add_bytes       (KgxBenchmark            *self,
+                                                     guint64                  bytes);
+void                  kgx_benchmark_sample          (KgxBenchmark            *self,
+                                                     const char              *series,
+                                                     double                   value);
+void                  kgx_benchmark_finish          (KgxBenchmark            *self);
+void                  kgx_benchmark_abort           (KgxBenchmark            *self);
+gboolean              kgx_benchmark_get_running     (KgxBenchmark            *self);
+gboolean              kgx_benchmark_is_content      (const char              *content);
+int                   kgx_benchmark_generate        (const char              *content,
+                                                     guint64                  size);
+void                  kgx_benchmark_start_latency   (KgxBenchmark            *self,
+                                                     KgxTerminal             *terminal,
+                                                     guint                    probes);
+int                   kgx_benchmark_echo            (void);
+
+G_END_DECLS
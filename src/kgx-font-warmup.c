@@ -0,0 +1,110 @@
+/* kgx-font-warmup.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-font-warmup
+ * @title: Font Warm-up
+ * @short_description: Get fontconfig going before the terminal needs it
+ *
+ * On a fresh login the first terminal to realise pays for fontconfig
+ * loading its config and caches, then for sorting fallbacks the first
+ * time a script turns up. None of that is tied to the main thread's font
+ * map, so we resolve the terminal font (and fallbacks for text people
+ * commonly see) through a private font map on a worker whilst the window
+ * is being built
+ */
+
+#include "kgx-config.h"
+
+#include <gio/gio.h>
+#include <pango/pangocairo.h>
+
+#include "kgx-font-warmup.h"
+
+
+/* A little of everything a prompt is likely to show */
+static const char *samples[] = {
+  "The quick brown fox jumps over the lazy dog 0123456789",
+  "┌─┬─┐│├┼┤└┴┘░▒▓█▀▄■●→←↑↓✓✗…",
+  "Ελληνικά Русский ქართული Հայերեն",
+  "العربية עברית",
+  "हिन्दी বাংলা தமிழ் ไทย",
+  "中文 日本語 한국어",
+  "🙂🚀⚠️",
+};
+
+
+static void
+warm_up (GTask        *task,
+         gpointer      source,
+         gpointer      data,
+         GCancellable *cancellable)
+{
+  PangoFontDescription *font = data;
+  g_autoptr (PangoFontMap) map = NULL;
+  g_autoptr (PangoContext) context = NULL;
+  g_autoptr (PangoFontset) fontset = NULL;
+  gint64 start = g_get_monotonic_time ();
+
+  /* The default font map is per-thread, this one is ours alone but the
+   * fontconfig state behind it is shared */
+  map = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (map);
+
+  fontset = pango_font_map_load_fontset (map,
+                                         context,
+                                         font,
+                                         pango_language_get_default ());
+  if (G_UNLIKELY (!fontset)) {
+    g_debug ("font-warmup: nothing matched");
+    return;
+  }
+
+  for (int i = 0; i < G_N_ELEMENTS (samples); i++) {
+    for (const char *c = samples[i]; *c; c = g_utf8_next_char (c)) {
+      g_autoptr (PangoFont) found = NULL;
+
+      found = pango_fontset_get_font (fontset, g_utf8_get_char (c));
+    }
+  }
+
+  g_debug ("font-warmup: done in %.1fms",
+           (g_get_monotonic_time () - start) / 1000.0);
+}
+
+
+/**
+ * kgx_font_warmup:
+ * @font: the font terminals are about to use
+ *
+ * Starts resolving @font in the background, returns immediately
+ */
+void
+kgx_font_warmup (PangoFontDescription *font)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (font != NULL);
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_source_tag (task, kgx_font_warmup);
+  g_task_set_task_data (task,
+                        pango_font_description_copy (font),
+                        (GDestroyNotify) pango_font_description_free);
+  g_task_run_in_thread (task, warm_up);
+}
@@ -0,0 +1,315 @@
+/* kgx-history-window.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include <glib/gi18n.h>
+
+#include "kgx-history-window.h"
+
+/* Nobody reads further down than this, so don't build rows for it */
+#define MAX_RESULTS 100
+
+
+/**
+ * KgxHistoryWindow:
+ * @history: where results come from
+ * @tab: (nullable): where the chosen command goes
+ * @entry: what the user is typing in
+ * @list: the results
+ *
+ * Find a command run before, in any tab, and put it back at the prompt
+ */
+struct _KgxHistoryWindow {
+  AdwWindow       parent_instance;
+
+  KgxHistory     *history;
+  KgxTab         *tab;
+
+  GtkWidget      *entry;
+  GtkWidget      *list;
+};
+
+
+G_DEFINE_FINAL_TYPE (KgxHistoryWindow, kgx_history_window, ADW_TYPE_WINDOW)
+
+
+static void
+kgx_history_window_dispose (GObject *object)
+{
+  KgxHistoryWindow *self = KGX_HISTORY_WINDOW (object);
+
+  g_clear_object (&self->history);
+  g_clear_weak_pointer (&self->tab);
+
+  G_OBJECT_CLASS (kgx_history_window_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_history_window_class_init (KgxHistoryWindowClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = kgx_history_window_dispose;
+
+  gtk_widget_class_add_binding_action (widget_class,
+                                       GDK_KEY_Escape, 0,
+                                       "window.close",
+                                       NULL);
+}
+
+
+static GtkWidget *
+build_row (KgxHistoryItem *item)
+{
+  g_autoptr (GString) subtitle = g_string_new (NULL);
+  g_autoptr (GDateTime) started = NULL;
+  g_autofree char *when = NULL;
+  GtkWidget *row;
+
+  if (item->host && g_strcmp0 (item->host, g_get_host_name ()) != 0) {
+    g_string_append_printf (subtitle, "%s:", item->host);
+  }
+
+  if (item->cwd) {
+    g_string_append (subtitle, item->cwd);
+  }
+
+  started = g_date_time_new_from_unix_local (item->started / G_USEC_PER_SEC);
+  if (started) {
+    when = g_date_time_format (started, "%x %X");
+
+    if (subtitle->len > 0) {
+      g_string_append (subtitle, " — ");
+    }
+    g_string_append (subtitle, when);
+  }
+
+  if (item->exit_status > 0) {
+    g_string_append (subtitle, " — ");
+    /* Translators: %i is the non-zero status a command exited with */
+    g_string_append_printf (subtitle, _("exit status %i"), item->exit_status);
+  }
+
+  row = g_object_new (ADW_TYPE_ACTION_ROW,
+                      "title", item->command,
+                      "subtitle", subtitle->str,
+                      "use-markup", FALSE,
+                      "title-lines", 1,
+                      "subtitle-lines", 1,
+                      "activatable", TRUE,
+                      NULL);
+  g_object_set_data_full (G_OBJECT (row),
+                          "kgx-command",
+                          g_strdup (item->command),
+                          g_free);
+
+  return row;
+}
+
+
+static void
+search_changed (KgxHistoryWindow *self)
+{
+  g_autoptr (GPtrArray) results = NULL;
+  GtkWidget *child;
+
+  results = kgx_history_search (self->history,
+                                gtk_editable_get_text (GTK_EDITABLE (self->entry)),
+                                MAX_RESULTS);
+
+  while ((child = gtk_widget_get_first_child (self->list))) {
+    gtk_list_box_remove (GTK_LIST_BOX (self->list), child);
+  }
+
+  for (guint i = 0; i < results->len; i++) {
+    gtk_list_box_append (GTK_LIST_BOX (self->list),
+                         build_row (g_ptr_array_index (results, i)));
+  }
+
+  gtk_list_box_select_row (GTK_LIST_BOX (self->list),
+                           gtk_list_box_get_row_at_index (GTK_LIST_BOX (self->list), 0));
+}
+
+
+static void
+row_activated (KgxHistoryWindow *self, GtkListBoxRow *row)
+{
+  g_autoptr (KgxTab) tab = self->tab ? g_object_ref (self->tab) : NULL;
+  g_autofree char *command =
+    g_strdup (g_object_get_data (G_OBJECT (row), "kgx-command"));
+
+  gtk_window_destroy (GTK_WINDOW (self));
+
+  /* Back at the prompt, for the user to look over before running */
+  if (tab && command) {
+    kgx_tab_accept_drop (tab, command);
+    gtk_widget_grab_focus (GTK_WIDGET (tab));
+  }
+}
+
+
+static void
+entry_activated (KgxHistoryWindow *self)
+{
+  GtkListBoxRow *row = gtk_list_box_get_selected_row (GTK_LIST_BOX (self->list));
+
+  if (row) {
+    row_activated (self, row);
+  }
+}
+
+
+static void
+move_selection (KgxHistoryWindow *self, int delta)
+{
+  GtkListBoxRow *row = gtk_list_box_get_selected_row (GTK_LIST_BOX (self->list));
+  int index = row ? gtk_list_box_row_get_index (row) + delta : 0;
+
+  row = gtk_list_box_get_row_at_index (GTK_LIST_BOX (self->list), MAX (index, 0));
+  if (row) {
+    gtk_list_box_select_row (GTK_LIST_BOX (self->list), row);
+    gtk_widget_grab_focus (self->entry);
+  }
+}
+
+
+static void
+next_match (KgxHistoryWindow *self)
+{
+  move_selection (self, 1);
+}
+
+
+static void
+previous_match (KgxHistoryWindow *self)
+{
+  move_selection (self, -1);
+}
+
+
+static gboolean
+key_pressed (GtkEventControllerKey *controller,
+             guint                  keyval,
+             guint                  keycode,
+             GdkModifierType        state,
+             KgxHistoryWindow      *self)
+{
+  switch (keyval) {
+    case GDK_KEY_Down:
+    case GDK_KEY_KP_Down:
+      move_selection (self, 1);
+      return GDK_EVENT_STOP;
+    case GDK_KEY_Up:
+    case GDK_KEY_KP_Up:
+      move_selection (self, -1);
+      return GDK_EVENT_STOP;
+    default:
+      return GDK_EVENT_PROPAGATE;
+  }
+}
+
+
+static void
+kgx_history_window_init (KgxHistoryWindow *self)
+{
+  GtkEventController *controller;
+  GtkWidget *view, *header, *scrolled;
+
+  gtk_window_set_title (GTK_WINDOW (self), _("Command History"));
+  gtk_window_set_modal (GTK_WINDOW (self), TRUE);
+  gtk_window_set_default_size (GTK_WINDOW (self), 560, 420);
+
+  self->entry = gtk_search_entry_new ();
+  gtk_search_entry_set_placeholder_text (GTK_SEARCH_ENTRY (self->entry),
+                                         _("Search commands"));
+  gtk_search_entry_set_search_delay (GTK_SEARCH_ENTRY (self->entry), 0);
+  gtk_widget_set_hexpand (self->entry, TRUE);
+  g_signal_connect_swapped (self->entry, "search-changed",
+                            G_CALLBACK (search_changed), self);
+  g_signal_connect_swapped (self->entry, "activate",
+                            G_CALLBACK (entry_activated), self);
+  g_signal_connect_swapped (self->entry, "next-match",
+                            G_CALLBACK (next_match), self);
+  g_signal_connect_swapped (self->entry, "previous-match",
+                            G_CALLBACK (previous_match), self);
+  g_signal_connect_swapped (self->entry, "stop-search",
+                            G_CALLBACK (gtk_window_close), self);
+
+  controller = gtk_event_controller_key_new ();
+  gtk_event_controller_set_propagation_phase (controller, GTK_PHASE_CAPTURE);
+  g_signal_connect (controller, "key-pressed", G_CALLBACK (key_pressed), self);
+  gtk_widget_add_controller (self->entry, controller);
+
+  header = adw_header_bar_new ();
+  adw_header_bar_set_title_widget (ADW_HEADER_BAR (header), self->entry);
+
+  self->list = gtk_list_box_new ();
+  gtk_list_box_set_selection_mode (GTK_LIST_BOX (self->list),
+                                   GTK_SELECTION_BROWSE);
+  gtk_widget_add_css_class (self->list, "navigation-sidebar");
+  g_signal_connect_swapped (self->list, "row-activated",
+                            G_CALLBACK (row_activated), self);
+
+  scrolled = gtk_scrolled_window_new ();
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_NEVER,
+                                  GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_child (GTK_SCROLLED_WINDOW (scrolled), self->list);
+  gtk_widget_set_vexpand (scrolled, TRUE);
+
+  view = adw_toolbar_view_new ();
+  adw_toolbar_view_add_top_bar (ADW_TOOLBAR_VIEW (view), header);
+  adw_toolbar_view_set_content (ADW_TOOLBAR_VIEW (view), scrolled);
+
+  adw_window_set_content (ADW_WINDOW (self), view);
+}
+
+
+/**
+ * kgx_history_window_new:
+ * @parent: the window to open over
+ * @history: the #KgxHistory to search
+ * @tab: (nullable): the #KgxTab to put the chosen command in
+ *
+ * Returns: (transfer none): a new #KgxHistoryWindow, ready to present
+ */
+GtkWidget *
+kgx_history_window_new (GtkWindow  *parent,
+                        KgxHistory *history,
+                        KgxTab     *tab)
+{
+  KgxHistoryWindow *self;
+
+  g_return_val_if_fail (GTK_IS_WINDOW (parent), NULL);
+  g_return_val_if_fail (KGX_IS_HISTORY (history), NULL);
+  g_return_val_if_fail (tab == NULL || KGX_IS_TAB (tab), NULL);
+
+  self = g_object_new (KGX_TYPE_HISTORY_WINDOW,
+                       "transient-for", parent,
+                       NULL);
+  self->history = g_object_ref (history);
+  g_set_weak_pointer (&self->tab, tab);
+
+  search_changed (self);
+  gtk_widget_grab_focus (self->entry);
+
+  return GTK_WIDGET (self);
+}
@@ -0,0 +1,36 @@
+/* kgx-history-window.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <adwaita.h>
+
+#include "kgx-history.h"
+#include "kgx-tab.h"
+
+G_BEGIN_DECLS
+
+#define KGX_TYPE_HISTORY_WINDOW kgx_history_window_get_type ()
+G_DECLARE_FINAL_TYPE (KgxHistoryWindow, kgx_history_window, KGX, HISTORY_WINDOW, AdwWindow)
+
+
+GtkWidget            *kgx_history_window_new          (GtkWindow      *parent,
+                                                       KgxHistory     *history,
+                                                       KgxTab         *tab);
+
+G_END_DECLS
@@ -0,0 +1,1210 @@
+/* kgx-history.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-history
+ * @title: KgxHistory
+ * @short_description: Remembers the commands run in every tab
+ *
+ * Each command a shell reports (see #KgxTerminal::shell-mark) is a line
+ * appended to a log, written in batches on a worker. Once the log gets
+ * long it's moved aside and a new one started, keeping one old log. Other
+ * instances append to the same log, so that only happens under a lock.
+ *
+ * Both logs are read back, also on a worker, into a compact in-memory
+ * index: every distinct command line is kept once, lower cased in one
+ * contiguous buffer, so a search is a single strstr() pass. The index is
+ * bounded on its own, dropping the oldest runs once it gets too big
+ */
+
+#include "kgx-config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <glib/gstdio.h>
+
+#include "kgx-history.h"
+
+#define LOG_NAME "history"
+#define OLD_LOG_NAME LOG_NAME ".1"
+#define LOCK_NAME LOG_NAME ".lock"
+/* Past this the log is moved to OLD_LOG_NAME, replacing the one before */
+#define LOG_LIMIT (32 * 1024 * 1024)
+/* Past this many runs the oldest are dropped, keeping the newest INDEX_KEEP */
+#define INDEX_LIMIT 500000
+#define INDEX_KEEP (INDEX_LIMIT / 4 * 3)
+/* Let a burst of commands settle into one write */
+#define FLUSH_DELAY 1000
+/* Fields are separated by this, and escaped so they can't contain it */
+#define FIELD_SEP '\t'
+#define N_FIELDS 6
+
+
+/**
+ * Entry:
+ * @started: the wall clock time, in microseconds
+ * @duration: in milliseconds
+ * @exit_status: as reported, or -1
+ * @command: index into #Index:commands
+ * @place: index into #Index:places
+ *
+ * One run of a command, kept small as there may be hundreds of thousands
+ *
+ * Stability: Private
+ */
+typedef struct {
+  gint64   started;
+  guint32  duration;
+  gint32   exit_status;
+  guint32  command;
+  guint32  place;
+} Entry;
+
+
+/**
+ * Command:
+ * @text: (not owned): the command line, in #Index:strings
+ * @folded: where the lower cased copy starts in #Index:folded
+ * @last: the most recent #Entry for it
+ * @uses: how many #Entry there are for it
+ *
+ * Stability: Private
+ */
+typedef struct {
+  const char *text;
+  gsize       folded;
+  guint       last;
+  guint       uses;
+} Command;
+
+
+/**
+ * Place:
+ * @host: (not owned) (nullable): in #Index:strings
+ * @cwd: (not owned) (nullable): in #Index:strings
+ *
+ * Stability: Private
+ */
+typedef struct {
+  const char *host;
+  const char *cwd;
+} Place;
+
+
+/**
+ * Index:
+ * @strings: backing for every string below
+ * @entries: (element-type Entry): oldest first
+ * @commands: (element-type Command): in order of first use
+ * @command_ids: (element-type utf8 guint): one more than the index of each
+ *               command in @commands
+ * @places: (element-type Place)
+ * @place_ids: (element-type utf8 guint): as @command_ids, keyed on the
+ *             host and cwd together
+ * @folded: every command in @commands, lower cased with newlines flattened,
+ *          each followed by a newline
+ *
+ * Built on a worker whilst loading, then handed to the main thread
+ *
+ * Stability: Private
+ */
+typedef struct {
+  GStringChunk *strings;
+  GArray       *entries;
+  GArray       *commands;
+  GHashTable   *command_ids;
+  GArray       *places;
+  GHashTable   *place_ids;
+  GString      *folded;
+} Index;
+
+
+typedef struct {
+  GFile   *directory;
+  GBytes  *lines;
+} Job;
+
+
+/**
+ * kgx_history_item_free:
+ * @item: the #KgxHistoryItem
+ */
+void
+kgx_history_item_free (KgxHistoryItem *item)
+{
+  g_clear_pointer (&item->command, g_free);
+  g_clear_pointer (&item->cwd, g_free);
+  g_clear_pointer (&item->host, g_free);
+
+  g_free (item);
+}
+
+
+static Index *
+index_new (void)
+{
+  Index *index = g_new0 (Index, 1);
+
+  index->strings = g_string_chunk_new (64 * 1024);
+  index->entries = g_array_new (FALSE, FALSE, sizeof (Entry));
+  index->commands = g_array_new (FALSE, FALSE, sizeof (Command));
+  index->command_ids = g_hash_table_new (g_str_hash, g_str_equal);
+  index->places = g_array_new (FALSE, FALSE, sizeof (Place));
+  index->place_ids = g_hash_table_new (g_str_hash, g_str_equal);
+  index->folded = g_string_new (NULL);
+
+  return index;
+}
+
+
+static void
+index_free (gpointer data)
+{
+  Index *index = data;
+
+  g_clear_pointer (&index->command_ids, g_hash_table_unref);
+  g_clear_pointer (&index->place_ids, g_hash_table_unref);
+  g_clear_pointer (&index->entries, g_array_unref);
+  g_clear_pointer (&index->commands, g_array_unref);
+  g_clear_pointer (&index->places, g_array_unref);
+  g_clear_pointer (&index->strings, g_string_chunk_free);
+  g_string_free (index->folded, TRUE);
+
+  g_free (index);
+}
+
+
+static guint32
+intern_command (Index *index, const char *text)
+{
+  gpointer id;
+  Command command = { 0, };
+
+  id = g_hash_table_lookup (index->command_ids, text);
+  if (id) {
+    return GPOINTER_TO_UINT (id) - 1;
+  }
+
+  command.text = g_string_chunk_insert_const (index->strings, text);
+  command.folded = index->folded->len;
+
+  for (const char *c = text; *c; c++) {
+    g_string_append_c (index->folded, *c == '\n' ? ' ' : g_ascii_tolower (*c));
+  }
+  g_string_append_c (index->folded, '\n');
+
+  g_array_append_val (index->commands, command);
+  g_hash_table_insert (index->command_ids,
+                       (gpointer) command.text,
+                       GUINT_TO_POINTER (index->commands->len));
+
+  return index->commands->len - 1;
+}
+
+
+static guint32
+intern_place (Index *index, const char *host, const char *cwd)
+{
+  g_autofree char *key = g_strconcat (host ? host : "", "\n", cwd ? cwd : "", NULL);
+  gpointer id;
+  Place place = { NULL, NULL };
+
+  id = g_hash_table_lookup (index->place_ids, key);
+  if (id) {
+    return GPOINTER_TO_UINT (id) - 1;
+  }
+
+  if (host && host[0]) {
+    place.host = g_string_chunk_insert_const (index->strings, host);
+  }
+  if (cwd && cwd[0]) {
+    place.cwd = g_string_chunk_insert_const (index->strings, cwd);
+  }
+
+  g_array_append_val (index->places, place);
+  g_hash_table_insert (index->place_ids,
+                       g_string_chunk_insert_const (index->strings, key),
+                       GUINT_TO_POINTER (index->places->len));
+
+  return index->places->len - 1;
+}
+
+
+static void
+index_add (Index      *index,
+           const char *command,
+           const char *cwd,
+           const char *host,
+           gint64      started,
+           gint64      duration,
+           int         exit_status)
+{
+  Entry entry;
+  Command *entry_command;
+
+  entry.started = started;
+  entry.duration = CLAMP (duration / 1000, 0, G_MAXUINT32);
+  entry.exit_status = exit_status;
+  entry.command = intern_command (index, command);
+  entry.place = intern_place (index, host, cwd);
+
+  g_array_append_val (index->entries, entry);
+
+  entry_command = &g_array_index (index->commands, Command, entry.command);
+  entry_command->last = index->entries->len - 1;
+  entry_command->uses++;
+}
+
+
+/*
+ * Rebuild @index from only its newest runs, so commands and places that
+ * are no longer used go as well
+ */
+static Index *
+index_compact (Index *index)
+{
+  Index *kept = index_new ();
+  guint len = index->entries->len;
+
+  for (guint i = len - MIN (len, INDEX_KEEP); i < len; i++) {
+    Entry *entry = &g_array_index (index->entries, Entry, i);
+    Command *command = &g_array_index (index->commands, Command, entry->command);
+    Place *place = &g_array_index (index->places, Place, entry->place);
+
+    index_add (kept,
+               command->text,
+               place->cwd,
+               place->host,
+               entry->started,
+               (gint64) entry->duration * 1000,
+               entry->exit_status);
+  }
+
+  index_free (index);
+
+  return kept;
+}
+
+
+/*
+ * Tabs, newlines, and backslashes would confuse the log, so they're
+ * escaped, everything else (including any UTF-8) is left as is
+ */
+static void
+append_field (GString *line, const char *field)
+{
+  for (const char *c = field ? field : ""; *c; c++) {
+    switch (*c) {
+      case '\\':
+        g_string_append (line, "\\\\");
+        break;
+      case '\t':
+        g_string_append (line, "\\t");
+        break;
+      case '\n':
+        g_string_append (line, "\\n");
+        break;
+      case '\r':
+        g_string_append (line, "\\r");
+        break;
+      default:
+        g_string_append_c (line, *c);
+        break;
+    }
+  }
+}
+
+
+static char *
+parse_field (const char *start, const char *end)
+{
+  GString *field = g_string_sized_new (end - start);
+
+  for (const char *c = start; c < end; c++) {
+    if (*c != '\\' || c + 1 >= end) {
+      g_string_append_c (field, *c);
+      continue;
+    }
+
+    c++;
+    switch (*c) {
+      case 't':
+        g_string_append_c (field, '\t');
+        break;
+      case 'n':
+        g_string_append_c (field, '\n');
+        break;
+      case 'r':
+        g_string_append_c (field, '\r');
+        break;
+      default:
+        g_string_append_c (field, *c);
+        break;
+    }
+  }
+
+  return g_string_free (field, FALSE);
+}
+
+
+/*
+ * started, duration, exit status, host, cwd, command
+ */
+static void
+parse_line (Index *index, const char *line, const char *end)
+{
+  const char *fields[N_FIELDS];
+  g_autofree char *host = NULL;
+  g_autofree char *cwd = NULL;
+  g_autofree char *command = NULL;
+  const char *c = line;
+  int n = 0;
+
+  fields[n++] = line;
+  while (n < N_FIELDS && (c = memchr (c, FIELD_SEP, end - c))) {
+    c++;
+    fields[n++] = c;
+  }
+
+  if (n != N_FIELDS) {
+    /* Half written, or from somewhere else entirely */
+    return;
+  }
+
+  command = parse_field (fields[5], end);
+  if (!command[0] || !g_utf8_validate (command, -1, NULL)) {
+    return;
+  }
+
+  host = parse_field (fields[3], fields[4] - 1);
+  cwd = parse_field (fields[4], fields[5] - 1);
+
+  index_add (index,
+             command,
+             cwd,
+             host,
+             g_ascii_strtoll (fields[0], NULL, 10),
+             g_ascii_strtoll (fields[1], NULL, 10) * 1000,
+             (int) g_ascii_strtoll (fields[2], NULL, 10));
+}
+
+
+/*
+ * The last @limit bytes or so of @log, from the start of a line
+ */
+static char *
+read_tail (GFile   *log,
+           goffset  limit,
+           gsize   *length,
+           GError **error)
+{
+  g_autoptr (GFileInputStream) stream = NULL;
+  g_autoptr (GFileInfo) info = NULL;
+  g_autofree char *contents = NULL;
+  goffset size, skip;
+  gsize got = 0;
+
+  stream = g_file_read (log, NULL, error);
+  if (!stream) {
+    return NULL;
+  }
+
+  info = g_file_input_stream_query_info (stream,
+                                         G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                         NULL,
+                                         error);
+  if (!info) {
+    return NULL;
+  }
+
+  size = g_file_info_get_size (info);
+  skip = MAX (size - limit, 0);
+
+  if (skip > 0 &&
+      !g_seekable_seek (G_SEEKABLE (stream), skip, G_SEEK_SET, NULL, error)) {
+    return NULL;
+  }
+
+  contents = g_malloc (size - skip + 1);
+  if (!g_input_stream_read_all (G_INPUT_STREAM (stream),
+                                contents,
+                                size - skip,
+                                &got,
+                                NULL,
+                                error)) {
+    return NULL;
+  }
+  contents[got] = '\0';
+
+  /* We landed part way through a line, so begin with the next */
+  if (skip > 0) {
+    const char *newline = memchr (contents, '\n', got);
+    gsize cut = newline ? newline - contents + 1 : got;
+
+    memmove (contents, contents + cut, got - cut + 1);
+    got -= cut;
+  }
+
+  *length = got;
+
+  return g_steal_pointer (&contents);
+}
+
+
+/*
+ * Every instance shares the log, so moving it aside has to wait for
+ * anybody part way through appending to it
+ *
+ * Returns: the locked descriptor, close it to unlock, or -1
+ */
+static int
+lock_log (GFile *directory, GError **error)
+{
+  g_autofree char *path = g_build_filename (g_file_peek_path (directory),
+                                            LOCK_NAME,
+                                            NULL);
+  int fd;
+
+  fd = g_open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    int saved = errno;
+
+    g_set_error (error,
+                 G_IO_ERROR, g_io_error_from_errno (saved),
+                 "Couldn't open %s: %s", path, g_strerror (saved));
+    return -1;
+  }
+
+  while (flock (fd, LOCK_EX) < 0) {
+    int saved = errno;
+
+    if (saved == EINTR) {
+      continue;
+    }
+
+    g_set_error (error,
+                 G_IO_ERROR, g_io_error_from_errno (saved),
+                 "Couldn't lock %s: %s", path, g_strerror (saved));
+    g_close (fd, NULL);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+static void
+load_log (Index *index, GFile *directory, const char *name)
+{
+  g_autoptr (GFile) log = g_file_get_child (directory, name);
+  g_autoptr (GError) error = NULL;
+  g_autofree char *contents = NULL;
+  gsize length = 0;
+  const char *line, *end;
+
+  /* Normally it's been kept short, but it could be from elsewhere */
+  contents = read_tail (log, LOG_LIMIT, &length, &error);
+  if (!contents && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+    g_warning ("history: couldn't load %s: %s", name, error->message);
+  }
+
+  line = contents;
+  end = contents + length;
+  while (line && line < end) {
+    const char *newline = memchr (line, '\n', end - line);
+
+    if (!newline) {
+      /* Cut short, probably mid-write when we last stopped */
+      break;
+    }
+
+    parse_line (index, line, newline);
+    line = newline + 1;
+  }
+}
+
+
+static void end_work (KgxHistory *self);
+
+
+static void
+load_thread (GTask        *task,
+             gpointer      source,
+             gpointer      data,
+             GCancellable *cancellable)
+{
+  GFile *directory = G_FILE (data);
+  g_autoptr (GError) error = NULL;
+  Index *index = index_new ();
+  int lock;
+
+  /* Without it we could read the old log just as the current one joins
+   * it, but there's still something to be had */
+  lock = lock_log (directory, &error);
+  if (lock < 0 && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+    g_warning ("history: %s", error->message);
+  }
+
+  load_log (index, directory, OLD_LOG_NAME);
+  load_log (index, directory, LOG_NAME);
+
+  if (lock >= 0) {
+    g_close (lock, NULL);
+  }
+
+  if (index->entries->len > INDEX_LIMIT) {
+    index = index_compact (index);
+  }
+
+  end_work (source);
+
+  g_task_return_pointer (task, index, index_free);
+}
+
+
+static void
+job_free (gpointer data)
+{
+  Job *job = data;
+
+  g_clear_object (&job->directory);
+  g_clear_pointer (&job->lines, g_bytes_unref);
+
+  g_free (job);
+}
+
+
+/*
+ * Keep the log short enough that loading it stays quick, however long
+ * the history gets. Moving it aside, rather than rewriting it, means an
+ * append that already has it open still lands somewhere we'll read
+ */
+static gboolean
+rotate_log (GFile *directory, GError **error)
+{
+  g_autoptr (GFile) log = g_file_get_child (directory, LOG_NAME);
+  g_autoptr (GFile) old = NULL;
+  g_autoptr (GFileInfo) info = NULL;
+
+  info = g_file_query_info (log,
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL,
+                            error);
+  if (!info) {
+    return FALSE;
+  }
+
+  if (g_file_info_get_size (info) <= LOG_LIMIT) {
+    return TRUE;
+  }
+
+  g_debug ("history: starting a new log");
+
+  old = g_file_get_child (directory, OLD_LOG_NAME);
+
+  return g_file_move (log,
+                      old,
+                      G_FILE_COPY_OVERWRITE | G_FILE_COPY_NO_FALLBACK_FOR_MOVE,
+                      NULL,
+                      NULL,
+                      NULL,
+                      error);
+}
+
+
+static gboolean
+write_lines (Job *job, GError **error)
+{
+  g_autoptr (GFile) log = g_file_get_child (job->directory, LOG_NAME);
+  g_autoptr (GFileOutputStream) stream = NULL;
+  g_autoptr (GError) local_error = NULL;
+  gconstpointer lines;
+  gsize len;
+  gboolean success;
+  int lock;
+
+  if (!g_file_make_directory_with_parents (job->directory, NULL, &local_error) &&
+      !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+    g_propagate_error (error, g_steal_pointer (&local_error));
+    return FALSE;
+  }
+
+  lock = lock_log (job->directory, error);
+  if (lock < 0) {
+    return FALSE;
+  }
+
+  lines = g_bytes_get_data (job->lines, &len);
+
+  stream = g_file_append_to (log, G_FILE_CREATE_PRIVATE, NULL, error);
+  success = stream &&
+            g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                       lines,
+                                       len,
+                                       NULL,
+                                       NULL,
+                                       error) &&
+            g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error) &&
+            rotate_log (job->directory, error);
+
+  g_close (lock, NULL);
+
+  return success;
+}
+
+
+static void
+write_thread (GTask        *task,
+              gpointer      source,
+              gpointer      data,
+              GCancellable *cancellable)
+{
+  g_autoptr (GError) error = NULL;
+  gboolean success = write_lines (data, &error);
+
+  end_work (source);
+
+  if (!success) {
+    g_task_return_error (task, g_steal_pointer (&error));
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+/**
+ * KgxHistory:
+ * @settings: whether we should be keeping a history at all
+ * @directory: where the log lives
+ * @index: (nullable): the history so far, %NULL until loaded
+ * @early: (element-type KgxHistoryItem): commands recorded before @index
+ *         was ready
+ * @pending: log lines waiting to be written
+ * @writing: a write is in progress
+ * @stopped: we're shutting down, anything more is written there and then
+ * @work_lock: guards @working
+ * @work_done: signalled as @working drops
+ * @working: the load and writes still running on workers
+ *
+ * Stability: Private
+ */
+struct _KgxHistory {
+  GObject       parent_instance;
+
+  KgxSettings  *settings;
+  GFile        *directory;
+
+  Index        *index;
+  GPtrArray    *early;
+
+  GString      *pending;
+  gboolean      writing;
+  gboolean      stopped;
+  guint         flush_timeout;
+
+  GMutex        work_lock;
+  GCond         work_done;
+  guint         working;
+};
+
+
+G_DEFINE_TYPE (KgxHistory, kgx_history, G_TYPE_OBJECT)
+
+
+static void
+kgx_history_dispose (GObject *object)
+{
+  KgxHistory *self = KGX_HISTORY (object);
+
+  g_clear_handle_id (&self->flush_timeout, g_source_remove);
+
+  g_clear_object (&self->settings);
+  g_clear_object (&self->directory);
+
+  G_OBJECT_CLASS (kgx_history_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_history_finalize (GObject *object)
+{
+  KgxHistory *self = KGX_HISTORY (object);
+
+  g_clear_pointer (&self->index, index_free);
+  g_clear_pointer (&self->early, g_ptr_array_unref);
+  g_string_free (self->pending, TRUE);
+
+  g_mutex_clear (&self->work_lock);
+  g_cond_clear (&self->work_done);
+
+  G_OBJECT_CLASS (kgx_history_parent_class)->finalize (object);
+}
+
+
+static void
+kgx_history_class_init (KgxHistoryClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = kgx_history_dispose;
+  object_class->finalize = kgx_history_finalize;
+}
+
+
+static void
+kgx_history_init (KgxHistory *self)
+{
+  g_autofree char *directory = g_build_filename (g_get_user_data_dir (),
+                                                KGX_BIN_NAME,
+                                                NULL);
+
+  self->directory = g_file_new_for_path (directory);
+  self->early = g_ptr_array_new_with_free_func ((GDestroyNotify) kgx_history_item_free);
+  self->pending = g_string_new (NULL);
+
+  g_mutex_init (&self->work_lock);
+  g_cond_init (&self->work_done);
+}
+
+
+static void
+begin_work (KgxHistory *self)
+{
+  g_mutex_lock (&self->work_lock);
+  self->working++;
+  g_mutex_unlock (&self->work_lock);
+}
+
+
+/*
+ * Called on the worker, once it's done with the log
+ */
+static void
+end_work (KgxHistory *self)
+{
+  g_mutex_lock (&self->work_lock);
+  self->working--;
+  g_cond_broadcast (&self->work_done);
+  g_mutex_unlock (&self->work_lock);
+}
+
+
+static void schedule_flush (KgxHistory *self);
+
+
+static void
+loaded (GObject      *source,
+        GAsyncResult *res,
+        gpointer      user_data)
+{
+  KgxHistory *self = KGX_HISTORY (source);
+
+  self->index = g_task_propagate_pointer (G_TASK (res), NULL);
+
+  g_debug ("history: loaded %u runs of %u commands",
+           self->index->entries->len,
+           self->index->commands->len);
+
+  for (guint i = 0; i < self->early->len; i++) {
+    KgxHistoryItem *item = g_ptr_array_index (self->early, i);
+
+    index_add (self->index,
+               item->command,
+               item->cwd,
+               item->host,
+               item->started,
+               item->duration,
+               item->exit_status);
+  }
+  g_ptr_array_set_size (self->early, 0);
+
+  if (self->pending->len > 0) {
+    schedule_flush (self);
+  }
+}
+
+
+/**
+ * kgx_history_new:
+ * @settings: the #KgxSettings to follow
+ *
+ * The existing history is read in the background, searches come up empty
+ * until it's done
+ *
+ * Returns: (transfer full): a new #KgxHistory
+ */
+KgxHistory *
+kgx_history_new (KgxSettings *settings)
+{
+  KgxHistory *self = g_object_new (KGX_TYPE_HISTORY, NULL);
+  g_autoptr (GTask) task = NULL;
+
+  self->settings = g_object_ref (settings);
+
+  task = g_task_new (self, NULL, loaded, NULL);
+  g_task_set_source_tag (task, kgx_history_new);
+  g_task_set_task_data (task, g_object_ref (self->directory), g_object_unref);
+  begin_work (self);
+  g_task_run_in_thread (task, load_thread);
+
+  return self;
+}
+
+
+static void flush (KgxHistory *self);
+
+
+static void
+written (GObject      *source,
+         GAsyncResult *res,
+         gpointer      user_data)
+{
+  g_autoptr (GError) error = NULL;
+  KgxHistory *self = KGX_HISTORY (source);
+
+  self->writing = FALSE;
+
+  if (!g_task_propagate_boolean (G_TASK (res), &error)) {
+    g_warning ("history: couldn't save: %s", error->message);
+  }
+
+  if (self->pending->len > 0) {
+    schedule_flush (self);
+  }
+}
+
+
+static Job *
+take_job (KgxHistory *self)
+{
+  Job *job;
+
+  if (self->pending->len == 0) {
+    return NULL;
+  }
+
+  job = g_new0 (Job, 1);
+  job->directory = g_object_ref (self->directory);
+  job->lines = g_bytes_new (self->pending->str, self->pending->len);
+
+  g_string_truncate (self->pending, 0);
+
+  return job;
+}
+
+
+static void
+flush (KgxHistory *self)
+{
+  g_autoptr (GTask) task = NULL;
+  Job *job;
+
+  /* Until it's loaded we'd be racing the read */
+  if (!self->index || self->writing) {
+    return;
+  }
+
+  job = take_job (self);
+  if (!job) {
+    return;
+  }
+
+  self->writing = TRUE;
+
+  task = g_task_new (self, NULL, written, NULL);
+  g_task_set_source_tag (task, flush);
+  g_task_set_task_data (task, job, job_free);
+  begin_work (self);
+  g_task_run_in_thread (task, write_thread);
+}
+
+
+static void
+flush_timeout (gpointer data)
+{
+  KgxHistory *self = data;
+
+  self->flush_timeout = 0;
+
+  flush (self);
+}
+
+
+static void
+schedule_flush (KgxHistory *self)
+{
+  if (self->flush_timeout || self->stopped) {
+    return;
+  }
+
+  self->flush_timeout = g_timeout_add_once (FLUSH_DELAY, flush_timeout, self);
+  g_source_set_name_by_id (self->flush_timeout, "[kgx] history flush");
+}
+
+
+/**
+ * kgx_history_record:
+ * @self: the #KgxHistory
+ * @command: the command line
+ * @cwd: (nullable): the directory it ran in
+ * @host: (nullable): the machine it ran on
+ * @started: the wall clock time it started, in microseconds
+ * @duration: how long it took, in microseconds
+ * @exit_status: how it went, or -1
+ *
+ * Add a finished command to the history, it's written out shortly after
+ */
+void
+kgx_history_record (KgxHistory *self,
+                    const char *command,
+                    const char *cwd,
+                    const char *host,
+                    gint64      started,
+                    gint64      duration,
+                    int         exit_status)
+{
+  g_return_if_fail (KGX_IS_HISTORY (self));
+
+  if (!command || !command[0] || !g_utf8_validate (command, -1, NULL)) {
+    return;
+  }
+
+  /* As with a shell's ignorespace, that's a way to keep it out */
+  if (command[0] == ' ') {
+    return;
+  }
+
+  if (!kgx_settings_get_command_history (self->settings)) {
+    return;
+  }
+
+  g_string_append_printf (self->pending,
+                          "%" G_GINT64_FORMAT "%c%" G_GINT64_FORMAT "%c%i%c",
+                          started,
+                          FIELD_SEP,
+                          duration / 1000,
+                          FIELD_SEP,
+                          exit_status,
+                          FIELD_SEP);
+  append_field (self->pending, host);
+  g_string_append_c (self->pending, FIELD_SEP);
+  append_field (self->pending, cwd);
+  g_string_append_c (self->pending, FIELD_SEP);
+  append_field (self->pending, command);
+  g_string_append_c (self->pending, '\n');
+
+  if (self->index) {
+    index_add (self->index, command, cwd, host, started, duration, exit_status);
+
+    /* Seldom, only once a session has run a great many commands */
+    if (G_UNLIKELY (self->index->entries->len > INDEX_LIMIT)) {
+      self->index = index_compact (self->index);
+    }
+  } else {
+    KgxHistoryItem *item = g_new0 (KgxHistoryItem, 1);
+
+    item->command = g_strdup (command);
+    item->cwd = g_strdup (cwd);
+    item->host = g_strdup (host);
+    item->started = started;
+    item->duration = duration;
+    item->exit_status = exit_status;
+
+    g_ptr_array_add (self->early, item);
+  }
+
+  schedule_flush (self);
+}
+
+
+static KgxHistoryItem *
+build_item (Index *index, guint32 id)
+{
+  Command *command = &g_array_index (index->commands, Command, id);
+  Entry *entry = &g_array_index (index->entries, Entry, command->last);
+  Place *place = &g_array_index (index->places, Place, entry->place);
+  KgxHistoryItem *item = g_new0 (KgxHistoryItem, 1);
+
+  item->command = g_strdup (command->text);
+  item->cwd = g_strdup (place->cwd);
+  item->host = g_strdup (place->host);
+  item->started = entry->started;
+  item->duration = (gint64) entry->duration * 1000;
+  item->exit_status = entry->exit_status;
+  item->uses = command->uses;
+
+  return item;
+}
+
+
+/*
+ * Which command the lower cased text at @offset belongs to
+ */
+static guint32
+command_at (Index *index, gsize offset)
+{
+  guint lo = 0;
+  guint hi = index->commands->len;
+
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (index->commands, Command, mid).folded <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+
+static int
+most_recent_first (gconstpointer a, gconstpointer b, gpointer data)
+{
+  Index *index = data;
+  guint last_a = g_array_index (index->commands, Command, *(guint32 *) a).last;
+  guint last_b = g_array_index (index->commands, Command, *(guint32 *) b).last;
+
+  return (last_a < last_b) - (last_a > last_b);
+}
+
+
+/**
+ * kgx_history_search:
+ * @self: the #KgxHistory
+ * @query: text to look for in the command, ignoring (ASCII) case
+ * @limit: the most results wanted
+ *
+ * An empty @query gives the most recent commands
+ *
+ * Returns: (transfer full) (element-type KgxHistoryItem): matching
+ *          commands, each once, most recently run first
+ */
+GPtrArray *
+kgx_history_search (KgxHistory *self,
+                    const char *query,
+                    guint       limit)
+{
+  g_autoptr (GPtrArray) results = NULL;
+  g_autoptr (GArray) matches = NULL;
+  g_autofree char *needle = NULL;
+  Index *index;
+  const char *haystack, *hit;
+
+  g_return_val_if_fail (KGX_IS_HISTORY (self), NULL);
+
+  results = g_ptr_array_new_with_free_func ((GDestroyNotify) kgx_history_item_free);
+  index = self->index;
+
+  if (!index || index->commands->len == 0) {
+    return g_steal_pointer (&results);
+  }
+
+  needle = g_ascii_strdown (query ? query : "", -1);
+  g_strdelimit (g_strstrip (needle), "\n", ' ');
+
+  if (!needle[0]) {
+    /* Newest first, skipping repeats */
+    for (guint i = index->entries->len; i > 0 && results->len < limit; i--) {
+      Entry *entry = &g_array_index (index->entries, Entry, i - 1);
+      Command *command = &g_array_index (index->commands, Command, entry->command);
+
+      if (command->last == i - 1) {
+        g_ptr_array_add (results, build_item (index, entry->command));
+      }
+    }
+
+    return g_steal_pointer (&results);
+  }
+
+  matches = g_array_new (FALSE, FALSE, sizeof (guint32));
+  haystack = index->folded->str;
+
+  hit = strstr (haystack, needle);
+  while (hit) {
+    guint32 id = command_at (index, hit - haystack);
+
+    g_array_append_val (matches, id);
+
+    /* On to the next command, one hit each is plenty */
+    if (id + 1 >= index->commands->len) {
+      break;
+    }
+    hit = strstr (haystack + g_array_index (index->commands, Command, id + 1).folded,
+                  needle);
+  }
+
+  g_array_sort_with_data (matches, most_recent_first, index);
+
+  for (guint i = 0; i < matches->len && i < limit; i++) {
+    g_ptr_array_add (results,
+                     build_item (index, g_array_index (matches, guint32, i)));
+  }
+
+  return g_steal_pointer (&results);
+}
+
+
+/**
+ * kgx_history_stop:
+ * @self: the #KgxHistory
+ *
+ * Write out anything pending now, as we're about to exit
+ */
+void
+kgx_history_stop (KgxHistory *self)
+{
+  g_autoptr (GTask) task = NULL;
+  Job *job;
+
+  g_return_if_fail (KGX_IS_HISTORY (self));
+
+  if (self->stopped) {
+    return;
+  }
+
+  g_clear_handle_id (&self->flush_timeout, g_source_remove);
+
+  self->stopped = TRUE;
+
+  /* Let the load and whatever is in flight finish with the log first.
+   * Only the workers need to be done, not their callbacks, so there's no
+   * need to turn the main loop (and run who knows what) to get there */
+  g_mutex_lock (&self->work_lock);
+  while (self->working > 0) {
+    g_cond_wait (&self->work_done, &self->work_lock);
+  }
+  g_mutex_unlock (&self->work_lock);
+
+  job = take_job (self);
+  if (!job) {
+    return;
+  }
+
+  task = g_task_new (self, NULL, NULL, NULL);
+  g_task_set_source_tag (task, kgx_history_stop);
+  g_task_set_task_data (task, job, job_free);
+  begin_work (self);
+  g_task_run_in_thread_sync (task, write_thread);
+}
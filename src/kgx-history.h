@@ -0,0 +1,73 @@
+/* kgx-history.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "kgx-settings.h"
+
+G_BEGIN_DECLS
+
+/**
+ * KgxHistoryItem:
+ * @command: the command line
+ * @cwd: (nullable): where it was last run
+ * @host: (nullable): the machine it was last run on
+ * @started: the wall clock time it was last run, in microseconds
+ * @duration: how long it took, in microseconds
+ * @exit_status: how it went, or -1 if we don't know
+ * @uses: how many times it's been run
+ *
+ * A command from the history, as it was most recently run
+ */
+typedef struct _KgxHistoryItem KgxHistoryItem;
+struct _KgxHistoryItem {
+  char     *command;
+  char     *cwd;
+  char     *host;
+  gint64    started;
+  gint64    duration;
+  int       exit_status;
+  guint     uses;
+};
+
+
+void kgx_history_item_free (KgxHistoryItem *item);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (KgxHistoryItem, kgx_history_item_free)
+
+
+#define KGX_TYPE_HISTORY kgx_history_get_type ()
+G_DECLARE_FINAL_TYPE (KgxHistory, kgx_history, KGX, HISTORY, GObject)
+
+
+KgxHistory           *kgx_history_new                      (KgxSettings         *settings);
+void                  kgx_history_record                   (KgxHistory          *self,
+                                                            const char          *command,
+                                                            const char          *cwd,
+                                                            const char          *host,
+                                                            gint64               started,
+                                                            gint64               duration,
+                                                            int                  exit_status);
+GPtrArray            *kgx_history_search                   (KgxHistory          *self,
+                                                            const char          *query,
+                                                            guint                limit);
+void                  kgx_history_stop                     (KgxHistory          *self);
+
+G_END_DECLS
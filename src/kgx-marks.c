@@ -0,0 +1,213 @@
+/* kgx-marks.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include <string.h>
+
+#include "kgx-marks.h"
+
+#define MARK_PREFIX "133;"
+#define MARK_PREFIX_LEN (sizeof (MARK_PREFIX) - 1)
+/* Anything longer isn't a mark we understand, and we don't want to buffer
+ * somebody's OSC 52 clipboard */
+#define MAX_PAYLOAD 8192
+
+#define BEL 0x07
+#define ESC 0x1b
+#define CAN 0x18
+#define SUB 0x1a
+
+
+enum {
+  GROUND,
+  ESCAPE,
+  OSC,
+  OSC_ESCAPE,
+  OSC_IGNORE,
+  OSC_IGNORE_ESCAPE,
+};
+
+
+void
+kgx_mark_scanner_init (KgxMarkScanner *self)
+{
+  self->state = GROUND;
+  self->payload = g_string_sized_new (64);
+}
+
+
+void
+kgx_mark_scanner_clear (KgxMarkScanner *self)
+{
+  if (self->payload) {
+    g_string_free (self->payload, TRUE);
+    self->payload = NULL;
+  }
+}
+
+
+static void
+dispatch (KgxMarkScanner *self,
+          gsize           end,
+          KgxMarkFunc     func,
+          gpointer        user_data)
+{
+  g_auto (GStrv) params = NULL;
+  g_autofree char *command = NULL;
+  const char *body = self->payload->str + MARK_PREFIX_LEN;
+  int exit_status = -1;
+  KgxMarkKind kind;
+
+  if (self->payload->len <= MARK_PREFIX_LEN) {
+    return;
+  }
+
+  switch (body[0]) {
+    case 'A':
+      kind = KGX_MARK_PROMPT;
+      break;
+    case 'B':
+      kind = KGX_MARK_INPUT;
+      break;
+    case 'C':
+      kind = KGX_MARK_EXECUTED;
+      break;
+    case 'D':
+      kind = KGX_MARK_FINISHED;
+      break;
+    default:
+      return;
+  }
+
+  if (body[1] == ';') {
+    params = g_strsplit (body + 2, ";", -1);
+  } else if (body[1] != '\0') {
+    return;
+  }
+
+  for (size_t i = 0; params && params[i]; i++) {
+    const char *param = params[i];
+
+    if (kind == KGX_MARK_FINISHED && i == 0) {
+      gint64 status;
+
+      if (g_ascii_string_to_signed (param, 10, 0, 255, &status, NULL)) {
+        exit_status = status;
+      }
+    } else if (kind == KGX_MARK_EXECUTED &&
+               g_str_has_prefix (param, "cmdline_url=")) {
+      g_free (command);
+      command = g_uri_unescape_string (param + strlen ("cmdline_url="), NULL);
+    } else if (kind == KGX_MARK_EXECUTED &&
+               g_str_has_prefix (param, "cmdline=")) {
+      g_free (command);
+      command = g_strdup (param + strlen ("cmdline="));
+    }
+  }
+
+  if (command && !g_utf8_validate (command, -1, NULL)) {
+    g_clear_pointer (&command, g_free);
+  }
+
+  func (kind, exit_status, command, end, user_data);
+}
+
+
+/**
+ * kgx_mark_scanner_feed:
+ * @self: the #KgxMarkScanner
+ * @data: the next piece of output
+ * @len: the length of @data
+ * @func: called for each mark
+ * @user_data: passed to @func
+ *
+ * Look through @data for marks, anything else passes by untouched. Almost
+ * all output is plain text, which costs a memchr() to skip
+ */
+void
+kgx_mark_scanner_feed (KgxMarkScanner *self,
+                       const guint8   *data,
+                       gsize           len,
+                       KgxMarkFunc     func,
+                       gpointer        user_data)
+{
+  gsize i = 0;
+
+  while (i < len) {
+    const guint8 *next;
+    guint8 c;
+
+    switch (self->state) {
+      case GROUND:
+        next = memchr (data + i, ESC, len - i);
+        if (G_LIKELY (!next)) {
+          return;
+        }
+        i = next - data + 1;
+        self->state = ESCAPE;
+        break;
+      case ESCAPE:
+        c = data[i++];
+        if (c == ']') {
+          g_string_truncate (self->payload, 0);
+          self->state = OSC;
+        } else if (c != ESC) {
+          self->state = GROUND;
+        }
+        break;
+      case OSC:
+      case OSC_IGNORE:
+        c = data[i++];
+        if (c == BEL) {
+          if (self->state == OSC) {
+            dispatch (self, i, func, user_data);
+          }
+          self->state = GROUND;
+        } else if (c == ESC) {
+          self->state = self->state == OSC ? OSC_ESCAPE : OSC_IGNORE_ESCAPE;
+        } else if (c == CAN || c == SUB) {
+          self->state = GROUND;
+        } else if (self->state == OSC) {
+          g_string_append_c (self->payload, c);
+
+          if ((self->payload->len <= MARK_PREFIX_LEN &&
+               memcmp (self->payload->str, MARK_PREFIX, self->payload->len) != 0) ||
+              self->payload->len > MAX_PAYLOAD) {
+            self->state = OSC_IGNORE;
+          }
+        }
+        break;
+      case OSC_ESCAPE:
+      case OSC_IGNORE_ESCAPE:
+        if (data[i] == '\\') {
+          i++;
+          if (self->state == OSC_ESCAPE) {
+            dispatch (self, i, func, user_data);
+          }
+          self->state = GROUND;
+        } else {
+          /* Not a terminator, so the OSC was cut short by a new sequence */
+          self->state = ESCAPE;
+        }
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+  }
+}
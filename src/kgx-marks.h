@@ -0,0 +1,90 @@
+/* kgx-marks.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * KgxMarkKind:
+ * @KGX_MARK_PROMPT: The shell is about to draw a prompt (OSC 133;A)
+ * @KGX_MARK_INPUT: The prompt is done, what follows is typed by the
+ *                  user (OSC 133;B)
+ * @KGX_MARK_EXECUTED: The user hit enter, what follows is the command's
+ *                     output (OSC 133;C)
+ * @KGX_MARK_FINISHED: The command is done (OSC 133;D)
+ *
+ * The semantic prompt marks shells with integration send
+ *
+ * Stability: Private
+ */
+typedef enum /*< enum,prefix=KGX >*/ {
+  KGX_MARK_PROMPT = 0,   /*< nick=prompt >*/
+  KGX_MARK_INPUT = 1,    /*< nick=input >*/
+  KGX_MARK_EXECUTED = 2, /*< nick=executed >*/
+  KGX_MARK_FINISHED = 3, /*< nick=finished >*/
+} KgxMarkKind;
+
+
+/**
+ * KgxMarkFunc:
+ * @kind: which mark was found
+ * @exit_status: for %KGX_MARK_FINISHED, how it went, otherwise (or if the
+ *               shell didn't say) -1
+ * @command: (nullable): for %KGX_MARK_EXECUTED, the command line if the
+ *           shell sent one
+ * @end: offset just past the mark in the data passed to
+ *       kgx_mark_scanner_feed()
+ * @user_data: the closure
+ *
+ * Called for each mark in the order they appear
+ */
+typedef void (*KgxMarkFunc) (KgxMarkKind  kind,
+                             int          exit_status,
+                             const char  *command,
+                             gsize        end,
+                             gpointer     user_data);
+
+
+/**
+ * KgxMarkScanner:
+ * @state: where we are in an escape sequence, which may span reads
+ * @payload: the body of the OSC so far
+ *
+ * Picks OSC 133 marks out of a stream of terminal output
+ *
+ * Stability: Private
+ */
+typedef struct _KgxMarkScanner KgxMarkScanner;
+struct _KgxMarkScanner {
+  int       state;
+  GString  *payload;
+};
+
+
+void        kgx_mark_scanner_init  (KgxMarkScanner  *self);
+void        kgx_mark_scanner_clear (KgxMarkScanner  *self);
+void        kgx_mark_scanner_feed  (KgxMarkScanner  *self,
+                                    const guint8    *data,
+                                    gsize            len,
+                                    KgxMarkFunc      func,
+                                    gpointer         user_data);
+
+G_END_DECLS
@@ -0,0 +1,414 @@
+/* kgx-monitor.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include <glib/gi18n.h>
+
+#include "kgx-application.h"
+#include "kgx-monitor.h"
+
+/* Each slot of the wheel is a second */
+#define WHEEL_SLOTS 64
+/* How often, per silence interval, we look at a busy tab */
+#define CHECKS_PER_INTERVAL 4
+
+
+/**
+ * Watch:
+ * @tab: (not owned): the tab being watched, it unwatches itself when
+ *       it goes away
+ * @flags: what we're watching @tab for
+ * @activity: the #KgxTab activity as of our last look
+ * @last_output: the tick we last saw @activity move on
+ * @due: the tick we next look at @tab
+ * @quiet: we've decided @tab has gone quiet
+ * @alerted: we've already said there was activity in @tab
+ * @link: our place in the wheel, %NULL data when parked
+ *
+ * Stability: Private
+ */
+typedef struct {
+  KgxTab          *tab;
+  KgxMonitorFlags  flags;
+  guint            activity;
+  guint64          last_output;
+  guint64          due;
+  gboolean         quiet;
+  gboolean         alerted;
+  GList            link;
+} Watch;
+
+
+/**
+ * KgxMonitor:
+ * @application: who we send notifications through
+ * @settings: where the silence interval comes from
+ * @watches: (element-type KgxTab Watch) everything we're watching
+ * @wheel: a queue of #Watch per slot, keyed by due tick modulo the size
+ * @now: the current tick
+ * @tick_source: the wheel's one timer, only running when there's
+ *               something to watch
+ *
+ * Keeps an eye on #KgxTab output for tmux style activity and silence
+ * monitoring
+ *
+ * Output itself doesn't involve us at all, a tab's activity counter is
+ * just bumped as the child writes, even whilst hibernated. Instead each
+ * tab is looked at when it falls due on a timer wheel, so a tab that's
+ * chattering away costs an integer comparison every few seconds, and
+ * hundreds share one timer
+ */
+struct _KgxMonitor {
+  GObject         parent_instance;
+
+  KgxApplication *application;
+  KgxSettings    *settings;
+
+  GHashTable     *watches;
+  GQueue          wheel[WHEEL_SLOTS];
+  guint64         now;
+  guint           tick_source;
+};
+
+
+G_DEFINE_TYPE (KgxMonitor, kgx_monitor, G_TYPE_OBJECT)
+
+
+static void
+kgx_monitor_dispose (GObject *object)
+{
+  KgxMonitor *self = KGX_MONITOR (object);
+
+  g_clear_handle_id (&self->tick_source, g_source_remove);
+
+  for (int i = 0; i < WHEEL_SLOTS; i++) {
+    g_queue_init (&self->wheel[i]);
+  }
+  g_clear_pointer (&self->watches, g_hash_table_unref);
+
+  g_clear_object (&self->settings);
+  g_clear_weak_pointer (&self->application);
+
+  G_OBJECT_CLASS (kgx_monitor_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_monitor_class_init (KgxMonitorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = kgx_monitor_dispose;
+}
+
+
+static void
+kgx_monitor_init (KgxMonitor *self)
+{
+  self->watches = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         g_free);
+
+  for (int i = 0; i < WHEEL_SLOTS; i++) {
+    g_queue_init (&self->wheel[i]);
+  }
+}
+
+
+KgxMonitor *
+kgx_monitor_new (KgxApplication *application,
+                 KgxSettings    *settings)
+{
+  KgxMonitor *self = g_object_new (KGX_TYPE_MONITOR, NULL);
+
+  g_set_weak_pointer (&self->application, application);
+  self->settings = g_object_ref (settings);
+
+  return self;
+}
+
+
+static inline void
+park (KgxMonitor *self, Watch *watch)
+{
+  if (!watch->link.data) {
+    return;
+  }
+
+  g_queue_unlink (&self->wheel[watch->due % WHEEL_SLOTS], &watch->link);
+  watch->link.data = NULL;
+}
+
+
+static void
+schedule (KgxMonitor *self, Watch *watch)
+{
+  guint64 interval, step;
+
+  park (self, watch);
+
+  interval = kgx_settings_get_monitor_silence_interval (self->settings);
+  step = MAX (interval / CHECKS_PER_INTERVAL, 1);
+
+  if (watch->quiet || ((watch->flags & KGX_MONITOR_ACTIVITY) && !watch->alerted)) {
+    /* Waiting for output, which we want to hear about promptly */
+    watch->due = self->now + 1;
+  } else if (watch->flags & KGX_MONITOR_SILENCE) {
+    watch->due = MIN (self->now + step, watch->last_output + interval);
+    watch->due = MAX (watch->due, self->now + 1);
+  } else {
+    /* Already said there's activity, nothing more until it's seen */
+    return;
+  }
+
+  watch->link.data = watch;
+  g_queue_push_tail_link (&self->wheel[watch->due % WHEEL_SLOTS], &watch->link);
+}
+
+
+static void
+alert (KgxMonitor *self,
+       const char *id,
+       GPtrArray  *tabs,
+       const char *title)
+{
+  KgxTab *last = g_ptr_array_index (tabs, tabs->len - 1);
+  g_autofree char *body = NULL;
+
+  for (guint i = 0; i < tabs->len; i++) {
+    g_object_set (g_ptr_array_index (tabs, i), "needs-attention", TRUE, NULL);
+  }
+
+  if (G_UNLIKELY (!self->application)) {
+    return;
+  }
+
+  g_object_get (last, "tab-title", &body, NULL);
+
+  kgx_application_send_notification (self->application,
+                                     id,
+                                     kgx_tab_get_id (last),
+                                     title,
+                                     body);
+}
+
+
+static void
+check (KgxMonitor *self,
+       Watch      *watch,
+       GPtrArray  *active,
+       GPtrArray  *quiet)
+{
+  guint activity = kgx_tab_get_activity (watch->tab);
+  gboolean seen = kgx_tab_is_active (watch->tab);
+  guint64 interval;
+
+  if (activity != watch->activity) {
+    watch->activity = activity;
+    watch->last_output = self->now;
+
+    if (watch->quiet) {
+      watch->quiet = FALSE;
+      if (!seen) {
+        g_ptr_array_add (active, watch->tab);
+      }
+    } else if ((watch->flags & KGX_MONITOR_ACTIVITY) && !watch->alerted && !seen) {
+      watch->alerted = TRUE;
+      g_ptr_array_add (active, watch->tab);
+    }
+  } else if ((watch->flags & KGX_MONITOR_SILENCE) && !watch->quiet) {
+    interval = kgx_settings_get_monitor_silence_interval (self->settings);
+
+    if (self->now - watch->last_output >= interval) {
+      watch->quiet = TRUE;
+      if (!seen) {
+        g_ptr_array_add (quiet, watch->tab);
+      }
+    }
+  }
+
+  schedule (self, watch);
+}
+
+
+static gboolean
+tick (gpointer data)
+{
+  KgxMonitor *self = KGX_MONITOR (data);
+  g_autoptr (GPtrArray) active = g_ptr_array_new ();
+  g_autoptr (GPtrArray) quiet = g_ptr_array_new ();
+  g_autofree char *title = NULL;
+  GQueue *slot;
+  GList *link;
+
+  self->now++;
+  slot = &self->wheel[self->now % WHEEL_SLOTS];
+
+  link = slot->head;
+  while (link) {
+    Watch *watch = link->data;
+
+    link = link->next;
+
+    /* Belongs to a later turn of the wheel */
+    if (watch->due > self->now) {
+      continue;
+    }
+
+    check (self, watch, active, quiet);
+  }
+
+  if (active->len == 1) {
+    alert (self, "monitor-activity", active, _("New output"));
+  } else if (active->len > 1) {
+    g_debug ("monitor: activity in %u tabs", active->len);
+    title = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                          "New output in %u tab",
+                                          "New output in %u tabs",
+                                          active->len),
+                             active->len);
+    alert (self, "monitor-activity", active, title);
+    g_clear_pointer (&title, g_free);
+  }
+
+  if (quiet->len == 1) {
+    alert (self, "monitor-silence", quiet, _("Output stopped"));
+  } else if (quiet->len > 1) {
+    g_debug ("monitor: %u tabs went quiet", quiet->len);
+    title = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                          "Output stopped in %u tab",
+                                          "Output stopped in %u tabs",
+                                          quiet->len),
+                             quiet->len);
+    alert (self, "monitor-silence", quiet, title);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+update_tick (KgxMonitor *self)
+{
+  if (g_hash_table_size (self->watches) == 0) {
+    g_clear_handle_id (&self->tick_source, g_source_remove);
+    return;
+  }
+
+  if (!self->tick_source) {
+    self->tick_source = g_timeout_add_seconds (1, tick, self);
+    g_source_set_name_by_id (self->tick_source, "[kgx] monitor");
+  }
+}
+
+
+/**
+ * kgx_monitor_watch:
+ * @self: the #KgxMonitor
+ * @tab: the #KgxTab to watch
+ * @flags: what to watch it for
+ *
+ * Start, or change, watching @tab. Passing %KGX_MONITOR_NONE is the same
+ * as kgx_monitor_unwatch()
+ */
+void
+kgx_monitor_watch (KgxMonitor      *self,
+                   KgxTab          *tab,
+                   KgxMonitorFlags  flags)
+{
+  Watch *watch;
+
+  g_return_if_fail (KGX_IS_MONITOR (self));
+  g_return_if_fail (KGX_IS_TAB (tab));
+
+  if (flags == KGX_MONITOR_NONE) {
+    kgx_monitor_unwatch (self, tab);
+    return;
+  }
+
+  watch = g_hash_table_lookup (self->watches, tab);
+  if (!watch) {
+    watch = g_new0 (Watch, 1);
+    watch->tab = tab;
+    g_hash_table_insert (self->watches, tab, watch);
+  }
+
+  watch->flags = flags;
+  watch->activity = kgx_tab_get_activity (tab);
+  watch->last_output = self->now;
+  watch->quiet = FALSE;
+  watch->alerted = FALSE;
+
+  schedule (self, watch);
+  update_tick (self);
+}
+
+
+/**
+ * kgx_monitor_unwatch:
+ * @self: the #KgxMonitor
+ * @tab: the #KgxTab to stop watching
+ */
+void
+kgx_monitor_unwatch (KgxMonitor *self,
+                     KgxTab     *tab)
+{
+  Watch *watch;
+
+  g_return_if_fail (KGX_IS_MONITOR (self));
+
+  watch = g_hash_table_lookup (self->watches, tab);
+  if (!watch) {
+    return;
+  }
+
+  park (self, watch);
+  g_hash_table_remove (self->watches, tab);
+
+  update_tick (self);
+}
+
+
+/**
+ * kgx_monitor_seen:
+ * @self: the #KgxMonitor
+ * @tab: the #KgxTab the user just looked at
+ *
+ * Whatever we had to say about @tab is known now, so start afresh
+ */
+void
+kgx_monitor_seen (KgxMonitor *self,
+                  KgxTab     *tab)
+{
+  Watch *watch;
+
+  g_return_if_fail (KGX_IS_MONITOR (self));
+
+  watch = g_hash_table_lookup (self->watches, tab);
+  if (!watch || !watch->alerted) {
+    return;
+  }
+
+  watch->alerted = FALSE;
+  watch->activity = kgx_tab_get_activity (tab);
+  watch->last_output = self->now;
+
+  schedule (self, watch);
+}
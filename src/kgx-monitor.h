@@ -0,0 +1,44 @@
+/* kgx-monitor.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "kgx-settings.h"
+#include "kgx-tab.h"
+
+G_BEGIN_DECLS
+
+typedef struct _KgxApplication KgxApplication;
+
+#define KGX_TYPE_MONITOR kgx_monitor_get_type ()
+G_DECLARE_FINAL_TYPE (KgxMonitor, kgx_monitor, KGX, MONITOR, GObject)
+
+
+KgxMonitor           *kgx_monitor_new                 (KgxApplication  *application,
+                                                       KgxSettings     *settings);
+void                  kgx_monitor_watch               (KgxMonitor      *self,
+                                                       KgxTab          *tab,
+                                                       KgxMonitorFlags  flags);
+void                  kgx_monitor_unwatch             (KgxMonitor      *self,
+                                                       KgxTab          *tab);
+void                  kgx_monitor_seen                (KgxMonitor      *self,
+                                                       KgxTab          *tab);
+
+G_END_DECLS
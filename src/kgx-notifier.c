@@ -0,0 +1,393 @@
+/* kgx-notifier.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include <glib/gi18n.h>
+
+#include "kgx-application.h"
+#include "kgx-notifier.h"
+
+/* How long to wait for more to happen before saying anything (ms) */
+#define BATCH_DELAY 500
+/* The least time between talking to the notification server (ms) */
+#define MIN_INTERVAL 2000
+
+
+/**
+ * PageCount:
+ * @page: a tab commands completed in
+ * @n_commands: how many of a #Batch it accounts for
+ *
+ * Stability: Private
+ */
+typedef struct {
+  guint       page;
+  guint       n_commands;
+} PageCount;
+
+
+/**
+ * Batch:
+ * @window: the window these happened in
+ * @n_commands: commands completed since the user last looked
+ * @pages: (element-type PageCount) the tabs they were in
+ * @last_page: where the most recent one was
+ * @last_command: what the most recent one was
+ * @shown: whether there's a notification up for @window
+ * @dirty: the notification is out of date
+ *
+ * Stability: Private
+ */
+typedef struct {
+  guint       window;
+  guint       n_commands;
+  GArray     *pages;
+  guint       last_page;
+  char       *last_command;
+  gboolean    shown;
+  gboolean    dirty;
+} Batch;
+
+
+static void
+batch_free (gpointer data)
+{
+  Batch *batch = data;
+
+  g_clear_pointer (&batch->pages, g_array_unref);
+  g_clear_pointer (&batch->last_command, g_free);
+
+  g_free (batch);
+}
+
+
+/**
+ * KgxNotifier:
+ * @application: who we send notifications through
+ * @batches: (element-type guint Batch) completions, by window
+ * @flush_source: pending update of the notifications
+ * @last_flush: the monotonic time we last sent anything
+ *
+ * Rather than a notification per command, which a busy script can turn
+ * into a flood, completions are gathered up per window and the
+ * notification server hears about them at a limited rate
+ */
+struct _KgxNotifier {
+  GObject         parent_instance;
+
+  KgxApplication *application;
+
+  GHashTable     *batches;
+  guint           flush_source;
+  gint64          last_flush;
+};
+
+
+G_DEFINE_TYPE (KgxNotifier, kgx_notifier, G_TYPE_OBJECT)
+
+
+static void
+kgx_notifier_dispose (GObject *object)
+{
+  KgxNotifier *self = KGX_NOTIFIER (object);
+
+  g_clear_handle_id (&self->flush_source, g_source_remove);
+  g_clear_pointer (&self->batches, g_hash_table_unref);
+  g_clear_weak_pointer (&self->application);
+
+  G_OBJECT_CLASS (kgx_notifier_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_notifier_class_init (KgxNotifierClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = kgx_notifier_dispose;
+}
+
+
+static void
+kgx_notifier_init (KgxNotifier *self)
+{
+  self->batches = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         batch_free);
+}
+
+
+KgxNotifier *
+kgx_notifier_new (KgxApplication *application)
+{
+  KgxNotifier *self = g_object_new (KGX_TYPE_NOTIFIER, NULL);
+
+  g_set_weak_pointer (&self->application, application);
+
+  return self;
+}
+
+
+static inline char *
+batch_id (Batch *batch)
+{
+  return g_strdup_printf ("command-completed-%u", batch->window);
+}
+
+
+static void
+send_batch (KgxNotifier *self,
+            Batch       *batch)
+{
+  g_autofree char *id = batch_id (batch);
+  g_autofree char *title = NULL;
+
+  if (batch->n_commands == 1) {
+    title = g_strdup (_("Command completed"));
+  } else if (batch->pages->len == 1) {
+    title = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                          "%u command completed",
+                                          "%u commands completed",
+                                          batch->n_commands),
+                             batch->n_commands);
+  } else {
+    /* Translators: The first %u is the number of commands (always more
+     * than one), the second is the number of tabs they were in */
+    title = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE,
+                                          "%u commands completed in %u tab",
+                                          "%u commands completed in %u tabs",
+                                          batch->pages->len),
+                             batch->n_commands,
+                             batch->pages->len);
+  }
+
+  kgx_application_send_notification (self->application,
+                                     id,
+                                     batch->last_page,
+                                     title,
+                                     batch->last_command);
+  batch->shown = TRUE;
+}
+
+
+static gboolean
+flush (gpointer data)
+{
+  KgxNotifier *self = KGX_NOTIFIER (data);
+  GHashTableIter iter;
+  Batch *batch;
+
+  self->flush_source = 0;
+  self->last_flush = g_get_monotonic_time ();
+
+  if (G_UNLIKELY (!self->application)) {
+    return G_SOURCE_REMOVE;
+  }
+
+  g_hash_table_iter_init (&iter, self->batches);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &batch)) {
+    if (!batch->dirty) {
+      continue;
+    }
+
+    batch->dirty = FALSE;
+
+    if (batch->n_commands > 0) {
+      g_debug ("notifier: %u commands in %u tabs of %u",
+               batch->n_commands, batch->pages->len, batch->window);
+      send_batch (self, batch);
+    } else if (batch->shown) {
+      g_autofree char *id = batch_id (batch);
+
+      kgx_application_withdraw_notification (self->application, id);
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+queue_flush (KgxNotifier *self)
+{
+  gint64 now, due;
+
+  if (self->flush_source) {
+    return;
+  }
+
+  now = g_get_monotonic_time ();
+  due = MAX (now + BATCH_DELAY * G_TIME_SPAN_MILLISECOND,
+             self->last_flush + MIN_INTERVAL * G_TIME_SPAN_MILLISECOND);
+
+  self->flush_source = g_timeout_add ((due - now) / G_TIME_SPAN_MILLISECOND,
+                                      flush,
+                                      self);
+  g_source_set_name_by_id (self->flush_source, "[kgx] flush notifications");
+}
+
+
+/**
+ * kgx_notifier_command_completed:
+ * @self: the #KgxNotifier
+ * @window: the id of the #GtkApplicationWindow @page is in
+ * @page: the id of the #KgxTab the command was running in
+ * @command: (nullable): a description of the command
+ *
+ * Let the user know, eventually, that something finished
+ */
+void
+kgx_notifier_command_completed (KgxNotifier *self,
+                                guint        window,
+                                guint        page,
+                                const char  *command)
+{
+  Batch *batch;
+  gboolean known = FALSE;
+
+  g_return_if_fail (KGX_IS_NOTIFIER (self));
+
+  batch = g_hash_table_lookup (self->batches, GUINT_TO_POINTER (window));
+  if (!batch) {
+    batch = g_new0 (Batch, 1);
+    batch->window = window;
+    batch->pages = g_array_new (FALSE, FALSE, sizeof (PageCount));
+    g_hash_table_insert (self->batches, GUINT_TO_POINTER (window), batch);
+  }
+
+  for (guint i = 0; i < batch->pages->len; i++) {
+    PageCount *count = &g_array_index (batch->pages, PageCount, i);
+
+    if (count->page == page) {
+      count->n_commands++;
+      known = TRUE;
+      break;
+    }
+  }
+
+  if (!known) {
+    PageCount count = { page, 1 };
+
+    g_array_append_val (batch->pages, count);
+  }
+
+  batch->n_commands++;
+  batch->last_page = page;
+  g_set_str (&batch->last_command, command);
+  batch->dirty = TRUE;
+
+  queue_flush (self);
+}
+
+
+/**
+ * kgx_notifier_dismiss:
+ * @self: the #KgxNotifier
+ * @window: the id of the #GtkApplicationWindow
+ *
+ * The user has come back to @window, so whatever we were going to tell
+ * them about it is old news
+ */
+void
+kgx_notifier_dismiss (KgxNotifier *self,
+                      guint        window)
+{
+  Batch *batch;
+
+  g_return_if_fail (KGX_IS_NOTIFIER (self));
+
+  batch = g_hash_table_lookup (self->batches, GUINT_TO_POINTER (window));
+  if (!batch) {
+    return;
+  }
+
+  if (!batch->shown) {
+    /* Nothing went out yet, so there's nothing to take back */
+    g_hash_table_remove (self->batches, GUINT_TO_POINTER (window));
+    return;
+  }
+
+  batch->n_commands = 0;
+  g_array_set_size (batch->pages, 0);
+  batch->dirty = TRUE;
+
+  queue_flush (self);
+}
+
+
+/**
+ * kgx_notifier_forget_page:
+ * @self: the #KgxNotifier
+ * @window: the id of the #GtkApplicationWindow @page was in
+ * @page: the id of the #KgxTab
+ *
+ * @page is going away, or moving to another window, so its commands no
+ * longer count towards @window. If it's all we had to say about @window
+ * then there's nothing left to say
+ */
+void
+kgx_notifier_forget_page (KgxNotifier *self,
+                          guint        window,
+                          guint        page)
+{
+  Batch *batch;
+  gboolean found = FALSE;
+
+  g_return_if_fail (KGX_IS_NOTIFIER (self));
+
+  batch = g_hash_table_lookup (self->batches, GUINT_TO_POINTER (window));
+  if (!batch) {
+    return;
+  }
+
+  for (guint i = 0; i < batch->pages->len; i++) {
+    PageCount *count = &g_array_index (batch->pages, PageCount, i);
+
+    if (count->page == page) {
+      batch->n_commands -= MIN (count->n_commands, batch->n_commands);
+      g_array_remove_index (batch->pages, i);
+      found = TRUE;
+      break;
+    }
+  }
+
+  if (!found) {
+    return;
+  }
+
+  if (batch->pages->len == 0) {
+    kgx_notifier_dismiss (self, window);
+    return;
+  }
+
+  /* Clicking it shouldn't go looking for a tab that isn't there */
+  if (batch->last_page == page) {
+    PageCount *count = &g_array_index (batch->pages,
+                                       PageCount,
+                                       batch->pages->len - 1);
+
+    batch->last_page = count->page;
+    g_clear_pointer (&batch->last_command, g_free);
+  }
+
+  batch->dirty = TRUE;
+  queue_flush (self);
+}
@@ -0,0 +1,42 @@
+/* kgx-notifier.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KgxApplication KgxApplication;
+
+#define KGX_TYPE_NOTIFIER kgx_notifier_get_type ()
+G_DECLARE_FINAL_TYPE (KgxNotifier, kgx_notifier, KGX, NOTIFIER, GObject)
+
+
+KgxNotifier          *kgx_notifier_new                (KgxApplication *application);
+void                  kgx_notifier_command_completed  (KgxNotifier    *self,
+                                                       guint           window,
+                                                       guint           page,
+                                                       const char     *command);
+void                  kgx_notifier_dismiss            (KgxNotifier    *self,
+                                                       guint           window);
+void                  kgx_notifier_forget_page        (KgxNotifier    *self,
+                                                       guint           window,
+                                                       guint           page);
+
+G_END_DECLS
@@ -21,11 +21,17 @@
 #include <glib/gi18n.h>
 
 #include "kgx-close-dialog.h"
+#include "kgx-drop-target.h"
 #include "kgx-pages.h"
 #include "kgx-tab.h"
 #include "kgx-settings.h"
 #include "kgx-marshals.h"
 
+/* Thumbnails redrawn per main loop iteration */
+#define THUMBNAILS_BATCH 4
+/* Seconds between looking for changes whilst the overview is open */
+#define THUMBNAILS_RECHECK 1
+
 
 /**
  * KgxPages:
@@ -39,6 +45,7 @@ struct _KgxPagesPrivate {
   GtkWidget            *view;
   char                 *title;
   GFile                *path;
+  char                 *remote_host;
   KgxTab               *active_page;
   gboolean              is_active;
   KgxStatus             page_status;
@@ -52,6 +59,13 @@ struct _KgxPagesPrivate {
   int                   last_rows;
   guint                 timeout;
 
+  guint                 hibernate_timeout;
+
+  gboolean              overview_open;
+  guint                 thumbnails_theme;
+  guint                 thumbnails_source;
+  guint                 thumbnails_cursor;
+
   GSignalGroup         *active_page_signals;
   GBindingGroup        *active_page_binds;
   GSignalGroup         *settings_signals;
@@ -59,6 +73,10 @@ struct _KgxPagesPrivate {
   GBinding             *is_active_bind;
 
   AdwTabPage           *action_page;
+
+  /* Shared by every tab, rather than each carrying its own */
+  KgxDropTarget        *drop_target;
+  KgxTab               *drop_tab;
 };
 
 
@@ -72,11 +90,13 @@ enum {
   PROP_TAB_COUNT,
   PROP_TITLE,
   PROP_PATH,
+  PROP_REMOTE_HOST,
   PROP_ACTIVE_PAGE,
   PROP_IS_ACTIVE,
   PROP_STATUS,
   PROP_SEARCH_MODE_ENABLED,
   PROP_RINGING,
+  PROP_OVERVIEW_OPEN,
   LAST_PROP
 };
 static GParamSpec *pspecs[LAST_PROP] = { NULL, };
@@ -100,9 +120,13 @@ kgx_pages_dispose (GObject *object)
   g_clear_object (&priv->settings);
 
   g_clear_handle_id (&priv->timeout, g_source_remove);
+  g_clear_handle_id (&priv->hibernate_timeout, g_source_remove);
+
+  g_clear_handle_id (&priv->thumbnails_source, g_source_remove);
 
   g_clear_pointer (&priv->title, g_free);
   g_clear_object (&priv->path);
+  g_clear_pointer (&priv->remote_host, g_free);
 
   g_clear_object (&priv->is_active_bind);
   g_clear_object (&priv->active_page);
@@ -136,6 +160,9 @@ kgx_pages_get_property (GObject    *object,
     case PROP_PATH:
       g_value_set_object (value, priv->path);
       break;
+    case PROP_REMOTE_HOST:
+      g_value_set_string (value, priv->remote_host);
+      break;
     case PROP_ACTIVE_PAGE:
       g_value_set_object (value, priv->active_page);
       break;
@@ -151,6 +178,9 @@ kgx_pages_get_property (GObject    *object,
     case PROP_RINGING:
       g_value_set_boolean (value, priv->ringing);
       break;
+    case PROP_OVERVIEW_OPEN:
+      g_value_set_boolean (value, priv->overview_open);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -158,6 +188,190 @@ kgx_pages_get_property (GObject    *object,
 }
 
 
+static gboolean
+hibernate_idle_tabs (gpointer data)
+{
+  KgxPages *self = data;
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  gint64 now = g_get_monotonic_time ();
+  gint64 after;
+  guint n;
+
+  after = (gint64) kgx_settings_get_hibernate_after (priv->settings) * G_USEC_PER_SEC;
+  n = adw_tab_view_get_n_pages (ADW_TAB_VIEW (priv->view));
+
+  for (guint i = 0; i < n; i++) {
+    AdwTabPage *page = adw_tab_view_get_nth_page (ADW_TAB_VIEW (priv->view), i);
+    KgxTab *tab = KGX_TAB (adw_tab_page_get_child (page));
+    gint64 hidden_since = kgx_tab_get_hidden_since (tab);
+
+    if (adw_tab_page_get_selected (page) || hidden_since == 0) {
+      continue;
+    }
+
+    if (now - hidden_since >= after) {
+      kgx_tab_hibernate (tab);
+    }
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+update_hibernation (KgxPages *self)
+{
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  guint after;
+
+  g_clear_handle_id (&priv->hibernate_timeout, g_source_remove);
+
+  if (!priv->settings) {
+    return;
+  }
+
+  after = kgx_settings_get_hibernate_after (priv->settings);
+
+  if (after == 0) {
+    return;
+  }
+
+  /* No need to be punctual, but don't overshoot by much either */
+  priv->hibernate_timeout =
+    g_timeout_add_seconds (CLAMP (after / 4, 5, 60), hibernate_idle_tabs, self);
+  g_source_set_name_by_id (priv->hibernate_timeout, "[kgx] hibernate idle tabs");
+}
+
+
+typedef struct {
+  guint generation;
+  guint theme;
+} Thumbnail;
+
+
+G_DEFINE_QUARK (kgx-thumbnail, thumbnail)
+
+
+/*
+ * Note what @page looked like when libadwaita last took its thumbnail
+ */
+static void
+stamp_thumbnail (KgxPages   *self,
+                 AdwTabPage *page)
+{
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  KgxTab *tab = KGX_TAB (adw_tab_page_get_child (page));
+  Thumbnail *thumbnail;
+
+  thumbnail = g_object_get_qdata (G_OBJECT (page), thumbnail_quark ());
+  if (!thumbnail) {
+    thumbnail = g_new0 (Thumbnail, 1);
+    g_object_set_qdata_full (G_OBJECT (page), thumbnail_quark (), thumbnail, g_free);
+  }
+
+  thumbnail->generation = kgx_tab_get_generation (tab);
+  thumbnail->theme = priv->thumbnails_theme;
+}
+
+
+static void queue_refresh_thumbnails (KgxPages *self);
+
+
+static gboolean
+recheck_thumbnails (gpointer data)
+{
+  KgxPages *self = data;
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+
+  priv->thumbnails_source = 0;
+  queue_refresh_thumbnails (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Redraws a handful of out of date thumbnails per iteration, so even with
+ * hundreds of tabs the overview opens straight away and fills in as we go
+ */
+static gboolean
+refresh_thumbnails (gpointer data)
+{
+  KgxPages *self = data;
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  guint n_pages = adw_tab_view_get_n_pages (ADW_TAB_VIEW (priv->view));
+  guint refreshed = 0;
+
+  while (priv->thumbnails_cursor < n_pages && refreshed < THUMBNAILS_BATCH) {
+    AdwTabPage *page =
+      adw_tab_view_get_nth_page (ADW_TAB_VIEW (priv->view),
+                                 priv->thumbnails_cursor++);
+    KgxTab *tab = KGX_TAB (adw_tab_page_get_child (page));
+    Thumbnail *thumbnail;
+
+    /* Drawing it would wake it up */
+    if (kgx_tab_get_hibernated (tab)) {
+      continue;
+    }
+
+    thumbnail = g_object_get_qdata (G_OBJECT (page), thumbnail_quark ());
+    if (thumbnail &&
+        thumbnail->generation == kgx_tab_get_generation (tab) &&
+        thumbnail->theme == priv->thumbnails_theme) {
+      continue;
+    }
+
+    adw_tab_page_invalidate_thumbnail (page);
+    stamp_thumbnail (self, page);
+    refreshed++;
+  }
+
+  if (priv->thumbnails_cursor < n_pages) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Whilst the overview is open, keep an eye out for more output */
+  priv->thumbnails_cursor = 0;
+  priv->thumbnails_source =
+    g_timeout_add_seconds (THUMBNAILS_RECHECK, recheck_thumbnails, self);
+  g_source_set_name_by_id (priv->thumbnails_source, "[kgx] recheck thumbnails");
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Thumbnails are only needed when the overview is open, so until then we
+ * just remember what changed
+ */
+static void
+queue_refresh_thumbnails (KgxPages *self)
+{
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+
+  g_clear_handle_id (&priv->thumbnails_source, g_source_remove);
+  priv->thumbnails_cursor = 0;
+
+  if (!priv->overview_open) {
+    return;
+  }
+
+  priv->thumbnails_source =
+    g_idle_add_full (G_PRIORITY_LOW, refresh_thumbnails, self, NULL);
+  g_source_set_name_by_id (priv->thumbnails_source, "[kgx] refresh thumbnails");
+}
+
+
+static void
+theme_changed (KgxPages *self)
+{
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+
+  priv->thumbnails_theme++;
+  queue_refresh_thumbnails (self);
+}
+
+
 static void
 kgx_pages_set_property (GObject      *object,
                         guint         property_id,
@@ -169,7 +383,9 @@ kgx_pages_set_property (GObject      *object,
 
   switch (property_id) {
     case PROP_SETTINGS:
-      g_set_object (&priv->settings, g_value_get_object (value));
+      if (g_set_object (&priv->settings, g_value_get_object (value))) {
+        update_hibernation (self);
+      }
       break;
     case PROP_TITLE:
       g_clear_pointer (&priv->title, g_free);
@@ -178,6 +394,9 @@ kgx_pages_set_property (GObject      *object,
     case PROP_PATH:
       g_set_object (&priv->path, g_value_get_object (value));
       break;
+    case PROP_REMOTE_HOST:
+      g_set_str (&priv->remote_host, g_value_get_string (value));
+      break;
     case PROP_ACTIVE_PAGE:
       if (priv->active_page) {
         g_object_set (priv->active_page, "is-active", FALSE, NULL);
@@ -203,6 +422,10 @@ kgx_pages_set_property (GObject      *object,
     case PROP_RINGING:
       priv->ringing = g_value_get_boolean (value);
       break;
+    case PROP_OVERVIEW_OPEN:
+      priv->overview_open = g_value_get_boolean (value);
+      queue_refresh_thumbnails (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -297,6 +520,23 @@ zoom (KgxTab   *tab,
 }
 
 
+/*
+ * libadwaita keeps the last frame of a tab as it's hidden, that's as good
+ * as a fresh thumbnail until the contents change
+ */
+static void
+tab_unmapped (GtkWidget *tab,
+              KgxPages  *self)
+{
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  AdwTabPage *page = adw_tab_view_get_page (ADW_TAB_VIEW (priv->view), tab);
+
+  if (page) {
+    stamp_thumbnail (self, page);
+  }
+}
+
+
 static void
 page_attached (AdwTabView *view,
                AdwTabPage *page,
@@ -312,6 +552,7 @@ page_attached (AdwTabView *view,
   g_object_connect (tab,
                     "signal::died", G_CALLBACK (died), self,
                     "signal::zoom", G_CALLBACK (zoom), self,
+                    "signal::unmap", G_CALLBACK (tab_unmapped), self,
                     NULL);
 }
 
@@ -331,6 +572,7 @@ page_detached (AdwTabView *view,
   g_object_disconnect (tab,
                        "any-signal::died", G_CALLBACK (died), self,
                        "any-signal::zoom", G_CALLBACK (zoom), self,
+                       "any-signal::unmap", G_CALLBACK (tab_unmapped), self,
                        NULL);
 
   if (adw_tab_view_get_n_pages (ADW_TAB_VIEW (view)) == 0) {
@@ -451,8 +693,40 @@ setup_menu (AdwTabView *view,
             KgxPages   *self)
 {
   KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  GtkWidget *root;
+  gboolean recording;
+  KgxRewrap rewrap;
+  KgxMonitorFlags monitor;
 
   priv->action_page = page;
+
+  if (!page) {
+    return;
+  }
+
+  /* The tab.* actions live on the window */
+  root = GTK_WIDGET (gtk_widget_get_root (GTK_WIDGET (self)));
+  recording = kgx_tab_get_recording (KGX_TAB (adw_tab_page_get_child (page)));
+
+  gtk_widget_action_set_enabled (root, "tab.start-recording", !recording);
+  gtk_widget_action_set_enabled (root, "tab.stop-recording", recording);
+
+  rewrap = kgx_tab_get_rewrap (KGX_TAB (adw_tab_page_get_child (page)));
+
+  gtk_widget_action_set_enabled (root, "tab.rewrap-auto", rewrap != KGX_REWRAP_AUTO);
+  gtk_widget_action_set_enabled (root, "tab.rewrap-always", rewrap != KGX_REWRAP_ALWAYS);
+  gtk_widget_action_set_enabled (root, "tab.rewrap-never", rewrap != KGX_REWRAP_NEVER);
+
+  monitor = kgx_tab_get_monitor (KGX_TAB (adw_tab_page_get_child (page)));
+
+  gtk_widget_action_set_enabled (root, "tab.monitor-activity",
+                                 !(monitor & KGX_MONITOR_ACTIVITY));
+  gtk_widget_action_set_enabled (root, "tab.unmonitor-activity",
+                                 (monitor & KGX_MONITOR_ACTIVITY) != 0);
+  gtk_widget_action_set_enabled (root, "tab.monitor-silence",
+                                 !(monitor & KGX_MONITOR_SILENCE));
+  gtk_widget_action_set_enabled (root, "tab.unmonitor-silence",
+                                 (monitor & KGX_MONITOR_SILENCE) != 0);
 }
 
 
@@ -549,6 +823,20 @@ object_accumulator (GSignalInvocationHint *ihint,
 }
 
 
+static void
+drop (KgxDropTarget *target,
+      const char    *text,
+      KgxPages      *self)
+{
+  KgxPagesPrivate *priv = kgx_pages_get_instance_private (self);
+  KgxTab *tab = priv->drop_tab ? priv->drop_tab : priv->active_page;
+
+  if (tab) {
+    kgx_tab_accept_drop (tab, text);
+  }
+}
+
+
 static void
 kgx_pages_class_init (KgxPagesClass *klass)
 {
@@ -620,6 +908,21 @@ kgx_pages_class_init (KgxPagesClass *klass)
                          G_TYPE_FILE,
                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+  /**
+   * KgxPages:remote-host:
+   *
+   * The #KgxTab:remote-host of the current #KgxTab
+   *
+   * Note the writability of this property in an implementation detail, DO NOT
+   * set this property
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_REMOTE_HOST] =
+    g_param_spec_string ("remote-host", NULL, NULL,
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
   /**
    * KgxPages:active-page:
    *
@@ -654,6 +957,18 @@ kgx_pages_class_init (KgxPagesClass *klass)
                           FALSE,
                           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+  /**
+   * KgxPages:overview-open:
+   *
+   * Whether the tab overview, and so the thumbnails, are being shown
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_OVERVIEW_OPEN] =
+    g_param_spec_boolean ("overview-open", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
 
   g_object_class_install_properties (object_class, LAST_PROP, pspecs);
 
@@ -702,12 +1017,14 @@ kgx_pages_class_init (KgxPagesClass *klass)
   gtk_widget_class_bind_template_child_private (widget_class, KgxPages, active_page_signals);
   gtk_widget_class_bind_template_child_private (widget_class, KgxPages, active_page_binds);
   gtk_widget_class_bind_template_child_private (widget_class, KgxPages, settings_signals);
+  gtk_widget_class_bind_template_child_private (widget_class, KgxPages, drop_target);
 
   gtk_widget_class_bind_template_callback (widget_class, page_attached);
   gtk_widget_class_bind_template_callback (widget_class, page_detached);
   gtk_widget_class_bind_template_callback (widget_class, create_window);
   gtk_widget_class_bind_template_callback (widget_class, close_page);
   gtk_widget_class_bind_template_callback (widget_class, setup_menu);
+  gtk_widget_class_bind_template_callback (widget_class, drop);
 
   gtk_widget_class_set_css_name (widget_class, "pages");
 }
@@ -726,19 +1043,22 @@ kgx_pages_init (KgxPages *self)
                           self);
 
   g_signal_group_connect_swapped (priv->settings_signals, "notify::theme",
-                                  G_CALLBACK (adw_tab_view_invalidate_thumbnails),
-                                  priv->view);
+                                  G_CALLBACK (theme_changed),
+                                  self);
+  g_signal_group_connect_swapped (priv->settings_signals, "notify::hibernate-after",
+                                  G_CALLBACK (update_hibernation),
+                                  self);
 
   g_signal_connect_object (style_manager,
                            "notify::dark",
-                           G_CALLBACK (adw_tab_view_invalidate_thumbnails),
-                           priv->view,
+                           G_CALLBACK (theme_changed),
+                           self,
                            G_CONNECT_SWAPPED);
 
   g_signal_connect_object (style_manager,
                            "notify::high-contrast",
-                           G_CALLBACK (adw_tab_view_invalidate_thumbnails),
-                           priv->view,
+                           G_CALLBACK (theme_changed),
+                           self,
                            G_CONNECT_SWAPPED);
 
   g_binding_group_bind (priv->active_page_binds, "search-mode-enabled",
@@ -750,6 +1070,8 @@ kgx_pages_init (KgxPages *self)
                                  ADW_TAB_VIEW_SHORTCUT_CONTROL_END |
                                  ADW_TAB_VIEW_SHORTCUT_CONTROL_SHIFT_HOME |
                                  ADW_TAB_VIEW_SHORTCUT_CONTROL_SHIFT_END);
+
+  kgx_drop_target_mount_on (priv->drop_target, priv->view);
 }
 
 
@@ -945,6 +1267,78 @@ kgx_pages_detach_page (KgxPages *self)
 }
 
 
+void
+kgx_pages_set_recording (KgxPages *self,
+                         gboolean  recording)
+{
+  KgxPagesPrivate *priv;
+  AdwTabPage *page;
+
+  g_return_if_fail (KGX_IS_PAGES (self));
+
+  priv = kgx_pages_get_instance_private (self);
+  page = priv->action_page;
+
+  if (!page)
+    page = adw_tab_view_get_selected_page (ADW_TAB_VIEW (priv->view));
+
+  if (!page)
+    return;
+
+  kgx_tab_set_recording (KGX_TAB (adw_tab_page_get_child (page)), recording);
+}
+
+
+void
+kgx_pages_set_rewrap (KgxPages  *self,
+                      KgxRewrap  rewrap)
+{
+  KgxPagesPrivate *priv;
+  AdwTabPage *page;
+
+  g_return_if_fail (KGX_IS_PAGES (self));
+
+  priv = kgx_pages_get_instance_private (self);
+  page = priv->action_page;
+
+  if (!page)
+    page = adw_tab_view_get_selected_page (ADW_TAB_VIEW (priv->view));
+
+  if (!page)
+    return;
+
+  kgx_tab_set_rewrap (KGX_TAB (adw_tab_page_get_child (page)), rewrap);
+}
+
+
+void
+kgx_pages_set_monitor (KgxPages        *self,
+                       KgxMonitorFlags  flags,
+                       gboolean         enabled)
+{
+  KgxPagesPrivate *priv;
+  AdwTabPage *page;
+  KgxTab *tab;
+  KgxMonitorFlags monitor;
+
+  g_return_if_fail (KGX_IS_PAGES (self));
+
+  priv = kgx_pages_get_instance_private (self);
+  page = priv->action_page;
+
+  if (!page)
+    page = adw_tab_view_get_selected_page (ADW_TAB_VIEW (priv->view));
+
+  if (!page)
+    return;
+
+  tab = KGX_TAB (adw_tab_page_get_child (page));
+  monitor = kgx_tab_get_monitor (tab);
+
+  kgx_tab_set_monitor (tab, enabled ? monitor | flags : monitor & ~flags);
+}
+
+
 AdwTabPage *
 kgx_pages_get_selected_page (KgxPages  *self)
 {
@@ -956,3 +1350,29 @@ kgx_pages_get_selected_page (KgxPages  *self)
 
   return adw_tab_view_get_selected_page (ADW_TAB_VIEW (priv->view));
 }
+
+
+/**
+ * kgx_pages_extra_drop:
+ * @self: the #KgxPages
+ * @tab: the #KgxTab the value was dropped on
+ * @value: the dropped value
+ *
+ * Handle something dropped onto @tab's entry in the tab bar/overview
+ */
+void
+kgx_pages_extra_drop (KgxPages     *self,
+                      KgxTab       *tab,
+                      const GValue *value)
+{
+  KgxPagesPrivate *priv;
+
+  g_return_if_fail (KGX_IS_PAGES (self));
+  g_return_if_fail (KGX_IS_TAB (tab));
+
+  priv = kgx_pages_get_instance_private (self);
+
+  priv->drop_tab = tab;
+  kgx_drop_target_extra_drop (priv->drop_target, value);
+  priv->drop_tab = NULL;
+}
@@ -47,6 +47,16 @@ KgxStatus   kgx_pages_current_status (KgxPages   *self);
 gboolean    kgx_pages_is_ringing          (KgxPages   *self);
 void        kgx_pages_close_page          (KgxPages  *self);
 void        kgx_pages_detach_page         (KgxPages  *self);
+void        kgx_pages_set_recording       (KgxPages  *self,
+                                           gboolean   recording);
+void        kgx_pages_set_rewrap          (KgxPages  *self,
+                                           KgxRewrap  rewrap);
+void        kgx_pages_set_monitor         (KgxPages        *self,
+                                           KgxMonitorFlags  flags,
+                                           gboolean         enabled);
 AdwTabPage *kgx_pages_get_selected_page   (KgxPages  *self);
+void        kgx_pages_extra_drop          (KgxPages     *self,
+                                           KgxTab       *tab,
+                                           const GValue *value);
 
 G_END_DECLS
@@ -45,6 +45,7 @@ struct _KgxProcess {
   GPid    parent;
   gint32  euid;
   GStrv   argv;
+  gint64  seen;
 };
 
 static void
@@ -90,6 +91,7 @@ kgx_process_new (GPid pid)
   self = g_rc_box_new0 (KgxProcess);
 
   self->pid = pid;
+  self->seen = g_get_monotonic_time ();
 
   glibtop_get_proc_uid (&info, pid);
 
@@ -99,6 +101,34 @@ kgx_process_new (GPid pid)
   return self;
 }
 
+
+/**
+ * kgx_process_new_for_command:
+ * @command: the command line, as the shell reported it
+ * @started: the monotonic time it started
+ *
+ * Describe a command we know about from shell integration rather than
+ * from /proc, it has no pid and may not even be a process of its own
+ *
+ * Stability: Private
+ */
+KgxProcess *
+kgx_process_new_for_command (const char *command,
+                             gint64      started)
+{
+  KgxProcess *self = g_rc_box_new0 (KgxProcess);
+
+  self->seen = started;
+  self->euid = -1;
+
+  if (!g_shell_parse_argv (command, NULL, &self->argv, NULL)) {
+    self->argv = g_new0 (char *, 2);
+    self->argv[0] = g_strdup (command);
+  }
+
+  return self;
+}
+
 /**
  * kgx_process_get_pid:
  * @self: the #KgxProcess
@@ -116,6 +146,25 @@ kgx_process_get_pid (KgxProcess *self)
 }
 
 
+/**
+ * kgx_process_get_age:
+ * @self: the #KgxProcess
+ *
+ * As we only look every so often, this is a lower bound
+ *
+ * Returns: microseconds since @self was first noticed
+ *
+ * Stability: Private
+ */
+gint64
+kgx_process_get_age (KgxProcess *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_get_monotonic_time () - self->seen;
+}
+
+
 /**
  * kgx_process_get_is_root:
  * @self: the #KgxProcess
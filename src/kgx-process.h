@@ -31,7 +31,11 @@ typedef struct _KgxProcess KgxProcess;
 
 GTree      *kgx_process_get_list    (void);
 KgxProcess *kgx_process_new         (GPid        pid);
+KgxProcess *kgx_process_new_for_command
+                                    (const char *command,
+                                     gint64      started);
 GPid        kgx_process_get_pid     (KgxProcess *self);
+gint64      kgx_process_get_age     (KgxProcess *self);
 gboolean    kgx_process_get_is_root (KgxProcess *self);
 GPid        kgx_process_get_parent  (KgxProcess *self);
 GStrv       kgx_process_get_argv    (KgxProcess *self);
@@ -222,8 +222,19 @@ proxy_settings_changed (GSettings *settings, const char *key, KgxProxyInfo *self
     return;
   }
 
+  self->mode = mode;
+
   switch (mode) {
     case G_DESKTOP_PROXY_MODE_MANUAL:
+      /* Most people never set a manual proxy, don't pay for the children
+       * (and their schemas) until someone does */
+      if (G_UNLIKELY (!self->protocols[HTTP])) {
+        self->protocols[HTTP] = g_settings_get_child (self->settings, "http");
+        self->protocols[HTTPS] = g_settings_get_child (self->settings, "https");
+        self->protocols[FTP] = g_settings_get_child (self->settings, "ftp");
+        self->protocols[SOCKS] = g_settings_get_child (self->settings, "socks");
+      }
+
       for (int i = 0; i < G_N_ELEMENTS (self->changed_handler); i++) {
         self->changed_handler[i] =
           g_signal_connect (self->protocols[i],
@@ -251,11 +262,6 @@ kgx_proxy_info_init (KgxProxyInfo *self)
 {
   self->settings = g_settings_new ("org.gnome.system.proxy");
 
-  self->protocols[HTTP] = g_settings_get_child (self->settings, "http");
-  self->protocols[HTTPS] = g_settings_get_child (self->settings, "https");
-  self->protocols[FTP] = g_settings_get_child (self->settings, "ftp");
-  self->protocols[SOCKS] = g_settings_get_child (self->settings, "socks");
-
   self->environ = g_hash_table_new_full (g_str_hash,
                                          g_str_equal,
                                          g_free,
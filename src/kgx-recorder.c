@@ -0,0 +1,540 @@
+/* kgx-recorder.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-recorder
+ * @title: KgxRecorder
+ * @short_description: Writes terminal output to disk
+ *
+ * Output is copied into a fixed ring on the main thread and written out
+ * (optionally gzipped) by a dedicated thread, so a busy terminal never
+ * waits on the disk. Should the writer fall a full ring behind, new output
+ * is dropped (and counted) rather than stalling the terminal
+ *
+ * Closing never waits for the writer either, it finishes off the ring in
+ * its own time, holding its own reference. Only kgx_recorder_wait_all(),
+ * on the way out, waits for them
+ */
+
+#include "kgx-config.h"
+
+#include <string.h>
+
+#include "kgx-recorder.h"
+
+/* Must be a power of two */
+#define RING_SIZE (4 * 1024 * 1024)
+#define RING_MASK (RING_SIZE - 1)
+/* Only bother waking the writer once there's a decent batch waiting */
+#define WAKE_THRESHOLD (RING_SIZE / 4)
+#define FLUSH_INTERVAL (250 * G_TIME_SPAN_MILLISECOND)
+#define ROTATE_SIZE (64 * 1024 * 1024)
+/* Names to try before giving up on the log */
+#define MAX_UNIQUE 100
+
+
+/* Writers yet to finish, see kgx_recorder_wait_all() */
+static GMutex writers_lock;
+static GCond writers_cond;
+static guint writers = 0;
+
+
+/**
+ * KgxRecorder:
+ * @ring: output waiting to be written
+ * @head: (atomic): total bytes ever added to @ring, only the main thread
+ *        moves this
+ * @tail: (atomic): total bytes ever taken from @ring, only the writer
+ *        moves this
+ * @dropped: (atomic): bytes thrown away since the writer last checked
+ * @sleeping: (atomic): the writer is (about to be) waiting on @cond
+ * @stopping: (atomic): the writer should drain @ring and exit
+ * @part: how many files we've rotated through, writer only
+ * @unique: sets our files apart from another recording with the same
+ *          name, writer only
+ *
+ * Stability: Private
+ */
+struct _KgxRecorder {
+  GObject                   parent_instance;
+
+  GFile                    *directory;
+  char                     *name;
+  gboolean                  compress;
+
+  guint8                   *ring;
+  guint                     head;
+  guint                     tail;
+  guint                     dropped;
+
+  GThread                  *thread;
+  GMutex                    lock;
+  GCond                     cond;
+  int                       sleeping;
+  int                       stopping;
+
+  guint                     part;
+  guint                     unique;
+};
+
+
+G_DEFINE_TYPE (KgxRecorder, kgx_recorder, G_TYPE_OBJECT)
+
+
+enum {
+  PROP_0,
+  PROP_DIRECTORY,
+  PROP_NAME,
+  PROP_COMPRESS,
+  LAST_PROP
+};
+static GParamSpec *pspecs[LAST_PROP] = { NULL, };
+
+
+static GOutputStream *
+open_log (KgxRecorder  *self,
+          GError      **error)
+{
+  g_autoptr (GError) local_error = NULL;
+  g_autoptr (GFileOutputStream) stream = NULL;
+  g_autoptr (GZlibCompressor) compressor = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *basename = NULL;
+  const char *suffix = self->compress ? ".log.gz" : ".log";
+
+  if (!g_file_make_directory_with_parents (self->directory, NULL, &local_error) &&
+      !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+    g_propagate_error (error, g_steal_pointer (&local_error));
+    return NULL;
+  }
+
+  /* Tab ids start afresh in every instance, so another could well have
+   * started recording the same tab in the same second */
+  do {
+    g_autofree char *stem = NULL;
+
+    g_clear_error (&local_error);
+    g_clear_pointer (&basename, g_free);
+    g_clear_object (&file);
+
+    if (self->unique == 0) {
+      stem = g_strdup (self->name);
+    } else {
+      stem = g_strdup_printf ("%s-%u", self->name, self->unique + 1);
+    }
+
+    if (self->part == 0) {
+      basename = g_strconcat (stem, suffix, NULL);
+    } else {
+      basename = g_strdup_printf ("%s.%u%s", stem, self->part, suffix);
+    }
+
+    file = g_file_get_child (self->directory, basename);
+    stream = g_file_create (file, G_FILE_CREATE_PRIVATE, NULL, &local_error);
+  } while (!stream &&
+           g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS) &&
+           ++self->unique < MAX_UNIQUE);
+
+  self->part++;
+
+  if (!stream) {
+    g_propagate_error (error, g_steal_pointer (&local_error));
+    return NULL;
+  }
+
+  g_debug ("recorder: writing to %s", g_file_peek_path (file));
+
+  if (!self->compress) {
+    return G_OUTPUT_STREAM (g_steal_pointer (&stream));
+  }
+
+  /* Favour speed, terminal output compresses well regardless */
+  compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, 1);
+
+  return g_converter_output_stream_new (G_OUTPUT_STREAM (stream),
+                                        G_CONVERTER (compressor));
+}
+
+
+static void
+close_log (KgxRecorder    *self,
+           GOutputStream **stream)
+{
+  g_autoptr (GError) error = NULL;
+
+  if (!*stream) {
+    return;
+  }
+
+  if (!g_output_stream_close (*stream, NULL, &error)) {
+    g_warning ("recorder: failed to close %s: %s", self->name, error->message);
+  }
+
+  g_clear_object (stream);
+}
+
+
+static gpointer
+writer_thread (gpointer data)
+{
+  KgxRecorder *self = data;
+  g_autoptr (GOutputStream) stream = NULL;
+  gsize part_size = 0;
+  gint64 last_flush = 0;
+  gboolean dirty = FALSE;
+  gboolean failed = FALSE;
+
+  while (TRUE) {
+    g_autoptr (GError) error = NULL;
+    guint head = g_atomic_int_get (&self->head);
+    guint tail = self->tail;
+    guint dropped = g_atomic_int_exchange (&self->dropped, 0);
+    gsize offset, len;
+
+    if (G_UNLIKELY (dropped > 0)) {
+      g_debug ("recorder: %s fell behind, dropped %u bytes", self->name, dropped);
+    }
+
+    if (head == tail) {
+      gint64 now = g_get_monotonic_time ();
+
+      if (g_atomic_int_get (&self->stopping)) {
+        break;
+      }
+
+      /* Flush when things go quiet, but not so often we defeat the
+       * compressor whilst something is busy */
+      if (stream && dirty && now - last_flush >= FLUSH_INTERVAL) {
+        g_output_stream_flush (stream, NULL, NULL);
+        last_flush = now;
+        dirty = FALSE;
+      }
+
+      g_mutex_lock (&self->lock);
+      g_atomic_int_set (&self->sleeping, TRUE);
+      if (g_atomic_int_get (&self->head) == tail &&
+          !g_atomic_int_get (&self->stopping)) {
+        g_cond_wait_until (&self->cond, &self->lock, now + FLUSH_INTERVAL);
+      }
+      g_atomic_int_set (&self->sleeping, FALSE);
+      g_mutex_unlock (&self->lock);
+
+      continue;
+    }
+
+    /* Write up to the end of the ring, any wrapped remainder is picked up
+     * on the next pass */
+    offset = tail & RING_MASK;
+    len = MIN (head - tail, RING_SIZE - offset);
+
+    if (stream && part_size >= ROTATE_SIZE) {
+      close_log (self, &stream);
+      part_size = 0;
+    }
+
+    if (!stream && !failed) {
+      stream = open_log (self, &error);
+      if (!stream) {
+        g_warning ("recorder: can't record %s: %s", self->name, error->message);
+        failed = TRUE;
+      }
+    }
+
+    if (stream) {
+      if (g_output_stream_write_all (stream, self->ring + offset, len, NULL, NULL, &error)) {
+        part_size += len;
+        dirty = TRUE;
+      } else {
+        g_warning ("recorder: failed writing %s: %s", self->name, error->message);
+        close_log (self, &stream);
+        failed = TRUE;
+      }
+    }
+
+    g_atomic_int_set (&self->tail, tail + len);
+  }
+
+  close_log (self, &stream);
+
+  g_mutex_lock (&writers_lock);
+  writers--;
+  g_cond_broadcast (&writers_cond);
+  g_mutex_unlock (&writers_lock);
+
+  /* Which may well be the last */
+  g_object_unref (self);
+
+  return NULL;
+}
+
+
+static void
+kgx_recorder_constructed (GObject *object)
+{
+  KgxRecorder *self = KGX_RECORDER (object);
+
+  G_OBJECT_CLASS (kgx_recorder_parent_class)->constructed (object);
+
+  g_return_if_fail (G_IS_FILE (self->directory));
+  g_return_if_fail (self->name != NULL);
+
+  self->ring = g_malloc (RING_SIZE);
+
+  g_mutex_lock (&writers_lock);
+  writers++;
+  g_mutex_unlock (&writers_lock);
+
+  self->thread = g_thread_new ("kgx-recorder", writer_thread, g_object_ref (self));
+}
+
+
+static void
+kgx_recorder_finalize (GObject *object)
+{
+  KgxRecorder *self = KGX_RECORDER (object);
+
+  g_clear_object (&self->directory);
+  g_clear_pointer (&self->name, g_free);
+  g_clear_pointer (&self->ring, g_free);
+
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (kgx_recorder_parent_class)->finalize (object);
+}
+
+
+static void
+kgx_recorder_set_property (GObject      *object,
+                           guint         property_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  KgxRecorder *self = KGX_RECORDER (object);
+
+  switch (property_id) {
+    case PROP_DIRECTORY:
+      g_set_object (&self->directory, g_value_get_object (value));
+      break;
+    case PROP_NAME:
+      g_set_str (&self->name, g_value_get_string (value));
+      break;
+    case PROP_COMPRESS:
+      self->compress = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+static void
+kgx_recorder_get_property (GObject    *object,
+                           guint       property_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  KgxRecorder *self = KGX_RECORDER (object);
+
+  switch (property_id) {
+    case PROP_DIRECTORY:
+      g_value_set_object (value, self->directory);
+      break;
+    case PROP_NAME:
+      g_value_set_string (value, self->name);
+      break;
+    case PROP_COMPRESS:
+      g_value_set_boolean (value, self->compress);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+static void
+kgx_recorder_class_init (KgxRecorderClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = kgx_recorder_constructed;
+  object_class->finalize = kgx_recorder_finalize;
+  object_class->set_property = kgx_recorder_set_property;
+  object_class->get_property = kgx_recorder_get_property;
+
+  /**
+   * KgxRecorder:directory:
+   *
+   * Where the logs go, created if needed
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_DIRECTORY] =
+    g_param_spec_object ("directory", NULL, NULL,
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * KgxRecorder:name:
+   *
+   * Basename for the logs, rotated parts gain a numeric suffix
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_NAME] =
+    g_param_spec_string ("name", NULL, NULL,
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  pspecs[PROP_COMPRESS] =
+    g_param_spec_boolean ("compress", NULL, NULL,
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+}
+
+
+static void
+kgx_recorder_init (KgxRecorder *self)
+{
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+}
+
+
+KgxRecorder *
+kgx_recorder_new (GFile      *directory,
+                  const char *name,
+                  gboolean    compress)
+{
+  g_return_val_if_fail (G_IS_FILE (directory), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  return g_object_new (KGX_TYPE_RECORDER,
+                       "directory", directory,
+                       "name", name,
+                       "compress", compress,
+                       NULL);
+}
+
+
+/**
+ * kgx_recorder_write:
+ * @self: the #KgxRecorder
+ * @data: (array length=len): some output
+ * @len: the length of @data
+ *
+ * Queue @data to be written, this never blocks on the writer. Only call
+ * this from the main thread
+ */
+void
+kgx_recorder_write (KgxRecorder  *self,
+                    const guint8 *data,
+                    gsize         len)
+{
+  guint head, tail;
+  gsize offset, first;
+
+  g_return_if_fail (KGX_IS_RECORDER (self));
+  g_return_if_fail (self->thread != NULL);
+
+  head = self->head;
+  tail = g_atomic_int_get (&self->tail);
+
+  if (G_UNLIKELY (len > RING_SIZE - (head - tail))) {
+    g_atomic_int_add (&self->dropped, len);
+    return;
+  }
+
+  offset = head & RING_MASK;
+  first = MIN (len, RING_SIZE - offset);
+  memcpy (self->ring + offset, data, first);
+  memcpy (self->ring, data + first, len - first);
+
+  g_atomic_int_set (&self->head, head + len);
+
+  if (g_atomic_int_get (&self->sleeping) &&
+      head + len - tail >= WAKE_THRESHOLD) {
+    g_mutex_lock (&self->lock);
+    g_cond_signal (&self->cond);
+    g_mutex_unlock (&self->lock);
+  }
+}
+
+
+/**
+ * kgx_recorder_close:
+ * @self: the #KgxRecorder
+ *
+ * Stop taking output, what's already been written to @self is still
+ * written out, but this doesn't wait for that
+ *
+ * The writer holds a reference until it's done, so this must be called
+ * for @self to ever be freed
+ */
+void
+kgx_recorder_close (KgxRecorder *self)
+{
+  g_return_if_fail (KGX_IS_RECORDER (self));
+
+  if (!self->thread) {
+    return;
+  }
+
+  g_mutex_lock (&self->lock);
+  g_atomic_int_set (&self->stopping, TRUE);
+  g_cond_signal (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  g_clear_pointer (&self->thread, g_thread_unref);
+}
+
+
+/**
+ * kgx_recorder_wait_all:
+ *
+ * Wait for every closed #KgxRecorder to finish writing, for when we're
+ * about to exit and would otherwise cut them short
+ */
+void
+kgx_recorder_wait_all (void)
+{
+  g_mutex_lock (&writers_lock);
+  while (writers > 0) {
+    g_cond_wait (&writers_cond, &writers_lock);
+  }
+  g_mutex_unlock (&writers_lock);
+}
+
+
+/**
+ * kgx_recorder_default_directory:
+ *
+ * Returns: (transfer full): where logs go when not otherwise specified
+ */
+GFile *
+kgx_recorder_default_directory (void)
+{
+  return g_file_new_build_filename (g_get_user_state_dir (),
+                                    KGX_BIN_NAME,
+                                    "logs",
+                                    NULL);
+}
@@ -0,0 +1,39 @@
+/* kgx-recorder.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define KGX_TYPE_RECORDER kgx_recorder_get_type ()
+G_DECLARE_FINAL_TYPE (KgxRecorder, kgx_recorder, KGX, RECORDER, GObject)
+
+
+KgxRecorder          *kgx_recorder_new               (GFile          *directory,
+                                                      const char     *name,
+                                                      gboolean        compress);
+void                  kgx_recorder_write             (KgxRecorder    *self,
+                                                      const guint8   *data,
+                                                      gsize           len);
+void                  kgx_recorder_close             (KgxRecorder    *self);
+void                  kgx_recorder_wait_all          (void);
+GFile                *kgx_recorder_default_directory (void);
+
+G_END_DECLS
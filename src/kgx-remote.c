@@ -0,0 +1,384 @@
+/* kgx-remote.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-remote
+ * @title: Remote
+ * @short_description: Open terminals in an existing instance, quickly
+ *
+ * Scripts opening many terminals would otherwise bring up GTK, Adwaita
+ * and VTE each time just to forward their command line. When the options
+ * are only ones we understand here, and an instance is already running,
+ * they're sent straight to its `app.new-terminal` (or `app.open-layout`)
+ * action instead, without initialising any of that. Anything else falls
+ * back to the usual path
+ *
+ * The instance leaves a marker in the runtime directory whilst it's up,
+ * so a cold start doesn't touch the bus at all here and GApplication's
+ * own uniqueness handles the (rare) race
+ */
+
+#include "kgx-config.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "kgx-remote.h"
+
+
+/*
+ * Mirrors kgx_application_local_command_line()'s handling of -e, as the
+ * arguments after it belong to the command
+ */
+static void
+fix_command (char **argv)
+{
+  for (size_t i = 1; argv[i] != NULL; i++) {
+    if (g_str_equal (argv[i], "-e")) {
+      if (!(argv[i + 1] != NULL && argv[i + 2] == NULL)) {
+        argv[i][1] = '-';
+      }
+
+      break;
+    } else if (g_str_equal (argv[i], "--")) {
+      break;
+    }
+  }
+}
+
+
+/**
+ * kgx_remote_object_path:
+ * @id: an application id
+ *
+ * Returns: (transfer full): where the #GApplication with @id exports its
+ * actions
+ */
+char *
+kgx_remote_object_path (const char *id)
+{
+  char *path = g_strconcat ("/", id, NULL);
+
+  /* As GApplication does */
+  for (char *c = path; *c; c++) {
+    if (*c == '.') {
+      *c = '/';
+    } else if (*c == '-') {
+      *c = '_';
+    }
+  }
+
+  return path;
+}
+
+
+static char *
+running_marker (void)
+{
+  return g_build_filename (g_get_user_runtime_dir (),
+                           KGX_APPLICATION_ID ".running",
+                           NULL);
+}
+
+
+/**
+ * kgx_remote_set_running:
+ * @running: whether the primary instance is up
+ *
+ * Called by the primary instance, so kgx_remote_try() knows whether it's
+ * worth asking
+ */
+void
+kgx_remote_set_running (gboolean running)
+{
+  g_autofree char *marker = running_marker ();
+  g_autoptr (GError) error = NULL;
+
+  if (!running) {
+    g_unlink (marker);
+  } else if (!g_file_set_contents (marker, "", 0, &error)) {
+    g_debug ("remote: can't mark running (%s)", error->message);
+  }
+}
+
+
+static GVariant *
+build_platform_data (void)
+{
+  g_autoptr (GVariantDict) data = g_variant_dict_new (NULL);
+  const char *token;
+
+  /* So the instance is allowed to raise the window */
+  token = g_getenv ("XDG_ACTIVATION_TOKEN");
+  if (token && token[0]) {
+    g_variant_dict_insert (data, "activation-token", "s", token);
+  }
+
+  token = g_getenv ("DESKTOP_STARTUP_ID");
+  if (token && token[0]) {
+    g_variant_dict_insert (data, "desktop-startup-id", "s", token);
+  }
+
+  return g_variant_dict_end (data);
+}
+
+
+static GVariant *
+build_new_terminal (const char *working_dir,
+                    const char *command,
+                    GStrv       remaining,
+                    const char *title,
+                    gboolean    tab)
+{
+  g_autoptr (GVariantDict) options = g_variant_dict_new (NULL);
+
+  if (working_dir) {
+    g_autoptr (GFile) file = g_file_new_for_commandline_arg (working_dir);
+    g_autofree char *path = g_file_get_path (file);
+
+    if (!path) {
+      return NULL;
+    }
+
+    g_variant_dict_insert (options, "working-directory", "^ay", path);
+  } else {
+    g_autofree char *cwd = g_get_current_dir ();
+
+    g_variant_dict_insert (options, "working-directory", "^ay", cwd);
+  }
+
+  if (command) {
+    g_variant_dict_insert (options, "command", "^ay", command);
+  } else if (remaining && remaining[0]) {
+    g_variant_dict_insert (options, "argv", "^aay", remaining);
+  }
+
+  if (title) {
+    g_variant_dict_insert (options, "title", "s", title);
+  }
+
+  g_variant_dict_insert (options, "tab", "b", tab);
+
+  return g_variant_dict_end (options);
+}
+
+
+static GVariant *
+build_layout (const char *layout)
+{
+  g_autoptr (GFile) file = g_file_new_for_commandline_arg (layout);
+  g_autoptr (GFile) base = g_file_get_parent (file);
+  g_autofree char *contents = NULL;
+
+  /* Errors are for the full application to report */
+  if (!base ||
+      !g_file_peek_path (base) ||
+      !g_file_load_contents (file, NULL, &contents, NULL, NULL, NULL) ||
+      !g_utf8_validate (contents, -1, NULL)) {
+    return NULL;
+  }
+
+  return g_variant_new ("(s^ay)", contents, g_file_peek_path (base));
+}
+
+
+/**
+ * kgx_remote_try:
+ * @argc: as passed to main()
+ * @argv: as passed to main()
+ * @exit_status: (out): what to exit with when handled
+ *
+ * Try and have a running instance deal with @argv
+ *
+ * Returns: %TRUE if it was dealt with, and we're done
+ */
+gboolean
+kgx_remote_try (int    argc,
+                char **argv,
+                int   *exit_status)
+{
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GDBusConnection) bus = NULL;
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree char *object_path = NULL;
+  g_autofree char *marker = NULL;
+  g_autofree char *working_dir = NULL;
+  g_autofree char *command = NULL;
+  g_autofree char *title = NULL;
+  g_autofree char *layout = NULL;
+  g_auto (GStrv) remaining = NULL;
+  g_auto (GStrv) args = NULL;
+  gboolean tab = FALSE;
+  const char *action = "new-terminal";
+  GVariant *parameter;
+  const GOptionEntry entries[] = {
+    { "tab", 0, 0, G_OPTION_ARG_NONE, &tab, NULL, NULL },
+    { "command", 'e', 0, G_OPTION_ARG_FILENAME, &command, NULL, NULL },
+    { "working-directory", 0, 0, G_OPTION_ARG_FILENAME, &working_dir, NULL, NULL },
+    { "title", 'T', 0, G_OPTION_ARG_STRING, &title, NULL, NULL },
+    { "layout", 0, 0, G_OPTION_ARG_FILENAME, &layout, NULL, NULL },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &remaining, NULL, NULL },
+    { NULL }
+  };
+
+  g_return_val_if_fail (exit_status != NULL, FALSE);
+
+  if (argc < 1) {
+    return FALSE;
+  }
+
+  args = g_strdupv (argv);
+  fix_command (args);
+
+  context = g_option_context_new (NULL);
+  g_option_context_set_help_enabled (context, FALSE);
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  /* Anything unusual (including --help) is for the full application */
+  if (!g_option_context_parse_strv (context, &args, NULL)) {
+    return FALSE;
+  }
+
+  if (command && remaining && remaining[0]) {
+    /* Let the application complain about that */
+    return FALSE;
+  }
+
+  if (layout && (tab || command || working_dir || title || (remaining && remaining[0]))) {
+    return FALSE;
+  }
+
+  /* Nothing running, so don't hold up the cold start. Should it be stale
+   * the call below just fails */
+  marker = running_marker ();
+  if (!g_file_test (marker, G_FILE_TEST_EXISTS)) {
+    return FALSE;
+  }
+
+  bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+  if (!bus) {
+    return FALSE;
+  }
+
+  if (layout) {
+    action = "open-layout";
+    parameter = build_layout (layout);
+  } else {
+    parameter = build_new_terminal (working_dir, command, remaining, title, tab);
+  }
+
+  if (!parameter) {
+    return FALSE;
+  }
+
+  parameter = g_variant_new_variant (parameter);
+  object_path = kgx_remote_object_path (KGX_APPLICATION_ID);
+
+  /* Only ever talk to a running instance, if there isn't one we're it */
+  reply = g_dbus_connection_call_sync (bus,
+                                       KGX_APPLICATION_ID,
+                                       object_path,
+                                       "org.gtk.Actions",
+                                       "Activate",
+                                       g_variant_new ("(s@av@a{sv})",
+                                                      action,
+                                                      g_variant_new_array (G_VARIANT_TYPE_VARIANT,
+                                                                           &parameter,
+                                                                           1),
+                                                      build_platform_data ()),
+                                       NULL,
+                                       G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                       -1,
+                                       NULL,
+                                       &error);
+  if (!reply) {
+    g_debug ("remote: falling back (%s)", error->message);
+
+    return FALSE;
+  }
+
+  *exit_status = EXIT_SUCCESS;
+
+  return TRUE;
+}
+
+
+static void
+activated (GObject      *source,
+           GAsyncResult *res,
+           gpointer      user_data)
+{
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree char *action = user_data;
+
+  reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source),
+                                         res,
+                                         &error);
+  if (!reply) {
+    g_warning ("remote: couldn’t activate %s: %s", action, error->message);
+  }
+}
+
+
+/**
+ * kgx_remote_activate:
+ * @bus: the connection to use
+ * @app_id: the instance to talk to
+ * @action: the name of an `app.` action
+ * @parameter: (nullable): for @action, floating references are consumed
+ *
+ * Activate @action in another instance, without waiting for it
+ */
+void
+kgx_remote_activate (GDBusConnection *bus,
+                     const char      *app_id,
+                     const char      *action,
+                     GVariant        *parameter)
+{
+  g_autofree char *object_path = NULL;
+  GVariantBuilder params;
+
+  g_return_if_fail (G_IS_DBUS_CONNECTION (bus));
+  g_return_if_fail (app_id != NULL);
+  g_return_if_fail (action != NULL);
+
+  g_variant_builder_init (&params, G_VARIANT_TYPE ("av"));
+  if (parameter) {
+    g_variant_builder_add (&params, "v", parameter);
+  }
+
+  object_path = kgx_remote_object_path (app_id);
+
+  g_dbus_connection_call (bus,
+                          app_id,
+                          object_path,
+                          "org.gtk.Actions",
+                          "Activate",
+                          g_variant_new ("(s@av@a{sv})",
+                                         action,
+                                         g_variant_builder_end (&params),
+                                         g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0)),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                          -1,
+                          NULL,
+                          activated,
+                          g_strdup (action));
+}
@@ -0,0 +1,35 @@
+/* kgx-remote.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+gboolean              kgx_remote_try            (int               argc,
+                                                 char            **argv,
+                                                 int              *exit_status);
+char                 *kgx_remote_object_path    (const char       *id);
+void                  kgx_remote_set_running    (gboolean          running);
+void                  kgx_remote_activate       (GDBusConnection  *bus,
+                                                 const char       *app_id,
+                                                 const char       *action,
+                                                 GVariant         *parameter);
+
+G_END_DECLS
@@ -0,0 +1,922 @@
+/* kgx-replay-tab.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-replay-tab
+ * @title: KgxReplayTab
+ * @short_description: #KgxTab that plays back recorded output
+ *
+ * Feeds a recording, either raw output (as written by #KgxRecorder or
+ * `script`, optionally gzipped) or an asciicast v2 file, into the
+ * terminal. Mostly useful for reproducible benchmarks, see `--replay`
+ */
+
+#include "kgx-config.h"
+
+#include <glib/gi18n.h>
+#include <string.h>
+
+#include "kgx-terminal.h"
+#include "kgx-replay-tab.h"
+
+/* How much we feed before giving the main loop a turn */
+#define CHUNK_SIZE (64 * 1024)
+
+
+typedef struct {
+  gint64 time;   /* µs from the start of the recording */
+  gsize  offset; /* into Recording.data */
+  gsize  length;
+} ReplayEvent;
+
+
+typedef struct {
+  GByteArray *data;
+  GArray     *events;
+} Recording;
+
+
+static void
+recording_free (gpointer data)
+{
+  Recording *self = data;
+
+  g_clear_pointer (&self->data, g_byte_array_unref);
+  g_clear_pointer (&self->events, g_array_unref);
+
+  g_free (self);
+}
+
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (Recording, recording_free)
+
+
+struct _KgxReplayTab {
+  KgxTab        parent_instance;
+
+  GFile        *file;
+  double        speed;
+
+  GtkWidget    *terminal;
+  GCancellable *load_cancellable;
+
+  Recording    *recording;
+  guint         next_event;
+  gsize         next_offset;
+  gint64        started_at;
+  guint         play_source;
+  gboolean      playing;
+};
+
+
+G_DEFINE_TYPE (KgxReplayTab, kgx_replay_tab, KGX_TYPE_TAB)
+
+enum {
+  PROP_0,
+  PROP_FILE,
+  PROP_SPEED,
+  PROP_PLAYING,
+  PROP_LENGTH,
+  LAST_PROP
+};
+static GParamSpec *pspecs[LAST_PROP] = { NULL, };
+
+
+static void
+kgx_replay_tab_dispose (GObject *object)
+{
+  KgxReplayTab *self = KGX_REPLAY_TAB (object);
+
+  g_cancellable_cancel (self->load_cancellable);
+  g_clear_object (&self->load_cancellable);
+
+  g_clear_handle_id (&self->play_source, g_source_remove);
+
+  g_clear_object (&self->file);
+  g_clear_pointer (&self->recording, recording_free);
+
+  G_OBJECT_CLASS (kgx_replay_tab_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_replay_tab_set_property (GObject      *object,
+                             guint         property_id,
+                             const GValue *value,
+                             GParamSpec   *pspec)
+{
+  KgxReplayTab *self = KGX_REPLAY_TAB (object);
+
+  switch (property_id) {
+    case PROP_FILE:
+      g_set_object (&self->file, g_value_get_object (value));
+      break;
+    case PROP_SPEED:
+      self->speed = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+static void
+kgx_replay_tab_get_property (GObject    *object,
+                             guint       property_id,
+                             GValue     *value,
+                             GParamSpec *pspec)
+{
+  KgxReplayTab *self = KGX_REPLAY_TAB (object);
+
+  switch (property_id) {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+    case PROP_SPEED:
+      g_value_set_double (value, self->speed);
+      break;
+    case PROP_PLAYING:
+      g_value_set_boolean (value, self->playing);
+      break;
+    case PROP_LENGTH:
+      g_value_set_uint64 (value, kgx_replay_tab_get_length (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+static inline const char *
+skip_space (const char *p, const char *end)
+{
+  while (p < end && g_ascii_isspace (*p)) {
+    p++;
+  }
+
+  return p;
+}
+
+
+/*
+ * Just enough JSON for asciicast, where each line is one value and we
+ * only ever need the numbers and strings out of it
+ */
+#define MAX_DEPTH 32
+
+
+static gboolean
+read_hex4 (const char **p, const char *end, gunichar *value)
+{
+  *value = 0;
+
+  if (end - *p < 4) {
+    return FALSE;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    int digit = g_ascii_xdigit_value ((*p)[i]);
+
+    if (digit < 0) {
+      return FALSE;
+    }
+
+    *value = (*value << 4) | digit;
+  }
+
+  *p += 4;
+
+  return TRUE;
+}
+
+
+static gboolean
+read_string (const char **p, const char *end, GByteArray *out)
+{
+  const char *c = skip_space (*p, end);
+
+  if (c >= end || *c != '"') {
+    return FALSE;
+  }
+  c++;
+
+  while (c < end) {
+    const char *run = c;
+    char utf8[6];
+    gunichar ch;
+
+    /* Copy unescaped runs in one go */
+    while (c < end && *c != '"' && *c != '\\') {
+      c++;
+    }
+
+    if (out && c > run) {
+      g_byte_array_append (out, (const guint8 *) run, c - run);
+    }
+
+    if (c >= end) {
+      return FALSE;
+    }
+
+    if (*c == '"') {
+      *p = c + 1;
+      return TRUE;
+    }
+
+    /* Backslash */
+    c++;
+    if (c >= end) {
+      return FALSE;
+    }
+
+    switch (*c++) {
+      case '"':
+      case '\\':
+      case '/':
+        ch = c[-1];
+        break;
+      case 'b':
+        ch = '\b';
+        break;
+      case 'f':
+        ch = '\f';
+        break;
+      case 'n':
+        ch = '\n';
+        break;
+      case 'r':
+        ch = '\r';
+        break;
+      case 't':
+        ch = '\t';
+        break;
+      case 'u':
+        if (!read_hex4 (&c, end, &ch)) {
+          return FALSE;
+        }
+
+        if (ch >= 0xd800 && ch < 0xdc00 &&
+            end - c >= 6 && c[0] == '\\' && c[1] == 'u') {
+          const char *next = c + 2;
+          gunichar low;
+
+          if (read_hex4 (&next, end, &low) && low >= 0xdc00 && low < 0xe000) {
+            ch = 0x10000 + ((ch - 0xd800) << 10) + (low - 0xdc00);
+            c = next;
+          }
+        }
+
+        /* Half a pair, as a truncated recording might have */
+        if (ch >= 0xd800 && ch < 0xe000) {
+          ch = 0xfffd;
+        }
+        break;
+      default:
+        return FALSE;
+    }
+
+    if (out) {
+      g_byte_array_append (out, (const guint8 *) utf8, g_unichar_to_utf8 (ch, utf8));
+    }
+  }
+
+  return FALSE;
+}
+
+
+static gboolean
+read_number (const char **p, const char *end, double *value)
+{
+  char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+  const char *c = skip_space (*p, end);
+  char *num_end;
+  gsize len = 0;
+
+  while (c + len < end && len < sizeof (buffer) - 1 &&
+         (g_ascii_isdigit (c[len]) || (c[len] != '\0' && strchr ("+-.eE", c[len])))) {
+    len++;
+  }
+
+  if (len == 0) {
+    return FALSE;
+  }
+
+  memcpy (buffer, c, len);
+  buffer[len] = '\0';
+
+  *value = g_ascii_strtod (buffer, &num_end);
+  if (num_end == buffer) {
+    return FALSE;
+  }
+
+  *p = c + (num_end - buffer);
+
+  return TRUE;
+}
+
+
+static gboolean
+read_literal (const char **p, const char *end, const char *literal)
+{
+  const char *c = skip_space (*p, end);
+  gsize len = strlen (literal);
+
+  if ((gsize) (end - c) < len || memcmp (c, literal, len) != 0) {
+    return FALSE;
+  }
+
+  *p = c + len;
+
+  return TRUE;
+}
+
+
+static gboolean
+expect (const char **p, const char *end, char what)
+{
+  const char *c = skip_space (*p, end);
+
+  if (c >= end || *c != what) {
+    return FALSE;
+  }
+
+  *p = c + 1;
+
+  return TRUE;
+}
+
+
+/*
+ * Step over whatever comes next, such as the members of the header we
+ * don't care about
+ */
+static gboolean
+skip_value (const char **p, const char *end, guint depth)
+{
+  const char *c = skip_space (*p, end);
+  double number;
+  char close;
+
+  if (c >= end || depth > MAX_DEPTH) {
+    return FALSE;
+  }
+
+  if (*c == '"') {
+    return read_string (p, end, NULL);
+  }
+
+  if (*c != '{' && *c != '[') {
+    return read_literal (p, end, "true") ||
+      read_literal (p, end, "false") ||
+      read_literal (p, end, "null") ||
+      read_number (p, end, &number);
+  }
+
+  close = *c == '{' ? '}' : ']';
+  *p = c + 1;
+
+  if (expect (p, end, close)) {
+    return TRUE;
+  }
+
+  do {
+    if (close == '}' && (!read_string (p, end, NULL) || !expect (p, end, ':'))) {
+      return FALSE;
+    }
+
+    if (!skip_value (p, end, depth + 1)) {
+      return FALSE;
+    }
+  } while (expect (p, end, ','));
+
+  return expect (p, end, close);
+}
+
+
+/* {"version": 2, "width": 80, ...} */
+static gboolean
+read_version (const char *line, const char *end, double *version)
+{
+  g_autoptr (GByteArray) key = g_byte_array_new ();
+  const char *p = line;
+
+  *version = 0;
+
+  if (!expect (&p, end, '{')) {
+    return FALSE;
+  }
+
+  if (expect (&p, end, '}')) {
+    return TRUE;
+  }
+
+  do {
+    g_byte_array_set_size (key, 0);
+
+    if (!read_string (&p, end, key) || !expect (&p, end, ':')) {
+      return FALSE;
+    }
+
+    if (key->len == strlen ("version") &&
+        memcmp (key->data, "version", key->len) == 0) {
+      if (!read_number (&p, end, version)) {
+        return FALSE;
+      }
+    } else if (!skip_value (&p, end, 0)) {
+      return FALSE;
+    }
+  } while (expect (&p, end, ','));
+
+  return expect (&p, end, '}') && skip_space (p, end) == end;
+}
+
+
+/* [time, "o", "data"] */
+static gboolean
+parse_event (const char *line,
+             const char *end,
+             Recording  *recording)
+{
+  g_autoptr (GByteArray) code = g_byte_array_new ();
+  const char *p = line;
+  ReplayEvent event = { 0, };
+  double time;
+
+  if (!expect (&p, end, '[') ||
+      !read_number (&p, end, &time) ||
+      !expect (&p, end, ',') ||
+      !read_string (&p, end, code) ||
+      !expect (&p, end, ',')) {
+    return FALSE;
+  }
+
+  /* Only output interests us, skip input/markers/resizes */
+  if (code->len != 1 || code->data[0] != 'o') {
+    return skip_value (&p, end, 0) && expect (&p, end, ']');
+  }
+
+  event.time = (gint64) (time * G_USEC_PER_SEC);
+  event.offset = recording->data->len;
+
+  if (!read_string (&p, end, recording->data) || !expect (&p, end, ']')) {
+    g_byte_array_set_size (recording->data, event.offset);
+    return FALSE;
+  }
+
+  event.length = recording->data->len - event.offset;
+
+  if (event.length > 0) {
+    g_array_append_val (recording->events, event);
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+parse_asciicast (const char  *contents,
+                 gsize        length,
+                 Recording   *recording,
+                 GError     **error)
+{
+  const char *end = contents + length;
+  const char *line = contents;
+  const char *line_end;
+  double version = 0;
+  gsize line_no = 1;
+
+  line_end = memchr (line, '\n', end - line);
+  if (!line_end) {
+    line_end = end;
+  }
+
+  /* The header is a single object, the version is all we care about */
+  if (!read_version (line, line_end, &version)) {
+    g_set_error_literal (error,
+                         G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "Bad asciicast header");
+    return FALSE;
+  }
+
+  if (version != 2) {
+    g_set_error_literal (error,
+                         G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Only asciicast version 2 is supported");
+    return FALSE;
+  }
+
+  while (line_end < end) {
+    line = line_end + 1;
+    line_no++;
+
+    line_end = memchr (line, '\n', end - line);
+    if (!line_end) {
+      line_end = end;
+    }
+
+    if (skip_space (line, line_end) == line_end) {
+      continue;
+    }
+
+    if (!parse_event (line, line_end, recording)) {
+      g_set_error (error,
+                   G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Bad event on line %" G_GSIZE_FORMAT, line_no);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+
+/*
+ * Opens @file, decompressing it on the way if it's one of the .log.gz
+ * files #KgxRecorder writes (or any other gzip)
+ */
+static GInputStream *
+open_recording (GFile         *file,
+                GCancellable  *cancellable,
+                GError       **error)
+{
+  g_autoptr (GFileInputStream) stream = NULL;
+  g_autoptr (GInputStream) buffered = NULL;
+  g_autoptr (GZlibDecompressor) decompressor = NULL;
+  const guint8 *magic;
+  gsize available;
+
+  stream = g_file_read (file, cancellable, error);
+  if (!stream) {
+    return NULL;
+  }
+
+  buffered = g_buffered_input_stream_new (G_INPUT_STREAM (stream));
+  if (g_buffered_input_stream_fill (G_BUFFERED_INPUT_STREAM (buffered),
+                                    2,
+                                    cancellable,
+                                    error) < 0) {
+    return NULL;
+  }
+
+  magic = g_buffered_input_stream_peek_buffer (G_BUFFERED_INPUT_STREAM (buffered),
+                                               &available);
+  if (available < 2 || magic[0] != 0x1f || magic[1] != 0x8b) {
+    return g_steal_pointer (&buffered);
+  }
+
+  decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+
+  return g_converter_input_stream_new (buffered, G_CONVERTER (decompressor));
+}
+
+
+static void
+load_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  g_autoptr (Recording) recording = g_new0 (Recording, 1);
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GInputStream) stream = NULL;
+  g_autoptr (GOutputStream) memory = NULL;
+  g_autofree char *contents = NULL;
+  GFile *file = task_data;
+  const char *start;
+  gsize length;
+
+  stream = open_recording (file, cancellable, &error);
+  if (!stream) {
+    g_task_return_error (task, g_steal_pointer (&error));
+    return;
+  }
+
+  memory = g_memory_output_stream_new_resizable ();
+  if (g_output_stream_splice (memory,
+                              stream,
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                              cancellable,
+                              &error) < 0) {
+    g_task_return_error (task, g_steal_pointer (&error));
+    return;
+  }
+
+  length = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (memory));
+  contents = g_memory_output_stream_steal_data (G_MEMORY_OUTPUT_STREAM (memory));
+
+  recording->events = g_array_new (FALSE, FALSE, sizeof (ReplayEvent));
+
+  start = skip_space (contents, contents + length);
+
+  if (start < contents + length && *start == '{') {
+    recording->data = g_byte_array_sized_new (length);
+
+    if (!parse_asciicast (contents, length, recording, &error)) {
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+  } else {
+    /* Raw output has no timing, it all happens at once */
+    ReplayEvent event = { 0, 0, length };
+
+    recording->data = g_byte_array_new_take ((guint8 *) g_steal_pointer (&contents),
+                                             length);
+    g_array_append_val (recording->events, event);
+  }
+
+  g_task_return_pointer (task, g_steal_pointer (&recording), recording_free);
+}
+
+
+static void
+set_playing (KgxReplayTab *self, gboolean playing)
+{
+  if (self->playing == playing) {
+    return;
+  }
+
+  self->playing = playing;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_PLAYING]);
+}
+
+
+static gboolean play_tick (gpointer data);
+
+
+static void
+schedule_tick (KgxReplayTab *self, gint64 now)
+{
+  ReplayEvent *event;
+  gint64 due;
+
+  if (self->speed <= 0 || self->next_offset > 0) {
+    self->play_source = g_idle_add (play_tick, self);
+    g_source_set_name_by_id (self->play_source, "[kgx] replay");
+    return;
+  }
+
+  event = &g_array_index (self->recording->events,
+                          ReplayEvent,
+                          self->next_event);
+  due = self->started_at + (gint64) (event->time / self->speed);
+
+  self->play_source = g_timeout_add (MAX (due - now, 0) / 1000, play_tick, self);
+  g_source_set_name_by_id (self->play_source, "[kgx] replay");
+}
+
+
+static gboolean
+play_tick (gpointer data)
+{
+  KgxReplayTab *self = data;
+  GArray *events = self->recording->events;
+  gint64 now = g_get_monotonic_time ();
+  gsize budget = CHUNK_SIZE;
+
+  self->play_source = 0;
+
+  while (self->next_event < events->len && budget > 0) {
+    ReplayEvent *event = &g_array_index (events, ReplayEvent, self->next_event);
+    gsize length;
+
+    if (self->speed > 0 && self->next_offset == 0 &&
+        self->started_at + (gint64) (event->time / self->speed) > now) {
+      break;
+    }
+
+    length = MIN (event->length - self->next_offset, budget);
+
+    vte_terminal_feed (VTE_TERMINAL (self->terminal),
+                       (const char *) self->recording->data->data + event->offset + self->next_offset,
+                       length);
+
+    budget -= length;
+    self->next_offset += length;
+
+    if (self->next_offset >= event->length) {
+      self->next_event++;
+      self->next_offset = 0;
+    }
+  }
+
+  if (self->next_event < events->len) {
+    schedule_tick (self, now);
+  } else {
+    g_debug ("replay: finished after %" G_GINT64_FORMAT "ms",
+             (g_get_monotonic_time () - self->started_at) / 1000);
+
+    set_playing (self, FALSE);
+    kgx_tab_died (KGX_TAB (self),
+                  GTK_MESSAGE_INFO,
+    // translators: <b> </b> marks the text as bold, ensure they are
+    // matched please!
+                  _("<b>Read Only</b> — Replay finished"),
+                  TRUE);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+loaded (GObject      *source,
+        GAsyncResult *res,
+        gpointer      user_data)
+{
+  g_autoptr (GTask) task = user_data;
+  g_autoptr (Recording) recording = NULL;
+  g_autoptr (GError) error = NULL;
+  KgxReplayTab *self = g_task_get_source_object (task);
+
+  recording = g_task_propagate_pointer (G_TASK (res), &error);
+
+  if (error) {
+    g_autofree char *message = NULL;
+
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+    // translators: <b> </b> marks the text as bold, ensure they are
+    // matched please!
+    message = g_strdup_printf (_("<b>Failed to start</b> — %s"),
+                               error->message);
+
+    kgx_tab_died (KGX_TAB (self), GTK_MESSAGE_ERROR, message, FALSE);
+
+    g_task_return_error (task, g_steal_pointer (&error));
+    return;
+  }
+
+  g_debug ("replay: loaded %u events, %u bytes",
+           recording->events->len,
+           recording->data->len);
+
+  self->recording = g_steal_pointer (&recording);
+  self->next_event = 0;
+  self->next_offset = 0;
+  self->started_at = g_get_monotonic_time ();
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_LENGTH]);
+  set_playing (self, TRUE);
+
+  schedule_tick (self, self->started_at);
+
+  /* No process involved */
+  g_task_return_int (task, 0);
+}
+
+
+static void
+kgx_replay_tab_start (KgxTab              *page,
+                      GAsyncReadyCallback  callback,
+                      gpointer             callback_data)
+{
+  KgxReplayTab *self;
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GTask) load = NULL;
+
+  g_return_if_fail (KGX_IS_REPLAY_TAB (page));
+
+  self = KGX_REPLAY_TAB (page);
+
+  g_return_if_fail (G_IS_FILE (self->file));
+
+  g_clear_handle_id (&self->play_source, g_source_remove);
+  g_clear_pointer (&self->recording, recording_free);
+  set_playing (self, FALSE);
+
+  if (self->load_cancellable) {
+    g_cancellable_reset (self->load_cancellable);
+  } else {
+    self->load_cancellable = g_cancellable_new ();
+  }
+
+  task = g_task_new (self, self->load_cancellable, callback, callback_data);
+  g_task_set_source_tag (task, kgx_replay_tab_start);
+
+  load = g_task_new (self, self->load_cancellable, loaded, g_steal_pointer (&task));
+  g_task_set_source_tag (load, load_thread);
+  g_task_set_task_data (load, g_object_ref (self->file), g_object_unref);
+  g_task_run_in_thread (load, load_thread);
+}
+
+
+static GPid
+kgx_replay_tab_start_finish (KgxTab        *page,
+                             GAsyncResult  *res,
+                             GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, page), 0);
+
+  return g_task_propagate_int (G_TASK (res), error);
+}
+
+
+static void
+kgx_replay_tab_class_init (KgxReplayTabClass *klass)
+{
+  GObjectClass   *object_class = G_OBJECT_CLASS   (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+  KgxTabClass    *tab_class    = KGX_TAB_CLASS    (klass);
+
+  object_class->dispose = kgx_replay_tab_dispose;
+  object_class->set_property = kgx_replay_tab_set_property;
+  object_class->get_property = kgx_replay_tab_get_property;
+
+  tab_class->start = kgx_replay_tab_start;
+  tab_class->start_finish = kgx_replay_tab_start_finish;
+
+  /**
+   * KgxReplayTab:file:
+   *
+   * The recording, raw output or asciicast v2
+   */
+  pspecs[PROP_FILE] =
+    g_param_spec_object ("file", NULL, NULL,
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * KgxReplayTab:speed:
+   *
+   * Multiplier for the recorded timing, 0 to play as fast as we can
+   */
+  pspecs[PROP_SPEED] =
+    g_param_spec_double ("speed", NULL, NULL,
+                         0.0, G_MAXDOUBLE, 1.0,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  pspecs[PROP_PLAYING] =
+    g_param_spec_boolean ("playing", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * KgxReplayTab:length:
+   *
+   * Bytes of output in the recording, once loaded
+   */
+  pspecs[PROP_LENGTH] =
+    g_param_spec_uint64 ("length", NULL, NULL,
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+
+  gtk_widget_class_set_template_from_resource (widget_class,
+                                               KGX_APPLICATION_PATH "kgx-replay-tab.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, KgxReplayTab, terminal);
+}
+
+
+static void
+kgx_replay_tab_init (KgxReplayTab *self)
+{
+  self->speed = 1.0;
+
+  gtk_widget_init_template (GTK_WIDGET (self));
+}
+
+
+gboolean
+kgx_replay_tab_get_playing (KgxReplayTab *self)
+{
+  g_return_val_if_fail (KGX_IS_REPLAY_TAB (self), FALSE);
+
+  return self->playing;
+}
+
+
+guint64
+kgx_replay_tab_get_length (KgxReplayTab *self)
+{
+  g_return_val_if_fail (KGX_IS_REPLAY_TAB (self), 0);
+
+  if (!self->recording) {
+    return 0;
+  }
+
+  return self->recording->data->len;
+}
@@ -0,0 +1,261 @@
+/* kgx-segments.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include "kgx-segments.h"
+
+/* Evicted segments are only dropped from the array in batches */
+#define COMPACT_THRESHOLD 64
+
+
+void
+kgx_segments_init (KgxSegments *self)
+{
+  self->segments = g_array_new (FALSE, FALSE, sizeof (KgxSegment));
+  self->head = 0;
+}
+
+
+void
+kgx_segments_clear (KgxSegments *self)
+{
+  g_clear_pointer (&self->segments, g_array_unref);
+  self->head = 0;
+}
+
+
+/**
+ * kgx_segments_reset:
+ * @self: the #KgxSegments
+ *
+ * Forget everything, for when the history is thrown away
+ */
+void
+kgx_segments_reset (KgxSegments *self)
+{
+  g_array_set_size (self->segments, 0);
+  self->head = 0;
+}
+
+
+static inline KgxSegment *
+last_segment (KgxSegments *self)
+{
+  if (self->head >= self->segments->len) {
+    return NULL;
+  }
+
+  return &g_array_index (self->segments, KgxSegment, self->segments->len - 1);
+}
+
+
+static inline KgxSegment *
+append (KgxSegments *self, glong prompt)
+{
+  KgxSegment segment = { prompt, -1, -1, -1, -1 };
+
+  g_array_append_val (self->segments, segment);
+
+  return last_segment (self);
+}
+
+
+/**
+ * kgx_segments_mark:
+ * @self: the #KgxSegments
+ * @kind: the mark the shell sent
+ * @row: where the cursor was when it did
+ * @exit_status: for %KGX_MARK_FINISHED
+ *
+ * Marks are expected in order, but shells vary in which they bother with,
+ * so anything missing is filled in as best we can
+ */
+void
+kgx_segments_mark (KgxSegments *self,
+                   KgxMarkKind  kind,
+                   glong        row,
+                   int          exit_status)
+{
+  KgxSegment *last = last_segment (self);
+
+  /* Going backwards means the history was cleared under us */
+  if (last && row < last->prompt) {
+    kgx_segments_reset (self);
+    last = NULL;
+  }
+
+  switch (kind) {
+    case KGX_MARK_PROMPT:
+      if (last && last->output >= 0 && last->end < 0) {
+        last->end = row;
+      }
+
+      /* Redrawn in place, say after a resize */
+      if (last && last->prompt == row && last->output < 0) {
+        break;
+      }
+
+      append (self, row);
+      break;
+    case KGX_MARK_INPUT:
+      if (!last || last->output >= 0) {
+        last = append (self, row);
+      }
+
+      last->command = row;
+      break;
+    case KGX_MARK_EXECUTED:
+      if (!last || last->output >= 0) {
+        last = append (self, row);
+      }
+
+      if (last->command < 0) {
+        last->command = last->prompt;
+      }
+      last->output = row;
+      break;
+    case KGX_MARK_FINISHED:
+      if (last && last->output >= 0 && last->end < 0) {
+        last->end = MAX (row, last->output);
+        last->exit_status = exit_status;
+      }
+      break;
+    default:
+      g_return_if_reached ();
+  }
+}
+
+
+/**
+ * kgx_segments_trim:
+ * @self: the #KgxSegments
+ * @first_row: the oldest row still in the scrollback
+ *
+ * Let go of prompts that have scrolled out of the history
+ */
+void
+kgx_segments_trim (KgxSegments *self,
+                   glong        first_row)
+{
+  while (self->head < self->segments->len &&
+         g_array_index (self->segments, KgxSegment, self->head).prompt < first_row) {
+    self->head++;
+  }
+
+  if (self->head >= COMPACT_THRESHOLD && self->head * 2 >= self->segments->len) {
+    g_array_remove_range (self->segments, 0, self->head);
+    self->head = 0;
+  }
+}
+
+
+gboolean
+kgx_segments_is_empty (KgxSegments *self)
+{
+  return self->head >= self->segments->len;
+}
+
+
+/*
+ * The index of the first segment with a prompt after @row, or the length
+ * if there isn't one
+ */
+static guint
+upper_bound (KgxSegments *self, glong row)
+{
+  guint lo = self->head;
+  guint hi = self->segments->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (self->segments, KgxSegment, mid).prompt <= row) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+
+/**
+ * kgx_segments_before:
+ * @self: the #KgxSegments
+ * @row: where to look back from
+ *
+ * Returns: (nullable): the closest segment with a prompt above @row
+ */
+const KgxSegment *
+kgx_segments_before (KgxSegments *self,
+                     glong        row)
+{
+  guint index = upper_bound (self, row - 1);
+
+  if (index <= self->head) {
+    return NULL;
+  }
+
+  return &g_array_index (self->segments, KgxSegment, index - 1);
+}
+
+
+/**
+ * kgx_segments_after:
+ * @self: the #KgxSegments
+ * @row: where to look on from
+ *
+ * Returns: (nullable): the closest segment with a prompt below @row
+ */
+const KgxSegment *
+kgx_segments_after (KgxSegments *self,
+                    glong        row)
+{
+  guint index = upper_bound (self, row);
+
+  if (index >= self->segments->len) {
+    return NULL;
+  }
+
+  return &g_array_index (self->segments, KgxSegment, index);
+}
+
+
+/**
+ * kgx_segments_last_finished:
+ * @self: the #KgxSegments
+ *
+ * Returns: (nullable): the most recent command that ran to completion
+ */
+const KgxSegment *
+kgx_segments_last_finished (KgxSegments *self)
+{
+  /* Almost always the last, or the one before the current prompt */
+  for (guint i = self->segments->len; i > self->head; i--) {
+    const KgxSegment *segment =
+      &g_array_index (self->segments, KgxSegment, i - 1);
+
+    if (segment->end >= 0) {
+      return segment;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,83 @@
+/* kgx-segments.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "kgx-marks.h"
+
+G_BEGIN_DECLS
+
+/**
+ * KgxSegment:
+ * @prompt: the row the prompt starts on
+ * @command: the row the user typed the command on, or -1
+ * @output: the first row of output, or -1 if it never ran
+ * @end: the row after the output, or -1 whilst it's running
+ * @exit_status: how it went, or -1 if we don't know
+ *
+ * One prompt and whatever was run from it, rows are counted from the
+ * start of the terminal's history, as VTE does
+ *
+ * Stability: Private
+ */
+typedef struct _KgxSegment KgxSegment;
+struct _KgxSegment {
+  glong  prompt;
+  glong  command;
+  glong  output;
+  glong  end;
+  int    exit_status;
+};
+
+
+/**
+ * KgxSegments:
+ * @segments: (element-type KgxSegment): oldest first
+ * @head: the first of @segments still in the scrollback
+ *
+ * The prompts in a terminal, in order, so they can be found by row
+ * without searching the text
+ *
+ * Stability: Private
+ */
+typedef struct _KgxSegments KgxSegments;
+struct _KgxSegments {
+  GArray  *segments;
+  guint    head;
+};
+
+
+void              kgx_segments_init          (KgxSegments *self);
+void              kgx_segments_clear         (KgxSegments *self);
+void              kgx_segments_reset         (KgxSegments *self);
+void              kgx_segments_mark          (KgxSegments *self,
+                                              KgxMarkKind  kind,
+                                              glong        row,
+                                              int          exit_status);
+void              kgx_segments_trim          (KgxSegments *self,
+                                              glong        first_row);
+gboolean          kgx_segments_is_empty      (KgxSegments *self);
+const KgxSegment *kgx_segments_before        (KgxSegments *self,
+                                              glong        row);
+const KgxSegment *kgx_segments_after         (KgxSegments *self,
+                                              glong        row);
+const KgxSegment *kgx_segments_last_finished (KgxSegments *self);
+
+G_END_DECLS
@@ -0,0 +1,1245 @@
+/* kgx-session.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-session
+ * @title: KgxSession
+ * @short_description: Journals open tabs so they survive a restart
+ *
+ * Each change to a tab appends a single line (a printed #GVariant) to a
+ * journal, later lines replacing earlier ones for the same tab. Writes
+ * are batched and happen on a worker, in order. Snapshots of terminal
+ * contents are taken a few at a time whilst the tab has changed, fetched
+ * in slices at idle priority and compressed on a worker. Once the journal
+ * has grown well past what it describes it's rewritten from scratch,
+ * again off the main thread
+ */
+
+#include "kgx-config.h"
+
+#include <string.h>
+
+#include "kgx-session.h"
+
+#define JOURNAL_NAME "journal"
+#define SNAPSHOT_SUFFIX ".snap"
+/* Let a burst of changes settle into one write */
+#define FLUSH_DELAY 1000
+#define SNAPSHOT_INTERVAL 30
+/* How many terminals to serialise per pass, so we never stall for long */
+#define SNAPSHOTS_PER_PASS 4
+#define COMPACT_SIZE (256 * 1024)
+
+
+typedef struct {
+  KgxSession  *session;
+  KgxTab      *tab;
+  KgxTerminal *terminal;
+  char        *key;
+  GStrv        argv;
+  char        *record;
+  gboolean     contents_dirty;
+} Entry;
+
+
+/*
+ * Snapshot:
+ * @session: set whilst it's being taken
+ * @key: the tab it's for
+ * @contents: once taken
+ */
+typedef struct {
+  KgxSession *session;
+  char       *key;
+  GBytes     *contents;
+} Snapshot;
+
+
+typedef struct {
+  guint64    serial;
+  GFile     *directory;
+  gboolean   clear;
+  gboolean   rewrite;
+  GBytes    *journal;
+  GStrv      keep;
+  GPtrArray *snapshots;
+  GPtrArray *removed;
+} Job;
+
+
+/**
+ * KgxSession:
+ * @entries: (element-type KgxTab Entry) the tabs being tracked
+ * @windows: (element-type GtkRoot guint) numbers for the windows we've
+ *           seen, only meaningful within a journal
+ * @loaded: the previous session has been read, until then we mustn't
+ *          write anything
+ * @needs_rewrite: the next write should replace the journal
+ * @pending: journal lines waiting to be written
+ * @writing: a #Job is in progress
+ * @journal_size: roughly how big the journal is now
+ * @snapshotting: snapshots yet to come back
+ * @write_lock: guards @jobs_written, the only thing workers touch
+ * @jobs_taken: serial of the last #Job handed out
+ * @jobs_written: serial of the last #Job a worker finished, they run
+ *                strictly in order
+ *
+ * Stability: Private
+ */
+struct _KgxSession {
+  GObject                   parent_instance;
+
+  KgxSettings              *settings;
+  GFile                    *directory;
+
+  GHashTable               *entries;
+  GHashTable               *windows;
+  guint                     next_window;
+
+  gboolean                  loaded;
+  gboolean                  stopped;
+  gboolean                  needs_rewrite;
+  gboolean                  needs_clear;
+  GString                  *pending;
+  GPtrArray                *pending_snapshots;
+  GPtrArray                *pending_removed;
+  gboolean                  writing;
+  gsize                     journal_size;
+  guint                     snapshotting;
+
+  GMutex                    write_lock;
+  GCond                     write_cond;
+  guint64                   jobs_taken;
+  guint64                   jobs_written;
+
+  guint                     flush_timeout;
+  guint                     snapshot_timeout;
+};
+
+
+G_DEFINE_TYPE (KgxSession, kgx_session, G_TYPE_OBJECT)
+
+
+enum {
+  PROP_0,
+  PROP_SETTINGS,
+  LAST_PROP
+};
+static GParamSpec *pspecs[LAST_PROP] = { NULL, };
+
+
+/**
+ * kgx_session_tab_free:
+ * @tab: the #KgxSessionTab
+ */
+void
+kgx_session_tab_free (KgxSessionTab *tab)
+{
+  g_clear_pointer (&tab->key, g_free);
+  g_clear_pointer (&tab->cwd, g_free);
+  g_clear_pointer (&tab->title, g_free);
+  g_clear_pointer (&tab->argv, g_strfreev);
+
+  g_free (tab);
+}
+
+
+static void
+snapshot_free (gpointer data)
+{
+  Snapshot *snapshot = data;
+
+  g_clear_object (&snapshot->session);
+  g_clear_pointer (&snapshot->key, g_free);
+  g_clear_pointer (&snapshot->contents, g_bytes_unref);
+
+  g_free (snapshot);
+}
+
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (Snapshot, snapshot_free)
+
+
+static void
+job_free (gpointer data)
+{
+  Job *job = data;
+
+  g_clear_object (&job->directory);
+  g_clear_pointer (&job->journal, g_bytes_unref);
+  g_clear_pointer (&job->keep, g_strfreev);
+  g_clear_pointer (&job->snapshots, g_ptr_array_unref);
+  g_clear_pointer (&job->removed, g_ptr_array_unref);
+
+  g_free (job);
+}
+
+
+static void tab_gone (gpointer data, GObject *where_the_object_was);
+
+
+static void
+entry_free (gpointer data)
+{
+  Entry *entry = data;
+
+  if (entry->terminal) {
+    g_signal_handlers_disconnect_by_data (entry->terminal, entry);
+    g_clear_weak_pointer (&entry->terminal);
+  }
+
+  if (entry->tab) {
+    g_signal_handlers_disconnect_by_data (entry->tab, entry);
+    g_object_weak_unref (G_OBJECT (entry->tab), tab_gone, entry);
+    entry->tab = NULL;
+  }
+
+  g_clear_pointer (&entry->key, g_free);
+  g_clear_pointer (&entry->argv, g_strfreev);
+  g_clear_pointer (&entry->record, g_free);
+
+  g_free (entry);
+}
+
+
+static void
+window_gone (gpointer data, GObject *where_the_object_was)
+{
+  KgxSession *self = data;
+
+  g_hash_table_remove (self->windows, where_the_object_was);
+}
+
+
+static void
+kgx_session_dispose (GObject *object)
+{
+  KgxSession *self = KGX_SESSION (object);
+
+  g_clear_handle_id (&self->flush_timeout, g_source_remove);
+  g_clear_handle_id (&self->snapshot_timeout, g_source_remove);
+
+  g_clear_pointer (&self->entries, g_hash_table_unref);
+
+  if (self->windows) {
+    GHashTableIter iter;
+    gpointer root;
+
+    g_hash_table_iter_init (&iter, self->windows);
+    while (g_hash_table_iter_next (&iter, &root, NULL)) {
+      g_object_weak_unref (root, window_gone, self);
+    }
+  }
+  g_clear_pointer (&self->windows, g_hash_table_unref);
+
+  if (self->settings) {
+    g_signal_handlers_disconnect_by_data (self->settings, self);
+  }
+  g_clear_object (&self->settings);
+  g_clear_object (&self->directory);
+
+  G_OBJECT_CLASS (kgx_session_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_session_finalize (GObject *object)
+{
+  KgxSession *self = KGX_SESSION (object);
+
+  g_string_free (self->pending, TRUE);
+  g_ptr_array_unref (self->pending_snapshots);
+  g_ptr_array_unref (self->pending_removed);
+
+  g_mutex_clear (&self->write_lock);
+  g_cond_clear (&self->write_cond);
+
+  G_OBJECT_CLASS (kgx_session_parent_class)->finalize (object);
+}
+
+
+static void schedule_flush (KgxSession *self);
+
+
+static void
+restore_session_changed (KgxSession *self)
+{
+  if (kgx_settings_get_restore_session (self->settings)) {
+    /* Start from what's open now */
+    self->needs_rewrite = TRUE;
+  } else {
+    /* Don't leave anything lying around */
+    self->needs_clear = TRUE;
+  }
+
+  schedule_flush (self);
+}
+
+
+static void
+kgx_session_set_property (GObject      *object,
+                          guint         property_id,
+                          const GValue *value,
+                          GParamSpec   *pspec)
+{
+  KgxSession *self = KGX_SESSION (object);
+
+  switch (property_id) {
+    case PROP_SETTINGS:
+      self->settings = g_value_dup_object (value);
+      g_signal_connect_swapped (self->settings,
+                                "notify::restore-session",
+                                G_CALLBACK (restore_session_changed),
+                                self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+static void
+kgx_session_get_property (GObject    *object,
+                          guint       property_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  KgxSession *self = KGX_SESSION (object);
+
+  switch (property_id) {
+    case PROP_SETTINGS:
+      g_value_set_object (value, self->settings);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+static void
+kgx_session_class_init (KgxSessionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = kgx_session_dispose;
+  object_class->finalize = kgx_session_finalize;
+  object_class->set_property = kgx_session_set_property;
+  object_class->get_property = kgx_session_get_property;
+
+  pspecs[PROP_SETTINGS] =
+    g_param_spec_object ("settings", NULL, NULL,
+                         KGX_TYPE_SETTINGS,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+}
+
+
+static void
+kgx_session_init (KgxSession *self)
+{
+  g_autofree char *directory = g_build_filename (g_get_user_state_dir (),
+                                                KGX_BIN_NAME,
+                                                "session",
+                                                NULL);
+
+  self->directory = g_file_new_for_path (directory);
+
+  self->entries = g_hash_table_new_full (g_direct_hash,
+                                         g_direct_equal,
+                                         NULL,
+                                         entry_free);
+  self->windows = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  self->pending = g_string_new (NULL);
+  self->pending_snapshots = g_ptr_array_new_with_free_func (snapshot_free);
+  self->pending_removed = g_ptr_array_new_with_free_func (g_free);
+
+  g_mutex_init (&self->write_lock);
+  g_cond_init (&self->write_cond);
+}
+
+
+/**
+ * kgx_session_new:
+ * @settings: the #KgxSettings to follow
+ *
+ * Returns: (transfer full): a new #KgxSession
+ */
+KgxSession *
+kgx_session_new (KgxSettings *settings)
+{
+  return g_object_new (KGX_TYPE_SESSION, "settings", settings, NULL);
+}
+
+
+static void
+write_journal (GFile     *file,
+               GBytes    *journal,
+               gboolean   rewrite,
+               GError   **error)
+{
+  g_autoptr (GFileOutputStream) stream = NULL;
+  gconstpointer data;
+  gsize len;
+
+  data = g_bytes_get_data (journal, &len);
+
+  if (rewrite) {
+    g_file_replace_contents (file,
+                             data,
+                             len,
+                             NULL,
+                             FALSE,
+                             G_FILE_CREATE_PRIVATE,
+                             NULL,
+                             NULL,
+                             error);
+    return;
+  }
+
+  if (len == 0) {
+    return;
+  }
+
+  stream = g_file_append_to (file, G_FILE_CREATE_PRIVATE, NULL, error);
+  if (!stream) {
+    return;
+  }
+
+  if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                  data,
+                                  len,
+                                  NULL,
+                                  NULL,
+                                  error)) {
+    return;
+  }
+
+  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error);
+}
+
+
+static void
+prune_snapshots (GFile *directory, GStrv keep)
+{
+  g_autoptr (GFileEnumerator) children = NULL;
+  GFileInfo *info;
+  GFile *child;
+
+  children = g_file_enumerate_children (directory,
+                                        G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                        G_FILE_QUERY_INFO_NONE,
+                                        NULL,
+                                        NULL);
+  if (!children) {
+    return;
+  }
+
+  while (g_file_enumerator_iterate (children, &info, &child, NULL, NULL) && info) {
+    const char *name = g_file_info_get_name (info);
+    g_autofree char *key = NULL;
+
+    if (!g_str_has_suffix (name, SNAPSHOT_SUFFIX)) {
+      continue;
+    }
+
+    key = g_strndup (name, strlen (name) - strlen (SNAPSHOT_SUFFIX));
+
+    if (!keep || !g_strv_contains ((const char *const *) keep, key)) {
+      g_file_delete (child, NULL, NULL);
+    }
+  }
+}
+
+
+static gboolean
+run_job (Job *job, GError **error)
+{
+  g_autoptr (GFile) journal = g_file_get_child (job->directory, JOURNAL_NAME);
+  g_autoptr (GError) local_error = NULL;
+
+  if (job->clear) {
+    g_file_delete (journal, NULL, NULL);
+    prune_snapshots (job->directory, NULL);
+    return TRUE;
+  }
+
+  if (!g_file_make_directory_with_parents (job->directory, NULL, &local_error) &&
+      !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+    g_propagate_error (error, g_steal_pointer (&local_error));
+    return FALSE;
+  }
+
+  for (guint i = 0; i < job->snapshots->len; i++) {
+    Snapshot *snapshot = g_ptr_array_index (job->snapshots, i);
+    g_autofree char *name = g_strconcat (snapshot->key, SNAPSHOT_SUFFIX, NULL);
+    g_autoptr (GFile) file = g_file_get_child (job->directory, name);
+
+    if (!g_file_replace_contents (file,
+                                  g_bytes_get_data (snapshot->contents, NULL),
+                                  g_bytes_get_size (snapshot->contents),
+                                  NULL,
+                                  FALSE,
+                                  G_FILE_CREATE_PRIVATE,
+                                  NULL,
+                                  NULL,
+                                  error)) {
+      return FALSE;
+    }
+  }
+
+  for (guint i = 0; i < job->removed->len; i++) {
+    g_autofree char *name = g_strconcat (g_ptr_array_index (job->removed, i),
+                                         SNAPSHOT_SUFFIX,
+                                         NULL);
+    g_autoptr (GFile) file = g_file_get_child (job->directory, name);
+
+    g_file_delete (file, NULL, NULL);
+  }
+
+  write_journal (journal, job->journal, job->rewrite, &local_error);
+  if (local_error) {
+    g_propagate_error (error, g_steal_pointer (&local_error));
+    return FALSE;
+  }
+
+  if (job->rewrite) {
+    prune_snapshots (job->directory, job->keep);
+  }
+
+  return TRUE;
+}
+
+
+static void
+write_thread (GTask        *task,
+              gpointer      source,
+              gpointer      data,
+              GCancellable *cancellable)
+{
+  KgxSession *self = source;
+  Job *job = data;
+  g_autoptr (GError) error = NULL;
+  gboolean success;
+
+  /* Appending out of order would let an old line replace a newer one */
+  g_mutex_lock (&self->write_lock);
+  while (self->jobs_written + 1 < job->serial) {
+    g_cond_wait (&self->write_cond, &self->write_lock);
+  }
+  g_mutex_unlock (&self->write_lock);
+
+  success = run_job (job, &error);
+
+  g_mutex_lock (&self->write_lock);
+  self->jobs_written = job->serial;
+  g_cond_broadcast (&self->write_cond);
+  g_mutex_unlock (&self->write_lock);
+
+  if (!success) {
+    g_task_return_error (task, g_steal_pointer (&error));
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+static guint
+window_id (KgxSession *self, GtkRoot *root)
+{
+  gpointer id;
+
+  if (!g_hash_table_lookup_extended (self->windows, root, NULL, &id)) {
+    id = GUINT_TO_POINTER (++self->next_window);
+    g_hash_table_insert (self->windows, root, id);
+    g_object_weak_ref (G_OBJECT (root), window_gone, self);
+  }
+
+  return GPOINTER_TO_UINT (id);
+}
+
+
+static char *
+build_record (KgxSession *self, Entry *entry)
+{
+  g_autoptr (GVariantDict) dict = NULL;
+  g_autoptr (GVariant) record = NULL;
+  g_autoptr (GFile) path = NULL;
+  g_autofree char *title = NULL;
+  GtkWidget *view;
+  AdwTabPage *page;
+
+  view = gtk_widget_get_ancestor (GTK_WIDGET (entry->tab), ADW_TYPE_TAB_VIEW);
+  if (!view) {
+    /* Between windows, we'll catch it next time */
+    return NULL;
+  }
+
+  page = adw_tab_view_get_page (ADW_TAB_VIEW (view), GTK_WIDGET (entry->tab));
+
+  g_object_get (entry->tab, "tab-path", &path, "tab-title", &title, NULL);
+
+  dict = g_variant_dict_new (NULL);
+  g_variant_dict_insert (dict, "tab", "s", entry->key);
+  g_variant_dict_insert (dict, "window", "u",
+                         window_id (self, gtk_widget_get_root (GTK_WIDGET (entry->tab))));
+  g_variant_dict_insert (dict, "position", "i",
+                         adw_tab_view_get_page_position (ADW_TAB_VIEW (view), page));
+  g_variant_dict_insert (dict, "selected", "b", adw_tab_page_get_selected (page));
+
+  if (path && g_file_peek_path (path)) {
+    g_variant_dict_insert (dict, "cwd", "^ay", g_file_peek_path (path));
+  }
+
+  if (title) {
+    g_variant_dict_insert (dict, "title", "s", title);
+  }
+
+  if (entry->argv) {
+    g_variant_dict_insert (dict, "argv", "^aay", entry->argv);
+  }
+
+  record = g_variant_ref_sink (g_variant_dict_end (dict));
+
+  return g_variant_print (record, TRUE);
+}
+
+
+static void
+record_entry (KgxSession *self, Entry *entry)
+{
+  g_autofree char *record = build_record (self, entry);
+
+  if (!record || g_strcmp0 (record, entry->record) == 0) {
+    return;
+  }
+
+  g_string_append (self->pending, record);
+  g_string_append_c (self->pending, '\n');
+
+  g_set_str (&entry->record, record);
+}
+
+
+static void flush (KgxSession *self);
+
+
+static void
+written (GObject      *source,
+         GAsyncResult *res,
+         gpointer      user_data)
+{
+  g_autoptr (GError) error = NULL;
+  KgxSession *self = KGX_SESSION (source);
+
+  self->writing = FALSE;
+
+  if (!g_task_propagate_boolean (G_TASK (res), &error)) {
+    g_warning ("session: couldn't save: %s", error->message);
+  }
+
+  if (self->pending->len > 0 ||
+      self->pending_snapshots->len > 0 ||
+      self->needs_rewrite ||
+      self->needs_clear) {
+    schedule_flush (self);
+  }
+}
+
+
+static Job *
+take_job (KgxSession *self)
+{
+  GHashTableIter iter;
+  Entry *entry;
+  Job *job;
+
+  job = g_new0 (Job, 1);
+  job->directory = g_object_ref (self->directory);
+
+  if (self->needs_clear || !kgx_settings_get_restore_session (self->settings)) {
+    job->clear = self->needs_clear;
+    self->needs_clear = FALSE;
+    self->needs_rewrite = FALSE;
+    self->journal_size = 0;
+
+    g_string_truncate (self->pending, 0);
+    g_ptr_array_set_size (self->pending_snapshots, 0);
+    g_ptr_array_set_size (self->pending_removed, 0);
+
+    /* Someone turned it back on in the meantime, start over */
+    if (kgx_settings_get_restore_session (self->settings)) {
+      self->needs_rewrite = TRUE;
+    }
+
+    if (!job->clear) {
+      job_free (job);
+      return NULL;
+    }
+
+    return job;
+  }
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry)) {
+    record_entry (self, entry);
+  }
+
+  if (self->needs_rewrite || self->journal_size > COMPACT_SIZE) {
+    g_autoptr (GString) journal = g_string_new (NULL);
+    g_autoptr (GStrvBuilder) keep = g_strv_builder_new ();
+
+    g_hash_table_iter_init (&iter, self->entries);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry)) {
+      g_strv_builder_add (keep, entry->key);
+
+      if (entry->record) {
+        g_string_append (journal, entry->record);
+        g_string_append_c (journal, '\n');
+      }
+    }
+
+    job->rewrite = TRUE;
+    job->keep = g_strv_builder_end (keep);
+    self->journal_size = journal->len;
+    self->needs_rewrite = FALSE;
+    job->journal = g_string_free_to_bytes (g_steal_pointer (&journal));
+
+    g_string_truncate (self->pending, 0);
+  } else {
+    self->journal_size += self->pending->len;
+    job->journal = g_bytes_new (self->pending->str, self->pending->len);
+
+    g_string_truncate (self->pending, 0);
+  }
+
+  job->snapshots = g_steal_pointer (&self->pending_snapshots);
+  self->pending_snapshots = g_ptr_array_new_with_free_func (snapshot_free);
+  job->removed = g_steal_pointer (&self->pending_removed);
+  self->pending_removed = g_ptr_array_new_with_free_func (g_free);
+
+  return job;
+}
+
+
+static void
+flush (KgxSession *self)
+{
+  g_autoptr (GTask) task = NULL;
+  Job *job;
+
+  if (!self->loaded || self->writing) {
+    return;
+  }
+
+  job = take_job (self);
+  if (!job) {
+    return;
+  }
+
+  self->writing = TRUE;
+  job->serial = ++self->jobs_taken;
+
+  task = g_task_new (self, NULL, written, NULL);
+  g_task_set_source_tag (task, flush);
+  g_task_set_task_data (task, job, job_free);
+  g_task_run_in_thread (task, write_thread);
+}
+
+
+static gboolean
+flush_timeout (gpointer data)
+{
+  KgxSession *self = data;
+
+  self->flush_timeout = 0;
+
+  flush (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+schedule_flush (KgxSession *self)
+{
+  if (self->flush_timeout || self->stopped || !self->loaded) {
+    return;
+  }
+
+  /* Nothing to write but the clearing up, we keep track of the tabs
+   * regardless so turning it on can start from them */
+  if (!kgx_settings_get_restore_session (self->settings) && !self->needs_clear) {
+    return;
+  }
+
+  self->flush_timeout = g_timeout_add (FLUSH_DELAY, flush_timeout, self);
+  g_source_set_name_by_id (self->flush_timeout, "[kgx] session flush");
+}
+
+
+static Entry *
+find_entry (KgxSession *self, const char *key)
+{
+  GHashTableIter iter;
+  Entry *entry;
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry)) {
+    if (g_str_equal (entry->key, key)) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void
+snapshot_taken (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr (Snapshot) snapshot = user_data;
+  g_autoptr (KgxSession) self = g_steal_pointer (&snapshot->session);
+  g_autoptr (GError) error = NULL;
+  Entry *entry;
+
+  snapshot->contents = kgx_terminal_snapshot_finish (KGX_TERMINAL (source), res, &error);
+
+  self->snapshotting--;
+
+  /* Closed in the meantime, or we're on the way out */
+  entry = self->entries ? find_entry (self, snapshot->key) : NULL;
+  if (!entry || self->stopped) {
+    return;
+  }
+
+  if (!snapshot->contents) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_warning ("session: couldn't snapshot: %s", error->message);
+    }
+    entry->contents_dirty = TRUE;
+    return;
+  }
+
+  g_ptr_array_add (self->pending_snapshots, g_steal_pointer (&snapshot));
+
+  schedule_flush (self);
+}
+
+
+static gboolean
+take_snapshots (gpointer data)
+{
+  KgxSession *self = data;
+  GHashTableIter iter;
+  Entry *entry;
+
+  /* Picks up tabs that moved, which we aren't told about */
+  schedule_flush (self);
+
+  if (!kgx_settings_get_restore_session (self->settings) ||
+      !kgx_settings_get_restore_scrollback (self->settings) ||
+      self->snapshotting > 0) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry) &&
+         self->snapshotting < SNAPSHOTS_PER_PASS) {
+    Snapshot *snapshot;
+
+    /* A hibernated terminal is empty, the last snapshot still stands */
+    if (!entry->contents_dirty ||
+        !entry->terminal ||
+        kgx_terminal_get_hibernated (entry->terminal)) {
+      continue;
+    }
+
+    entry->contents_dirty = FALSE;
+    self->snapshotting++;
+
+    snapshot = g_new0 (Snapshot, 1);
+    snapshot->session = g_object_ref (self);
+    snapshot->key = g_strdup (entry->key);
+
+    kgx_terminal_snapshot_async (entry->terminal,
+                                 NULL,
+                                 snapshot_taken,
+                                 snapshot);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+tab_gone (gpointer data, GObject *where_the_object_was)
+{
+  Entry *entry = data;
+  KgxSession *self = entry->session;
+  g_autoptr (GVariant) record = NULL;
+  g_autofree char *printed = NULL;
+
+  entry->tab = NULL;
+
+  if (!self->stopped && kgx_settings_get_restore_session (self->settings)) {
+    record = g_variant_ref_sink (g_variant_new_parsed ("{'close': <%s>}", entry->key));
+    printed = g_variant_print (record, TRUE);
+
+    g_string_append (self->pending, printed);
+    g_string_append_c (self->pending, '\n');
+
+    g_ptr_array_add (self->pending_removed, g_strdup (entry->key));
+
+    schedule_flush (self);
+  }
+
+  g_hash_table_remove (self->entries, where_the_object_was);
+}
+
+
+static void
+tab_changed (KgxTab *tab, GParamSpec *pspec, Entry *entry)
+{
+  schedule_flush (entry->session);
+}
+
+
+static void
+contents_changed (KgxTerminal *terminal, Entry *entry)
+{
+  entry->contents_dirty = TRUE;
+}
+
+
+/**
+ * kgx_session_add_tab:
+ * @self: the #KgxSession
+ * @tab: the #KgxTab to keep track of
+ * @key: (nullable): what @tab was known as, if it's being restored
+ * @argv: (nullable): what @tab is running, %NULL for the user's shell
+ *
+ * Journal @tab until it's closed
+ */
+void
+kgx_session_add_tab (KgxSession *self,
+                     KgxTab     *tab,
+                     const char *key,
+                     GStrv       argv)
+{
+  g_autoptr (KgxTerminal) terminal = NULL;
+  Entry *entry;
+
+  g_return_if_fail (KGX_IS_SESSION (self));
+  g_return_if_fail (KGX_IS_TAB (tab));
+
+  if (self->stopped) {
+    return;
+  }
+
+  entry = g_new0 (Entry, 1);
+  entry->session = self;
+  entry->tab = tab;
+  entry->key = key ? g_strdup (key) : g_uuid_string_random ();
+  entry->argv = g_strdupv (argv);
+  /* Restored contents still count */
+  entry->contents_dirty = TRUE;
+
+  g_object_weak_ref (G_OBJECT (tab), tab_gone, entry);
+  g_signal_connect (tab,
+                    "notify::tab-path", G_CALLBACK (tab_changed),
+                    entry);
+  g_signal_connect (tab,
+                    "notify::tab-title", G_CALLBACK (tab_changed),
+                    entry);
+
+  g_object_get (tab, "terminal", &terminal, NULL);
+  if (terminal) {
+    g_set_weak_pointer (&entry->terminal, terminal);
+    g_signal_connect (terminal,
+                      "contents-changed", G_CALLBACK (contents_changed),
+                      entry);
+  }
+
+  g_hash_table_insert (self->entries, tab, entry);
+
+  schedule_flush (self);
+}
+
+
+static gint
+compare_tabs (gconstpointer a, gconstpointer b)
+{
+  const KgxSessionTab *tab_a = *((KgxSessionTab **) a);
+  const KgxSessionTab *tab_b = *((KgxSessionTab **) b);
+
+  if (tab_a->window != tab_b->window) {
+    return tab_a->window < tab_b->window ? -1 : 1;
+  }
+
+  return tab_a->position - tab_b->position;
+}
+
+
+/**
+ * kgx_session_load:
+ * @self: the #KgxSession
+ *
+ * Read back the previous session, after which the current one is saved
+ * over it. Only the first call does anything
+ *
+ * Returns: (transfer container) (element-type KgxSessionTab) (nullable):
+ *          the tabs, ordered by window then position, or %NULL if there
+ *          aren't any to restore
+ */
+GPtrArray *
+kgx_session_load (KgxSession *self)
+{
+  g_autoptr (GHashTable) records = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GPtrArray) tabs = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree char *contents = NULL;
+  g_auto (GStrv) lines = NULL;
+  GHashTableIter iter;
+  GVariant *record;
+
+  g_return_val_if_fail (KGX_IS_SESSION (self), NULL);
+
+  if (self->loaded) {
+    return NULL;
+  }
+
+  self->loaded = TRUE;
+  self->needs_rewrite = TRUE;
+  schedule_flush (self);
+
+  self->snapshot_timeout = g_timeout_add_seconds (SNAPSHOT_INTERVAL, take_snapshots, self);
+  g_source_set_name_by_id (self->snapshot_timeout, "[kgx] session snapshots");
+
+  if (!kgx_settings_get_restore_session (self->settings)) {
+    return NULL;
+  }
+
+  file = g_file_get_child (self->directory, JOURNAL_NAME);
+  if (!g_file_load_contents (file, NULL, &contents, NULL, NULL, &error)) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+      g_warning ("session: couldn't load: %s", error->message);
+    }
+    return NULL;
+  }
+
+  records = g_hash_table_new_full (g_str_hash,
+                                   g_str_equal,
+                                   g_free,
+                                   (GDestroyNotify) g_variant_unref);
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (int i = 0; lines[i]; i++) {
+    g_autoptr (GVariant) line = NULL;
+    const char *key;
+
+    if (!lines[i][0]) {
+      continue;
+    }
+
+    /* The last line may be torn if we crashed mid-write */
+    line = g_variant_parse (G_VARIANT_TYPE_VARDICT, lines[i], NULL, NULL, NULL);
+    if (!line) {
+      g_debug ("session: skipping bad line %i", i);
+      continue;
+    }
+
+    if (g_variant_lookup (line, "close", "&s", &key)) {
+      g_hash_table_remove (records, key);
+    } else if (g_variant_lookup (line, "tab", "&s", &key)) {
+      g_hash_table_replace (records, g_strdup (key), g_steal_pointer (&line));
+    }
+  }
+
+  tabs = g_ptr_array_new_with_free_func ((GDestroyNotify) kgx_session_tab_free);
+
+  g_hash_table_iter_init (&iter, records);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &record)) {
+    KgxSessionTab *tab = g_new0 (KgxSessionTab, 1);
+
+    g_variant_lookup (record, "tab", "s", &tab->key);
+    g_variant_lookup (record, "window", "u", &tab->window);
+    g_variant_lookup (record, "position", "i", &tab->position);
+    g_variant_lookup (record, "selected", "b", &tab->selected);
+    g_variant_lookup (record, "cwd", "^ay", &tab->cwd);
+    g_variant_lookup (record, "title", "s", &tab->title);
+    g_variant_lookup (record, "argv", "^aay", &tab->argv);
+
+    g_ptr_array_add (tabs, tab);
+  }
+
+  if (tabs->len == 0) {
+    return NULL;
+  }
+
+  g_ptr_array_sort (tabs, compare_tabs);
+
+  g_debug ("session: loaded %u tabs", tabs->len);
+
+  return g_steal_pointer (&tabs);
+}
+
+
+static void
+snapshot_loaded (GObject      *source,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  g_autoptr (GTask) task = user_data;
+  g_autoptr (KgxTerminal) terminal = NULL;
+  g_autoptr (GBytes) contents = NULL;
+  g_autoptr (GError) error = NULL;
+  KgxTab *tab = g_task_get_task_data (task);
+
+  contents = g_file_load_bytes_finish (G_FILE (source), res, NULL, &error);
+  if (!contents) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+      g_warning ("session: couldn't restore contents: %s", error->message);
+    }
+
+    g_task_return_boolean (task, FALSE);
+    return;
+  }
+
+  g_object_get (tab, "terminal", &terminal, NULL);
+  if (terminal) {
+    kgx_terminal_restore (terminal, contents);
+
+    /* Leave the old prompt be, the new shell starts below it */
+    vte_terminal_feed (VTE_TERMINAL (terminal), "\r\n", -1);
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+/**
+ * kgx_session_restore_contents:
+ * @self: the #KgxSession
+ * @tab: a #KgxTab that hasn't been started
+ * @key: what @tab was previously known as
+ * @callback: called once done
+ * @callback_data: data for @callback
+ *
+ * Fill @tab with the contents it had last time, if we have them
+ */
+void
+kgx_session_restore_contents (KgxSession          *self,
+                              KgxTab              *tab,
+                              const char          *key,
+                              GAsyncReadyCallback  callback,
+                              gpointer             callback_data)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *name = NULL;
+
+  g_return_if_fail (KGX_IS_SESSION (self));
+  g_return_if_fail (KGX_IS_TAB (tab));
+  g_return_if_fail (key != NULL);
+
+  task = g_task_new (self, NULL, callback, callback_data);
+  g_task_set_source_tag (task, kgx_session_restore_contents);
+  g_task_set_task_data (task, g_object_ref (tab), g_object_unref);
+
+  if (!kgx_settings_get_restore_scrollback (self->settings)) {
+    g_task_return_boolean (task, FALSE);
+    return;
+  }
+
+  name = g_strconcat (key, SNAPSHOT_SUFFIX, NULL);
+  file = g_file_get_child (self->directory, name);
+
+  g_file_load_bytes_async (file, NULL, snapshot_loaded, g_steal_pointer (&task));
+}
+
+
+/**
+ * kgx_session_restore_contents_finish:
+ * @self: the #KgxSession
+ * @res: the #GAsyncResult
+ * @error: return location for a #GError
+ *
+ * Returns: %TRUE if there were contents to restore
+ */
+gboolean
+kgx_session_restore_contents_finish (KgxSession    *self,
+                                     GAsyncResult  *res,
+                                     GError       **error)
+{
+  g_return_val_if_fail (KGX_IS_SESSION (self), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+
+/**
+ * kgx_session_stop:
+ * @self: the #KgxSession
+ *
+ * We're quitting, write out anything outstanding and stop journalling so
+ * windows being torn down don't look like tabs being closed
+ */
+void
+kgx_session_stop (KgxSession *self)
+{
+  g_autoptr (GTask) task = NULL;
+  Job *job;
+
+  g_return_if_fail (KGX_IS_SESSION (self));
+
+  if (self->stopped) {
+    return;
+  }
+
+  g_clear_handle_id (&self->flush_timeout, g_source_remove);
+  g_clear_handle_id (&self->snapshot_timeout, g_source_remove);
+
+  if (!self->loaded) {
+    self->stopped = TRUE;
+    return;
+  }
+
+  self->stopped = TRUE;
+
+  job = take_job (self);
+  if (!job) {
+    return;
+  }
+
+  /* Anything in flight is written first, see write_thread() */
+  job->serial = ++self->jobs_taken;
+
+  task = g_task_new (self, NULL, NULL, NULL);
+  g_task_set_source_tag (task, kgx_session_stop);
+  g_task_set_task_data (task, job, job_free);
+  g_task_run_in_thread_sync (task, write_thread);
+}
@@ -0,0 +1,77 @@
+/* kgx-session.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "kgx-settings.h"
+#include "kgx-tab.h"
+
+G_BEGIN_DECLS
+
+/**
+ * KgxSessionTab:
+ * @key: identifies the tab across runs
+ * @window: tabs with the same @window were in the same window
+ * @position: where in the window
+ * @selected: whether it was the window's current tab
+ * @cwd: (nullable): the last known working directory
+ * @title: (nullable): the last known title
+ * @argv: (nullable): the command, or %NULL for the user's shell
+ *
+ * A tab as it was when the session was last saved
+ */
+typedef struct _KgxSessionTab KgxSessionTab;
+struct _KgxSessionTab {
+  char     *key;
+  guint     window;
+  int       position;
+  gboolean  selected;
+  char     *cwd;
+  char     *title;
+  GStrv     argv;
+};
+
+
+void kgx_session_tab_free (KgxSessionTab *tab);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (KgxSessionTab, kgx_session_tab_free)
+
+
+#define KGX_TYPE_SESSION kgx_session_get_type ()
+G_DECLARE_FINAL_TYPE (KgxSession, kgx_session, KGX, SESSION, GObject)
+
+
+KgxSession           *kgx_session_new                      (KgxSettings         *settings);
+GPtrArray            *kgx_session_load                     (KgxSession          *self);
+void                  kgx_session_add_tab                  (KgxSession          *self,
+                                                            KgxTab              *tab,
+                                                            const char          *key,
+                                                            GStrv                argv);
+void                  kgx_session_restore_contents         (KgxSession          *self,
+                                                            KgxTab              *tab,
+                                                            const char          *key,
+                                                            GAsyncReadyCallback  callback,
+                                                            gpointer             callback_data);
+gboolean              kgx_session_restore_contents_finish  (KgxSession          *self,
+                                                            GAsyncResult        *res,
+                                                            GError             **error);
+void                  kgx_session_stop                     (KgxSession          *self);
+
+G_END_DECLS
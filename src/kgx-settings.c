@@ -46,6 +46,9 @@
 
 #define CUSTOM_FONT "custom-font"
 
+/* A zoom gesture is many steps, so wait for it to settle before saving */
+#define SCALE_SAVE_DELAY 250
+
 struct _KgxSettings {
   GObject               parent_instance;
 
@@ -56,9 +59,21 @@ struct _KgxSettings {
   gboolean              visual_bell;
   gboolean              use_system_font;
   PangoFontDescription *custom_font;
+  guint                 hibernate_after;
+  gboolean              compress_logs;
+  gboolean              restore_session;
+  gboolean              restore_scrollback;
+  gboolean              window_isolation;
+  guint                 rewrap_limit;
+  guint                 notify_min_duration;
+  guint                 monitor_silence_interval;
+  gboolean              shell_integration;
+  gboolean              command_history;
 
   GSettings            *settings;
   GSettings            *desktop_interface;
+
+  guint                 scale_save;
 };
 
 
@@ -78,17 +93,35 @@ enum {
   PROP_VISUAL_BELL,
   PROP_USE_SYSTEM_FONT,
   PROP_CUSTOM_FONT,
+  PROP_HIBERNATE_AFTER,
+  PROP_COMPRESS_LOGS,
+  PROP_RESTORE_SESSION,
+  PROP_RESTORE_SCROLLBACK,
+  PROP_WINDOW_ISOLATION,
+  PROP_REWRAP_LIMIT,
+  PROP_NOTIFY_MIN_DURATION,
+  PROP_MONITOR_SILENCE_INTERVAL,
+  PROP_SHELL_INTEGRATION,
+  PROP_COMMAND_HISTORY,
   LAST_PROP
 };
 
 static GParamSpec *pspecs[LAST_PROP] = { NULL, };
 
 
+static gboolean save_scale (gpointer data);
+
+
 static void
 kgx_settings_dispose (GObject *object)
 {
   KgxSettings *self = KGX_SETTINGS (object);
 
+  if (self->scale_save) {
+    g_clear_handle_id (&self->scale_save, g_source_remove);
+    save_scale (self);
+  }
+
   g_clear_object (&self->settings);
   g_clear_object (&self->desktop_interface);
 
@@ -107,12 +140,31 @@ update_scale (KgxSettings *self, double value)
 
   self->scale = clamped;
 
+  if (!self->scale_save) {
+    self->scale_save = g_timeout_add (SCALE_SAVE_DELAY, save_scale, self);
+  }
+
   g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_FONT_SCALE]);
   g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_SCALE_CAN_INCREASE]);
   g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_SCALE_CAN_DECREASE]);
 }
 
 
+static gboolean
+save_scale (gpointer data)
+{
+  KgxSettings *self = KGX_SETTINGS (data);
+
+  self->scale_save = 0;
+
+  if (g_settings_get_double (self->settings, "font-scale") != self->scale) {
+    g_settings_set_double (self->settings, "font-scale", self->scale);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
 static void
 kgx_settings_set_property (GObject      *object,
                            guint         property_id,
@@ -144,6 +196,36 @@ kgx_settings_set_property (GObject      *object,
     case PROP_CUSTOM_FONT:
       kgx_settings_set_custom_font (self, g_value_get_boxed (value));
       break;
+    case PROP_HIBERNATE_AFTER:
+      kgx_settings_set_hibernate_after (self, g_value_get_uint (value));
+      break;
+    case PROP_COMPRESS_LOGS:
+      kgx_settings_set_compress_logs (self, g_value_get_boolean (value));
+      break;
+    case PROP_RESTORE_SESSION:
+      kgx_settings_set_restore_session (self, g_value_get_boolean (value));
+      break;
+    case PROP_RESTORE_SCROLLBACK:
+      kgx_settings_set_restore_scrollback (self, g_value_get_boolean (value));
+      break;
+    case PROP_WINDOW_ISOLATION:
+      kgx_settings_set_window_isolation (self, g_value_get_boolean (value));
+      break;
+    case PROP_REWRAP_LIMIT:
+      kgx_settings_set_rewrap_limit (self, g_value_get_uint (value));
+      break;
+    case PROP_NOTIFY_MIN_DURATION:
+      kgx_settings_set_notify_min_duration (self, g_value_get_uint (value));
+      break;
+    case PROP_MONITOR_SILENCE_INTERVAL:
+      kgx_settings_set_monitor_silence_interval (self, g_value_get_uint (value));
+      break;
+    case PROP_SHELL_INTEGRATION:
+      kgx_settings_set_shell_integration (self, g_value_get_boolean (value));
+      break;
+    case PROP_COMMAND_HISTORY:
+      kgx_settings_set_command_history (self, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -193,6 +275,36 @@ kgx_settings_get_property (GObject    *object,
     case PROP_CUSTOM_FONT:
       g_value_set_boxed (value, self->custom_font);
       break;
+    case PROP_HIBERNATE_AFTER:
+      g_value_set_uint (value, self->hibernate_after);
+      break;
+    case PROP_COMPRESS_LOGS:
+      g_value_set_boolean (value, self->compress_logs);
+      break;
+    case PROP_RESTORE_SESSION:
+      g_value_set_boolean (value, self->restore_session);
+      break;
+    case PROP_RESTORE_SCROLLBACK:
+      g_value_set_boolean (value, self->restore_scrollback);
+      break;
+    case PROP_WINDOW_ISOLATION:
+      g_value_set_boolean (value, self->window_isolation);
+      break;
+    case PROP_REWRAP_LIMIT:
+      g_value_set_uint (value, self->rewrap_limit);
+      break;
+    case PROP_NOTIFY_MIN_DURATION:
+      g_value_set_uint (value, self->notify_min_duration);
+      break;
+    case PROP_MONITOR_SILENCE_INTERVAL:
+      g_value_set_uint (value, self->monitor_silence_interval);
+      break;
+    case PROP_SHELL_INTEGRATION:
+      g_value_set_boolean (value, self->shell_integration);
+      break;
+    case PROP_COMMAND_HISTORY:
+      g_value_set_boolean (value, self->command_history);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -282,6 +394,130 @@ kgx_settings_class_init (KgxSettingsClass *klass)
                         PANGO_TYPE_FONT_DESCRIPTION,
                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
 
+  /**
+   * KgxSettings:hibernate-after:
+   *
+   * Seconds a tab spends in the background before being hibernated, or
+   * 0 to never hibernate
+   *
+   * Bound to ‘hibernate-after’ GSetting so changes persist
+   */
+  pspecs[PROP_HIBERNATE_AFTER] =
+    g_param_spec_uint ("hibernate-after", NULL, NULL,
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:compress-logs:
+   *
+   * Whether recorded tab output is gzipped as it's written
+   *
+   * Bound to ‘compress-logs’ GSetting so changes persist
+   */
+  pspecs[PROP_COMPRESS_LOGS] =
+    g_param_spec_boolean ("compress-logs", NULL, NULL,
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:restore-session:
+   *
+   * Whether open tabs are journalled so they can be brought back next time
+   *
+   * Bound to ‘restore-session’ GSetting so changes persist
+   */
+  pspecs[PROP_RESTORE_SESSION] =
+    g_param_spec_boolean ("restore-session", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:restore-scrollback:
+   *
+   * Whether the journalled session includes (compressed) terminal contents
+   *
+   * Bound to ‘restore-scrollback’ GSetting so changes persist
+   */
+  pspecs[PROP_RESTORE_SCROLLBACK] =
+    g_param_spec_boolean ("restore-scrollback", NULL, NULL,
+                          TRUE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:window-isolation:
+   *
+   * Host each window after the first in its own process, so a window that's busy rendering can't hold up the others
+   *
+   * Bound to ‘window-isolation’ GSetting so changes persist
+   */
+  pspecs[PROP_WINDOW_ISOLATION] =
+    g_param_spec_boolean ("window-isolation", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:rewrap-limit:
+   *
+   * Tabs with more scrollback than this many lines don't rewrap it when
+   * resized (unless told otherwise), 0 for no limit
+   *
+   * Bound to ‘rewrap-limit’ GSetting so changes persist
+   */
+  pspecs[PROP_REWRAP_LIMIT] =
+    g_param_spec_uint ("rewrap-limit", NULL, NULL,
+                       0, G_MAXUINT32, 50000,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:notify-min-duration:
+   *
+   * Commands that finish quicker than this many seconds don't notify
+   *
+   * Bound to ‘notify-min-duration’ GSetting so changes persist
+   */
+  pspecs[PROP_NOTIFY_MIN_DURATION] =
+    g_param_spec_uint ("notify-min-duration", NULL, NULL,
+                       0, 86400, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:monitor-silence-interval:
+   *
+   * Seconds without output before a tab monitored for silence is considered quiet
+   *
+   * Bound to ‘monitor-silence-interval’ GSetting so changes persist
+   */
+  pspecs[PROP_MONITOR_SILENCE_INTERVAL] =
+    g_param_spec_uint ("monitor-silence-interval", NULL, NULL,
+                       1, 3600, 30,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:shell-integration:
+   *
+   * Read output ourselves to pick out the marks shells with integration send about prompts and commands
+   *
+   * Only once the shell reports its location, and not for long if no marks follow
+   *
+   * Bound to ‘shell-integration’ GSetting so changes persist
+   */
+  pspecs[PROP_SHELL_INTEGRATION] =
+    g_param_spec_boolean ("shell-integration", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxSettings:command-history:
+   *
+   * Keep a history of the commands shells with integration report, across tabs and sessions
+   *
+   * Bound to ‘command-history’ GSetting so changes persist
+   */
+  pspecs[PROP_COMMAND_HISTORY] =
+    g_param_spec_boolean ("command-history", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
   g_object_class_install_properties (object_class, LAST_PROP, pspecs);
 }
 
@@ -365,9 +601,10 @@ kgx_settings_init (KgxSettings *self)
   g_settings_bind (self->settings, "theme",
                    self, "theme",
                    G_SETTINGS_BIND_DEFAULT);
+  /* Written back by save_scale() */
   g_settings_bind (self->settings, "font-scale",
                    self, "font-scale",
-                   G_SETTINGS_BIND_DEFAULT);
+                   G_SETTINGS_BIND_GET);
   g_settings_bind (self->settings, "scrollback-lines",
                    self, "scrollback-lines",
                    G_SETTINGS_BIND_DEFAULT);
@@ -386,6 +623,36 @@ kgx_settings_init (KgxSettings *self)
                                 decode_font,
                                 encode_font,
                                 NULL, NULL);
+  g_settings_bind (self->settings, "hibernate-after",
+                   self, "hibernate-after",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "compress-logs",
+                   self, "compress-logs",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "restore-session",
+                   self, "restore-session",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "restore-scrollback",
+                   self, "restore-scrollback",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "window-isolation",
+                   self, "window-isolation",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "rewrap-limit",
+                   self, "rewrap-limit",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "notify-min-duration",
+                   self, "notify-min-duration",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "monitor-silence-interval",
+                   self, "monitor-silence-interval",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "shell-integration",
+                   self, "shell-integration",
+                   G_SETTINGS_BIND_DEFAULT);
+  g_settings_bind (self->settings, "command-history",
+                   self, "command-history",
+                   G_SETTINGS_BIND_DEFAULT);
 
   g_signal_connect (self->settings,
                     "changed::restore-window-size",
@@ -456,6 +723,15 @@ kgx_settings_get_font (KgxSettings *self)
 }
 
 
+double
+kgx_settings_get_font_scale (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), KGX_FONT_SCALE_DEFAULT);
+
+  return self->scale;
+}
+
+
 void
 kgx_settings_increase_scale (KgxSettings *self)
 {
@@ -531,6 +807,15 @@ kgx_settings_set_custom_shell (KgxSettings *self, const char *const *shell)
 }
 
 
+int64_t
+kgx_settings_get_scrollback (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), 0);
+
+  return self->scrollback_lines;
+}
+
+
 void
 kgx_settings_set_scrollback (KgxSettings *self,
                              int64_t      value)
@@ -701,3 +986,243 @@ kgx_settings_set_custom_font (KgxSettings          *self,
   g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_CUSTOM_FONT]);
   g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_FONT]);
 }
+
+
+guint
+kgx_settings_get_hibernate_after (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), 0);
+
+  return self->hibernate_after;
+}
+
+
+void
+kgx_settings_set_hibernate_after (KgxSettings *self,
+                                  guint        hibernate_after)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->hibernate_after == hibernate_after)
+    return;
+
+  self->hibernate_after = hibernate_after;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_HIBERNATE_AFTER]);
+}
+
+
+gboolean
+kgx_settings_get_compress_logs (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), FALSE);
+
+  return self->compress_logs;
+}
+
+
+void
+kgx_settings_set_compress_logs (KgxSettings *self,
+                                gboolean     compress_logs)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->compress_logs == compress_logs)
+    return;
+
+  self->compress_logs = compress_logs;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_COMPRESS_LOGS]);
+}
+
+
+gboolean
+kgx_settings_get_restore_session (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), FALSE);
+
+  return self->restore_session;
+}
+
+
+void
+kgx_settings_set_restore_session (KgxSettings *self,
+                                  gboolean     restore_session)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->restore_session == restore_session)
+    return;
+
+  self->restore_session = restore_session;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RESTORE_SESSION]);
+}
+
+
+gboolean
+kgx_settings_get_restore_scrollback (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), FALSE);
+
+  return self->restore_scrollback;
+}
+
+
+void
+kgx_settings_set_restore_scrollback (KgxSettings *self,
+                                     gboolean     restore_scrollback)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->restore_scrollback == restore_scrollback)
+    return;
+
+  self->restore_scrollback = restore_scrollback;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RESTORE_SCROLLBACK]);
+}
+
+
+gboolean
+kgx_settings_get_window_isolation (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), FALSE);
+
+  return self->window_isolation;
+}
+
+
+void
+kgx_settings_set_window_isolation (KgxSettings *self,
+                                   gboolean     window_isolation)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->window_isolation == window_isolation)
+    return;
+
+  self->window_isolation = window_isolation;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_WINDOW_ISOLATION]);
+}
+
+
+guint
+kgx_settings_get_rewrap_limit (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), 0);
+
+  return self->rewrap_limit;
+}
+
+
+void
+kgx_settings_set_rewrap_limit (KgxSettings *self,
+                               guint        rewrap_limit)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->rewrap_limit == rewrap_limit)
+    return;
+
+  self->rewrap_limit = rewrap_limit;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_REWRAP_LIMIT]);
+}
+
+
+guint
+kgx_settings_get_notify_min_duration (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), 0);
+
+  return self->notify_min_duration;
+}
+
+
+void
+kgx_settings_set_notify_min_duration (KgxSettings *self,
+                                      guint        notify_min_duration)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->notify_min_duration == notify_min_duration)
+    return;
+
+  self->notify_min_duration = notify_min_duration;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_NOTIFY_MIN_DURATION]);
+}
+
+
+guint
+kgx_settings_get_monitor_silence_interval (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), 0);
+
+  return self->monitor_silence_interval;
+}
+
+
+void
+kgx_settings_set_monitor_silence_interval (KgxSettings *self,
+                                           guint        monitor_silence_interval)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->monitor_silence_interval == monitor_silence_interval)
+    return;
+
+  self->monitor_silence_interval = monitor_silence_interval;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_MONITOR_SILENCE_INTERVAL]);
+}
+
+
+gboolean
+kgx_settings_get_shell_integration (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), FALSE);
+
+  return self->shell_integration;
+}
+
+
+void
+kgx_settings_set_shell_integration (KgxSettings *self,
+                                    gboolean     shell_integration)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->shell_integration == shell_integration)
+    return;
+
+  self->shell_integration = shell_integration;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_SHELL_INTEGRATION]);
+}
+
+
+gboolean
+kgx_settings_get_command_history (KgxSettings *self)
+{
+  g_return_val_if_fail (KGX_IS_SETTINGS (self), FALSE);
+
+  return self->command_history;
+}
+
+
+void
+kgx_settings_set_command_history (KgxSettings *self,
+                                  gboolean     command_history)
+{
+  g_return_if_fail (KGX_IS_SETTINGS (self));
+
+  if (self->command_history == command_history)
+    return;
+
+  self->command_history = command_history;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_COMMAND_HISTORY]);
+}
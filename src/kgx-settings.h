@@ -73,12 +73,14 @@ G_DECLARE_FINAL_TYPE (KgxSettings, kgx_settings, KGX, SETTINGS, GObject)
 
 KgxTheme              kgx_settings_get_resolved_theme     (KgxSettings           *self);
 PangoFontDescription *kgx_settings_get_font          (KgxSettings       *self);
+double                kgx_settings_get_font_scale    (KgxSettings       *self);
 void                  kgx_settings_increase_scale    (KgxSettings       *self);
 void                  kgx_settings_decrease_scale    (KgxSettings       *self);
 void                  kgx_settings_reset_scale       (KgxSettings       *self);
 GStrv                 kgx_settings_get_shell         (KgxSettings       *self);
 void                  kgx_settings_set_custom_shell  (KgxSettings       *self,
                                                       const char *const *shell);
+int64_t               kgx_settings_get_scrollback    (KgxSettings       *self);
 void                  kgx_settings_set_scrollback    (KgxSettings       *self,
                                                       int64_t            value);
 gboolean              kgx_settings_get_restore_size  (KgxSettings       *self);
@@ -102,5 +104,35 @@ void                  kgx_settings_set_use_system_font  (KgxSettings           *
 PangoFontDescription *kgx_settings_get_custom_font      (KgxSettings           *self);
 void                  kgx_settings_set_custom_font      (KgxSettings           *self,
                                                          PangoFontDescription  *custom_font);
+guint                 kgx_settings_get_hibernate_after  (KgxSettings           *self);
+void                  kgx_settings_set_hibernate_after  (KgxSettings           *self,
+                                                         guint                  hibernate_after);
+gboolean              kgx_settings_get_compress_logs    (KgxSettings           *self);
+void                  kgx_settings_set_compress_logs    (KgxSettings           *self,
+                                                         gboolean               compress_logs);
+gboolean              kgx_settings_get_restore_session  (KgxSettings           *self);
+void                  kgx_settings_set_restore_session  (KgxSettings           *self,
+                                                         gboolean               restore_session);
+gboolean              kgx_settings_get_restore_scrollback (KgxSettings           *self);
+void                  kgx_settings_set_restore_scrollback (KgxSettings           *self,
+                                                         gboolean               restore_scrollback);
+gboolean              kgx_settings_get_window_isolation (KgxSettings           *self);
+void                  kgx_settings_set_window_isolation (KgxSettings           *self,
+                                                         gboolean               window_isolation);
+guint                 kgx_settings_get_rewrap_limit     (KgxSettings           *self);
+void                  kgx_settings_set_rewrap_limit     (KgxSettings           *self,
+                                                         guint                  rewrap_limit);
+guint                 kgx_settings_get_notify_min_duration (KgxSettings           *self);
+void                  kgx_settings_set_notify_min_duration (KgxSettings           *self,
+                                                         guint                  notify_min_duration);
+guint                 kgx_settings_get_monitor_silence_interval (KgxSettings           *self);
+void                  kgx_settings_set_monitor_silence_interval (KgxSettings           *self,
+                                                         guint                  monitor_silence_interval);
+gboolean              kgx_settings_get_shell_integration (KgxSettings           *self);
+void                  kgx_settings_set_shell_integration (KgxSettings           *self,
+                                                         gboolean               shell_integration);
+gboolean              kgx_settings_get_command_history  (KgxSettings           *self);
+void                  kgx_settings_set_command_history  (KgxSettings           *self,
+                                                         gboolean               command_history);
 
 G_END_DECLS
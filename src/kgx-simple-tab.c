@@ -309,14 +309,14 @@ kgx_simple_tab_start_finish (KgxTab        *page,
 
 
 static char *
-format_tooltip (GObject *object, GFile *current_path)
+format_tooltip (GObject *object, GFile *current_path, const char *remote_host)
 {
   g_autofree char *path_raw = NULL;
   g_autofree char *path_utf8 = NULL;
   g_autoptr (GError) error = NULL;
 
   if (!current_path) {
-    return NULL;
+    return g_strdup (remote_host);
   }
 
   path_raw = g_file_get_path (current_path);
@@ -330,6 +330,10 @@ format_tooltip (GObject *object, GFile *current_path)
     return g_file_get_uri (current_path);
   }
 
+  if (remote_host) {
+    return g_strdup_printf ("%s:%s", remote_host, path_utf8);
+  }
+
   return g_steal_pointer (&path_utf8);
 }
 
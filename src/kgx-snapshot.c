@@ -0,0 +1,388 @@
+/* kgx-snapshot.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION:kgx-snapshot
+ * @title: Snapshots
+ * @short_description: Terminal contents, for feeding back in later
+ *
+ * The only way VTE will give us the contents along with their attributes
+ * is as HTML, so that is turned back into the SGR it (more or less) came
+ * from and compressed. Colours come out as RGB, as they were resolved
+ * against the palette at the time
+ *
+ * Nothing here touches the terminal, so it's safe to use from a worker
+ */
+
+#include "kgx-config.h"
+
+#include <string.h>
+
+#include "kgx-snapshot.h"
+
+/* Longest entity we bother decoding, &#x10FFFF; */
+#define MAX_ENTITY 10
+
+
+/*
+ * Attribute:
+ * @tag: the element that set it
+ * @sgr: (nullable): the SGR parameters it stands for
+ */
+typedef struct {
+  char *tag;
+  char *sgr;
+} Attribute;
+
+
+static void
+attribute_clear (gpointer data)
+{
+  Attribute *attribute = data;
+
+  g_clear_pointer (&attribute->tag, g_free);
+  g_clear_pointer (&attribute->sgr, g_free);
+}
+
+
+/*
+ * Encoder:
+ * @out: the SGR & text so far
+ * @attributes: (element-type Attribute): the open elements, innermost last
+ * @dirty: @attributes changed since the last text
+ */
+typedef struct {
+  GString  *out;
+  GArray   *attributes;
+  gboolean  dirty;
+} Encoder;
+
+
+static char *
+colour_after (const char *attrs, gsize len, const char *key, const char *sgr)
+{
+  const char *found = g_strstr_len (attrs, len, key);
+  const char *hex;
+  guint rgb[3];
+
+  if (!found) {
+    return NULL;
+  }
+
+  hex = found + strlen (key);
+  if (hex + 6 > attrs + len) {
+    return NULL;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    int high = g_ascii_xdigit_value (hex[i * 2]);
+    int low = g_ascii_xdigit_value (hex[i * 2 + 1]);
+
+    if (high < 0 || low < 0) {
+      return NULL;
+    }
+
+    rgb[i] = high * 16 + low;
+  }
+
+  return g_strdup_printf ("%s;2;%u;%u;%u", sgr, rgb[0], rgb[1], rgb[2]);
+}
+
+
+/*
+ * What VTE wraps runs of cells in, see Terminal::cellattr_to_html
+ */
+static char *
+sgr_for (const char *tag, const char *attrs, gsize len)
+{
+  if (g_str_equal (tag, "b")) {
+    return g_strdup ("1");
+  } else if (g_str_equal (tag, "i")) {
+    return g_strdup ("3");
+  } else if (g_str_equal (tag, "u")) {
+    return g_strdup ("4");
+  } else if (g_str_equal (tag, "blink")) {
+    return g_strdup ("5");
+  } else if (g_str_equal (tag, "strike") ||
+             g_str_equal (tag, "s") ||
+             g_str_equal (tag, "del")) {
+    return g_strdup ("9");
+  } else if (g_str_equal (tag, "font")) {
+    return colour_after (attrs, len, "color=\"#", "38");
+  } else if (g_str_equal (tag, "span")) {
+    char *sgr = colour_after (attrs, len, "background-color:#", "48");
+
+    return sgr ? sgr : colour_after (attrs, len, "color:#", "38");
+  }
+
+  return NULL;
+}
+
+
+static void
+open_element (Encoder *self, const char *element, gsize len)
+{
+  gsize name_len = strcspn (element, " \t\n/>");
+  Attribute attribute;
+
+  name_len = MIN (name_len, len);
+  attribute.tag = g_ascii_strdown (element, name_len);
+
+  if (g_str_equal (attribute.tag, "br")) {
+    g_free (attribute.tag);
+    g_string_append (self->out, "\r\n");
+    return;
+  }
+
+  attribute.sgr = sgr_for (attribute.tag,
+                           element + name_len,
+                           len - name_len);
+
+  g_array_append_val (self->attributes, attribute);
+  self->dirty = TRUE;
+}
+
+
+static void
+close_element (Encoder *self, const char *element, gsize len)
+{
+  g_autofree char *tag = g_ascii_strdown (element, MIN (strcspn (element, " \t\n>"), len));
+
+  for (guint i = self->attributes->len; i > 0; i--) {
+    if (g_str_equal (g_array_index (self->attributes, Attribute, i - 1).tag, tag)) {
+      g_array_remove_index (self->attributes, i - 1);
+      self->dirty = TRUE;
+      return;
+    }
+  }
+}
+
+
+static inline void
+flush_attributes (Encoder *self)
+{
+  if (!self->dirty) {
+    return;
+  }
+
+  self->dirty = FALSE;
+
+  g_string_append (self->out, "\033[0");
+  for (guint i = 0; i < self->attributes->len; i++) {
+    const char *sgr = g_array_index (self->attributes, Attribute, i).sgr;
+
+    if (sgr) {
+      g_string_append_c (self->out, ';');
+      g_string_append (self->out, sgr);
+    }
+  }
+  g_string_append_c (self->out, 'm');
+}
+
+
+/*
+ * Returns: how much of @text the entity took, or 0 if it isn't one
+ */
+static gsize
+append_entity (Encoder *self, const char *text, gsize len)
+{
+  const char *end = memchr (text, ';', MIN (len, MAX_ENTITY));
+  gsize entity_len;
+  gunichar c = 0;
+
+  if (!end) {
+    return 0;
+  }
+
+  entity_len = end - text + 1;
+
+  if (g_str_has_prefix (text, "&amp;")) {
+    c = '&';
+  } else if (g_str_has_prefix (text, "&lt;")) {
+    c = '<';
+  } else if (g_str_has_prefix (text, "&gt;")) {
+    c = '>';
+  } else if (g_str_has_prefix (text, "&quot;")) {
+    c = '"';
+  } else if (g_str_has_prefix (text, "&apos;")) {
+    c = '\'';
+  } else if (text[1] == '#') {
+    g_autofree char *number = g_strndup (text + 2, entity_len - 3);
+    gboolean hex = number[0] == 'x' || number[0] == 'X';
+    char *number_end;
+    guint64 value;
+
+    value = g_ascii_strtoull (number + (hex ? 1 : 0), &number_end, hex ? 16 : 10);
+    if (number_end == number + (hex ? 1 : 0) || *number_end != '\0' ||
+        value == 0 || value > 0x10FFFF || !g_unichar_validate (value)) {
+      return 0;
+    }
+    c = value;
+  } else {
+    return 0;
+  }
+
+  flush_attributes (self);
+  g_string_append_unichar (self->out, c);
+
+  return entity_len;
+}
+
+
+/*
+ * Turn VTE's HTML back into text & SGR, with CRLF line ends as VTE wants
+ * them fed
+ */
+static GString *
+encode (const char *html, gsize len)
+{
+  g_autoptr (GArray) attributes = g_array_new (FALSE, FALSE, sizeof (Attribute));
+  Encoder self = { g_string_sized_new (len), attributes, FALSE };
+  gsize i = 0;
+
+  g_array_set_clear_func (attributes, attribute_clear);
+
+  while (i < len) {
+    const char *here = html + i;
+
+    if (*here == '<') {
+      const char *end = memchr (here, '>', len - i);
+
+      if (!end) {
+        break;
+      }
+
+      if (here[1] == '/') {
+        close_element (&self, here + 2, end - here - 2);
+      } else {
+        open_element (&self, here + 1, end - here - 1);
+      }
+
+      i = end - html + 1;
+    } else if (*here == '&') {
+      gsize taken = append_entity (&self, here, len - i);
+
+      if (taken == 0) {
+        flush_attributes (&self);
+        g_string_append_c (self.out, '&');
+        taken = 1;
+      }
+
+      i += taken;
+    } else if (*here == '\n') {
+      g_string_append (self.out, "\r\n");
+      i++;
+    } else if (*here == '\r') {
+      i++;
+    } else {
+      flush_attributes (&self);
+      g_string_append_c (self.out, *here);
+      i++;
+    }
+  }
+
+  return self.out;
+}
+
+
+/**
+ * kgx_snapshot_pack:
+ * @html: the contents, up to the end of the cursor's row, from
+ *        vte_terminal_get_text_range_format()
+ * @len: the length of @html
+ * @cursor_col: the column the cursor was in
+ * @error: return location for a #GError
+ *
+ * Returns: (transfer full): the compressed snapshot, see
+ *          kgx_snapshot_unpack()
+ */
+GBytes *
+kgx_snapshot_pack (const char  *html,
+                   gsize        len,
+                   glong        cursor_col,
+                   GError     **error)
+{
+  g_autoptr (GString) text = NULL;
+  g_autoptr (GConverter) compressor = NULL;
+  g_autoptr (GOutputStream) memory = NULL;
+  g_autoptr (GOutputStream) stream = NULL;
+
+  g_return_val_if_fail (html != NULL || len == 0, NULL);
+
+  text = encode (html, len);
+
+  /* The text ends on the cursor's row, so that's where feeding it leaves
+   * the cursor, only the column needs putting back */
+  if (g_str_has_suffix (text->str, "\r\n")) {
+    g_string_truncate (text, text->len - 2);
+  }
+  g_string_append (text, "\033[0m\r");
+  if (cursor_col > 0) {
+    g_string_append_printf (text, "\033[%ldC", cursor_col);
+  }
+
+  memory = g_memory_output_stream_new_resizable ();
+  compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+  stream = g_converter_output_stream_new (memory, compressor);
+
+  if (!g_output_stream_write_all (stream, text->str, text->len, NULL, NULL, error)) {
+    return NULL;
+  }
+
+  if (!g_output_stream_close (stream, NULL, error)) {
+    return NULL;
+  }
+
+  return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory));
+}
+
+
+/**
+ * kgx_snapshot_unpack:
+ * @snapshot: from kgx_snapshot_pack()
+ * @error: return location for a #GError
+ *
+ * Returns: (transfer full): output to feed the terminal
+ */
+GBytes *
+kgx_snapshot_unpack (GBytes  *snapshot,
+                     GError **error)
+{
+  g_autoptr (GInputStream) memory = NULL;
+  g_autoptr (GConverter) decompressor = NULL;
+  g_autoptr (GInputStream) stream = NULL;
+  g_autoptr (GOutputStream) contents = NULL;
+
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  memory = g_memory_input_stream_new_from_bytes (snapshot);
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+  stream = g_converter_input_stream_new (memory, decompressor);
+  contents = g_memory_output_stream_new_resizable ();
+
+  if (g_output_stream_splice (contents,
+                              stream,
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                              NULL,
+                              error) < 0) {
+    return NULL;
+  }
+
+  return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (contents));
+}
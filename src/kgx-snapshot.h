@@ -0,0 +1,32 @@
+/* kgx-snapshot.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+GBytes     *kgx_snapshot_pack      (const char  *html,
+                                    gsize        len,
+                                    glong        cursor_col,
+                                    GError     **error);
+GBytes     *kgx_snapshot_unpack    (GBytes      *snapshot,
+                                    GError     **error);
+
+G_END_DECLS
@@ -0,0 +1,462 @@
+/* kgx-tab-index.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include <gio/gio.h>
+
+#include "kgx-tab-index.h"
+
+/* Separates the title, path, and command in a haystack */
+#define FIELD_SEPARATOR '\x1f'
+
+#define MATCH_SCORE 16
+#define BOUNDARY_BONUS 8
+#define CONSECUTIVE_BONUS 12
+#define TITLE_BONUS 4
+#define MAX_GAP_PENALTY 8
+
+
+/**
+ * Entry:
+ * @tab: (not owned): the tab this is for
+ * @position: where @self is in #KgxTabIndex:entries
+ * @haystack: the casefolded title, path, and command
+ * @title_end: offset of the end of the title in @haystack
+ * @mask: a rough summary of the bytes in @haystack
+ * @score: scratch space for ranking
+ *
+ * Stability: Private
+ */
+typedef struct {
+  KgxTab     *tab;
+  guint       position;
+  char       *haystack;
+  gsize       title_end;
+  guint64     mask;
+  int         score;
+} Entry;
+
+
+static void
+entry_free (gpointer data)
+{
+  Entry *entry = data;
+
+  g_clear_pointer (&entry->haystack, g_free);
+
+  g_free (entry);
+}
+
+
+/**
+ * KgxTabIndex:
+ * @entries: (element-type Entry) every tab we know about, oldest first
+ * @by_tab: (element-type KgxTab Entry) the same, for finding them again
+ * @serial: bumped whenever an entry changes or goes away
+ * @last_query: the normalised form of the previous query
+ * @last_matches: (element-type Entry) everything that matched @last_query
+ * @last_serial: @serial as of @last_matches
+ *
+ * Searchable summaries of every #KgxTab in the instance, kept up to date
+ * as the tabs change, so a query only has to walk a flat array of short
+ * strings rather than poke at hundreds of widgets
+ *
+ * When the user is typing, each query usually extends the last, in which
+ * case only what matched last time can still match
+ */
+struct _KgxTabIndex {
+  GObject         parent_instance;
+
+  GPtrArray      *entries;
+  GHashTable     *by_tab;
+  guint           serial;
+
+  char           *last_query;
+  GPtrArray      *last_matches;
+  guint           last_serial;
+};
+
+
+G_DEFINE_TYPE (KgxTabIndex, kgx_tab_index, G_TYPE_OBJECT)
+
+
+static void tab_died    (gpointer    data,
+                         GObject    *dead);
+static void tab_changed (GObject    *object,
+                         GParamSpec *pspec,
+                         gpointer    data);
+
+
+static void
+kgx_tab_index_dispose (GObject *object)
+{
+  KgxTabIndex *self = KGX_TAB_INDEX (object);
+
+  if (self->entries) {
+    for (guint i = 0; i < self->entries->len; i++) {
+      Entry *entry = g_ptr_array_index (self->entries, i);
+
+      g_signal_handlers_disconnect_by_func (entry->tab, tab_changed, self);
+      g_object_weak_unref (G_OBJECT (entry->tab), tab_died, self);
+    }
+  }
+
+  g_clear_pointer (&self->last_matches, g_ptr_array_unref);
+  g_clear_pointer (&self->last_query, g_free);
+  g_clear_pointer (&self->by_tab, g_hash_table_unref);
+  g_clear_pointer (&self->entries, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (kgx_tab_index_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_tab_index_class_init (KgxTabIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = kgx_tab_index_dispose;
+}
+
+
+static void
+kgx_tab_index_init (KgxTabIndex *self)
+{
+  self->entries = g_ptr_array_new_with_free_func (entry_free);
+  self->by_tab = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+
+KgxTabIndex *
+kgx_tab_index_new (void)
+{
+  return g_object_new (KGX_TYPE_TAB_INDEX, NULL);
+}
+
+
+static inline guint64
+mask_of (const char *text)
+{
+  guint64 mask = 0;
+
+  for (const char *c = text; *c; c++) {
+    mask |= G_GUINT64_CONSTANT (1) << ((guchar) *c & 63);
+  }
+
+  return mask;
+}
+
+
+static inline gboolean
+is_boundary (char c)
+{
+  return c == FIELD_SEPARATOR ||
+         c == ' ' || c == '/' || c == '-' || c == '_' || c == '.';
+}
+
+
+static void
+update_entry (KgxTabIndex *self, Entry *entry)
+{
+  g_autoptr (GString) text = g_string_sized_new (128);
+  g_autofree char *title = NULL;
+  g_autoptr (GFile) path = NULL;
+  const char *command;
+
+  g_object_get (entry->tab, "tab-title", &title, "tab-path", &path, NULL);
+  command = kgx_tab_get_running_command (entry->tab);
+
+  if (title) {
+    g_string_append (text, title);
+  }
+  g_string_append_c (text, FIELD_SEPARATOR);
+  entry->title_end = text->len;
+
+  if (path) {
+    g_autofree char *parse_name = g_file_get_parse_name (path);
+
+    g_string_append (text, parse_name);
+  }
+  g_string_append_c (text, FIELD_SEPARATOR);
+
+  if (command) {
+    g_string_append (text, command);
+  }
+
+  g_clear_pointer (&entry->haystack, g_free);
+  entry->haystack = g_utf8_casefold (text->str, text->len);
+  entry->mask = mask_of (entry->haystack);
+
+  /* Folding can change lengths, but only matters for the bonus */
+  entry->title_end = MIN (entry->title_end, strlen (entry->haystack));
+
+  self->serial++;
+}
+
+
+static void
+tab_changed (GObject *object, GParamSpec *pspec, gpointer data)
+{
+  KgxTabIndex *self = data;
+  Entry *entry = g_hash_table_lookup (self->by_tab, object);
+
+  if (G_LIKELY (entry)) {
+    update_entry (self, entry);
+  }
+}
+
+
+static void
+tab_died (gpointer data, GObject *dead)
+{
+  KgxTabIndex *self = data;
+  Entry *entry = g_hash_table_lookup (self->by_tab, dead);
+  guint position;
+
+  if (G_UNLIKELY (!entry)) {
+    return;
+  }
+
+  g_hash_table_remove (self->by_tab, dead);
+
+  /* Keep the rest in order, everyone after the gap moves up one */
+  position = entry->position;
+  g_ptr_array_remove_index (self->entries, position);
+  for (guint i = position; i < self->entries->len; i++) {
+    Entry *moved = g_ptr_array_index (self->entries, i);
+
+    moved->position = i;
+  }
+
+  /* @last_matches could be pointing at @entry */
+  self->serial++;
+}
+
+
+/**
+ * kgx_tab_index_add:
+ * @self: the #KgxTabIndex
+ * @tab: the #KgxTab to track
+ *
+ * Start following @tab, it's dropped again when @tab is finalised
+ */
+void
+kgx_tab_index_add (KgxTabIndex *self,
+                   KgxTab      *tab)
+{
+  Entry *entry;
+
+  g_return_if_fail (KGX_IS_TAB_INDEX (self));
+  g_return_if_fail (KGX_IS_TAB (tab));
+
+  if (g_hash_table_contains (self->by_tab, tab)) {
+    return;
+  }
+
+  entry = g_new0 (Entry, 1);
+  entry->tab = tab;
+  entry->position = self->entries->len;
+
+  g_ptr_array_add (self->entries, entry);
+  g_hash_table_insert (self->by_tab, tab, entry);
+
+  update_entry (self, entry);
+
+  g_signal_connect (tab, "notify::tab-title", G_CALLBACK (tab_changed), self);
+  g_signal_connect (tab, "notify::tab-path", G_CALLBACK (tab_changed), self);
+  g_signal_connect (tab, "notify::running-command", G_CALLBACK (tab_changed), self);
+  g_object_weak_ref (G_OBJECT (tab), tab_died, self);
+}
+
+
+/*
+ * A greedy subsequence match, scoring matches that start words or follow
+ * on from the last one higher, and gaps lower
+ */
+static inline gboolean
+score_entry (Entry      *entry,
+             const char *needle,
+             gsize       needle_len,
+             guint64     needle_mask)
+{
+  const char *haystack = entry->haystack;
+  gboolean have_last = FALSE;
+  gsize last = 0;
+  gsize matched = 0;
+  int score = 0;
+
+  if ((entry->mask & needle_mask) != needle_mask) {
+    return FALSE;
+  }
+
+  for (gsize i = 0; haystack[i] && matched < needle_len; i++) {
+    if (haystack[i] != needle[matched]) {
+      continue;
+    }
+
+    score += MATCH_SCORE;
+
+    if (i == 0 || is_boundary (haystack[i - 1])) {
+      score += BOUNDARY_BONUS;
+    }
+
+    if (i < entry->title_end) {
+      score += TITLE_BONUS;
+    }
+
+    if (have_last) {
+      if (last + 1 == i) {
+        score += CONSECUTIVE_BONUS;
+      } else {
+        score -= MIN (i - last - 1, MAX_GAP_PENALTY);
+      }
+    }
+
+    have_last = TRUE;
+    last = i;
+    matched++;
+  }
+
+  if (matched < needle_len) {
+    return FALSE;
+  }
+
+  entry->score = score;
+
+  return TRUE;
+}
+
+
+static int
+compare_entries (gconstpointer a, gconstpointer b)
+{
+  const Entry *entry_a = *((Entry **) a);
+  const Entry *entry_b = *((Entry **) b);
+
+  if (entry_a->score != entry_b->score) {
+    return entry_b->score - entry_a->score;
+  }
+
+  /* Newer tabs first */
+  return (int) entry_b->position - (int) entry_a->position;
+}
+
+
+static char *
+normalise_query (const char *query)
+{
+  g_autofree char *folded = g_utf8_casefold (query, -1);
+  char *out = folded;
+
+  /* Spaces are just for readability, don't make them have to match */
+  for (char *in = folded; *in; in++) {
+    if (!g_ascii_isspace (*in)) {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+
+  return g_steal_pointer (&folded);
+}
+
+
+/**
+ * kgx_tab_index_query:
+ * @self: the #KgxTabIndex
+ * @query: (nullable): what the user typed
+ * @limit: the most results wanted
+ *
+ * Find the tabs that best fuzzily match @query, an empty @query lists
+ * the newest tabs
+ *
+ * Returns: (element-type KgxTab) (transfer full): the tabs, best first
+ */
+GPtrArray *
+kgx_tab_index_query (KgxTabIndex *self,
+                     const char  *query,
+                     guint        limit)
+{
+  g_autofree char *needle = NULL;
+  g_autoptr (GPtrArray) matches = NULL;
+  GPtrArray *candidates;
+  GPtrArray *results;
+  gsize needle_len;
+  guint64 needle_mask;
+  gint64 start;
+
+  g_return_val_if_fail (KGX_IS_TAB_INDEX (self), NULL);
+
+  results = g_ptr_array_new_with_free_func (g_object_unref);
+
+  needle = normalise_query (query ? query : "");
+  needle_len = strlen (needle);
+
+  if (needle_len == 0) {
+    for (guint i = self->entries->len; i > 0 && results->len < limit; i--) {
+      Entry *entry = g_ptr_array_index (self->entries, i - 1);
+
+      g_ptr_array_add (results, g_object_ref (entry->tab));
+    }
+
+    return results;
+  }
+
+  start = g_get_monotonic_time ();
+
+  needle_mask = mask_of (needle);
+
+  if (self->last_query &&
+      self->last_serial == self->serial &&
+      g_str_has_prefix (needle, self->last_query)) {
+    candidates = self->last_matches;
+  } else {
+    candidates = self->entries;
+  }
+
+  matches = g_ptr_array_sized_new (candidates->len);
+  for (guint i = 0; i < candidates->len; i++) {
+    Entry *entry = g_ptr_array_index (candidates, i);
+
+    if (score_entry (entry, needle, needle_len, needle_mask)) {
+      g_ptr_array_add (matches, entry);
+    }
+  }
+
+  g_ptr_array_sort (matches, compare_entries);
+
+  for (guint i = 0; i < matches->len && results->len < limit; i++) {
+    Entry *entry = g_ptr_array_index (matches, i);
+
+    g_ptr_array_add (results, g_object_ref (entry->tab));
+  }
+
+  g_debug ("tab-index: “%s” matched %u of %u (from %u) in %" G_GINT64_FORMAT "µs",
+           needle,
+           matches->len,
+           self->entries->len,
+           candidates->len,
+           g_get_monotonic_time () - start);
+
+  g_clear_pointer (&self->last_matches, g_ptr_array_unref);
+  self->last_matches = g_steal_pointer (&matches);
+  g_set_str (&self->last_query, needle);
+  self->last_serial = self->serial;
+
+  return results;
+}
@@ -0,0 +1,38 @@
+/* kgx-tab-index.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "kgx-tab.h"
+
+G_BEGIN_DECLS
+
+#define KGX_TYPE_TAB_INDEX kgx_tab_index_get_type ()
+G_DECLARE_FINAL_TYPE (KgxTabIndex, kgx_tab_index, KGX, TAB_INDEX, GObject)
+
+
+KgxTabIndex          *kgx_tab_index_new               (void);
+void                  kgx_tab_index_add               (KgxTabIndex    *self,
+                                                       KgxTab         *tab);
+GPtrArray            *kgx_tab_index_query             (KgxTabIndex    *self,
+                                                       const char     *query,
+                                                       guint           limit);
+
+G_END_DECLS
@@ -0,0 +1,307 @@
+/* kgx-tab-switcher.c
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kgx-config.h"
+
+#include <glib/gi18n.h>
+
+#include "kgx-tab-switcher.h"
+
+/* Nobody reads further down than this, so don't build rows for it */
+#define MAX_RESULTS 50
+
+
+/**
+ * KgxTabSwitcher:
+ * @index: where results come from
+ * @entry: what the user is typing in
+ * @list: the results
+ *
+ * Jump to any tab, in any window, by typing bits of its title, path, or
+ * what's running in it
+ */
+struct _KgxTabSwitcher {
+  AdwWindow       parent_instance;
+
+  KgxTabIndex    *index;
+
+  GtkWidget      *entry;
+  GtkWidget      *list;
+};
+
+
+G_DEFINE_FINAL_TYPE (KgxTabSwitcher, kgx_tab_switcher, ADW_TYPE_WINDOW)
+
+
+static void
+kgx_tab_switcher_dispose (GObject *object)
+{
+  KgxTabSwitcher *self = KGX_TAB_SWITCHER (object);
+
+  g_clear_object (&self->index);
+
+  G_OBJECT_CLASS (kgx_tab_switcher_parent_class)->dispose (object);
+}
+
+
+static void
+kgx_tab_switcher_class_init (KgxTabSwitcherClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = kgx_tab_switcher_dispose;
+
+  gtk_widget_class_add_binding_action (widget_class,
+                                       GDK_KEY_Escape, 0,
+                                       "window.close",
+                                       NULL);
+}
+
+
+static GtkWidget *
+build_row (KgxTab *tab)
+{
+  g_autofree char *title = NULL;
+  g_autoptr (GFile) path = NULL;
+  g_autoptr (GString) subtitle = g_string_new (NULL);
+  const char *command;
+  GtkWidget *row;
+
+  g_object_get (tab, "tab-title", &title, "tab-path", &path, NULL);
+  command = kgx_tab_get_running_command (tab);
+
+  if (path) {
+    g_autofree char *parse_name = g_file_get_parse_name (path);
+
+    g_string_append (subtitle, parse_name);
+  }
+
+  if (command) {
+    if (subtitle->len > 0) {
+      g_string_append (subtitle, " — ");
+    }
+    g_string_append (subtitle, command);
+  }
+
+  row = g_object_new (ADW_TYPE_ACTION_ROW,
+                      "title", title ? title : _("Terminal"),
+                      "subtitle", subtitle->str,
+                      "use-markup", FALSE,
+                      "title-lines", 1,
+                      "subtitle-lines", 1,
+                      "activatable", TRUE,
+                      NULL);
+  g_object_set_data (G_OBJECT (row),
+                     "kgx-page-id",
+                     GUINT_TO_POINTER (kgx_tab_get_id (tab)));
+
+  return row;
+}
+
+
+static void
+search_changed (KgxTabSwitcher *self)
+{
+  g_autoptr (GPtrArray) results = NULL;
+  GtkWidget *child;
+
+  results = kgx_tab_index_query (self->index,
+                                 gtk_editable_get_text (GTK_EDITABLE (self->entry)),
+                                 MAX_RESULTS);
+
+  while ((child = gtk_widget_get_first_child (self->list))) {
+    gtk_list_box_remove (GTK_LIST_BOX (self->list), child);
+  }
+
+  for (guint i = 0; i < results->len; i++) {
+    gtk_list_box_append (GTK_LIST_BOX (self->list),
+                         build_row (g_ptr_array_index (results, i)));
+  }
+
+  gtk_list_box_select_row (GTK_LIST_BOX (self->list),
+                           gtk_list_box_get_row_at_index (GTK_LIST_BOX (self->list), 0));
+}
+
+
+static void
+row_activated (KgxTabSwitcher *self, GtkListBoxRow *row)
+{
+  GtkWindow *parent = gtk_window_get_transient_for (GTK_WINDOW (self));
+  guint id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (row), "kgx-page-id"));
+  GtkApplication *application = NULL;
+
+  /* We aren't one of the application's windows ourselves, so that the
+   * active window is always a terminal, but our parent is */
+  if (G_LIKELY (parent)) {
+    application = gtk_window_get_application (parent);
+  }
+
+  gtk_window_destroy (GTK_WINDOW (self));
+
+  if (G_LIKELY (application)) {
+    g_action_group_activate_action (G_ACTION_GROUP (application),
+                                    "focus-page",
+                                    g_variant_new_uint32 (id));
+  }
+}
+
+
+static void
+entry_activated (KgxTabSwitcher *self)
+{
+  GtkListBoxRow *row = gtk_list_box_get_selected_row (GTK_LIST_BOX (self->list));
+
+  if (row) {
+    row_activated (self, row);
+  }
+}
+
+
+static void
+move_selection (KgxTabSwitcher *self, int delta)
+{
+  GtkListBoxRow *row = gtk_list_box_get_selected_row (GTK_LIST_BOX (self->list));
+  int index = row ? gtk_list_box_row_get_index (row) + delta : 0;
+
+  row = gtk_list_box_get_row_at_index (GTK_LIST_BOX (self->list), MAX (index, 0));
+  if (row) {
+    gtk_list_box_select_row (GTK_LIST_BOX (self->list), row);
+    gtk_widget_grab_focus (self->entry);
+  }
+}
+
+
+static void
+next_match (KgxTabSwitcher *self)
+{
+  move_selection (self, 1);
+}
+
+
+static void
+previous_match (KgxTabSwitcher *self)
+{
+  move_selection (self, -1);
+}
+
+
+static gboolean
+key_pressed (GtkEventControllerKey *controller,
+             guint                  keyval,
+             guint                  keycode,
+             GdkModifierType        state,
+             KgxTabSwitcher        *self)
+{
+  switch (keyval) {
+    case GDK_KEY_Down:
+    case GDK_KEY_KP_Down:
+      move_selection (self, 1);
+      return GDK_EVENT_STOP;
+    case GDK_KEY_Up:
+    case GDK_KEY_KP_Up:
+      move_selection (self, -1);
+      return GDK_EVENT_STOP;
+    default:
+      return GDK_EVENT_PROPAGATE;
+  }
+}
+
+
+static void
+kgx_tab_switcher_init (KgxTabSwitcher *self)
+{
+  GtkEventController *controller;
+  GtkWidget *view, *header, *scrolled;
+
+  gtk_window_set_title (GTK_WINDOW (self), _("Switch to Tab"));
+  gtk_window_set_modal (GTK_WINDOW (self), TRUE);
+  gtk_window_set_default_size (GTK_WINDOW (self), 480, 420);
+
+  self->entry = gtk_search_entry_new ();
+  gtk_search_entry_set_placeholder_text (GTK_SEARCH_ENTRY (self->entry),
+                                         _("Title, directory, or command"));
+  gtk_search_entry_set_search_delay (GTK_SEARCH_ENTRY (self->entry), 0);
+  gtk_widget_set_hexpand (self->entry, TRUE);
+  g_signal_connect_swapped (self->entry, "search-changed",
+                            G_CALLBACK (search_changed), self);
+  g_signal_connect_swapped (self->entry, "activate",
+                            G_CALLBACK (entry_activated), self);
+  g_signal_connect_swapped (self->entry, "next-match",
+                            G_CALLBACK (next_match), self);
+  g_signal_connect_swapped (self->entry, "previous-match",
+                            G_CALLBACK (previous_match), self);
+  g_signal_connect_swapped (self->entry, "stop-search",
+                            G_CALLBACK (gtk_window_close), self);
+
+  controller = gtk_event_controller_key_new ();
+  gtk_event_controller_set_propagation_phase (controller, GTK_PHASE_CAPTURE);
+  g_signal_connect (controller, "key-pressed", G_CALLBACK (key_pressed), self);
+  gtk_widget_add_controller (self->entry, controller);
+
+  header = adw_header_bar_new ();
+  adw_header_bar_set_title_widget (ADW_HEADER_BAR (header), self->entry);
+
+  self->list = gtk_list_box_new ();
+  gtk_list_box_set_selection_mode (GTK_LIST_BOX (self->list),
+                                   GTK_SELECTION_BROWSE);
+  gtk_widget_add_css_class (self->list, "navigation-sidebar");
+  g_signal_connect_swapped (self->list, "row-activated",
+                            G_CALLBACK (row_activated), self);
+
+  scrolled = gtk_scrolled_window_new ();
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_NEVER,
+                                  GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_child (GTK_SCROLLED_WINDOW (scrolled), self->list);
+  gtk_widget_set_vexpand (scrolled, TRUE);
+
+  view = adw_toolbar_view_new ();
+  adw_toolbar_view_add_top_bar (ADW_TOOLBAR_VIEW (view), header);
+  adw_toolbar_view_set_content (ADW_TOOLBAR_VIEW (view), scrolled);
+
+  adw_window_set_content (ADW_WINDOW (self), view);
+}
+
+
+/**
+ * kgx_tab_switcher_new:
+ * @parent: the window to open over
+ * @index: the #KgxTabIndex to search
+ *
+ * Returns: (transfer none): a new #KgxTabSwitcher, ready to present
+ */
+GtkWidget *
+kgx_tab_switcher_new (GtkWindow   *parent,
+                      KgxTabIndex *index)
+{
+  KgxTabSwitcher *self;
+
+  g_return_val_if_fail (GTK_IS_WINDOW (parent), NULL);
+  g_return_val_if_fail (KGX_IS_TAB_INDEX (index), NULL);
+
+  self = g_object_new (KGX_TYPE_TAB_SWITCHER,
+                       "transient-for", parent,
+                       NULL);
+  self->index = g_object_ref (index);
+
+  search_changed (self);
+  gtk_widget_grab_focus (self->entry);
+
+  return GTK_WIDGET (self);
+}
@@ -0,0 +1,34 @@
+/* kgx-tab-switcher.h
+ *
+ * Copyright 2024 Zander Brown
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <adwaita.h>
+
+#include "kgx-tab-index.h"
+
+G_BEGIN_DECLS
+
+#define KGX_TYPE_TAB_SWITCHER kgx_tab_switcher_get_type ()
+G_DECLARE_FINAL_TYPE (KgxTabSwitcher, kgx_tab_switcher, KGX, TAB_SWITCHER, AdwWindow)
+
+
+GtkWidget            *kgx_tab_switcher_new            (GtkWindow      *parent,
+                                                       KgxTabIndex    *index);
+
+G_END_DECLS
@@ -27,8 +27,16 @@
 #include "kgx-terminal.h"
 #include "kgx-settings.h"
 #include "kgx-application.h"
-#include "kgx-drop-target.h"
+#include "kgx-recorder.h"
 #include "kgx-marshals.h"
+#include "kgx-marks.h"
+
+/* Bells are rung at most once a frame, and beyond a burst of BELL_BURST at
+ * most once every BELL_REFILL microseconds */
+#define BELL_BURST 4
+#define BELL_REFILL (G_USEC_PER_SEC / 4)
+/* How often hidden tabs pass on title/path changes (ms) */
+#define HIDDEN_TITLE_INTERVAL 1000
 
 
 typedef struct _KgxTabPrivate KgxTabPrivate;
@@ -51,17 +59,32 @@ struct _KgxTabPrivate {
   gboolean              ringing;
   guint                 ringing_timeout;
 
-  gboolean              dropping;
+  /* Token bucket for bells */
+  guint                 pending_bells;
+  guint                 bell_tick;
+  guint                 bell_idle;
+  double                bell_tokens;
+  gint64                bell_refilled;
+
+  gint64                hidden_since;
+
+  KgxRecorder          *recorder;
+  GFile                *log_dir;
 
   KgxTerminal          *terminal;
   GSignalGroup         *terminal_signals;
-  GBindingGroup        *terminal_binds;
 
-  GCancellable         *cancellable;
+  /* The terminal's title/path changed, but we haven't caught up yet */
+  gboolean              title_pending;
+  guint                 title_tick;
+  guint                 title_timeout;
 
-  KgxDropTarget        *drop_target;
+  GCancellable         *cancellable;
 
+  GtkWidget            *layout;
+  GtkWidget            *toolbar;
   GtkWidget            *stack;
+  GtkWidget            *placeholder;
   GtkWidget            *spinner_revealer;
   GtkWidget            *content;
   guint                 spinner_timeout;
@@ -74,10 +97,22 @@ struct _KgxTabPrivate {
 
   /* Remote/root states */
   GHashTable           *root;
-  GHashTable           *remote;
   GHashTable           *children;
+  char                 *running_command;
+
+  /* Where the shell says it is, see #KgxTerminal:remote-host */
+  char                 *remote_host;
+  char                 *command_host;
+
+  /* The shell tells us about its commands, as well as the watcher */
+  gboolean              shell_integrated;
+  gint64                command_started;
+  gboolean              command_privileged;
+
+  /* The window we told the #KgxNotifier about, if any */
+  guint                 notified_window;
 
-  char                 *notification_id;
+  KgxMonitorFlags       monitor;
 };
 
 
@@ -104,8 +139,12 @@ enum {
   PROP_NEEDS_ATTENTION,
   PROP_SEARCH_MODE_ENABLED,
   PROP_RINGING,
-  PROP_DROPPING,
   PROP_CANCELLABLE,
+  PROP_RECORDING,
+  PROP_RUNNING_COMMAND,
+  PROP_MONITOR,
+  PROP_SHELL_INTEGRATED,
+  PROP_REMOTE_HOST,
   LAST_PROP
 };
 static GParamSpec *pspecs[LAST_PROP] = { NULL, };
@@ -131,15 +170,22 @@ kgx_tab_dispose (GObject *object)
 
   g_clear_handle_id (&priv->spinner_timeout, g_source_remove);
 
-  if (priv->notification_id) {
-    g_application_withdraw_notification (G_APPLICATION (priv->application),
-                                         priv->notification_id);
-    g_clear_pointer (&priv->notification_id, g_free);
+  kgx_tab_set_recording (self, FALSE);
+  kgx_tab_set_monitor (self, KGX_MONITOR_NONE);
+
+  if (priv->notified_window && priv->application) {
+    kgx_notifier_forget_page (kgx_application_get_notifier (priv->application),
+                              priv->notified_window,
+                              priv->id);
+    priv->notified_window = 0;
   }
 
+  g_clear_object (&priv->log_dir);
   g_clear_object (&priv->application);
   g_clear_object (&priv->settings);
-  g_clear_object (&priv->terminal);
+  if (priv->terminal) {
+    kgx_terminal_retire (g_steal_pointer (&priv->terminal));
+  }
   g_clear_object (&priv->cancellable);
 
   g_clear_pointer (&priv->title, g_free);
@@ -147,10 +193,14 @@ kgx_tab_dispose (GObject *object)
   g_clear_object (&priv->path);
 
   g_clear_handle_id (&priv->ringing_timeout, g_source_remove);
+  g_clear_handle_id (&priv->bell_idle, g_source_remove);
+  g_clear_handle_id (&priv->title_timeout, g_source_remove);
 
   g_clear_pointer (&priv->root, g_hash_table_unref);
-  g_clear_pointer (&priv->remote, g_hash_table_unref);
   g_clear_pointer (&priv->children, g_hash_table_unref);
+  g_clear_pointer (&priv->running_command, g_free);
+  g_clear_pointer (&priv->remote_host, g_free);
+  g_clear_pointer (&priv->command_host, g_free);
 
   g_clear_pointer (&priv->last_search, g_free);
 
@@ -269,10 +319,89 @@ spinner_unmapped (GtkSpinner *spinner,
 }
 
 
+/*
+ * The search bar, spinner and exit message are only wanted by a handful of
+ * tabs at any one time, so rather than have every tab pay for them up front
+ * they're built the first time they're needed
+ */
+static void
+ensure_search_bar (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  GtkWidget *clamp, *box, *button;
+
+  if (priv->search_bar) {
+    return;
+  }
+
+  priv->search_entry = gtk_search_entry_new ();
+  gtk_search_entry_set_placeholder_text (GTK_SEARCH_ENTRY (priv->search_entry),
+                                         _("Find text"));
+  gtk_widget_set_hexpand (priv->search_entry, TRUE);
+  g_signal_connect (priv->search_entry, "next-match",
+                    G_CALLBACK (search_next), self);
+  g_signal_connect (priv->search_entry, "previous-match",
+                    G_CALLBACK (search_prev), self);
+  g_signal_connect (priv->search_entry, "search-changed",
+                    G_CALLBACK (search_changed), self);
+
+  box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  gtk_box_append (GTK_BOX (box), priv->search_entry);
+
+  button = gtk_button_new_from_icon_name ("go-up-symbolic");
+  gtk_widget_set_receives_default (button, TRUE);
+  gtk_widget_set_tooltip_text (button, _("Previous Match"));
+  g_signal_connect (button, "clicked", G_CALLBACK (search_prev), self);
+  gtk_box_append (GTK_BOX (box), button);
+
+  button = gtk_button_new_from_icon_name ("go-down-symbolic");
+  gtk_widget_set_receives_default (button, TRUE);
+  gtk_widget_set_tooltip_text (button, _("Next Match"));
+  g_signal_connect (button, "clicked", G_CALLBACK (search_next), self);
+  gtk_box_append (GTK_BOX (box), button);
+
+  clamp = adw_clamp_new ();
+  adw_clamp_set_maximum_size (ADW_CLAMP (clamp), 500);
+  adw_clamp_set_child (ADW_CLAMP (clamp), box);
+  gtk_widget_set_hexpand (clamp, TRUE);
+
+  priv->search_bar = gtk_search_bar_new ();
+  gtk_widget_add_css_class (priv->search_bar, "view");
+  gtk_search_bar_set_child (GTK_SEARCH_BAR (priv->search_bar), clamp);
+  gtk_search_bar_connect_entry (GTK_SEARCH_BAR (priv->search_bar),
+                                GTK_EDITABLE (priv->search_entry));
+
+  g_object_bind_property (self, "search-mode-enabled",
+                          priv->search_bar, "search-mode-enabled",
+                          G_BINDING_SYNC_CREATE | G_BINDING_BIDIRECTIONAL);
+  g_signal_connect (priv->search_bar, "notify::search-mode-enabled",
+                    G_CALLBACK (search_enabled), self);
+
+  adw_toolbar_view_add_top_bar (ADW_TOOLBAR_VIEW (priv->toolbar),
+                                priv->search_bar);
+}
+
+
 static gboolean
 start_spinner_timeout_cb (KgxTab *self)
 {
   KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  GtkWidget *spinner;
+
+  spinner = gtk_spinner_new ();
+  gtk_widget_set_halign (spinner, GTK_ALIGN_CENTER);
+  gtk_widget_set_valign (spinner, GTK_ALIGN_CENTER);
+  g_signal_connect (spinner, "map", G_CALLBACK (spinner_mapped), self);
+  g_signal_connect (spinner, "unmap", G_CALLBACK (spinner_unmapped), self);
+
+  priv->spinner_revealer = gtk_revealer_new ();
+  gtk_widget_set_hexpand (priv->spinner_revealer, TRUE);
+  gtk_revealer_set_transition_type (GTK_REVEALER (priv->spinner_revealer),
+                                    GTK_REVEALER_TRANSITION_TYPE_CROSSFADE);
+  gtk_revealer_set_transition_duration (GTK_REVEALER (priv->spinner_revealer),
+                                        1000);
+  gtk_revealer_set_child (GTK_REVEALER (priv->spinner_revealer), spinner);
+  gtk_box_append (GTK_BOX (priv->placeholder), priv->spinner_revealer);
 
   gtk_revealer_set_reveal_child (GTK_REVEALER (priv->spinner_revealer), TRUE);
   priv->spinner_timeout = 0;
@@ -287,6 +416,13 @@ set_status (KgxTab    *self,
 {
   KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
 
+  /* Remoteness comes from the shell, not from whoever is setting this */
+  if (priv->remote_host) {
+    status |= KGX_REMOTE;
+  } else {
+    status &= ~KGX_REMOTE;
+  }
+
   if (priv->status == status) {
     return;
   }
@@ -309,6 +445,70 @@ set_status (KgxTab    *self,
 }
 
 
+static void
+remote_host_changed (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  const char *host = NULL;
+
+  if (priv->terminal) {
+    host = kgx_terminal_get_remote_host (priv->terminal);
+  }
+
+  if (!g_set_str (&priv->remote_host, host)) {
+    return;
+  }
+
+  g_debug ("tab: %u on %s", priv->id, host ? host : "this host");
+
+  set_status (self, priv->status);
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_REMOTE_HOST]);
+}
+
+
+/*
+ * Privileged whilst the watcher has seen a root child, or the shell says
+ * it's running something like sudo
+ */
+static void
+update_privileged (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  KgxStatus status = priv->status & ~KGX_PRIVILEGED;
+
+  if (g_hash_table_size (priv->root) > 0 || priv->command_privileged) {
+    status |= KGX_PRIVILEGED;
+  }
+
+  set_status (self, status);
+}
+
+
+static void
+integrated_changed (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  gboolean integrated = FALSE;
+
+  if (priv->terminal) {
+    integrated = kgx_terminal_get_integrated (priv->terminal);
+  }
+
+  if (priv->shell_integrated == integrated) {
+    return;
+  }
+
+  g_debug ("tab: %u %s shell integration",
+           priv->id,
+           integrated ? "has" : "lost");
+
+  priv->shell_integrated = integrated;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_SHELL_INTEGRATED]);
+}
+
+
 static void
 kgx_tab_get_property (GObject    *object,
                       guint       property_id,
@@ -355,12 +555,24 @@ kgx_tab_get_property (GObject    *object,
     case PROP_RINGING:
       g_value_set_boolean (value, priv->ringing);
       break;
-    case PROP_DROPPING:
-      g_value_set_boolean (value, priv->dropping);
-      break;
     case PROP_CANCELLABLE:
       g_value_set_object (value, priv->cancellable);
       break;
+    case PROP_RECORDING:
+      g_value_set_boolean (value, priv->recorder != NULL);
+      break;
+    case PROP_RUNNING_COMMAND:
+      g_value_set_string (value, priv->running_command);
+      break;
+    case PROP_MONITOR:
+      g_value_set_flags (value, priv->monitor);
+      break;
+    case PROP_SHELL_INTEGRATED:
+      g_value_set_boolean (value, priv->shell_integrated);
+      break;
+    case PROP_REMOTE_HOST:
+      g_value_set_string (value, priv->remote_host);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -384,10 +596,14 @@ kgx_tab_set_is_active (KgxTab   *self,
 
   priv->is_active = active;
 
-  if (active && priv->notification_id) {
-    g_application_withdraw_notification (G_APPLICATION (priv->application),
-                                          priv->notification_id);
-    g_clear_pointer (&priv->notification_id, g_free);
+  if (active && priv->notified_window) {
+    kgx_notifier_dismiss (kgx_application_get_notifier (priv->application),
+                          priv->notified_window);
+    priv->notified_window = 0;
+  }
+
+  if (active && priv->monitor && priv->application) {
+    kgx_monitor_seen (kgx_application_get_monitor (priv->application), self);
   }
   g_object_set (self, "needs-attention", FALSE, NULL);
 
@@ -395,6 +611,89 @@ kgx_tab_set_is_active (KgxTab   *self,
 }
 
 
+/*
+ * Pass the terminal's title and path on to everyone watching us
+ */
+static void
+sync_title (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  g_autofree char *title = NULL;
+  g_autoptr (GFile) path = NULL;
+
+  priv->title_pending = FALSE;
+
+  if (!priv->terminal) {
+    return;
+  }
+
+  g_object_get (priv->terminal,
+                "window-title", &title,
+                "path", &path,
+                NULL);
+
+  if (g_strcmp0 (title, priv->title) != 0) {
+    g_object_set (self, "tab-title", title, NULL);
+  }
+
+  if (path != priv->path &&
+      (!path || !priv->path || !g_file_equal (path, priv->path))) {
+    g_object_set (self, "tab-path", path, NULL);
+  }
+}
+
+
+static gboolean
+title_tick (GtkWidget     *widget,
+            GdkFrameClock *frame_clock,
+            gpointer       data)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (KGX_TAB (widget));
+
+  priv->title_tick = 0;
+  sync_title (KGX_TAB (widget));
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+title_timeout (gpointer data)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (KGX_TAB (data));
+
+  priv->title_timeout = 0;
+  sync_title (KGX_TAB (data));
+}
+
+
+/*
+ * Some programs set the title constantly (progress in OSC 0, prompts), so
+ * visible tabs catch up at most once a frame and hidden ones once in a
+ * while, saving the tab bar, window title, etc. from keeping up with it
+ */
+static void
+queue_sync_title (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+
+  priv->title_pending = TRUE;
+
+  if (priv->title_tick || priv->title_timeout) {
+    return;
+  }
+
+  if (gtk_widget_get_mapped (GTK_WIDGET (self))) {
+    priv->title_tick =
+      gtk_widget_add_tick_callback (GTK_WIDGET (self), title_tick, NULL, NULL);
+  } else {
+    priv->title_timeout =
+      g_timeout_add_once (HIDDEN_TITLE_INTERVAL, title_timeout, self);
+    g_source_set_name_by_id (priv->title_timeout, "[kgx] hidden tab title");
+  }
+}
+
+
 static void
 kgx_tab_set_property (GObject      *object,
                       guint         property_id,
@@ -416,7 +715,13 @@ kgx_tab_set_property (GObject      *object,
       g_set_object (&priv->settings, g_value_get_object (value));
       break;
     case PROP_TERMINAL:
+      if (priv->terminal != g_value_get_object (value)) {
+        kgx_tab_set_recording (self, FALSE);
+      }
       g_set_object (&priv->terminal, g_value_get_object (value));
+      sync_title (self);
+      remote_host_changed (self);
+      integrated_changed (self);
       break;
     case PROP_TAB_TITLE:
       g_clear_pointer (&priv->title, g_free);
@@ -443,9 +748,15 @@ kgx_tab_set_property (GObject      *object,
       break;
     case PROP_SEARCH_MODE_ENABLED:
       priv->search_mode_enabled = g_value_get_boolean (value);
+      if (priv->search_mode_enabled) {
+        ensure_search_bar (self);
+      }
       break;
-    case PROP_DROPPING:
-      priv->dropping = g_value_get_boolean (value);
+    case PROP_RECORDING:
+      kgx_tab_set_recording (self, g_value_get_boolean (value));
+      break;
+    case PROP_MONITOR:
+      kgx_tab_set_monitor (self, g_value_get_flags (value));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -454,31 +765,175 @@ kgx_tab_set_property (GObject      *object,
 }
 
 
-static void
-drop (KgxDropTarget *target,
-      const char    *text,
-      KgxTab        *self)
+static gboolean
+kgx_tab_grab_focus (GtkWidget *widget)
 {
+  KgxTab *self = KGX_TAB (widget);
   KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
 
   if (priv->terminal) {
-    kgx_terminal_accept_paste (KGX_TERMINAL (priv->terminal), text);
+    gtk_widget_grab_focus (GTK_WIDGET (priv->terminal));
+    return GDK_EVENT_STOP;
+  }
+
+  return GTK_WIDGET_CLASS (kgx_tab_parent_class)->grab_focus (widget);
+}
+
+
+/*
+ * However many bells arrived since last time they ring (at most) once,
+ * and only if the bucket has a token to spare, so a stream of BELs can't
+ * turn into a stream of notifies, restyles and beeps
+ */
+static void
+flush_bells (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  gint64 now = g_get_monotonic_time ();
+  guint pending = priv->pending_bells;
+
+  priv->pending_bells = 0;
+
+  if (!pending) {
+    return;
+  }
+
+  priv->bell_tokens = MIN (BELL_BURST,
+                           priv->bell_tokens +
+                             (double) (now - priv->bell_refilled) / BELL_REFILL);
+  priv->bell_refilled = now;
+
+  if (priv->bell_tokens < 1.0) {
+    g_debug ("tab: %u ignoring %u bells", priv->id, pending);
+    return;
   }
+
+  priv->bell_tokens -= 1.0;
+
+  g_signal_emit (self, signals[BELL], 0);
 }
 
 
 static gboolean
-kgx_tab_grab_focus (GtkWidget *widget)
+bell_tick (GtkWidget     *widget,
+           GdkFrameClock *frame_clock,
+           gpointer       data)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (KGX_TAB (widget));
+
+  priv->bell_tick = 0;
+  flush_bells (KGX_TAB (widget));
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+bell_idle (gpointer data)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (KGX_TAB (data));
+
+  priv->bell_idle = 0;
+  flush_bells (KGX_TAB (data));
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+queue_bells (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+
+  if (priv->bell_tick || priv->bell_idle) {
+    return;
+  }
+
+  /* Hidden tabs don't get frames, so make do with the main loop */
+  if (gtk_widget_get_mapped (GTK_WIDGET (self))) {
+    priv->bell_tick =
+      gtk_widget_add_tick_callback (GTK_WIDGET (self), bell_tick, NULL, NULL);
+  } else {
+    priv->bell_idle = g_idle_add (bell_idle, self);
+    g_source_set_name_by_id (priv->bell_idle, "[kgx] tab bells");
+  }
+}
+
+
+static void
+kgx_tab_map (GtkWidget *widget)
 {
   KgxTab *self = KGX_TAB (widget);
   KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
 
+  priv->hidden_since = 0;
+
+  if (priv->title_pending) {
+    g_clear_handle_id (&priv->title_timeout, g_source_remove);
+    sync_title (self);
+  }
+
+  /* Wake before we're drawn so the snapshot never shows, this also stops
+   * a hibernation that's still on its way */
   if (priv->terminal) {
-    gtk_widget_grab_focus (GTK_WIDGET (priv->terminal));
-    return GDK_EVENT_STOP;
+    if (kgx_terminal_get_hibernated (priv->terminal)) {
+      g_debug ("tab: waking %u", priv->id);
+    }
+    kgx_terminal_thaw (priv->terminal);
   }
 
-  return GTK_WIDGET_CLASS (kgx_tab_parent_class)->grab_focus (widget);
+  GTK_WIDGET_CLASS (kgx_tab_parent_class)->map (widget);
+}
+
+
+/*
+ * Whatever we told the notifier was about the window we're leaving, so
+ * don't leave it there to be dismissed (or not) by the wrong window
+ */
+static void
+kgx_tab_unroot (GtkWidget *widget)
+{
+  KgxTab *self = KGX_TAB (widget);
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+
+  if (priv->notified_window && priv->application) {
+    kgx_notifier_forget_page (kgx_application_get_notifier (priv->application),
+                              priv->notified_window,
+                              priv->id);
+  }
+  priv->notified_window = 0;
+
+  GTK_WIDGET_CLASS (kgx_tab_parent_class)->unroot (widget);
+}
+
+
+static void
+kgx_tab_unmap (GtkWidget *widget)
+{
+  KgxTab *self = KGX_TAB (widget);
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+
+  if (priv->bell_tick) {
+    gtk_widget_remove_tick_callback (widget, priv->bell_tick);
+    priv->bell_tick = 0;
+  }
+
+  if (priv->title_tick) {
+    gtk_widget_remove_tick_callback (widget, priv->title_tick);
+    priv->title_tick = 0;
+  }
+
+  GTK_WIDGET_CLASS (kgx_tab_parent_class)->unmap (widget);
+
+  priv->hidden_since = g_get_monotonic_time ();
+
+  if (priv->pending_bells) {
+    queue_bells (self);
+  }
+
+  if (priv->title_pending) {
+    queue_sync_title (self);
+  }
 }
 
 
@@ -514,6 +969,21 @@ kgx_tab_real_died (KgxTab         *self,
 
   priv = kgx_tab_get_instance_private (self);
 
+  if (!priv->exit_revealer) {
+    priv->exit_message = gtk_label_new (NULL);
+    gtk_label_set_wrap (GTK_LABEL (priv->exit_message), TRUE);
+    gtk_label_set_xalign (GTK_LABEL (priv->exit_message), 0.0);
+    gtk_widget_add_css_class (priv->exit_message, "exit-info");
+
+    priv->exit_revealer = gtk_revealer_new ();
+    gtk_widget_set_can_focus (priv->exit_revealer, FALSE);
+    gtk_revealer_set_transition_type (GTK_REVEALER (priv->exit_revealer),
+                                      GTK_REVEALER_TRANSITION_TYPE_SLIDE_UP);
+    gtk_revealer_set_child (GTK_REVEALER (priv->exit_revealer),
+                            priv->exit_message);
+    gtk_box_append (GTK_BOX (priv->layout), priv->exit_revealer);
+  }
+
   gtk_label_set_markup (GTK_LABEL (priv->exit_message), message);
 
   if (type == GTK_MESSAGE_ERROR) {
@@ -554,12 +1024,19 @@ kgx_tab_real_bell (KgxTab *self)
 
   priv = kgx_tab_get_instance_private (self);
 
+  /* VTE would beep for every single BEL, so we do it here instead */
+  if (kgx_settings_get_audible_bell (priv->settings)) {
+    gtk_widget_error_bell (GTK_WIDGET (self));
+  }
+
   if (!kgx_settings_get_visual_bell (priv->settings)) {
     return;
   }
 
-  priv->ringing = TRUE;
-  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RINGING]);
+  if (!priv->ringing) {
+    priv->ringing = TRUE;
+    g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RINGING]);
+  }
 
   g_clear_handle_id (&priv->ringing_timeout, g_source_remove);
   priv->ringing_timeout = g_timeout_add_once (500, clear_ringing, self);
@@ -579,6 +1056,9 @@ kgx_tab_class_init (KgxTabClass *klass)
   object_class->set_property = kgx_tab_set_property;
 
   widget_class->grab_focus = kgx_tab_grab_focus;
+  widget_class->map = kgx_tab_map;
+  widget_class->unmap = kgx_tab_unmap;
+  widget_class->unroot = kgx_tab_unroot;
 
   tab_class->start = kgx_tab_real_start;
   tab_class->start_finish = kgx_tab_real_start_finish;
@@ -674,36 +1154,95 @@ kgx_tab_class_init (KgxTabClass *klass)
                           FALSE,
                           G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
-  pspecs[PROP_DROPPING] =
-    g_param_spec_boolean ("dropping", NULL, NULL,
-                          FALSE,
-                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
-
   pspecs[PROP_CANCELLABLE] =
     g_param_spec_object ("cancellable", NULL, NULL,
                          G_TYPE_CANCELLABLE,
                          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
 
-  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+  /**
+   * KgxTab:recording:
+   *
+   * Output is being logged to disk, see kgx_tab_set_recording()
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_RECORDING] =
+    g_param_spec_boolean ("recording", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
-  signals[SIZE_CHANGED] = g_signal_new ("size-changed",
-                                        G_TYPE_FROM_CLASS (klass),
-                                        G_SIGNAL_RUN_LAST,
-                                        0, NULL, NULL,
-                                        kgx_marshals_VOID__UINT_UINT,
-                                        G_TYPE_NONE,
-                                        2,
-                                        G_TYPE_UINT,
-                                        G_TYPE_UINT);
-  g_signal_set_va_marshaller (signals[SIZE_CHANGED],
-                              G_TYPE_FROM_CLASS (klass),
-                              kgx_marshals_VOID__UINT_UINTv);
+  /**
+   * KgxTab:running-command:
+   *
+   * The most recently started of the children, or %NULL when the shell
+   * is idle
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_RUNNING_COMMAND] =
+    g_param_spec_string ("running-command", NULL, NULL,
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
-  signals[ZOOM] = g_signal_new ("zoom",
-                                G_TYPE_FROM_CLASS (klass),
-                                G_SIGNAL_RUN_LAST,
-                                0, NULL, NULL,
-                                kgx_marshals_VOID__ENUM,
+  /**
+   * KgxTab:monitor:
+   *
+   * What to tell the user about, see kgx_tab_set_monitor()
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_MONITOR] =
+    g_param_spec_flags ("monitor", NULL, NULL,
+                        KGX_TYPE_MONITOR_FLAGS,
+                        KGX_MONITOR_NONE,
+                        G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * KgxTab:shell-integrated:
+   *
+   * The shell sends OSC 133 marks, so we know when commands start and
+   * finish, what they were, and how they went. Processes are still
+   * watched regardless, the marks stop whenever the shell does
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_SHELL_INTEGRATED] =
+    g_param_spec_boolean ("shell-integrated", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * KgxTab:remote-host:
+   *
+   * The #KgxTerminal:remote-host of our terminal, %NULL when local
+   *
+   * Stability: Private
+   */
+  pspecs[PROP_REMOTE_HOST] =
+    g_param_spec_string ("remote-host", NULL, NULL,
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+
+  signals[SIZE_CHANGED] = g_signal_new ("size-changed",
+                                        G_TYPE_FROM_CLASS (klass),
+                                        G_SIGNAL_RUN_LAST,
+                                        0, NULL, NULL,
+                                        kgx_marshals_VOID__UINT_UINT,
+                                        G_TYPE_NONE,
+                                        2,
+                                        G_TYPE_UINT,
+                                        G_TYPE_UINT);
+  g_signal_set_va_marshaller (signals[SIZE_CHANGED],
+                              G_TYPE_FROM_CLASS (klass),
+                              kgx_marshals_VOID__UINT_UINTv);
+
+  signals[ZOOM] = g_signal_new ("zoom",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL,
+                                kgx_marshals_VOID__ENUM,
                                 G_TYPE_NONE,
                                 1,
                                 KGX_TYPE_ZOOM);
@@ -741,23 +1280,11 @@ kgx_tab_class_init (KgxTabClass *klass)
   gtk_widget_class_set_template_from_resource (widget_class,
                                                KGX_APPLICATION_PATH "kgx-tab.ui");
 
+  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, layout);
+  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, toolbar);
   gtk_widget_class_bind_template_child_private (widget_class, KgxTab, stack);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, spinner_revealer);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, exit_revealer);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, exit_message);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, search_entry);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, search_bar);
+  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, placeholder);
   gtk_widget_class_bind_template_child_private (widget_class, KgxTab, terminal_signals);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, terminal_binds);
-  gtk_widget_class_bind_template_child_private (widget_class, KgxTab, drop_target);
-
-  gtk_widget_class_bind_template_callback (widget_class, search_enabled);
-  gtk_widget_class_bind_template_callback (widget_class, search_changed);
-  gtk_widget_class_bind_template_callback (widget_class, search_next);
-  gtk_widget_class_bind_template_callback (widget_class, search_prev);
-  gtk_widget_class_bind_template_callback (widget_class, spinner_mapped);
-  gtk_widget_class_bind_template_callback (widget_class, spinner_unmapped);
-  gtk_widget_class_bind_template_callback (widget_class, drop);
 
   gtk_widget_class_set_css_name (widget_class, "kgx-tab");
 }
@@ -824,6 +1351,150 @@ bell (KgxTerminal *term,
 }
 
 
+static void
+command_completed (KgxTab     *self,
+                   const char *body,
+                   gint64      duration)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  GtkRoot *root = gtk_widget_get_root (GTK_WIDGET (self));
+  gint64 min_duration =
+    kgx_settings_get_notify_min_duration (priv->settings) * G_USEC_PER_SEC;
+
+  if (GTK_IS_APPLICATION_WINDOW (root) && duration >= min_duration) {
+    priv->notified_window =
+      gtk_application_window_get_id (GTK_APPLICATION_WINDOW (root));
+    kgx_notifier_command_completed (kgx_application_get_notifier (priv->application),
+                                    priv->notified_window,
+                                    priv->id,
+                                    body);
+  }
+
+  if (!gtk_widget_get_mapped (GTK_WIDGET (self))) {
+    g_object_set (self, "needs-attention", TRUE, NULL);
+  }
+}
+
+
+static void
+command_finished (KgxTab *self,
+                  int     exit_status)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  g_autofree char *body = NULL;
+  const char *command;
+  gint64 duration;
+
+  if (!priv->command_started) {
+    return;
+  }
+
+  duration = g_get_monotonic_time () - priv->command_started;
+  priv->command_started = 0;
+
+  command = priv->running_command ? priv->running_command : _("Unknown command");
+  if (exit_status > 0) {
+    /* Translators: %s is a command line, %i the non-zero status it exited with */
+    body = g_strdup_printf (_("%s (exit status %i)"), command, exit_status);
+  } else {
+    body = g_strdup (command);
+  }
+
+  g_debug ("tab: %u finished %s", priv->id, body);
+
+  if (priv->running_command && priv->application) {
+    g_autoptr (GFile) path = NULL;
+
+    g_object_get (self, "tab-path", &path, NULL);
+
+    kgx_history_record (kgx_application_get_history (priv->application),
+                        priv->running_command,
+                        path ? g_file_peek_path (path) : NULL,
+                        priv->command_host ? priv->command_host : g_get_host_name (),
+                        g_get_real_time () - duration,
+                        duration,
+                        exit_status);
+  }
+
+  if (g_set_str (&priv->running_command, NULL)) {
+    g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RUNNING_COMMAND]);
+  }
+  priv->command_privileged = FALSE;
+  update_privileged (self);
+
+  if (!kgx_tab_is_active (self)) {
+    command_completed (self, body, duration);
+  }
+}
+
+
+static inline gboolean
+is_privileged_command (const char *command)
+{
+  static const char *const elevators[] = { "sudo", "doas", "pkexec", "run0", "su" };
+  gsize len;
+
+  command += strspn (command, " \t");
+  len = strcspn (command, " \t");
+
+  for (gsize i = 0; i < G_N_ELEMENTS (elevators); i++) {
+    if (strlen (elevators[i]) == len && strncmp (command, elevators[i], len) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+
+static void
+command_started (KgxTab     *self,
+                 const char *command)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+
+  /* Shells are allowed to skip the D, so whatever was running is done */
+  command_finished (self, -1);
+
+  priv->command_started = g_get_monotonic_time ();
+  /* The prompt that ran it may well have been somewhere else by the end */
+  g_set_str (&priv->command_host, priv->remote_host);
+
+  if (g_set_str (&priv->running_command, command)) {
+    g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RUNNING_COMMAND]);
+  }
+
+  priv->command_privileged = command && is_privileged_command (command);
+  update_privileged (self);
+}
+
+
+static void
+shell_mark (KgxTerminal *term,
+            KgxMarkKind  kind,
+            int          exit_status,
+            const char  *command,
+            KgxTab      *self)
+{
+  switch (kind) {
+    case KGX_MARK_PROMPT:
+      /* A prompt means nothing is running, even if we missed the end */
+      command_finished (self, -1);
+      break;
+    case KGX_MARK_INPUT:
+      break;
+    case KGX_MARK_EXECUTED:
+      command_started (self, command);
+      break;
+    case KGX_MARK_FINISHED:
+      command_finished (self, exit_status);
+      break;
+    default:
+      g_return_if_reached ();
+  }
+}
+
+
 static void
 kgx_tab_init (KgxTab *self)
 {
@@ -835,13 +1506,13 @@ kgx_tab_init (KgxTab *self)
   priv->id = last_id;
 
   priv->root = g_hash_table_new (g_direct_hash, g_direct_equal);
-  priv->remote = g_hash_table_new (g_direct_hash, g_direct_equal);
   priv->children = g_hash_table_new_full (g_direct_hash,
                                           g_direct_equal,
                                           NULL,
                                           (GDestroyNotify) kgx_process_unref);
 
   priv->cancellable = g_cancellable_new ();
+  priv->hidden_since = g_get_monotonic_time ();
 
   gtk_widget_init_template (GTK_WIDGET (self));
 
@@ -854,18 +1525,21 @@ kgx_tab_init (KgxTab *self)
   g_signal_group_connect (priv->terminal_signals,
                           "bell", G_CALLBACK (bell),
                           self),
-
-  g_binding_group_bind (priv->terminal_binds, "window-title",
-                        self, "tab-title",
-                        G_BINDING_SYNC_CREATE);
-  g_binding_group_bind (priv->terminal_binds, "path",
-                        self, "tab-path",
-                        G_BINDING_SYNC_CREATE);
-
-  gtk_search_bar_connect_entry (GTK_SEARCH_BAR (priv->search_bar),
-                                GTK_EDITABLE (priv->search_entry));
-
-  kgx_drop_target_mount_on (priv->drop_target, GTK_WIDGET (self));
+  g_signal_group_connect_swapped (priv->terminal_signals,
+                                  "notify::window-title", G_CALLBACK (queue_sync_title),
+                                  self);
+  g_signal_group_connect_swapped (priv->terminal_signals,
+                                  "notify::path", G_CALLBACK (queue_sync_title),
+                                  self);
+  g_signal_group_connect (priv->terminal_signals,
+                          "shell-mark", G_CALLBACK (shell_mark),
+                          self);
+  g_signal_group_connect_swapped (priv->terminal_signals,
+                                  "notify::remote-host", G_CALLBACK (remote_host_changed),
+                                  self);
+  g_signal_group_connect_swapped (priv->terminal_signals,
+                                  "notify::integrated", G_CALLBACK (integrated_changed),
+                                  self);
 }
 
 
@@ -904,6 +1578,10 @@ kgx_tab_start_finish (KgxTab        *self,
   pid = KGX_TAB_GET_CLASS (self)->start_finish (self, res, error);
 
   g_clear_handle_id (&priv->spinner_timeout, g_source_remove);
+  if (priv->spinner_revealer) {
+    gtk_box_remove (GTK_BOX (priv->placeholder), priv->spinner_revealer);
+    priv->spinner_revealer = NULL;
+  }
   gtk_stack_set_visible_child (GTK_STACK (priv->stack), priv->content);
   gtk_widget_grab_focus (GTK_WIDGET (self));
 
@@ -934,7 +1612,8 @@ kgx_tab_bell (KgxTab *self)
     g_object_set (self, "needs-attention", TRUE, NULL);
   }
 
-  g_signal_emit (self, signals[BELL], 0);
+  priv->pending_bells++;
+  queue_bells (self);
 }
 
 
@@ -997,6 +1676,40 @@ push_type (GHashTable      *table,
 }
 
 
+static void
+update_running_command (KgxTab *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  g_autofree char *command = NULL;
+  g_autofree char *subtitle = NULL;
+  KgxProcess *youngest = NULL;
+  GHashTableIter iter;
+  gpointer process;
+
+  /* The shell told us what it's running, which beats guessing */
+  if (priv->command_started) {
+    return;
+  }
+
+  g_hash_table_iter_init (&iter, priv->children);
+  while (g_hash_table_iter_next (&iter, NULL, &process)) {
+    if (!youngest ||
+        kgx_process_get_age (process) < kgx_process_get_age (youngest)) {
+      youngest = process;
+    }
+  }
+
+  if (youngest) {
+    kgx_process_get_title (youngest, &command, &subtitle);
+    g_strstrip (command);
+  }
+
+  if (g_set_str (&priv->running_command, command)) {
+    g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RUNNING_COMMAND]);
+  }
+}
+
+
 /**
  * kgx_tab_push_child:
  * @self: the #KgxTab
@@ -1009,9 +1722,6 @@ kgx_tab_push_child (KgxTab     *self,
                     KgxProcess *process)
 {
   GPid pid = 0;
-  GStrv argv;
-  g_autofree char *program = NULL;
-  KgxStatus new_status = KGX_NONE;
   KgxTabPrivate *priv;
 
   g_return_if_fail (KGX_IS_TAB (self));
@@ -1019,37 +1729,15 @@ kgx_tab_push_child (KgxTab     *self,
   priv = kgx_tab_get_instance_private (self);
 
   pid = kgx_process_get_pid (process);
-  argv = kgx_process_get_argv (process);
-
-  if (G_LIKELY (argv[0] != NULL)) {
-    program = g_path_get_basename (argv[0]);
-  }
-
-  if (G_UNLIKELY (g_strcmp0 (program, "ssh") == 0 ||
-                  g_strcmp0 (program, "telnet") == 0 ||
-                  g_strcmp0 (program, "mosh-client") == 0 ||
-                  g_strcmp0 (program, "mosh") == 0 ||
-                  g_strcmp0 (program, "et") == 0)) {
-    new_status |= push_type (priv->remote, pid, NULL, KGX_REMOTE);
-  }
-
-  if (G_UNLIKELY (g_strcmp0 (program, "waypipe") == 0)) {
-    for (int i = 1; argv[i]; i++) {
-      if (G_UNLIKELY (g_strcmp0 (argv[i], "ssh") == 0 ||
-                      g_strcmp0 (argv[i], "telnet") == 0)) {
-        new_status |= push_type (priv->remote, pid, NULL, KGX_REMOTE);
-        break;
-      }
-    }
-  }
 
   if (G_UNLIKELY (kgx_process_get_is_root (process))) {
-    new_status |= push_type (priv->root, pid, NULL, KGX_PRIVILEGED);
+    push_type (priv->root, pid, NULL, KGX_PRIVILEGED);
   }
 
   push_type (priv->children, pid, process, KGX_NONE);
 
-  set_status (self, new_status);
+  update_privileged (self);
+  update_running_command (self);
 }
 
 
@@ -1088,7 +1776,6 @@ kgx_tab_pop_child (KgxTab     *self,
                    KgxProcess *process)
 {
   GPid pid = 0;
-  KgxStatus new_status = KGX_NONE;
   KgxTabPrivate *priv;
 
   g_return_if_fail (KGX_IS_TAB (self));
@@ -1097,20 +1784,26 @@ kgx_tab_pop_child (KgxTab     *self,
 
   pid = kgx_process_get_pid (process);
 
-  new_status |= pop_type (priv->remote, pid, KGX_REMOTE);
-  new_status |= pop_type (priv->root, pid, KGX_PRIVILEGED);
+  pop_type (priv->root, pid, KGX_PRIVILEGED);
   pop_type (priv->children, pid, KGX_NONE);
 
-  set_status (self, new_status);
+  if (priv->terminal) {
+    kgx_terminal_process_exited (priv->terminal, pid);
+  }
+
+  update_privileged (self);
+  update_running_command (self);
+
+  /* The D mark says when it's done, along with how it went */
+  if (priv->shell_integrated) {
+    return;
+  }
 
   if (!kgx_tab_is_active (self)) {
-    g_autoptr (GNotification) noti = NULL;
     g_autofree char *body = NULL;
     g_autofree char *process_title = NULL;
     g_autofree char *process_subtitle = NULL;
 
-    noti = g_notification_new (_("Command completed"));
-
     kgx_process_get_title (process, &process_title, &process_subtitle);
     if (process_subtitle) {
       body = g_strdup_printf ("%s, %s",
@@ -1119,21 +1812,8 @@ kgx_tab_pop_child (KgxTab     *self,
     } else {
       body = g_steal_pointer (&process_title);
     }
-    g_notification_set_body (noti, body);
-
-    g_notification_set_default_action_and_target (noti,
-                                                  "app.focus-page",
-                                                  "u",
-                                                  priv->id);
-
-    priv->notification_id = g_strdup_printf ("command-completed-%u", priv->id);
-    g_application_send_notification (G_APPLICATION (priv->application),
-                                     priv->notification_id,
-                                     noti);
 
-    if (!gtk_widget_get_mapped (GTK_WIDGET (self))) {
-      g_object_set (self, "needs-attention", TRUE, NULL);
-    }
+    command_completed (self, body, kgx_process_get_age (process));
   }
 }
 
@@ -1180,13 +1860,23 @@ kgx_tab_get_children (KgxTab *self)
     g_ptr_array_add (children, g_rc_box_acquire (process));
   }
 
+  /* Nothing the watcher can see, a builtin or another machine perhaps,
+   * but the shell says it's busy */
+  if (children->len == 0 && priv->command_started) {
+    g_ptr_array_add (children,
+                     kgx_process_new_for_command (priv->running_command ?
+                                                    priv->running_command :
+                                                    _("Unknown command"),
+                                                  priv->command_started));
+  }
+
   return children;
 }
 
 
 void
-kgx_tab_extra_drop (KgxTab       *self,
-                    const GValue *value)
+kgx_tab_accept_drop (KgxTab     *self,
+                     const char *text)
 {
   KgxTabPrivate *priv;
 
@@ -1194,7 +1884,9 @@ kgx_tab_extra_drop (KgxTab       *self,
 
   priv = kgx_tab_get_instance_private (self);
 
-  kgx_drop_target_extra_drop (priv->drop_target, value);
+  if (priv->terminal) {
+    kgx_terminal_accept_paste (KGX_TERMINAL (priv->terminal), text);
+  }
 }
 
 
@@ -1217,3 +1909,376 @@ kgx_tab_set_initial_title (KgxTab     *self,
                 "tab-path", path,
                 NULL);
 }
+
+
+/**
+ * kgx_tab_get_hidden_since:
+ * @self: the #KgxTab
+ *
+ * Returns: the monotonic time @self was last unmapped, or 0 when visible
+ */
+gint64
+kgx_tab_get_hidden_since (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), 0);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  return priv->hidden_since;
+}
+
+
+/**
+ * kgx_tab_get_generation:
+ * @self: the #KgxTab
+ *
+ * Returns: a counter that moves on whenever the contents change
+ */
+guint
+kgx_tab_get_generation (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), 0);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (!priv->terminal) {
+    return 0;
+  }
+
+  return kgx_terminal_get_generation (priv->terminal);
+}
+
+
+/**
+ * kgx_tab_get_activity:
+ * @self: the #KgxTab
+ *
+ * Returns: a counter that moves on whenever the child writes something,
+ *          hibernated or not
+ */
+guint
+kgx_tab_get_activity (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), 0);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (!priv->terminal) {
+    return 0;
+  }
+
+  return kgx_terminal_get_activity (priv->terminal);
+}
+
+
+gboolean
+kgx_tab_get_hibernated (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), FALSE);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  return priv->terminal && kgx_terminal_get_hibernated (priv->terminal);
+}
+
+
+/**
+ * kgx_tab_hibernate:
+ * @self: the #KgxTab
+ *
+ * Swap the contents of a hidden tab out for a compressed snapshot, it'll be
+ * restored when next mapped
+ *
+ * Tabs with something running in them are left alone, as whatever it is may
+ * have put the terminal in a mode the snapshot can't capture
+ *
+ * Returns: %TRUE if @self is now hibernating, or will be once the snapshot
+ *          is taken
+ */
+gboolean
+kgx_tab_hibernate (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), FALSE);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (!priv->terminal || gtk_widget_get_mapped (GTK_WIDGET (self))) {
+    return FALSE;
+  }
+
+  if (kgx_terminal_get_hibernated (priv->terminal)) {
+    return TRUE;
+  }
+
+  if (g_hash_table_size (priv->children) > 0) {
+    return FALSE;
+  }
+
+  g_debug ("tab: hibernating %u", priv->id);
+
+  kgx_terminal_hibernate (priv->terminal);
+
+  return TRUE;
+}
+
+
+static void
+record_output (KgxTerminal *terminal,
+               GBytes      *output,
+               KgxTab      *self)
+{
+  KgxTabPrivate *priv = kgx_tab_get_instance_private (self);
+  const guint8 *data;
+  gsize len;
+
+  data = g_bytes_get_data (output, &len);
+
+  kgx_recorder_write (priv->recorder, data, len);
+}
+
+
+/**
+ * kgx_tab_set_recording:
+ * @self: the #KgxTab
+ * @recording: whether to record
+ *
+ * Start (or stop) logging everything the terminal receives to a new file,
+ * in the directory given to kgx_tab_record_to() or the default
+ */
+void
+kgx_tab_set_recording (KgxTab   *self,
+                       gboolean  recording)
+{
+  KgxTabPrivate *priv;
+
+  g_return_if_fail (KGX_IS_TAB (self));
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if ((priv->recorder != NULL) == (recording != FALSE)) {
+    return;
+  }
+
+  if (recording) {
+    g_autoptr (GDateTime) now = g_date_time_new_now_local ();
+    g_autoptr (GFile) directory = NULL;
+    g_autofree char *stamp = NULL;
+    g_autofree char *name = NULL;
+    gboolean compress = TRUE;
+
+    if (G_UNLIKELY (!priv->terminal)) {
+      g_warning ("tab: %u has no terminal to record", priv->id);
+      return;
+    }
+
+    if (priv->log_dir) {
+      directory = g_object_ref (priv->log_dir);
+    } else {
+      directory = kgx_recorder_default_directory ();
+    }
+
+    if (priv->settings) {
+      compress = kgx_settings_get_compress_logs (priv->settings);
+    }
+
+    stamp = g_date_time_format (now, "%Y-%m-%d-%H%M%S");
+    name = g_strdup_printf ("%s-%u", stamp, priv->id);
+
+    g_debug ("tab: recording %u as %s", priv->id, name);
+
+    priv->recorder = kgx_recorder_new (directory, name, compress);
+    g_signal_connect (priv->terminal,
+                      "output", G_CALLBACK (record_output),
+                      self);
+    kgx_terminal_push_tap (priv->terminal);
+  } else {
+    g_debug ("tab: stopped recording %u", priv->id);
+
+    g_signal_handlers_disconnect_by_func (priv->terminal, record_output, self);
+    kgx_terminal_pop_tap (priv->terminal);
+
+    /* It finishes writing in the background */
+    kgx_recorder_close (priv->recorder);
+    g_clear_object (&priv->recorder);
+  }
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_RECORDING]);
+}
+
+
+/**
+ * kgx_tab_record_to:
+ * @self: the #KgxTab
+ * @directory: where the logs go
+ *
+ * Start recording to @directory, which is used from then on whenever
+ * @self is recorded
+ */
+void
+kgx_tab_record_to (KgxTab *self,
+                   GFile  *directory)
+{
+  KgxTabPrivate *priv;
+
+  g_return_if_fail (KGX_IS_TAB (self));
+  g_return_if_fail (G_IS_FILE (directory));
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (g_set_object (&priv->log_dir, directory)) {
+    kgx_tab_set_recording (self, FALSE);
+  }
+
+  kgx_tab_set_recording (self, TRUE);
+}
+
+
+gboolean
+kgx_tab_get_recording (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), FALSE);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  return priv->recorder != NULL;
+}
+
+
+/**
+ * kgx_tab_set_rewrap:
+ * @self: the #KgxTab
+ * @rewrap: the policy
+ *
+ * Override #KgxSettings:rewrap-limit for this tab, or go back to
+ * following it with %KGX_REWRAP_AUTO
+ */
+void
+kgx_tab_set_rewrap (KgxTab    *self,
+                    KgxRewrap  rewrap)
+{
+  KgxTabPrivate *priv;
+
+  g_return_if_fail (KGX_IS_TAB (self));
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (G_UNLIKELY (!priv->terminal)) {
+    return;
+  }
+
+  kgx_terminal_set_rewrap (priv->terminal, rewrap);
+}
+
+
+KgxRewrap
+kgx_tab_get_rewrap (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), KGX_REWRAP_AUTO);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (G_UNLIKELY (!priv->terminal)) {
+    return KGX_REWRAP_AUTO;
+  }
+
+  return kgx_terminal_get_rewrap (priv->terminal);
+}
+
+
+/**
+ * kgx_tab_get_running_command:
+ * @self: the #KgxTab
+ *
+ * Returns: (nullable): the value of #KgxTab:running-command
+ */
+const char *
+kgx_tab_get_running_command (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), NULL);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  return priv->running_command;
+}
+
+
+/**
+ * kgx_tab_set_monitor:
+ * @self: the #KgxTab
+ * @monitor: what to watch for
+ *
+ * Have the #KgxMonitor of #KgxTab:application tell the user when @self
+ * has output in the background, or goes quiet
+ */
+void
+kgx_tab_set_monitor (KgxTab          *self,
+                     KgxMonitorFlags  monitor)
+{
+  KgxTabPrivate *priv;
+
+  g_return_if_fail (KGX_IS_TAB (self));
+
+  priv = kgx_tab_get_instance_private (self);
+
+  if (priv->monitor == monitor) {
+    return;
+  }
+
+  priv->monitor = monitor;
+
+  if (priv->application) {
+    kgx_monitor_watch (kgx_application_get_monitor (priv->application),
+                       self,
+                       monitor);
+  }
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_MONITOR]);
+}
+
+
+KgxMonitorFlags
+kgx_tab_get_monitor (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), KGX_MONITOR_NONE);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  return priv->monitor;
+}
+
+
+/**
+ * kgx_tab_get_shell_integrated:
+ * @self: the #KgxTab
+ *
+ * Returns: the value of #KgxTab:shell-integrated
+ */
+gboolean
+kgx_tab_get_shell_integrated (KgxTab *self)
+{
+  KgxTabPrivate *priv;
+
+  g_return_val_if_fail (KGX_IS_TAB (self), FALSE);
+
+  priv = kgx_tab_get_instance_private (self);
+
+  return priv->shell_integrated;
+}
@@ -30,7 +30,8 @@ G_BEGIN_DECLS
 /**
  * KgxStatus:
  * @KGX_NONE: It's a regular #KgxTab
- * @KGX_REMOTE: The #KgxTab is connected to a "remote" session
+ * @KGX_REMOTE: The #KgxTab is connected to a "remote" session, as reported
+ *              by the shell, see #KgxTab:remote-host
  * @KGX_PRIVILEGED: The #KgxTab is running as someone other than the current
  *                  user
  *
@@ -45,6 +46,25 @@ typedef enum /*< flags,prefix=KGX >*/ {
 } KgxStatus;
 
 
+/**
+ * KgxMonitorFlags:
+ * @KGX_MONITOR_NONE: Not being watched
+ * @KGX_MONITOR_ACTIVITY: Tell the user when there's output in the
+ *                        background
+ * @KGX_MONITOR_SILENCE: Tell the user when the output stops, and when it
+ *                       starts again
+ *
+ * What a #KgxMonitor should keep an eye on a #KgxTab for
+ *
+ * Stability: Private
+ */
+typedef enum /*< flags,prefix=KGX >*/ {
+  KGX_MONITOR_NONE = 0,             /*< nick=none >*/
+  KGX_MONITOR_ACTIVITY = (1 << 0),  /*< nick=activity >*/
+  KGX_MONITOR_SILENCE = (1 << 1),   /*< nick=silence >*/
+} KgxMonitorFlags;
+
+
 #ifndef __GTK_DOC_IGNORE__
 typedef struct _KgxPages KgxPages;
 #endif
@@ -98,10 +118,28 @@ void        kgx_tab_pop_child        (KgxTab               *self,
                                       KgxProcess           *process);
 gboolean    kgx_tab_is_active        (KgxTab               *self);
 GPtrArray  *kgx_tab_get_children     (KgxTab               *self);
-void        kgx_tab_extra_drop       (KgxTab               *self,
-                                      const GValue         *value);
+void        kgx_tab_accept_drop      (KgxTab               *self,
+                                      const char           *text);
 void        kgx_tab_set_initial_title (KgxTab              *self,
                                        const char          *title,
                                        GFile               *path);
+gint64      kgx_tab_get_hidden_since (KgxTab               *self);
+guint       kgx_tab_get_generation   (KgxTab               *self);
+guint       kgx_tab_get_activity     (KgxTab               *self);
+gboolean    kgx_tab_get_hibernated   (KgxTab               *self);
+gboolean    kgx_tab_hibernate        (KgxTab               *self);
+void        kgx_tab_set_recording    (KgxTab               *self,
+                                      gboolean              recording);
+gboolean    kgx_tab_get_recording    (KgxTab               *self);
+void        kgx_tab_record_to        (KgxTab               *self,
+                                      GFile                *directory);
+void        kgx_tab_set_rewrap       (KgxTab               *self,
+                                      KgxRewrap             rewrap);
+KgxRewrap   kgx_tab_get_rewrap       (KgxTab               *self);
+const char *kgx_tab_get_running_command (KgxTab             *self);
+void        kgx_tab_set_monitor      (KgxTab               *self,
+                                      KgxMonitorFlags       monitor);
+KgxMonitorFlags kgx_tab_get_monitor  (KgxTab               *self);
+gboolean    kgx_tab_get_shell_integrated (KgxTab            *self);
 
 G_END_DECLS
@@ -28,6 +28,10 @@
 #include "kgx-config.h"
 
 #include <glib/gi18n.h>
+#include <glib-unix.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <vte/vte.h>
 #define PCRE2_CODE_UNIT_WIDTH 0
@@ -37,7 +41,10 @@
 
 #include "kgx-terminal.h"
 #include "kgx-despatcher.h"
+#include "kgx-marks.h"
+#include "kgx-segments.h"
 #include "kgx-settings.h"
+#include "kgx-snapshot.h"
 #include "kgx-paste-dialog.h"
 #include "kgx-marshals.h"
 
@@ -71,10 +78,69 @@ static const char *links[KGX_TERMINAL_N_LINK_REGEX] = {
 
 /*       Regex adapted from TerminalWidget.vala in Pantheon Terminal       */
 
+#define TAP_CHUNK_SIZE (64 * 1024)
+/* Output VTE hasn't got round to yet before we stop reading, leaving the
+ * rest in the pty so whatever is writing it slows to match */
+#define TAP_BACKLOG (256 * 1024)
+/* How long to wait on VTE before reading regardless (ms) */
+#define TAP_STALL_TIMEOUT 100
+#define HELD_OUTPUT_LIMIT (8 * 1024 * 1024)
+/* Rows fetched per turn of the main loop by kgx_terminal_snapshot_async() */
+#define SNAPSHOT_SLICE 500
+/* Trimmed back to this, so we aren't shuffling it along on every read */
+#define HELD_OUTPUT_KEEP (HELD_OUTPUT_LIMIT / 4 * 3)
+/* Lines of scrollback released per step when retiring, and how often
+ * (ms). A timeout rather than an idle, so busy terminals can't starve it
+ * and leave the memory held indefinitely */
+#define RETIRE_SLICE 20000
+#define RETIRE_INTERVAL 10
+/* How long to give VTE to catch up with output ahead of a mark (ms) */
+#define MARK_SYNC_TIMEOUT 50
+/* Output held behind marks before we stop lining them up with VTE */
+#define MARK_OUTPUT_LIMIT (1024 * 1024)
+/* Prompts we read through without a mark before deciding the shell
+ * doesn't send them */
+#define MARK_PROBES 3
+
 /**
  * KgxTerminal:
  * @current_url: the address under the cursor
  * @match_id: regex ids for finding hyperlinks
+ * @taps: number of users wanting to see the raw output
+ * @tap_pty: the pty we are reading from whilst tapped
+ * @tap_buffer: what we read into
+ * @tap_unseen: output fed to VTE that it hasn't processed yet
+ * @tap_stall: stops us waiting on VTE forever
+ * @tap_closed: the other end of @tap_pty has gone
+ * @held_output: output waiting to be fed once we thaw
+ * @held_trimmed: the start of @held_output was thrown away
+ * @hibernations: bumped each time we hibernate, so slow snapshots can
+ *                tell their rows went away
+ * @snapshot: compressed contents whilst hibernated
+ * @hibernating: cancels the snapshot we're on our way into hibernation with
+ * @dirty: settings that changed whilst we weren't looking
+ * @apply_tick: applies @dirty on the next frame
+ * @rewrap: the #KgxRewrap policy
+ * @resize_pending: we were resized whilst hidden
+ * @sized: we've been allocated at least once, so have a grid to keep
+ * @last_rows: the size we last told everyone about
+ * @last_cols: the size we last told everyone about
+ * @size_tick: tells everyone about a new size on the next frame
+ * @retire_lines: scrollback still to be released once retired
+ * @generation: bumped whenever the contents change
+ * @activity: bumped whenever the child writes, even if VTE never sees it
+ * @marks: finds shell integration marks in the output
+ * @integration_wanted: #KgxSettings:shell-integration is on
+ * @integration: we hold a tap for @marks
+ * @integration_probes: prompts seen since we tapped, whilst no marks came
+ * @integration_refused: the shell didn't send marks, so we stopped looking
+ * @integrated: the shell has sent a mark whilst we were looking
+ * @mark_output: output held back behind @pending_marks
+ * @pending_marks: (element-type PendingMark) marks VTE hasn't reached yet
+ * @mark_sync: gives up waiting for VTE to reach the first of @pending_marks
+ * @segments: where the prompts are in the scrollback
+ * @remote_host: the host the shell last reported (OSC 7), if not this one
+ * @remote_pgrp: what was in the foreground when @remote_host was reported
  *
  * Stability: Private
  */
@@ -90,16 +156,114 @@ struct _KgxTerminal {
   /* Hyperlinks */
   char       *current_url;
   int         match_id[KGX_TERMINAL_N_LINK_REGEX];
+
+  /* Output tap */
+  guint       taps;
+  VtePty     *tap_pty;
+  guint8     *tap_buffer;
+  gsize       tap_unseen;
+  guint       tap_stall;
+  gboolean    tap_closed;
+  guint       tap_read_source;
+  guint       tap_write_source;
+  GByteArray *tap_pending_input;
+  gboolean    tap_swapping;
+
+  /* Hibernation */
+  gboolean    hibernated;
+  guint       hibernations;
+  GBytes     *snapshot;
+  GCancellable *hibernating;
+  GByteArray *held_output;
+  gboolean    held_trimmed;
+
+  /* Settings */
+  guint       dirty;
+  guint       apply_tick;
+
+  /* Resizing */
+  KgxRewrap   rewrap;
+  gboolean    resize_pending;
+  gboolean    sized;
+  int         last_rows;
+  int         last_cols;
+  guint       size_tick;
+
+  /* Teardown */
+  glong       retire_lines;
+
+  guint       generation;
+  guint       activity;
+
+  /* Shell integration */
+  KgxMarkScanner marks;
+  gboolean       integration_wanted;
+  gboolean       integration;
+  guint          integration_probes;
+  gboolean       integration_refused;
+  gboolean       integrated;
+  GByteArray    *mark_output;
+  GArray        *pending_marks;
+  guint          mark_sync;
+  KgxSegments    segments;
+
+  char          *remote_host;
+  GPid           remote_pgrp;
 };
 
 
+/**
+ * PendingMark:
+ * @offset: where in #KgxTerminal:mark_output the mark ended
+ * @kind: the #KgxMarkKind
+ * @exit_status: as for #KgxTerminal::shell-mark
+ * @command: as for #KgxTerminal::shell-mark
+ *
+ * Stability: Private
+ */
+typedef struct {
+  gsize        offset;
+  KgxMarkKind  kind;
+  int          exit_status;
+  char        *command;
+} PendingMark;
+
+
+static void
+pending_mark_clear (gpointer data)
+{
+  PendingMark *mark = data;
+
+  g_clear_pointer (&mark->command, g_free);
+}
+
+
 G_DEFINE_TYPE (KgxTerminal, kgx_terminal, VTE_TYPE_TERMINAL)
 
+
+/*
+ * Hidden terminals leave all of these until they're shown, the rest apply
+ * them straight away, except for those that relayout the terminal which
+ * happen at most once a frame
+ */
+enum {
+  DIRTY_FONT       = 1 << 0,
+  DIRTY_FONT_SCALE = 1 << 1,
+  DIRTY_SCROLLBACK = 1 << 2,
+  DIRTY_COLOURS    = 1 << 3,
+  DIRTY_ALL        = DIRTY_FONT | DIRTY_FONT_SCALE | DIRTY_SCROLLBACK | DIRTY_COLOURS,
+  /* Changing these resizes every cell */
+  DIRTY_RELAYOUT   = DIRTY_FONT | DIRTY_FONT_SCALE,
+};
+
 enum {
   PROP_0,
   PROP_SETTINGS,
   PROP_CANCELLABLE,
   PROP_PATH,
+  PROP_REWRAP,
+  PROP_REMOTE_HOST,
+  PROP_INTEGRATED,
   LAST_PROP
 };
 
@@ -108,19 +272,46 @@ static GParamSpec *pspecs[LAST_PROP] = { NULL, };
 enum {
   SIZE_CHANGED,
   ZOOM,
+  OUTPUT,
+  SHELL_MARK,
   N_SIGNALS
 };
 static guint signals[N_SIGNALS];
 
 
+static void stop_tap (KgxTerminal *self);
+static void resume_tap (KgxTerminal *self);
+static void integration_changed (KgxTerminal *self);
+
+
+/* Terminals waiting for their scrollback to be released, see
+ * kgx_terminal_retire() */
+static GQueue retiring = G_QUEUE_INIT;
+static guint retire_source = 0;
+
+
 static void
 kgx_terminal_dispose (GObject *object)
 {
   KgxTerminal *self = KGX_TERMINAL (object);
 
+  stop_tap (self);
+  g_clear_pointer (&self->tap_buffer, g_free);
+  g_clear_pointer (&self->tap_pending_input, g_byte_array_unref);
+  g_clear_pointer (&self->snapshot, g_bytes_unref);
+  g_cancellable_cancel (self->hibernating);
+  g_clear_object (&self->hibernating);
+  g_clear_pointer (&self->held_output, g_byte_array_unref);
+  kgx_mark_scanner_clear (&self->marks);
+  g_clear_handle_id (&self->mark_sync, g_source_remove);
+  g_clear_pointer (&self->mark_output, g_byte_array_unref);
+  g_clear_pointer (&self->pending_marks, g_array_unref);
+  kgx_segments_clear (&self->segments);
+
   g_clear_object (&self->cancellable);
 
   g_clear_pointer (&self->current_url, g_free);
+  g_clear_pointer (&self->remote_host, g_free);
 
   g_clear_object (&self->settings);
 
@@ -184,6 +375,116 @@ update_terminal_colours (KgxTerminal *self)
 }
 
 
+static void
+apply_dirty (KgxTerminal *self, guint which)
+{
+  VteTerminal *term = VTE_TERMINAL (self);
+  guint dirty = self->dirty & which;
+
+  if (!self->settings || !dirty) {
+    return;
+  }
+
+  self->dirty &= ~dirty;
+
+  if (dirty & DIRTY_FONT) {
+    g_autoptr (PangoFontDescription) font = kgx_settings_get_font (self->settings);
+
+    vte_terminal_set_font (term, font);
+  }
+
+  if (dirty & DIRTY_FONT_SCALE) {
+    vte_terminal_set_font_scale (term, kgx_settings_get_font_scale (self->settings));
+  }
+
+  if (dirty & DIRTY_SCROLLBACK) {
+    vte_terminal_set_scrollback_lines (term, kgx_settings_get_scrollback (self->settings));
+  }
+
+  if (dirty & DIRTY_COLOURS) {
+    update_terminal_colours (self);
+  }
+}
+
+
+static void
+apply_settings (KgxTerminal *self)
+{
+  if (self->apply_tick) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->apply_tick);
+    self->apply_tick = 0;
+  }
+
+  apply_dirty (self, DIRTY_ALL);
+}
+
+
+static gboolean
+apply_tick (GtkWidget     *widget,
+            GdkFrameClock *frame_clock,
+            gpointer       data)
+{
+  KgxTerminal *self = KGX_TERMINAL (widget);
+
+  self->apply_tick = 0;
+  apply_settings (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+queue_apply (KgxTerminal *self, guint dirty)
+{
+  self->dirty |= dirty;
+
+  /* Trimming scrollback or recolouring every cell can wait for a hidden
+   * tab to be shown, as kgx_terminal_map() catches up */
+  if (!gtk_widget_get_mapped (GTK_WIDGET (self))) {
+    return;
+  }
+
+  apply_dirty (self, ~DIRTY_RELAYOUT);
+
+  if (!(self->dirty & DIRTY_RELAYOUT) || self->apply_tick) {
+    return;
+  }
+
+  self->apply_tick = gtk_widget_add_tick_callback (GTK_WIDGET (self),
+                                                   apply_tick,
+                                                   NULL,
+                                                   NULL);
+}
+
+
+static void
+font_changed (KgxTerminal *self)
+{
+  queue_apply (self, DIRTY_FONT);
+}
+
+
+static void
+font_scale_changed (KgxTerminal *self)
+{
+  queue_apply (self, DIRTY_FONT_SCALE);
+}
+
+
+static void
+scrollback_changed (KgxTerminal *self)
+{
+  queue_apply (self, DIRTY_SCROLLBACK);
+}
+
+
+static void
+theme_changed (KgxTerminal *self)
+{
+  queue_apply (self, DIRTY_COLOURS);
+}
+
+
 static void
 kgx_terminal_set_property (GObject      *object,
                            guint         property_id,
@@ -195,7 +496,16 @@ kgx_terminal_set_property (GObject      *object,
   switch (property_id) {
     case PROP_SETTINGS:
       if (g_set_object (&self->settings, g_value_get_object (value))) {
-        update_terminal_colours (self);
+        self->dirty = DIRTY_ALL;
+        /* Nothing has been laid out yet when we're being constructed, so
+         * there's nothing for a new font to undo */
+        if (gtk_widget_get_mapped (GTK_WIDGET (self)) ||
+            !gtk_widget_get_realized (GTK_WIDGET (self))) {
+          apply_settings (self);
+        } else {
+          queue_apply (self, 0);
+        }
+        integration_changed (self);
         g_object_notify_by_pspec (object, pspec);
       }
       break;
@@ -204,6 +514,9 @@ kgx_terminal_set_property (GObject      *object,
         g_object_notify_by_pspec (object, pspec);
       }
       break;
+    case PROP_REWRAP:
+      kgx_terminal_set_rewrap (self, g_value_get_enum (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -236,6 +549,15 @@ kgx_terminal_get_property (GObject    *object,
       }
       g_value_set_object (value, path);
       break;
+    case PROP_REWRAP:
+      g_value_set_enum (value, self->rewrap);
+      break;
+    case PROP_REMOTE_HOST:
+      g_value_set_string (value, self->remote_host);
+      break;
+    case PROP_INTEGRATED:
+      g_value_set_boolean (value, self->integrated);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -442,358 +764,2077 @@ show_in_files_activated (KgxTerminal *self)
 
 
 static void
-kgx_terminal_size_allocate (GtkWidget *widget,
-                            int        width,
-                            int        height,
-                            int        baseline)
+update_tap_size (KgxTerminal *self)
 {
-  int          rows;
-  int          cols;
-  KgxTerminal *self = KGX_TERMINAL (widget);
-  VteTerminal *term = VTE_TERMINAL (self);
-
-  GTK_WIDGET_CLASS (kgx_terminal_parent_class)->size_allocate (widget, width, height, baseline);
+  g_autoptr (GError) error = NULL;
 
-  rows = vte_terminal_get_row_count (term);
-  cols = vte_terminal_get_column_count (term);
+  if (!self->tap_pty) {
+    return;
+  }
 
-  g_signal_emit (self, signals[SIZE_CHANGED], 0, rows, cols);
+  if (!vte_pty_set_size (self->tap_pty,
+                         vte_terminal_get_row_count (VTE_TERMINAL (self)),
+                         vte_terminal_get_column_count (VTE_TERMINAL (self)),
+                         &error)) {
+    g_debug ("terminal: couldn't resize tapped pty: %s", error->message);
+  }
 }
 
 
-static gboolean
-kgx_terminal_query_tooltip (GtkWidget  *widget,
-                            int         x,
-                            int         y,
-                            gboolean    keyboard_tooltip,
-                            GtkTooltip *tooltip)
+/*
+ * Where to cut the front off @held so at least @excess goes, without
+ * splitting a character or starting part way through an escape sequence
+ */
+static gsize
+held_cut (GByteArray *held, gsize excess)
 {
-  KgxTerminal *self = KGX_TERMINAL (widget);
-  g_autofree char *text = NULL;
+  const guint8 *newline = memchr (held->data + excess, '\n', held->len - excess);
+  gsize cut;
 
-  if (keyboard_tooltip || !have_url_under_pointer (self, x, y)) {
-    return GTK_WIDGET_CLASS (kgx_terminal_parent_class)->query_tooltip (widget,
-                                                                        x,
-                                                                        y,
-                                                                        keyboard_tooltip,
-                                                                        tooltip);
+  /* Past a newline is never inside a character, nor a control sequence */
+  if (!newline) {
+    return held->len;
   }
 
-  text = g_strdup_printf (_("Ctrl-click to open:\n%s"), self->current_url);
+  cut = newline - held->data + 1;
 
-  gtk_tooltip_set_text (tooltip, text);
+  /* Strings (OSC, DCS and friends) can hold newlines though, if we are in
+   * one it ends before anything else starts */
+  for (gsize i = cut; i < held->len; i++) {
+    if (held->data[i] == 0x07) {
+      return i + 1;
+    } else if (held->data[i] == 0x1b) {
+      if (i + 1 < held->len && held->data[i + 1] == '\\') {
+        return i + 2;
+      }
+      break;
+    }
+  }
 
-  return TRUE;
+  return cut;
 }
 
 
 static void
-kgx_terminal_selection_changed (VteTerminal *self)
+deliver (KgxTerminal *self, const guint8 *data, gsize len)
 {
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy",
-                                 vte_terminal_get_has_selection (self));
+  if (len == 0) {
+    return;
+  }
+
+  self->activity++;
+
+  if (G_UNLIKELY (self->held_output)) {
+    g_byte_array_append (self->held_output, data, len);
+
+    /* Keep the tail, much as the scrollback would */
+    if (self->held_output->len > HELD_OUTPUT_LIMIT) {
+      gsize cut = held_cut (self->held_output,
+                            self->held_output->len - HELD_OUTPUT_KEEP);
+
+      g_byte_array_remove_range (self->held_output, 0, cut);
+      self->held_trimmed = TRUE;
+    }
+
+    return;
+  }
+
+  self->tap_unseen += len;
+  vte_terminal_feed (VTE_TERMINAL (self), (const char *) data, len);
 }
 
 
-static void
-kgx_terminal_increase_font_size (VteTerminal *self)
+/*
+ * How far the scrollbar moves per row, VTE may be scrolling by pixel
+ */
+static double
+row_scale (KgxTerminal *self)
 {
-  g_signal_emit (self, signals[ZOOM], 0, KGX_ZOOM_IN);
+  if (vte_terminal_get_scroll_unit_is_pixels (VTE_TERMINAL (self))) {
+    return MAX (vte_terminal_get_char_height (VTE_TERMINAL (self)), 1);
+  }
+
+  return 1;
 }
 
 
-static void
-kgx_terminal_decrease_font_size (VteTerminal *self)
+/*
+ * The oldest row still in the history, rows are counted from the start
+ * of the terminal so this creeps up as the scrollback fills
+ */
+static glong
+first_row (KgxTerminal *self)
 {
-  g_signal_emit (self, signals[ZOOM], 0, KGX_ZOOM_OUT);
+  GtkAdjustment *adjustment =
+    gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
+
+  if (!adjustment) {
+    return 0;
+  }
+
+  return (glong) (gtk_adjustment_get_lower (adjustment) / row_scale (self));
 }
 
 
 static void
-location_changed (KgxTerminal *self)
+update_segment_actions (KgxTerminal *self)
 {
-  gboolean value;
+  gboolean have_prompts = !kgx_segments_is_empty (&self->segments);
+  gboolean have_output = kgx_segments_last_finished (&self->segments) != NULL;
 
-  value = vte_terminal_get_current_file_uri (VTE_TERMINAL (self)) ||
-            vte_terminal_get_current_directory_uri (VTE_TERMINAL (self));
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.previous-prompt", have_prompts);
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.next-prompt", have_prompts);
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy-last-output", have_output);
+}
 
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.show-in-files", value);
 
-  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_PATH]);
+static void
+reset_segments (KgxTerminal *self)
+{
+  kgx_segments_reset (&self->segments);
+  update_segment_actions (self);
 }
 
 
 static void
-setup_context_menu (KgxTerminal *self, VteEventContext *context)
+reached_mark (KgxTerminal *self,
+              PendingMark *mark,
+              gboolean     synced)
 {
-  gboolean enabled;
+  glong col, row;
 
-  if (context) {
-    double x, y;
+  /* Whilst held VTE isn't looking at the output, so the cursor means
+   * nothing, and the history is about to be replaced anyway. Nor does it
+   * if VTE hasn't caught up */
+  if (G_LIKELY (!self->held_output && synced)) {
+    vte_terminal_get_cursor_position (VTE_TERMINAL (self), &col, &row);
 
-    vte_event_context_get_coordinates (context, &x, &y);
+    /* Output that didn't end with a newline still counts */
+    if (mark->kind == KGX_MARK_FINISHED && col > 0) {
+      row++;
+    }
 
-    enabled = have_url_under_pointer (self, x, y);
-  } else {
-    enabled = FALSE;
+    kgx_segments_trim (&self->segments, first_row (self));
+    kgx_segments_mark (&self->segments, mark->kind, row, mark->exit_status);
+    update_segment_actions (self);
   }
 
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.open-link", enabled);
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy-link", enabled);
+  g_signal_emit (self,
+                 signals[SHELL_MARK],
+                 0,
+                 mark->kind,
+                 mark->exit_status,
+                 mark->command);
 }
 
 
+static void mark_sync_timeout (gpointer data);
+
+
+/*
+ * Feed VTE up to the next mark, then wait for it to get there so the
+ * cursor is where the mark was. Marks with nothing before them are taken
+ * straight away, as is everything once we're too far behind
+ */
 static void
-pressed (GtkGestureClick *gesture,
-         int              n_presses,
-         double           x,
-         double           y,
-         KgxTerminal     *self)
+release_marks (KgxTerminal *self)
 {
-  GdkModifierType state = gtk_event_controller_get_current_event_state (GTK_EVENT_CONTROLLER (gesture));
-  guint button = gtk_gesture_single_get_current_button (GTK_GESTURE_SINGLE (gesture));
+  g_autoptr (KgxTerminal) ref = NULL;
+  gboolean behind;
 
-  if (button == GDK_BUTTON_SECONDARY)
-  {
-    if (vte_terminal_get_has_selection(VTE_TERMINAL(self)))
-    {
-      copy_activated(self);
-      vte_terminal_unselect_all(VTE_TERMINAL(self));
-    }
-    else
-    {
-      paste_activated(self);
+  if (self->mark_sync || !self->pending_marks) {
+    return;
+  }
+
+  ref = g_object_ref (self);
+
+  behind = self->mark_output->len > MARK_OUTPUT_LIMIT;
+  if (G_UNLIKELY (behind)) {
+    g_debug ("terminal: %u bytes behind marks, not lining them up",
+             self->mark_output->len);
+  }
+
+  while (self->pending_marks && self->pending_marks->len > 0) {
+    PendingMark *first = &g_array_index (self->pending_marks, PendingMark, 0);
+    PendingMark mark;
+    gsize ahead = first->offset;
+
+    if (ahead > 0) {
+      deliver (self, self->mark_output->data, ahead);
+      g_byte_array_remove_range (self->mark_output, 0, ahead);
+
+      for (guint i = 0; i < self->pending_marks->len; i++) {
+        g_array_index (self->pending_marks, PendingMark, i).offset -= ahead;
+      }
+
+      if (G_LIKELY (!self->held_output && !behind)) {
+        self->mark_sync = g_timeout_add_once (MARK_SYNC_TIMEOUT,
+                                              mark_sync_timeout,
+                                              self);
+        g_source_set_name_by_id (self->mark_sync, "[kgx] mark sync");
+        return;
+      }
     }
+
+    mark = *first;
+    first->command = NULL;
+    g_array_remove_index (self->pending_marks, 0);
+
+    reached_mark (self, &mark, !behind);
+    g_free (mark.command);
   }
 
-  if (n_presses > 1) {
-    gtk_gesture_set_state (GTK_GESTURE (gesture), GTK_EVENT_SEQUENCE_DENIED);
-    return;
+  if (self->mark_output) {
+    deliver (self, self->mark_output->data, self->mark_output->len);
+    g_byte_array_set_size (self->mark_output, 0);
   }
 
-  if (have_url_under_pointer (self, x, y) &&
-      (button == GDK_BUTTON_PRIMARY || button == GDK_BUTTON_MIDDLE) &&
-      state & GDK_CONTROL_MASK) {
+  /* Reading stopped whilst we waited on VTE */
+  resume_tap (self);
+}
 
-    open_link (self);
-    gtk_gesture_set_state (GTK_GESTURE (gesture), GTK_EVENT_SEQUENCE_CLAIMED);
 
+static void
+mark_sync_timeout (gpointer data)
+{
+  KgxTerminal *self = data;
+
+  self->mark_sync = 0;
+  release_marks (self);
+}
+
+
+static void
+vte_caught_up (KgxTerminal *self)
+{
+  if (!self->mark_sync) {
     return;
   }
 
-  gtk_gesture_set_state (GTK_GESTURE (gesture), GTK_EVENT_SEQUENCE_DENIED);
+  g_clear_handle_id (&self->mark_sync, g_source_remove);
+  release_marks (self);
 }
 
 
-static gboolean
-scroll (GtkEventControllerScroll *scroll,
-        double                   dx,
-        double                   dy,
-        KgxTerminal              *self)
+static void
+set_integrated (KgxTerminal *self, gboolean integrated)
 {
-  GdkModifierType mods = gtk_event_controller_get_current_event_state (GTK_EVENT_CONTROLLER (scroll));
-
-  if ((mods & GDK_CONTROL_MASK) == 0 || dy == 0) {
-    return FALSE;
+  if (self->integrated == integrated) {
+    return;
   }
 
-  g_signal_emit (self, signals[ZOOM], 0, dy > 0 ? KGX_ZOOM_OUT : KGX_ZOOM_IN);
+  self->integrated = integrated;
 
-  return TRUE;
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_INTEGRATED]);
 }
 
 
 static void
-kgx_terminal_class_init (KgxTerminalClass *klass)
+found_mark (KgxMarkKind  kind,
+            int          exit_status,
+            const char  *command,
+            gsize        end,
+            gpointer     user_data)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
-  VteTerminalClass *term_class = VTE_TERMINAL_CLASS (klass);
+  KgxTerminal *self = user_data;
+  PendingMark mark = {
+    .offset = self->mark_output->len + end,
+    .kind = kind,
+    .exit_status = exit_status,
+    .command = g_strdup (command),
+  };
 
-  object_class->dispose = kgx_terminal_dispose;
-  object_class->set_property = kgx_terminal_set_property;
-  object_class->get_property = kgx_terminal_get_property;
+  g_array_append_val (self->pending_marks, mark);
 
-  widget_class->size_allocate = kgx_terminal_size_allocate;
-  widget_class->query_tooltip = kgx_terminal_query_tooltip;
+  set_integrated (self, TRUE);
+}
 
-  term_class->selection_changed = kgx_terminal_selection_changed;
-  term_class->increase_font_size = kgx_terminal_increase_font_size;
-  term_class->decrease_font_size = kgx_terminal_decrease_font_size;
 
-  pspecs[PROP_SETTINGS] =
-    g_param_spec_object ("settings", NULL, NULL,
-                         KGX_TYPE_SETTINGS,
-                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+static void
+handle_output (KgxTerminal *self, const guint8 *data, gsize len)
+{
+  guint had_marks;
 
-  pspecs[PROP_CANCELLABLE] =
-    g_param_spec_object ("cancellable", NULL, NULL,
-                         G_TYPE_CANCELLABLE,
-                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+  if (g_signal_has_handler_pending (self, signals[OUTPUT], 0, FALSE)) {
+    g_autoptr (GBytes) bytes = g_bytes_new_static (data, len);
 
-  pspecs[PROP_PATH] =
-    g_param_spec_object ("path", NULL, NULL,
-                         G_TYPE_FILE,
-                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    g_signal_emit (self, signals[OUTPUT], 0, bytes);
+  }
 
-  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+  if (!self->integration) {
+    deliver (self, data, len);
+    return;
+  }
 
-  signals[SIZE_CHANGED] = g_signal_new ("size-changed",
-                                        G_TYPE_FROM_CLASS (klass),
-                                        G_SIGNAL_RUN_LAST,
-                                        0, NULL, NULL,
-                                        kgx_marshals_VOID__UINT_UINT,
-                                        G_TYPE_NONE,
-                                        2,
-                                        G_TYPE_UINT,
-                                        G_TYPE_UINT);
-  g_signal_set_va_marshaller (signals[SIZE_CHANGED],
-                              G_TYPE_FROM_CLASS (klass),
-                              kgx_marshals_VOID__UINT_UINTv);
+  had_marks = self->pending_marks->len;
+  kgx_mark_scanner_feed (&self->marks, data, len, found_mark, self);
 
-  signals[ZOOM] = g_signal_new ("zoom",
-                                G_TYPE_FROM_CLASS (klass),
-                                G_SIGNAL_RUN_LAST,
-                                0, NULL, NULL,
-                                kgx_marshals_VOID__ENUM,
-                                G_TYPE_NONE,
-                                1,
-                                KGX_TYPE_ZOOM);
-  g_signal_set_va_marshaller (signals[ZOOM],
-                              G_TYPE_FROM_CLASS (klass),
-                              kgx_marshals_VOID__ENUMv);
+  /* Nothing to line up, so skip the copy */
+  if (had_marks == 0 && self->pending_marks->len == 0) {
+    deliver (self, data, len);
+    return;
+  }
 
-  gtk_widget_class_set_template_from_resource (widget_class,
-                                               KGX_APPLICATION_PATH "kgx-terminal.ui");
+  g_byte_array_append (self->mark_output, data, len);
+  release_marks (self);
+}
 
-  gtk_widget_class_bind_template_child (widget_class, KgxTerminal, settings_signals);
 
-  gtk_widget_class_bind_template_callback (widget_class, location_changed);
-  gtk_widget_class_bind_template_callback (widget_class, setup_context_menu);
-  gtk_widget_class_bind_template_callback (widget_class, pressed);
-  gtk_widget_class_bind_template_callback (widget_class, scroll);
+static void
+scroll_to_row (KgxTerminal *self, glong row)
+{
+  GtkAdjustment *adjustment =
+    gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
 
-  gtk_widget_class_install_action (widget_class,
-                                   "term.open-link",
-                                   NULL,
-                                   (GtkWidgetActionActivateFunc) open_link_activated);
-  gtk_widget_class_install_action (widget_class,
-                                   "term.copy-link",
-                                   NULL,
-                                   (GtkWidgetActionActivateFunc) copy_link_activated);
-  gtk_widget_class_install_action (widget_class,
-                                   "term.copy",
-                                   NULL,
-                                   (GtkWidgetActionActivateFunc) copy_activated);
-  gtk_widget_class_install_action (widget_class,
-                                   "term.paste",
-                                   NULL,
-                                   (GtkWidgetActionActivateFunc) paste_activated);
-  gtk_widget_class_install_action (widget_class,
-                                   "term.select-all",
-                                   NULL,
-                                   (GtkWidgetActionActivateFunc) select_all_activated);
-  gtk_widget_class_install_action (widget_class,
-                                   "term.show-in-files",
-                                   NULL,
-                                   (GtkWidgetActionActivateFunc) show_in_files_activated);
+  if (!adjustment) {
+    return;
+  }
+
+  gtk_adjustment_set_value (adjustment, row * row_scale (self));
+}
+
+
+static glong
+top_row (KgxTerminal *self)
+{
+  GtkAdjustment *adjustment =
+    gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
+
+  if (!adjustment) {
+    return 0;
+  }
+
+  return (glong) (gtk_adjustment_get_value (adjustment) / row_scale (self));
 }
 
 
 static void
-kgx_terminal_init (KgxTerminal *self)
+previous_prompt_activated (KgxTerminal *self)
 {
-  gtk_widget_init_template (GTK_WIDGET (self));
+  const KgxSegment *segment;
 
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.open-link", FALSE);
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy-link", FALSE);
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy", FALSE);
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.show-in-files", FALSE);
+  kgx_segments_trim (&self->segments, first_row (self));
+  segment = kgx_segments_before (&self->segments, top_row (self));
 
-  vte_terminal_set_mouse_autohide (VTE_TERMINAL (self), TRUE);
-  vte_terminal_search_set_wrap_around (VTE_TERMINAL (self), TRUE);
+  if (segment) {
+    scroll_to_row (self, segment->prompt);
+  }
+}
 
-  for (int i = 0; i < KGX_TERMINAL_N_LINK_REGEX; i++) {
-    g_autoptr (VteRegex) regex = NULL;
-    g_autoptr (GError) error = NULL;
 
-    regex = vte_regex_new_for_match (links[i], -1, PCRE2_MULTILINE, &error);
+static void
+next_prompt_activated (KgxTerminal *self)
+{
+  GtkAdjustment *adjustment;
+  const KgxSegment *segment;
 
-    if (error) {
-      g_warning ("link regex failed: %s", error->message);
-      continue;
+  kgx_segments_trim (&self->segments, first_row (self));
+  segment = kgx_segments_after (&self->segments, top_row (self));
+
+  if (segment) {
+    scroll_to_row (self, segment->prompt);
+    return;
+  }
+
+  /* Past the last prompt is just the bottom */
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
+  if (adjustment) {
+    gtk_adjustment_set_value (adjustment,
+                              gtk_adjustment_get_upper (adjustment) -
+                              gtk_adjustment_get_page_size (adjustment));
+  }
+}
+
+
+static void
+copy_last_output_activated (KgxTerminal *self)
+{
+  GdkClipboard *clipboard = gtk_widget_get_clipboard (GTK_WIDGET (self));
+  g_autofree char *text = NULL;
+  const KgxSegment *segment;
+  glong start;
+
+  kgx_segments_trim (&self->segments, first_row (self));
+  segment = kgx_segments_last_finished (&self->segments);
+
+  if (!segment || segment->end <= segment->output) {
+    return;
+  }
+
+  /* The top may have scrolled away already, take what's left */
+  start = MAX (segment->output, first_row (self));
+
+  text = vte_terminal_get_text_range_format (VTE_TERMINAL (self),
+                                             VTE_FORMAT_TEXT,
+                                             start, 0,
+                                             segment->end, 0,
+                                             NULL);
+  if (!text) {
+    return;
+  }
+
+  gdk_clipboard_set_text (clipboard, g_strchomp (text));
+}
+
+
+static gboolean tap_readable (int fd, GIOCondition condition, gpointer user_data);
+
+
+/*
+ * Output is read at the same priority VTE would read it itself, behind
+ * redraws and input
+ */
+static void
+watch_tap (KgxTerminal *self)
+{
+  if (self->tap_read_source || !self->tap_pty || self->tap_closed) {
+    return;
+  }
+
+  self->tap_read_source = g_unix_fd_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                              vte_pty_get_fd (self->tap_pty),
+                                              G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                              tap_readable,
+                                              self,
+                                              NULL);
+  g_source_set_name_by_id (self->tap_read_source, "[kgx] terminal tap");
+}
+
+
+/*
+ * Stop reading once VTE is far enough behind, or whilst we're waiting for
+ * it to reach a mark so there's no more output to hold on to
+ */
+static inline gboolean
+tap_should_wait (KgxTerminal *self)
+{
+  return self->tap_unseen >= TAP_BACKLOG || self->mark_sync;
+}
+
+
+static void
+resume_tap (KgxTerminal *self)
+{
+  if (tap_should_wait (self)) {
+    return;
+  }
+
+  g_clear_handle_id (&self->tap_stall, g_source_remove);
+  watch_tap (self);
+}
+
+
+static void
+tap_stalled (gpointer data)
+{
+  KgxTerminal *self = data;
+
+  /* Whatever we fed didn't change anything VTE tells us about */
+  self->tap_stall = 0;
+  self->tap_unseen = 0;
+  resume_tap (self);
+}
+
+
+static gboolean
+tap_readable (int fd, GIOCondition condition, gpointer user_data)
+{
+  g_autoptr (KgxTerminal) self = g_object_ref (user_data);
+  gssize len;
+
+  len = read (fd, self->tap_buffer, TAP_CHUNK_SIZE);
+
+  if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return G_SOURCE_CONTINUE;
+  } else if (len <= 0) {
+    /* EOF or EIO, either way the other end has gone */
+    g_debug ("terminal: tapped pty closed");
+    self->tap_read_source = 0;
+    self->tap_closed = TRUE;
+    return G_SOURCE_REMOVE;
+  }
+
+  handle_output (self, self->tap_buffer, len);
+
+  if (!self->tap_read_source || !tap_should_wait (self)) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Leave the rest in the pty until VTE catches up */
+  self->tap_read_source = 0;
+  if (!self->tap_stall) {
+    self->tap_stall = g_timeout_add_once (TAP_STALL_TIMEOUT, tap_stalled, self);
+    g_source_set_name_by_id (self->tap_stall, "[kgx] terminal tap stall");
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+tap_writable (int fd, GIOCondition condition, gpointer user_data)
+{
+  KgxTerminal *self = user_data;
+  gssize written;
+
+  written = write (fd,
+                   self->tap_pending_input->data,
+                   self->tap_pending_input->len);
+
+  if (written < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return G_SOURCE_CONTINUE;
+  } else if (written < 0) {
+    g_debug ("terminal: dropping input: %s", g_strerror (errno));
+    g_byte_array_set_size (self->tap_pending_input, 0);
+  } else {
+    g_byte_array_remove_range (self->tap_pending_input, 0, written);
+  }
+
+  if (self->tap_pending_input->len > 0) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  self->tap_write_source = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+tap_write (KgxTerminal *self, const char *data, gsize len)
+{
+  int fd = vte_pty_get_fd (self->tap_pty);
+
+  if (self->tap_pending_input->len == 0) {
+    gssize written = write (fd, data, len);
+
+    if (written < 0 && errno != EAGAIN && errno != EINTR) {
+      g_debug ("terminal: dropping input: %s", g_strerror (errno));
+      return;
     }
 
-    self->match_id[i] = vte_terminal_match_add_regex (VTE_TERMINAL (self),
-                                                      regex,
-                                                      0);
+    written = MAX (written, 0);
+    data += written;
+    len -= written;
+  }
 
-    vte_terminal_match_set_cursor_name (VTE_TERMINAL (self),
-                                        self->match_id[i],
-                                        "pointer");
+  if (len == 0) {
+    return;
   }
 
-  g_signal_group_connect_swapped (self->settings_signals,
-                                  "notify::resolved-theme", G_CALLBACK (update_terminal_colours),
-                                  self);
+  g_byte_array_append (self->tap_pending_input, (const guint8 *) data, len);
+
+  if (!self->tap_write_source) {
+    self->tap_write_source = g_unix_fd_add (fd, G_IO_OUT, tap_writable, self);
+    g_source_set_name_by_id (self->tap_write_source, "[kgx] terminal tap input");
+  }
 }
 
 
+/*
+ * VTE doesn't offer us the raw output, so whilst somebody wants it we take
+ * the pty away from VTE, read it ourselves, and feed VTE by hand. Input
+ * still arrives via ::commit, which is emitted with or without a pty
+ */
 static void
-got_paste (GObject      *source,
-           GAsyncResult *res,
-           gpointer      user_data)
+start_tap (KgxTerminal *self)
 {
-  g_autoptr (KgxPasteDialog) dialogue = KGX_PASTE_DIALOG (source);
-  g_autoptr (KgxTerminal) self = user_data;
   g_autoptr (GError) error = NULL;
-  KgxPasteDialogResult result;
-  const char *content;
+  VtePty *pty = vte_terminal_get_pty (VTE_TERMINAL (self));
+  int fd;
 
-  result = kgx_paste_dialog_run_finish (dialogue, res, &content, &error);
+  if (self->tap_pty || !pty) {
+    return;
+  }
 
-  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-    result = KGX_PASTE_CANCELLED;
-  } else if (error) {
-    g_critical ("terminal [paste]: Unexpected: %s", error->message);
+  self->tap_pty = g_object_ref (pty);
+
+  self->tap_swapping = TRUE;
+  vte_terminal_set_pty (VTE_TERMINAL (self), NULL);
+  self->tap_swapping = FALSE;
+
+  fd = vte_pty_get_fd (self->tap_pty);
+
+  if (!g_unix_set_fd_nonblocking (fd, TRUE, &error)) {
+    g_warning ("terminal: couldn't make pty non-blocking: %s", error->message);
+  }
+
+  update_tap_size (self);
+
+  if (!self->tap_buffer) {
+    self->tap_buffer = g_malloc (TAP_CHUNK_SIZE);
+  }
+  self->tap_closed = FALSE;
+  self->tap_unseen = 0;
+  watch_tap (self);
+
+  g_debug ("terminal: tapped");
+}
+
+
+static void
+stop_tap (KgxTerminal *self)
+{
+  g_autoptr (VtePty) pty = NULL;
+
+  g_clear_handle_id (&self->tap_read_source, g_source_remove);
+  g_clear_handle_id (&self->tap_write_source, g_source_remove);
+  g_clear_handle_id (&self->tap_stall, g_source_remove);
+
+  if (!self->tap_pty) {
     return;
   }
 
-  if (result == KGX_PASTE_CANCELLED) {
+  pty = g_steal_pointer (&self->tap_pty);
+
+  if (self->tap_pending_input->len > 0) {
+    if (write (vte_pty_get_fd (pty),
+               self->tap_pending_input->data,
+               self->tap_pending_input->len) < 0) {
+      g_debug ("terminal: dropping input: %s", g_strerror (errno));
+    }
+    g_byte_array_set_size (self->tap_pending_input, 0);
+  }
+
+  if (gtk_widget_in_destruction (GTK_WIDGET (self))) {
     return;
   }
 
-  vte_terminal_paste_text (VTE_TERMINAL (self), content);
+  self->tap_swapping = TRUE;
+  vte_terminal_set_pty (VTE_TERMINAL (self), pty);
+  self->tap_swapping = FALSE;
+
+  g_debug ("terminal: untapped");
 }
 
 
-void
-kgx_terminal_accept_paste (KgxTerminal *self,
-                           const char  *text)
+static void
+pty_changed (KgxTerminal *self)
 {
-  g_autofree char *striped = g_strchug (g_strdup (text));
-  size_t len;
+  if (self->tap_swapping || self->taps == 0) {
+    return;
+  }
 
-  g_return_if_fail (KGX_IS_TERMINAL (self));
+  /* We were given a (new) pty whilst tapped, take it over */
+  g_clear_handle_id (&self->tap_read_source, g_source_remove);
+  g_clear_handle_id (&self->tap_write_source, g_source_remove);
+  g_clear_handle_id (&self->tap_stall, g_source_remove);
+  g_clear_object (&self->tap_pty);
+  g_byte_array_set_size (self->tap_pending_input, 0);
 
-  if (G_UNLIKELY (!text || !text[0])) {
+  start_tap (self);
+}
+
+
+static void
+start_integration (KgxTerminal *self)
+{
+  if (self->integration) {
     return;
   }
 
-  len = strlen (striped);
+  g_debug ("terminal: looking for marks");
 
-  if (g_strstr_len (striped, len, "sudo") != NULL &&
-      g_strstr_len (striped, len, "\n") != NULL) {
-    KgxPasteDialog *paste = g_object_new (KGX_TYPE_PASTE_DIALOG,
-                                          "content", text,
-                                          "transient-for", gtk_widget_get_root (GTK_WIDGET (self)),
-                                          NULL);
+  self->integration = TRUE;
+  self->integration_probes = 0;
 
-    kgx_paste_dialog_run (paste,
-                          self->cancellable,
-                          got_paste,
-                          g_object_ref (self));
+  /* We can only see the marks by reading the output ourselves */
+  kgx_terminal_push_tap (self);
+}
+
+
+static void
+stop_integration (KgxTerminal *self)
+{
+  if (!self->integration) {
+    return;
+  }
+
+  self->integration = FALSE;
+
+  /* Let go of anything waiting on VTE, there's no one to tell */
+  g_clear_handle_id (&self->mark_sync, g_source_remove);
+  g_array_set_size (self->pending_marks, 0);
+  deliver (self, self->mark_output->data, self->mark_output->len);
+  g_byte_array_set_size (self->mark_output, 0);
+  reset_segments (self);
+
+  /* Whatever it was part way through is never finishing */
+  kgx_mark_scanner_clear (&self->marks);
+  kgx_mark_scanner_init (&self->marks);
+
+  set_integrated (self, FALSE);
+
+  kgx_terminal_pop_tap (self);
+  resume_tap (self);
+}
+
+
+/*
+ * Reading the output ourselves costs, so rather than do it for every
+ * shell we wait for one to report its location, as ours does at each
+ * prompt, and give up again if a few prompts pass without a mark
+ */
+static void
+probe_integration (KgxTerminal *self)
+{
+  if (!self->integration_wanted ||
+      self->integration_refused ||
+      self->integrated) {
+    return;
+  }
+
+  if (!self->integration) {
+    start_integration (self);
+    return;
+  }
+
+  self->integration_probes++;
+  if (self->integration_probes < MARK_PROBES) {
+    return;
+  }
+
+  g_debug ("terminal: no marks after %u prompts, not looking any more",
+           self->integration_probes);
+
+  self->integration_refused = TRUE;
+  stop_integration (self);
+}
+
+
+static void
+integration_changed (KgxTerminal *self)
+{
+  gboolean wanted = self->settings &&
+                    kgx_settings_get_shell_integration (self->settings);
+
+  if (wanted == self->integration_wanted) {
+    return;
+  }
+
+  self->integration_wanted = wanted;
+  self->integration_refused = FALSE;
+
+  /* Otherwise it waits for the shell, see probe_integration() */
+  if (!wanted) {
+    stop_integration (self);
+  }
+}
+
+
+static void
+kgx_terminal_map (GtkWidget *widget)
+{
+  KgxTerminal *self = KGX_TERMINAL (widget);
+
+  /* Catch up before anything is drawn */
+  apply_settings (self);
+
+  GTK_WIDGET_CLASS (kgx_terminal_parent_class)->map (widget);
+
+  if (self->resize_pending) {
+    self->resize_pending = FALSE;
+    gtk_widget_queue_allocate (widget);
+  }
+}
+
+
+static void
+kgx_terminal_unmap (GtkWidget *widget)
+{
+  KgxTerminal *self = KGX_TERMINAL (widget);
+
+  if (self->apply_tick) {
+    gtk_widget_remove_tick_callback (widget, self->apply_tick);
+    self->apply_tick = 0;
+  }
+
+  if (self->size_tick) {
+    gtk_widget_remove_tick_callback (widget, self->size_tick);
+    self->size_tick = 0;
+  }
+
+  GTK_WIDGET_CLASS (kgx_terminal_parent_class)->unmap (widget);
+}
+
+
+static gboolean
+size_tick (GtkWidget     *widget,
+           GdkFrameClock *frame_clock,
+           gpointer       data)
+{
+  KgxTerminal *self = KGX_TERMINAL (widget);
+  VteTerminal *term = VTE_TERMINAL (self);
+  int rows = vte_terminal_get_row_count (term);
+  int cols = vte_terminal_get_column_count (term);
+
+  self->size_tick = 0;
+
+  if (rows == self->last_rows && cols == self->last_cols) {
+    return G_SOURCE_REMOVE;
+  }
+
+  self->last_rows = rows;
+  self->last_cols = cols;
+
+  update_tap_size (self);
+
+  g_signal_emit (self, signals[SIZE_CHANGED], 0, rows, cols);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+kgx_terminal_size_allocate (GtkWidget *widget,
+                            int        width,
+                            int        height,
+                            int        baseline)
+{
+  KgxTerminal *self = KGX_TERMINAL (widget);
+
+  /* Hidden tabs keep their last geometry, sparing them a rewrap and
+   * whatever is running a redraw, until they're shown again. One opened
+   * in the background still needs a first size though, or whatever runs
+   * in it starts out at 80x24 */
+  if (!gtk_widget_get_mapped (widget) && self->sized) {
+    self->resize_pending = TRUE;
+    return;
+  }
+
+  /* Sizing with stale metrics would only be undone next frame */
+  if (self->dirty) {
+    apply_settings (self);
+  }
+
+  /* Deprecated since VTE 0.58, which would rather always rewrap, but it
+   * remains the only way to skip rewrapping a huge scrollback. Should it
+   * ever go, #KgxTerminal:rewrap goes with it */
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  vte_terminal_set_rewrap_on_resize (VTE_TERMINAL (self),
+                                     kgx_terminal_will_rewrap (self));
+  G_GNUC_END_IGNORE_DEPRECATIONS
+
+  /* VTE resizes its own pty in here, whenever the allocation changes the
+   * number of whole cells, which we can't coalesce without holding back
+   * the allocation itself */
+  GTK_WIDGET_CLASS (kgx_terminal_parent_class)->size_allocate (widget, width, height, baseline);
+  self->sized = TRUE;
+
+  /* Live resizing allocates us constantly, but only whole cells matter,
+   * and only once a frame. This covers the pty when we've tapped it, and
+   * everyone listening to ::size-changed */
+  if (!self->size_tick) {
+    self->size_tick = gtk_widget_add_tick_callback (widget, size_tick, NULL, NULL);
+  }
+}
+
+
+static gboolean
+kgx_terminal_query_tooltip (GtkWidget  *widget,
+                            int         x,
+                            int         y,
+                            gboolean    keyboard_tooltip,
+                            GtkTooltip *tooltip)
+{
+  KgxTerminal *self = KGX_TERMINAL (widget);
+  g_autofree char *text = NULL;
+
+  if (keyboard_tooltip || !have_url_under_pointer (self, x, y)) {
+    return GTK_WIDGET_CLASS (kgx_terminal_parent_class)->query_tooltip (widget,
+                                                                        x,
+                                                                        y,
+                                                                        keyboard_tooltip,
+                                                                        tooltip);
+  }
+
+  text = g_strdup_printf (_("Ctrl-click to open:\n%s"), self->current_url);
+
+  gtk_tooltip_set_text (tooltip, text);
+
+  return TRUE;
+}
+
+
+static void
+kgx_terminal_selection_changed (VteTerminal *self)
+{
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy",
+                                 vte_terminal_get_has_selection (self));
+}
+
+
+static void
+kgx_terminal_contents_changed (VteTerminal *term)
+{
+  KgxTerminal *self = KGX_TERMINAL (term);
+
+  self->generation++;
+
+  /* Untapped VTE reads the child itself, so this is all we'll hear */
+  if (!self->tap_pty) {
+    self->activity++;
+  }
+
+  /* It's caught up with what we fed it */
+  if (G_UNLIKELY (self->tap_pty)) {
+    self->tap_unseen = 0;
+    resume_tap (self);
+  }
+}
+
+
+static void
+kgx_terminal_commit (VteTerminal *term,
+                     const char  *text,
+                     guint        size)
+{
+  KgxTerminal *self = KGX_TERMINAL (term);
+
+  if (G_UNLIKELY (self->tap_pty)) {
+    tap_write (self, text, size);
+  }
+}
+
+
+static void
+kgx_terminal_increase_font_size (VteTerminal *self)
+{
+  g_signal_emit (self, signals[ZOOM], 0, KGX_ZOOM_IN);
+}
+
+
+static void
+kgx_terminal_decrease_font_size (VteTerminal *self)
+{
+  g_signal_emit (self, signals[ZOOM], 0, KGX_ZOOM_OUT);
+}
+
+
+static gboolean
+is_local_host (const char *host)
+{
+  const char *local = g_get_host_name ();
+  gsize len;
+
+  if (!host || !host[0] || g_ascii_strcasecmp (host, "localhost") == 0) {
+    return TRUE;
+  }
+
+  /* Two qualified names had better match, web1.a & web1.b are different
+   * machines */
+  if (strchr (host, '.') && strchr (local, '.')) {
+    return g_ascii_strcasecmp (host, local) == 0;
+  }
+
+  /* Shells disagree on whether $HOSTNAME is qualified, and so might we,
+   * so when one side isn't only the first label is there to compare */
+  len = strcspn (host, ".");
+  return len == strcspn (local, ".") && g_ascii_strncasecmp (host, local, len) == 0;
+}
+
+
+/*
+ * Whoever has the child's pty at the moment, which is us when tapped
+ */
+static GPid
+foreground_pgrp (KgxTerminal *self)
+{
+  VtePty *pty = self->tap_pty ? self->tap_pty : vte_terminal_get_pty (VTE_TERMINAL (self));
+  pid_t pgrp;
+
+  if (!pty) {
+    return 0;
+  }
+
+  pgrp = tcgetpgrp (vte_pty_get_fd (pty));
+
+  return pgrp > 0 ? pgrp : 0;
+}
+
+
+/*
+ * The shell puts its host in the OSC 7 it sends at each prompt, so a
+ * different one means we're talking to another machine however we got
+ * there (jump hosts, wrappers, nested sessions). #KgxTab only falls back
+ * on spotting ssh & co when there's nothing from the shell
+ */
+static void
+update_remote_host (KgxTerminal *self, const char *uri)
+{
+  g_autofree char *host = NULL;
+  g_autofree char *path = NULL;
+
+  if (uri) {
+    path = g_filename_from_uri (uri, &host, NULL);
+  }
+
+  if (is_local_host (host)) {
+    g_clear_pointer (&host, g_free);
+  }
+
+  /* Likely ssh or similar, when it goes so does the other machine, see
+   * kgx_terminal_process_exited() */
+  self->remote_pgrp = host ? foreground_pgrp (self) : 0;
+
+  if (g_set_str (&self->remote_host, host)) {
+    g_debug ("terminal: now on %s", host ? host : "this host");
+    g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_REMOTE_HOST]);
+  }
+}
+
+
+static void
+location_changed (KgxTerminal *self)
+{
+  const char *directory;
+  gboolean value;
+
+  directory = vte_terminal_get_current_directory_uri (VTE_TERMINAL (self));
+  value = vte_terminal_get_current_file_uri (VTE_TERMINAL (self)) || directory;
+
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.show-in-files", value);
+
+  /* OSC 6 alone says nothing about where the shell is */
+  if (directory) {
+    update_remote_host (self, directory);
+    probe_integration (self);
+  }
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_PATH]);
+}
+
+
+static void
+setup_context_menu (KgxTerminal *self, VteEventContext *context)
+{
+  gboolean enabled;
+
+  if (context) {
+    double x, y;
+
+    vte_event_context_get_coordinates (context, &x, &y);
+
+    enabled = have_url_under_pointer (self, x, y);
   } else {
-    vte_terminal_paste_text (VTE_TERMINAL (self), text);
+    enabled = FALSE;
+  }
+
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.open-link", enabled);
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy-link", enabled);
+}
+
+
+static void
+pressed (GtkGestureClick *gesture,
+         int              n_presses,
+         double           x,
+         double           y,
+         KgxTerminal     *self)
+{
+  GdkModifierType state = gtk_event_controller_get_current_event_state (GTK_EVENT_CONTROLLER (gesture));
+  guint button = gtk_gesture_single_get_current_button (GTK_GESTURE_SINGLE (gesture));
+
+  if (button == GDK_BUTTON_SECONDARY)
+  {
+    if (vte_terminal_get_has_selection(VTE_TERMINAL(self)))
+    {
+      copy_activated(self);
+      vte_terminal_unselect_all(VTE_TERMINAL(self));
+    }
+    else
+    {
+      paste_activated(self);
+    }
+  }
+
+  if (n_presses > 1) {
+    gtk_gesture_set_state (GTK_GESTURE (gesture), GTK_EVENT_SEQUENCE_DENIED);
+    return;
+  }
+
+  if (have_url_under_pointer (self, x, y) &&
+      (button == GDK_BUTTON_PRIMARY || button == GDK_BUTTON_MIDDLE) &&
+      state & GDK_CONTROL_MASK) {
+
+    open_link (self);
+    gtk_gesture_set_state (GTK_GESTURE (gesture), GTK_EVENT_SEQUENCE_CLAIMED);
+
+    return;
+  }
+
+  gtk_gesture_set_state (GTK_GESTURE (gesture), GTK_EVENT_SEQUENCE_DENIED);
+}
+
+
+static gboolean
+scroll (GtkEventControllerScroll *scroll,
+        double                   dx,
+        double                   dy,
+        KgxTerminal              *self)
+{
+  GdkModifierType mods = gtk_event_controller_get_current_event_state (GTK_EVENT_CONTROLLER (scroll));
+
+  if ((mods & GDK_CONTROL_MASK) == 0 || dy == 0) {
+    return FALSE;
+  }
+
+  g_signal_emit (self, signals[ZOOM], 0, dy > 0 ? KGX_ZOOM_OUT : KGX_ZOOM_IN);
+
+  return TRUE;
+}
+
+
+static void
+kgx_terminal_class_init (KgxTerminalClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+  VteTerminalClass *term_class = VTE_TERMINAL_CLASS (klass);
+
+  object_class->dispose = kgx_terminal_dispose;
+  object_class->set_property = kgx_terminal_set_property;
+  object_class->get_property = kgx_terminal_get_property;
+
+  widget_class->map = kgx_terminal_map;
+  widget_class->unmap = kgx_terminal_unmap;
+  widget_class->size_allocate = kgx_terminal_size_allocate;
+  widget_class->query_tooltip = kgx_terminal_query_tooltip;
+
+  term_class->selection_changed = kgx_terminal_selection_changed;
+  term_class->contents_changed = kgx_terminal_contents_changed;
+  term_class->commit = kgx_terminal_commit;
+  term_class->increase_font_size = kgx_terminal_increase_font_size;
+  term_class->decrease_font_size = kgx_terminal_decrease_font_size;
+
+  pspecs[PROP_SETTINGS] =
+    g_param_spec_object ("settings", NULL, NULL,
+                         KGX_TYPE_SETTINGS,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  pspecs[PROP_CANCELLABLE] =
+    g_param_spec_object ("cancellable", NULL, NULL,
+                         G_TYPE_CANCELLABLE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  pspecs[PROP_PATH] =
+    g_param_spec_object ("path", NULL, NULL,
+                         G_TYPE_FILE,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * KgxTerminal:rewrap:
+   *
+   * Whether existing lines are rewrapped to a new width, see #KgxRewrap
+   */
+  pspecs[PROP_REWRAP] =
+    g_param_spec_enum ("rewrap", NULL, NULL,
+                       KGX_TYPE_REWRAP,
+                       KGX_REWRAP_AUTO,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxTerminal:remote-host:
+   *
+   * The machine the shell says it's on, when that isn't this one
+   *
+   * Taken from the host of the current directory (OSC 7), so only shells
+   * that report it are seen as remote
+   */
+  pspecs[PROP_REMOTE_HOST] =
+    g_param_spec_string ("remote-host", NULL, NULL,
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * KgxTerminal:integrated:
+   *
+   * The shell is sending OSC 133 marks, and we're reading them
+   *
+   * Only ever set whilst #KgxSettings:shell-integration is enabled, and
+   * then only once the shell has reported its location
+   */
+  pspecs[PROP_INTEGRATED] =
+    g_param_spec_boolean ("integrated", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  g_object_class_install_properties (object_class, LAST_PROP, pspecs);
+
+  signals[SIZE_CHANGED] = g_signal_new ("size-changed",
+                                        G_TYPE_FROM_CLASS (klass),
+                                        G_SIGNAL_RUN_LAST,
+                                        0, NULL, NULL,
+                                        kgx_marshals_VOID__UINT_UINT,
+                                        G_TYPE_NONE,
+                                        2,
+                                        G_TYPE_UINT,
+                                        G_TYPE_UINT);
+  g_signal_set_va_marshaller (signals[SIZE_CHANGED],
+                              G_TYPE_FROM_CLASS (klass),
+                              kgx_marshals_VOID__UINT_UINTv);
+
+  signals[ZOOM] = g_signal_new ("zoom",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL,
+                                kgx_marshals_VOID__ENUM,
+                                G_TYPE_NONE,
+                                1,
+                                KGX_TYPE_ZOOM);
+  g_signal_set_va_marshaller (signals[ZOOM],
+                              G_TYPE_FROM_CLASS (klass),
+                              kgx_marshals_VOID__ENUMv);
+
+  /**
+   * KgxTerminal::output:
+   * @self: the #KgxTerminal
+   * @output: the raw bytes read from the pty, only valid during emission
+   *
+   * Only emitted whilst tapped, see kgx_terminal_push_tap()
+   */
+  signals[OUTPUT] = g_signal_new ("output",
+                                  G_TYPE_FROM_CLASS (klass),
+                                  G_SIGNAL_RUN_LAST,
+                                  0, NULL, NULL,
+                                  kgx_marshals_VOID__BOXED,
+                                  G_TYPE_NONE,
+                                  1,
+                                  G_TYPE_BYTES | G_SIGNAL_TYPE_STATIC_SCOPE);
+  g_signal_set_va_marshaller (signals[OUTPUT],
+                              G_TYPE_FROM_CLASS (klass),
+                              kgx_marshals_VOID__BOXEDv);
+
+  /**
+   * KgxTerminal::shell-mark:
+   * @self: the #KgxTerminal
+   * @kind: the #KgxMarkKind
+   * @exit_status: for %KGX_MARK_FINISHED the status, if known, else -1
+   * @command: (nullable): for %KGX_MARK_EXECUTED the command line, if the
+   *           shell sent one
+   *
+   * The shell marked a prompt or command boundary (OSC 133), everything
+   * before it has already reached the terminal
+   *
+   * Only emitted whilst #KgxSettings:shell-integration is enabled
+   */
+  signals[SHELL_MARK] = g_signal_new ("shell-mark",
+                                      G_TYPE_FROM_CLASS (klass),
+                                      G_SIGNAL_RUN_LAST,
+                                      0, NULL, NULL,
+                                      kgx_marshals_VOID__ENUM_INT_STRING,
+                                      G_TYPE_NONE,
+                                      3,
+                                      KGX_TYPE_MARK_KIND,
+                                      G_TYPE_INT,
+                                      G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
+  g_signal_set_va_marshaller (signals[SHELL_MARK],
+                              G_TYPE_FROM_CLASS (klass),
+                              kgx_marshals_VOID__ENUM_INT_STRINGv);
+
+  gtk_widget_class_set_template_from_resource (widget_class,
+                                               KGX_APPLICATION_PATH "kgx-terminal.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, KgxTerminal, settings_signals);
+
+  gtk_widget_class_bind_template_callback (widget_class, location_changed);
+  gtk_widget_class_bind_template_callback (widget_class, setup_context_menu);
+  gtk_widget_class_bind_template_callback (widget_class, pressed);
+  gtk_widget_class_bind_template_callback (widget_class, scroll);
+
+  gtk_widget_class_install_action (widget_class,
+                                   "term.open-link",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) open_link_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.copy-link",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) copy_link_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.copy",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) copy_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.paste",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) paste_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.select-all",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) select_all_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.show-in-files",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) show_in_files_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.previous-prompt",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) previous_prompt_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.next-prompt",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) next_prompt_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "term.copy-last-output",
+                                   NULL,
+                                   (GtkWidgetActionActivateFunc) copy_last_output_activated);
+}
+
+
+static void
+kgx_terminal_init (KgxTerminal *self)
+{
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  self->tap_pending_input = g_byte_array_new ();
+  kgx_mark_scanner_init (&self->marks);
+  self->mark_output = g_byte_array_new ();
+  self->pending_marks = g_array_new (FALSE, FALSE, sizeof (PendingMark));
+  g_array_set_clear_func (self->pending_marks, pending_mark_clear);
+  kgx_segments_init (&self->segments);
+  g_signal_connect (self, "notify::pty", G_CALLBACK (pty_changed), NULL);
+  g_signal_connect (self, "contents-changed", G_CALLBACK (vte_caught_up), NULL);
+  g_signal_connect (self, "cursor-moved", G_CALLBACK (vte_caught_up), NULL);
+
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.open-link", FALSE);
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy-link", FALSE);
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.copy", FALSE);
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "term.show-in-files", FALSE);
+  update_segment_actions (self);
+
+  vte_terminal_set_mouse_autohide (VTE_TERMINAL (self), TRUE);
+  vte_terminal_search_set_wrap_around (VTE_TERMINAL (self), TRUE);
+
+  for (int i = 0; i < KGX_TERMINAL_N_LINK_REGEX; i++) {
+    g_autoptr (VteRegex) regex = NULL;
+    g_autoptr (GError) error = NULL;
+
+    regex = vte_regex_new_for_match (links[i], -1, PCRE2_MULTILINE, &error);
+
+    if (error) {
+      g_warning ("link regex failed: %s", error->message);
+      continue;
+    }
+
+    self->match_id[i] = vte_terminal_match_add_regex (VTE_TERMINAL (self),
+                                                      regex,
+                                                      0);
+
+    vte_terminal_match_set_cursor_name (VTE_TERMINAL (self),
+                                        self->match_id[i],
+                                        "pointer");
+  }
+
+  g_signal_group_connect_swapped (self->settings_signals,
+                                  "notify::font", G_CALLBACK (font_changed),
+                                  self);
+  g_signal_group_connect_swapped (self->settings_signals,
+                                  "notify::font-scale", G_CALLBACK (font_scale_changed),
+                                  self);
+  g_signal_group_connect_swapped (self->settings_signals,
+                                  "notify::scrollback-lines", G_CALLBACK (scrollback_changed),
+                                  self);
+  g_signal_group_connect_swapped (self->settings_signals,
+                                  "notify::resolved-theme", G_CALLBACK (theme_changed),
+                                  self);
+  g_signal_group_connect_swapped (self->settings_signals,
+                                  "notify::shell-integration", G_CALLBACK (integration_changed),
+                                  self);
+}
+
+
+static void
+got_paste (GObject      *source,
+           GAsyncResult *res,
+           gpointer      user_data)
+{
+  g_autoptr (KgxPasteDialog) dialogue = KGX_PASTE_DIALOG (source);
+  g_autoptr (KgxTerminal) self = user_data;
+  g_autoptr (GError) error = NULL;
+  KgxPasteDialogResult result;
+  const char *content;
+
+  result = kgx_paste_dialog_run_finish (dialogue, res, &content, &error);
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    result = KGX_PASTE_CANCELLED;
+  } else if (error) {
+    g_critical ("terminal [paste]: Unexpected: %s", error->message);
+    return;
+  }
+
+  if (result == KGX_PASTE_CANCELLED) {
+    return;
+  }
+
+  vte_terminal_paste_text (VTE_TERMINAL (self), content);
+}
+
+
+void
+kgx_terminal_accept_paste (KgxTerminal *self,
+                           const char  *text)
+{
+  g_autofree char *striped = g_strchug (g_strdup (text));
+  size_t len;
+
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  if (G_UNLIKELY (!text || !text[0])) {
+    return;
+  }
+
+  len = strlen (striped);
+
+  if (g_strstr_len (striped, len, "sudo") != NULL &&
+      g_strstr_len (striped, len, "\n") != NULL) {
+    KgxPasteDialog *paste = g_object_new (KGX_TYPE_PASTE_DIALOG,
+                                          "content", text,
+                                          "transient-for", gtk_widget_get_root (GTK_WIDGET (self)),
+                                          NULL);
+
+    kgx_paste_dialog_run (paste,
+                          self->cancellable,
+                          got_paste,
+                          g_object_ref (self));
+  } else {
+    vte_terminal_paste_text (VTE_TERMINAL (self), text);
+  }
+}
+
+
+/**
+ * kgx_terminal_push_tap:
+ * @self: the #KgxTerminal
+ *
+ * Start routing the pty through us so #KgxTerminal::output is emitted,
+ * balance with kgx_terminal_pop_tap()
+ */
+void
+kgx_terminal_push_tap (KgxTerminal *self)
+{
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  if (self->taps++ == 0) {
+    start_tap (self);
+  }
+}
+
+
+void
+kgx_terminal_pop_tap (KgxTerminal *self)
+{
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+  g_return_if_fail (self->taps > 0);
+
+  if (--self->taps == 0) {
+    stop_tap (self);
+  }
+}
+
+
+/**
+ * kgx_terminal_snapshot:
+ * @self: the #KgxTerminal
+ * @error: return location for a #GError
+ *
+ * Serialise the scrollback and screen, with their attributes, up to the
+ * cursor's row, compressed
+ *
+ * Returns: (transfer full): the snapshot, for kgx_terminal_restore()
+ */
+GBytes *
+kgx_terminal_snapshot (KgxTerminal  *self,
+                       GError      **error)
+{
+  g_autofree char *html = NULL;
+  gsize len = 0;
+  glong col, row;
+
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), NULL);
+
+  vte_terminal_get_cursor_position (VTE_TERMINAL (self), &col, &row);
+
+  /* Only HTML keeps the colours, there's no ANSI export */
+  html = vte_terminal_get_text_range_format (VTE_TERMINAL (self),
+                                             VTE_FORMAT_HTML,
+                                             first_row (self), 0,
+                                             row + 1, 0,
+                                             &len);
+
+  return kgx_snapshot_pack (html, html ? len : 0, col, error);
+}
+
+
+typedef struct {
+  GString *html;
+  glong    row;
+  glong    end_row;
+  glong    cursor_col;
+  guint    generation;
+} SnapshotState;
+
+
+static void
+snapshot_state_free (gpointer data)
+{
+  SnapshotState *state = data;
+
+  g_string_free (state->html, TRUE);
+
+  g_free (state);
+}
+
+
+static void
+snapshot_pack_thread (GTask        *task,
+                      gpointer      source,
+                      gpointer      data,
+                      GCancellable *cancellable)
+{
+  SnapshotState *state = data;
+  g_autoptr (GError) error = NULL;
+  GBytes *snapshot;
+
+  snapshot = kgx_snapshot_pack (state->html->str,
+                                state->html->len,
+                                state->cursor_col,
+                                &error);
+  if (!snapshot) {
+    g_task_return_error (task, g_steal_pointer (&error));
+    return;
+  }
+
+  g_task_return_pointer (task, snapshot, (GDestroyNotify) g_bytes_unref);
+}
+
+
+static gboolean
+snapshot_slice (gpointer data)
+{
+  GTask *task = data;
+  KgxTerminal *self = g_task_get_source_object (task);
+  SnapshotState *state = g_task_get_task_data (task);
+  g_autofree char *html = NULL;
+  gsize len = 0;
+  glong end;
+
+  if (g_task_return_error_if_cancelled (task)) {
+    return G_SOURCE_REMOVE;
+  }
+
+  if (self->hibernated || self->hibernations != state->generation) {
+    g_task_return_new_error (task,
+                             G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                             "Hibernated whilst taking a snapshot");
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Rows may have scrolled off the top in the meantime */
+  state->row = MAX (state->row, first_row (self));
+  end = MIN (state->row + SNAPSHOT_SLICE, state->end_row);
+
+  if (state->row < end) {
+    html = vte_terminal_get_text_range_format (VTE_TERMINAL (self),
+                                               VTE_FORMAT_HTML,
+                                               state->row, 0,
+                                               end, 0,
+                                               &len);
+    if (html) {
+      g_string_append_len (state->html, html, len);
+    }
+    state->row = end;
+  }
+
+  if (state->row < state->end_row) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Compressing doesn't need the terminal */
+  g_task_run_in_thread (task, snapshot_pack_thread);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * kgx_terminal_snapshot_async:
+ * @self: the #KgxTerminal
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: called with the snapshot
+ * @callback_data: data for @callback
+ *
+ * As kgx_terminal_snapshot(), but the contents are fetched a slice at a
+ * time, at idle priority, and compressed on a worker. Rows written after
+ * the call are not included
+ */
+void
+kgx_terminal_snapshot_async (KgxTerminal         *self,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             callback_data)
+{
+  g_autoptr (GTask) task = NULL;
+  SnapshotState *state;
+  glong row;
+  guint source;
+
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  task = g_task_new (self, cancellable, callback, callback_data);
+  g_task_set_source_tag (task, kgx_terminal_snapshot_async);
+
+  state = g_new0 (SnapshotState, 1);
+  state->html = g_string_new (NULL);
+  state->row = first_row (self);
+  state->generation = self->hibernations;
+  vte_terminal_get_cursor_position (VTE_TERMINAL (self), &state->cursor_col, &row);
+  state->end_row = row + 1;
+  g_task_set_task_data (task, state, snapshot_state_free);
+
+  source = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                            snapshot_slice,
+                            g_object_ref (task),
+                            g_object_unref);
+  g_source_set_name_by_id (source, "[kgx] terminal snapshot");
+}
+
+
+/**
+ * kgx_terminal_snapshot_finish:
+ * @self: the #KgxTerminal
+ * @res: the #GAsyncResult
+ * @error: return location for a #GError
+ *
+ * Returns: (transfer full): the snapshot, for kgx_terminal_restore()
+ */
+GBytes *
+kgx_terminal_snapshot_finish (KgxTerminal   *self,
+                              GAsyncResult  *res,
+                              GError       **error)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), NULL);
+  g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+
+/**
+ * kgx_terminal_restore:
+ * @self: the #KgxTerminal
+ * @snapshot: from kgx_terminal_snapshot()
+ *
+ * Feed the contents of @snapshot back in at the cursor, leaving the cursor
+ * where it was when the snapshot was taken
+ */
+void
+kgx_terminal_restore (KgxTerminal *self,
+                      GBytes      *snapshot)
+{
+  g_autoptr (GBytes) contents = NULL;
+  g_autoptr (GError) error = NULL;
+  gsize len;
+  const char *data;
+
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+  g_return_if_fail (snapshot != NULL);
+
+  contents = kgx_snapshot_unpack (snapshot, &error);
+  if (!contents) {
+    g_warning ("terminal: couldn't restore snapshot: %s", error->message);
+    return;
+  }
+
+  data = g_bytes_get_data (contents, &len);
+  vte_terminal_feed (VTE_TERMINAL (self), data, len);
+}
+
+
+static void
+wake_early (KgxTerminal *self)
+{
+  g_autoptr (GByteArray) held = g_steal_pointer (&self->held_output);
+
+  g_clear_object (&self->hibernating);
+
+  if (self->held_trimmed) {
+    self->held_trimmed = FALSE;
+    vte_terminal_feed (VTE_TERMINAL (self), "\033[0m\r\n", -1);
+  }
+  vte_terminal_feed (VTE_TERMINAL (self), (const char *) held->data, held->len);
+  kgx_terminal_pop_tap (self);
+}
+
+
+static void
+hibernate_ready (GObject      *source,
+                 GAsyncResult *res,
+                 gpointer      data)
+{
+  KgxTerminal *self = KGX_TERMINAL (source);
+  g_autoptr (GBytes) snapshot = NULL;
+  g_autoptr (GError) error = NULL;
+
+  snapshot = kgx_terminal_snapshot_finish (self, res, &error);
+
+  /* Already woken by kgx_terminal_thaw(), or gone */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    return;
+  }
+
+  if (G_UNLIKELY (!snapshot)) {
+    g_warning ("terminal: couldn't hibernate: %s", error->message);
+    wake_early (self);
+    return;
+  }
+
+  /* Shown again whilst we were busy, the contents are still there */
+  if (gtk_widget_get_mapped (GTK_WIDGET (self))) {
+    wake_early (self);
+    return;
+  }
+
+  g_clear_object (&self->hibernating);
+
+  vte_terminal_reset (VTE_TERMINAL (self), TRUE, TRUE);
+  reset_segments (self);
+
+  self->snapshot = g_steal_pointer (&snapshot);
+  self->hibernated = TRUE;
+  self->hibernations++;
+
+  g_debug ("terminal: hibernated into %" G_GSIZE_FORMAT " bytes",
+           g_bytes_get_size (self->snapshot));
+}
+
+
+/**
+ * kgx_terminal_hibernate:
+ * @self: the #KgxTerminal
+ *
+ * Swap the contents out for a compressed snapshot, anything the child
+ * writes in the meantime is held until kgx_terminal_thaw()
+ *
+ * The snapshot is taken in the background, the contents only go once it's
+ * done, and only if we weren't shown again in the meantime
+ */
+void
+kgx_terminal_hibernate (KgxTerminal *self)
+{
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  if (self->hibernated || self->hibernating) {
+    return;
+  }
+
+  /* From here on output waits for us to wake, so the snapshot can't miss
+   * anything */
+  self->held_output = g_byte_array_new ();
+  self->held_trimmed = FALSE;
+  kgx_terminal_push_tap (self);
+
+  self->hibernating = g_cancellable_new ();
+  kgx_terminal_snapshot_async (self,
+                               self->hibernating,
+                               hibernate_ready,
+                               NULL);
+}
+
+
+void
+kgx_terminal_thaw (KgxTerminal *self)
+{
+  g_autoptr (GBytes) snapshot = NULL;
+  g_autoptr (GByteArray) held = NULL;
+  VtePty *pty;
+
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  if (self->hibernating) {
+    g_cancellable_cancel (self->hibernating);
+    wake_early (self);
+    return;
+  }
+
+  if (!self->hibernated) {
+    return;
+  }
+
+  self->hibernated = FALSE;
+  snapshot = g_steal_pointer (&self->snapshot);
+  held = g_steal_pointer (&self->held_output);
+
+  vte_terminal_reset (VTE_TERMINAL (self), TRUE, TRUE);
+  kgx_terminal_restore (self, snapshot);
+
+  /* There's a gap, start the rest afresh rather than mid-line */
+  if (self->held_trimmed) {
+    self->held_trimmed = FALSE;
+    vte_terminal_feed (VTE_TERMINAL (self), "\033[0m\r\n", -1);
+  }
+  vte_terminal_feed (VTE_TERMINAL (self), (const char *) held->data, held->len);
+
+  kgx_terminal_pop_tap (self);
+
+  /* Wiggle the size so whatever is running redraws, the pty is still ours
+   * if anybody else is tapping */
+  pty = self->taps > 0 ? self->tap_pty : vte_terminal_get_pty (VTE_TERMINAL (self));
+  if (pty) {
+    int rows = vte_terminal_get_row_count (VTE_TERMINAL (self));
+    int cols = vte_terminal_get_column_count (VTE_TERMINAL (self));
+
+    vte_pty_set_size (pty, rows, MAX (cols - 1, 1), NULL);
+    vte_pty_set_size (pty, rows, cols, NULL);
+  }
+
+  g_debug ("terminal: thawed with %u bytes of held output", held->len);
+}
+
+
+gboolean
+kgx_terminal_get_hibernated (KgxTerminal *self)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), FALSE);
+
+  return self->hibernated;
+}
+
+
+/**
+ * kgx_terminal_get_generation:
+ * @self: the #KgxTerminal
+ *
+ * Returns: a counter that moves on whenever the contents change
+ */
+guint
+kgx_terminal_get_generation (KgxTerminal *self)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), 0);
+
+  return self->generation;
+}
+
+
+/**
+ * kgx_terminal_get_activity:
+ * @self: the #KgxTerminal
+ *
+ * Unlike kgx_terminal_get_generation() this also counts output held
+ * whilst hibernated
+ *
+ * Returns: a counter that moves on whenever the child writes something
+ */
+guint
+kgx_terminal_get_activity (KgxTerminal *self)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), 0);
+
+  return self->activity;
+}
+
+
+/**
+ * kgx_terminal_get_remote_host:
+ * @self: the #KgxTerminal
+ *
+ * Returns: (nullable): see #KgxTerminal:remote-host
+ */
+const char *
+kgx_terminal_get_remote_host (KgxTerminal *self)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), NULL);
+
+  return self->remote_host;
+}
+
+
+/**
+ * kgx_terminal_process_exited:
+ * @self: the #KgxTerminal
+ * @pid: a process that was running in @self
+ *
+ * If @pid was in the foreground when the shell last reported another
+ * machine we're back from there, whether or not the shell here says so
+ */
+void
+kgx_terminal_process_exited (KgxTerminal *self,
+                             GPid         pid)
+{
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  if (!self->remote_host || pid <= 0 || pid != self->remote_pgrp) {
+    return;
+  }
+
+  g_debug ("terminal: %i left %s", pid, self->remote_host);
+
+  self->remote_pgrp = 0;
+  g_clear_pointer (&self->remote_host, g_free);
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_REMOTE_HOST]);
+}
+
+
+/**
+ * kgx_terminal_get_integrated:
+ * @self: the #KgxTerminal
+ *
+ * Returns: see #KgxTerminal:integrated
+ */
+gboolean
+kgx_terminal_get_integrated (KgxTerminal *self)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), FALSE);
+
+  return self->integrated;
+}
+
+
+/**
+ * kgx_terminal_set_rewrap:
+ * @self: the #KgxTerminal
+ * @rewrap: the new policy
+ *
+ * Set #KgxTerminal:rewrap, taking effect from the next resize
+ */
+void
+kgx_terminal_set_rewrap (KgxTerminal *self,
+                         KgxRewrap    rewrap)
+{
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  if (self->rewrap == rewrap) {
+    return;
+  }
+
+  self->rewrap = rewrap;
+
+  g_object_notify_by_pspec (G_OBJECT (self), pspecs[PROP_REWRAP]);
+}
+
+
+KgxRewrap
+kgx_terminal_get_rewrap (KgxTerminal *self)
+{
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), KGX_REWRAP_AUTO);
+
+  return self->rewrap;
+}
+
+
+/*
+ * How long the history is, going by the scrollbar as VTE won't say
+ */
+static double
+count_lines (KgxTerminal *self)
+{
+  GtkAdjustment *adjustment;
+  double lines;
+
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
+  if (!adjustment) {
+    return 0;
+  }
+
+  lines = gtk_adjustment_get_upper (adjustment);
+  if (vte_terminal_get_scroll_unit_is_pixels (VTE_TERMINAL (self))) {
+    lines /= MAX (vte_terminal_get_char_height (VTE_TERMINAL (self)), 1);
+  }
+
+  return lines;
+}
+
+
+/**
+ * kgx_terminal_will_rewrap:
+ * @self: the #KgxTerminal
+ *
+ * Resolve #KgxTerminal:rewrap for the current contents
+ *
+ * Returns: whether the lines would be rewrapped, were @self resized now
+ */
+gboolean
+kgx_terminal_will_rewrap (KgxTerminal *self)
+{
+  guint limit;
+
+  g_return_val_if_fail (KGX_IS_TERMINAL (self), TRUE);
+
+  if (self->rewrap != KGX_REWRAP_AUTO) {
+    return self->rewrap == KGX_REWRAP_ALWAYS;
+  }
+
+  if (!self->settings) {
+    return TRUE;
+  }
+
+  limit = kgx_settings_get_rewrap_limit (self->settings);
+  if (limit == 0) {
+    return TRUE;
+  }
+
+  return count_lines (self) <= limit;
+}
+
+
+static gboolean
+retire_step (gpointer data)
+{
+  KgxTerminal *self = g_queue_peek_head (&retiring);
+
+  if (!self) {
+    retire_source = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Shrinking the scrollback drops the oldest lines, so we can let go of
+   * a huge history a slice at a time rather than all at once in dispose */
+  self->retire_lines = MAX (self->retire_lines - RETIRE_SLICE, 0);
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (self), self->retire_lines);
+
+  if (self->retire_lines == 0) {
+    g_queue_pop_head (&retiring);
+    g_object_unref (self);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * kgx_terminal_retire:
+ * @self: (transfer full): the #KgxTerminal
+ *
+ * Drop the terminal, without stalling the UI should it have an enormous
+ * scrollback
+ *
+ * The pty is let go of straight away, the scrollback in slices on a short
+ * timeout, and then finally @self
+ */
+void
+kgx_terminal_retire (KgxTerminal *self)
+{
+  double lines;
+
+  g_return_if_fail (KGX_IS_TERMINAL (self));
+
+  stop_tap (self);
+  vte_terminal_set_pty (VTE_TERMINAL (self), NULL);
+
+  lines = count_lines (self);
+
+  if (lines <= RETIRE_SLICE) {
+    g_object_unref (self);
+    return;
+  }
+
+  g_debug ("terminal: retiring %.0f lines", lines);
+
+  self->retire_lines = (glong) lines;
+  g_queue_push_tail (&retiring, self);
+
+  if (!retire_source) {
+    retire_source = g_timeout_add (RETIRE_INTERVAL, retire_step, NULL);
+    g_source_set_name_by_id (retire_source, "[kgx] retire terminals");
   }
 }
@@ -38,11 +38,55 @@ typedef enum /*< enum,prefix=KGX >*/ {
 } KgxZoom;
 
 
+/**
+ * KgxRewrap:
+ * @KGX_REWRAP_AUTO: Rewrap unless the scrollback is longer than
+ *                   #KgxSettings:rewrap-limit
+ * @KGX_REWRAP_ALWAYS: Always rewrap
+ * @KGX_REWRAP_NEVER: Leave lines as they are
+ *
+ * What to do with the existing lines of a #KgxTerminal when its width
+ * changes
+ */
+typedef enum /*< enum,prefix=KGX >*/ {
+  KGX_REWRAP_AUTO = 0,   /*< nick=auto >*/
+  KGX_REWRAP_ALWAYS = 1, /*< nick=always >*/
+  KGX_REWRAP_NEVER = 2,  /*< nick=never >*/
+} KgxRewrap;
+
+
 #define KGX_TYPE_TERMINAL kgx_terminal_get_type()
 
 G_DECLARE_FINAL_TYPE (KgxTerminal, kgx_terminal, KGX, TERMINAL, VteTerminal)
 
-void kgx_terminal_accept_paste (KgxTerminal *self,
-                                const char  *text);
+void        kgx_terminal_accept_paste    (KgxTerminal  *self,
+                                          const char   *text);
+void        kgx_terminal_push_tap        (KgxTerminal  *self);
+void        kgx_terminal_pop_tap         (KgxTerminal  *self);
+GBytes     *kgx_terminal_snapshot        (KgxTerminal  *self,
+                                          GError      **error);
+void        kgx_terminal_snapshot_async  (KgxTerminal         *self,
+                                          GCancellable        *cancellable,
+                                          GAsyncReadyCallback  callback,
+                                          gpointer             callback_data);
+GBytes     *kgx_terminal_snapshot_finish (KgxTerminal  *self,
+                                          GAsyncResult *res,
+                                          GError      **error);
+void        kgx_terminal_restore         (KgxTerminal  *self,
+                                          GBytes       *snapshot);
+void        kgx_terminal_hibernate       (KgxTerminal  *self);
+void        kgx_terminal_thaw            (KgxTerminal  *self);
+gboolean    kgx_terminal_get_hibernated  (KgxTerminal  *self);
+guint       kgx_terminal_get_generation  (KgxTerminal  *self);
+guint       kgx_terminal_get_activity    (KgxTerminal  *self);
+const char *kgx_terminal_get_remote_host (KgxTerminal  *self);
+void        kgx_terminal_process_exited  (KgxTerminal  *self,
+                                          GPid          pid);
+gboolean    kgx_terminal_get_integrated  (KgxTerminal  *self);
+void        kgx_terminal_set_rewrap      (KgxTerminal  *self,
+                                          KgxRewrap     rewrap);
+KgxRewrap   kgx_terminal_get_rewrap      (KgxTerminal  *self);
+gboolean    kgx_terminal_will_rewrap     (KgxTerminal  *self);
+void        kgx_terminal_retire          (KgxTerminal  *self);
 
 G_END_DECLS
@@ -40,7 +40,8 @@ struct ProcessWatch {
  * @children: (element-type GLib.Pid ProcessWatch) the processes running in shells
  * @active: counter of #KgxWindow's with #GtkWindow:is-active = %TRUE,
  *          obviously this should only ever be 1 or but we can't be certain
- * @timeout: the current #GSource id of the watcher
+ * @timeout: the current #GSource id of the watcher, 0 whilst there is
+ *           nothing to watch
  *
  * Used to monitor processes running in pages
  */
@@ -161,6 +162,13 @@ remove_dead (gpointer pid,
 }
 
 
+static inline gboolean
+has_watches (KgxWatcher *self)
+{
+  return g_tree_nnodes (self->watching) > 0 || g_tree_nnodes (self->children) > 0;
+}
+
+
 static gboolean
 watch (gpointer data)
 {
@@ -184,6 +192,13 @@ watch (gpointer data)
 
   g_ptr_array_unref (dead.dead);
 
+  if (G_UNLIKELY (!has_watches (self))) {
+    g_debug ("watcher: idle");
+    self->timeout = 0;
+
+    return G_SOURCE_REMOVE;
+  }
+
   return G_SOURCE_CONTINUE;
 }
 
@@ -193,8 +208,11 @@ set_watcher (KgxWatcher *self, gboolean focused)
 {
   g_debug ("watcher: focused? %s", focused ? "yes" : "no");
 
-  if (self->timeout != 0) {
-    g_source_remove (self->timeout);
+  g_clear_handle_id (&self->timeout, g_source_remove);
+
+  // Nothing to poll for yet, kgx_watcher_add will start us
+  if (!has_watches (self)) {
+    return;
   }
 
   // Slow down polling when nothing is focused
@@ -217,8 +235,6 @@ kgx_watcher_init (KgxWatcher *self)
 
   self->active = 0;
   self->timeout = 0;
-
-  set_watcher (self, TRUE);
 }
 
 
@@ -247,6 +263,10 @@ kgx_watcher_add (KgxWatcher *self,
   g_debug ("watcher: started %i", pid);
 
   g_tree_insert (self->watching, GINT_TO_POINTER (pid), watch);
+
+  if (G_UNLIKELY (self->timeout == 0)) {
+    set_watcher (self, self->active > 0);
+  }
 }
 
 
@@ -27,8 +27,10 @@
 #include "kgx-window.h"
 #include "kgx-application.h"
 #include "kgx-close-dialog.h"
+#include "kgx-history-window.h"
 #include "kgx-pages.h"
 #include "kgx-preferences-window.h"
+#include "kgx-tab-switcher.h"
 #include "kgx-theme-switcher.h"
 #include "kgx-watcher.h"
 
@@ -314,9 +316,10 @@ extra_drag_drop (AdwTabBar        *bar,
                  GValue           *value,
                  KgxWindow        *self)
 {
+  KgxWindowPrivate *priv = kgx_window_get_instance_private (self);
   KgxTab *tab = KGX_TAB (adw_tab_page_get_child (page));
 
-  kgx_tab_extra_drop (tab, value);
+  kgx_pages_extra_drop (KGX_PAGES (priv->pages), tab, value);
 }
 
 
@@ -367,7 +370,10 @@ title_or_fallback (GObject *object, const char *title)
 
 
 static char *
-path_as_subtitle (GObject *object, GFile *file, const char *window_title)
+path_as_subtitle (GObject    *object,
+                  GFile      *file,
+                  const char *remote_host,
+                  const char *window_title)
 {
   g_autoptr (GFile) home = NULL;
   g_autoptr (GError) error = NULL;
@@ -379,12 +385,12 @@ path_as_subtitle (GObject *object, GFile *file, const char *window_title)
   const char *home_path = NULL;
 
   if (!file) {
-    return NULL;
+    return g_strdup (remote_host);
   }
 
   path_raw = g_file_get_path (file);
   if (G_UNLIKELY (!path_raw || g_strcmp0 (path_raw, window_title) == 0)) {
-    return NULL;
+    return g_strdup (remote_host);
   }
 
   path_utf8 = g_filename_to_utf8 (path_raw, -1, NULL, NULL, &error);
@@ -393,6 +399,11 @@ path_as_subtitle (GObject *object, GFile *file, const char *window_title)
     return g_file_get_uri (file);
   }
 
+  /* Our home means nothing over there, but where there is worth knowing */
+  if (remote_host) {
+    return g_strdup_printf ("%s:%s", remote_host, path_utf8);
+  }
+
   home_path = g_get_home_dir ();
   if (G_UNLIKELY (!g_str_has_prefix (path_raw, home_path))) {
     return g_steal_pointer (&path_utf8);
@@ -452,6 +463,60 @@ detach_tab_activated (GtkWidget  *widget,
 }
 
 
+static void
+recording_activated (GtkWidget  *widget,
+                     const char *action_name,
+                     GVariant   *parameter)
+{
+  KgxWindow *self = KGX_WINDOW (widget);
+  KgxWindowPrivate *priv = kgx_window_get_instance_private (self);
+
+  kgx_pages_set_recording (KGX_PAGES (priv->pages),
+                           g_str_equal (action_name, "tab.start-recording"));
+}
+
+
+static void
+rewrap_activated (GtkWidget  *widget,
+                  const char *action_name,
+                  GVariant   *parameter)
+{
+  KgxWindow *self = KGX_WINDOW (widget);
+  KgxWindowPrivate *priv = kgx_window_get_instance_private (self);
+
+  KgxRewrap rewrap = KGX_REWRAP_AUTO;
+
+  if (g_str_equal (action_name, "tab.rewrap-always")) {
+    rewrap = KGX_REWRAP_ALWAYS;
+  } else if (g_str_equal (action_name, "tab.rewrap-never")) {
+    rewrap = KGX_REWRAP_NEVER;
+  }
+
+  kgx_pages_set_rewrap (KGX_PAGES (priv->pages), rewrap);
+}
+
+
+static void
+monitor_activated (GtkWidget  *widget,
+                   const char *action_name,
+                   GVariant   *parameter)
+{
+  KgxWindow *self = KGX_WINDOW (widget);
+  KgxWindowPrivate *priv = kgx_window_get_instance_private (self);
+  KgxMonitorFlags flags;
+
+  if (g_str_has_suffix (action_name, "-activity")) {
+    flags = KGX_MONITOR_ACTIVITY;
+  } else {
+    flags = KGX_MONITOR_SILENCE;
+  }
+
+  kgx_pages_set_monitor (KGX_PAGES (priv->pages),
+                         flags,
+                         g_str_has_prefix (action_name, "tab.monitor-"));
+}
+
+
 static void
 new_activated (GtkWidget  *widget,
                const char *action_name,
@@ -465,12 +530,11 @@ new_activated (GtkWidget  *widget,
   application = gtk_window_get_application (GTK_WINDOW (self));
   dir = kgx_window_get_working_dir (self);
 
-  kgx_application_add_terminal (KGX_APPLICATION (application),
-                                NULL,
-                                timestamp,
-                                dir,
-                                NULL,
-                                NULL);
+  kgx_application_open_window (KGX_APPLICATION (application),
+                               timestamp,
+                               dir,
+                               NULL,
+                               NULL);
 }
 
 
@@ -537,6 +601,38 @@ tab_switcher_activated (GtkWidget  *widget,
 }
 
 
+static void
+switch_tab_activated (GtkWidget  *widget,
+                      const char *action_name,
+                      GVariant   *parameter)
+{
+  GtkApplication *application = gtk_window_get_application (GTK_WINDOW (widget));
+  GtkWidget *switcher;
+
+  switcher = kgx_tab_switcher_new (GTK_WINDOW (widget),
+                                   kgx_application_get_tab_index (KGX_APPLICATION (application)));
+  gtk_window_present (GTK_WINDOW (switcher));
+}
+
+
+static void
+search_history_activated (GtkWidget  *widget,
+                          const char *action_name,
+                          GVariant   *parameter)
+{
+  KgxWindow *self = KGX_WINDOW (widget);
+  KgxWindowPrivate *priv = kgx_window_get_instance_private (self);
+  GtkApplication *application = gtk_window_get_application (GTK_WINDOW (widget));
+  AdwTabPage *page = kgx_pages_get_selected_page (KGX_PAGES (priv->pages));
+  GtkWidget *history;
+
+  history = kgx_history_window_new (GTK_WINDOW (widget),
+                                    kgx_application_get_history (KGX_APPLICATION (application)),
+                                    page ? KGX_TAB (adw_tab_page_get_child (page)) : NULL);
+  gtk_window_present (GTK_WINDOW (history));
+}
+
+
 static void
 show_preferences_window_activated (GtkWidget  *widget,
                                    const char *action_name,
@@ -613,6 +709,15 @@ kgx_window_class_init (KgxWindowClass *klass)
 
   gtk_widget_class_install_action (widget_class, "tab.close", NULL, close_tab_activated);
   gtk_widget_class_install_action (widget_class, "tab.detach", NULL, detach_tab_activated);
+  gtk_widget_class_install_action (widget_class, "tab.start-recording", NULL, recording_activated);
+  gtk_widget_class_install_action (widget_class, "tab.stop-recording", NULL, recording_activated);
+  gtk_widget_class_install_action (widget_class, "tab.rewrap-auto", NULL, rewrap_activated);
+  gtk_widget_class_install_action (widget_class, "tab.rewrap-always", NULL, rewrap_activated);
+  gtk_widget_class_install_action (widget_class, "tab.rewrap-never", NULL, rewrap_activated);
+  gtk_widget_class_install_action (widget_class, "tab.monitor-activity", NULL, monitor_activated);
+  gtk_widget_class_install_action (widget_class, "tab.unmonitor-activity", NULL, monitor_activated);
+  gtk_widget_class_install_action (widget_class, "tab.monitor-silence", NULL, monitor_activated);
+  gtk_widget_class_install_action (widget_class, "tab.unmonitor-silence", NULL, monitor_activated);
 
   gtk_widget_class_install_action (widget_class,
                                    "win.new-window",
@@ -638,6 +743,14 @@ kgx_window_class_init (KgxWindowClass *klass)
                                    "win.show-tabs-desktop",
                                    NULL,
                                    tab_switcher_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "win.switch-tab",
+                                   NULL,
+                                   switch_tab_activated);
+  gtk_widget_class_install_action (widget_class,
+                                   "win.search-history",
+                                   NULL,
+                                   search_history_activated);
   gtk_widget_class_install_action (widget_class,
                                    "win.show-preferences-window",
                                    NULL,
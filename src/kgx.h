@@ -24,5 +24,6 @@
 #include "kgx-process.h"
 #include "kgx-pages.h"
 #include "kgx-tab.h"
+#include "kgx-remote.h"
 
 #include "fp-vte-util.h"
@@ -24,12 +24,18 @@ int
 main (int argc, char *argv[])
 {
   g_autoptr (GtkApplication) app = NULL;
+  int status;
 
   /* Set up gettext translations */
   bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
   bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
   textdomain (GETTEXT_PACKAGE);
 
+  /* Skip everything below if an existing instance can take it */
+  if (kgx_remote_try (argc, argv, &status)) {
+    return status;
+  }
+
   g_set_application_name (KGX_DISPLAY_NAME);
   gtk_window_set_default_icon_name (KGX_APPLICATION_ID);
 